@@ -5,10 +5,15 @@
 #include <disk/disk_scheduler.hpp>
 #include <misc/config.hpp>
 #include <optional>
+#include <queue>
 #include <stdexcept>
+#include <string>
+#include <utility>
 
 namespace hivedb {
-template <disk_manager_t T, index_t K, value_t V, value_t V_leaf>
+// PageSize has to be the page size of the db file, see disk_manager.
+template <disk_manager_t T, index_t K, value_t V, value_t V_leaf,
+          std::size_t PageSize = PAGE_SIZE>
 struct b_plus_tree {
  private:
   buffer_pool<T> m_bp;
@@ -21,14 +26,14 @@ struct b_plus_tree {
         auto const victim_frame = &m_bp.request_page(victim_page_id);
         victim_frame->is_dirty = true;
 
-        auto victim = b_plus_tree_inner_node<K, V>(victim_frame->get_data());
+        auto victim = b_plus_tree_inner_node<K, V, PageSize>(victim_frame->get_data());
 
         const auto new_root = m_bp.allocate_new_page();
         auto const new_root_frame = &m_bp.request_page(new_root);
         new_root_frame->is_dirty = true;
-        auto new_root_node = b_plus_tree_inner_node<K, V>(new_root_frame->get_data());
+        auto new_root_node = b_plus_tree_inner_node<K, V, PageSize>(new_root_frame->get_data());
 
-        new_root_node.max_size = b_plus_tree_inner_node<K, V>::MAX_NUMBER_OF_ELEMENTS;
+        new_root_node.max_size = b_plus_tree_inner_node<K, V, PageSize>::MAX_NUMBER_OF_ELEMENTS;
         new_root_node.current_size = 2;
         new_root_node.type = b_plus_tree_node_type::inner_node;
         new_root_node.previous_page_id = INVALID_PAGE_ID;
@@ -48,13 +53,26 @@ struct b_plus_tree {
         // victim.dump_contents(+1);
 
         m_root_page_id = new_root;
+        victim_frame->decrease_pin_count();
+        new_root_frame->decrease_pin_count();
         // throw std::runtime_error("foo:(");
   }
  public:
   b_plus_tree() = delete;
+  // anything after the path is forwarded to the disk manager
+  template <typename... Args>
   explicit b_plus_tree(page_id_t root_page_id, std::int32_t max_frames,
-                       const std::filesystem::path &path)
-      : m_bp(max_frames, path), m_root_page_id(root_page_id), m_frame_queue() {}
+                       const std::filesystem::path &path, Args &&...args)
+      : m_bp(max_frames, path, std::forward<Args>(args)...),
+        m_root_page_id(root_page_id),
+        m_frame_queue() {
+    if (m_bp.get_page_size() != PageSize) {
+      throw std::runtime_error("The db file has pages of " +
+                               std::to_string(m_bp.get_page_size()) +
+                               " bytes, the tree expects " +
+                               std::to_string(PageSize));
+    }
+  }
 
 
   void dump_contents() {
@@ -68,7 +86,7 @@ struct b_plus_tree {
 
       if (node.type == b_plus_tree_node_type::inner_node) {
         const auto inner_node =
-            b_plus_tree_inner_node<K, V>(current_page->get_data());
+            b_plus_tree_inner_node<K, V, PageSize>(current_page->get_data());
 
         inner_node.dump_contents();
         auto idx = 0u;
@@ -80,7 +98,7 @@ struct b_plus_tree {
       }
 
       const auto leaf_node =
-            b_plus_tree_leaf_node<K, V_leaf>(current_page->get_data());
+            b_plus_tree_leaf_node<K, V_leaf, PageSize>(current_page->get_data());
 
       leaf_node.dump_contents();
     }
@@ -99,7 +117,7 @@ struct b_plus_tree {
 
       if (node.type == b_plus_tree_node_type::inner_node) {
         const auto inner_node =
-            b_plus_tree_inner_node<K, V>(current_page->get_data());
+            b_plus_tree_inner_node<K, V, PageSize>(current_page->get_data());
         const auto next_key_index = inner_node.find_index(key);
         const auto next_page_id = *inner_node.page_ids(next_key_index);
 
@@ -110,7 +128,7 @@ struct b_plus_tree {
         continue;
       }
     const auto leaf_node =
-        b_plus_tree_leaf_node<K, V_leaf>(current_page->get_data());
+        b_plus_tree_leaf_node<K, V_leaf, PageSize>(current_page->get_data());
     const auto idx = leaf_node.find_index(key);
     if (!idx.has_value())
         return;
@@ -133,7 +151,7 @@ struct b_plus_tree {
 
       if (node.type == b_plus_tree_node_type::inner_node) {
         auto inner_node =
-            b_plus_tree_inner_node<K, V>(current_page->get_data());
+            b_plus_tree_inner_node<K, V, PageSize>(current_page->get_data());
         const auto next_key_index = inner_node.find_index(key);
         const auto next_page_id = *inner_node.page_ids(next_key_index);
         previous_page_id = next_page_id.key;
@@ -142,7 +160,7 @@ struct b_plus_tree {
       } else {
         current_page->is_dirty = true;
         auto leaf_node =
-            b_plus_tree_leaf_node<K, V_leaf>(current_page->get_data());
+            b_plus_tree_leaf_node<K, V_leaf, PageSize>(current_page->get_data());
 
         leaf_node.trivial_insert(key, value);
         if (!leaf_node.should_split()) {
@@ -153,7 +171,7 @@ struct b_plus_tree {
         auto const new_page = &m_bp.request_page(new_page_id.value());
         new_page->is_dirty = true;
         auto new_leaf_node =
-            b_plus_tree_leaf_node<K, V_leaf>(new_page->get_data());
+            b_plus_tree_leaf_node<K, V_leaf, PageSize>(new_page->get_data());
         leaf_node.split_node(new_leaf_node, new_page_id.value());
         // new_page->decrease_pin_count();
         break;
@@ -172,11 +190,11 @@ struct b_plus_tree {
 
       root_node_frame->is_dirty = true;
       auto new_node =
-          b_plus_tree_leaf_node<K, V_leaf>(root_node_frame->get_data());
+          b_plus_tree_leaf_node<K, V_leaf, PageSize>(root_node_frame->get_data());
 
       new_node.init_first_node(key, value);
 
-      return m_bp.flush_page(m_root_page_id);
+      return m_bp.flush_page(m_root_page_id, true, false);
     }
 
     auto new_page_id = find_place_for_new_key_and_insert(key, value);
@@ -186,13 +204,13 @@ struct b_plus_tree {
         const auto new_root = m_bp.allocate_new_page();
         auto const new_root_frame = &m_bp.request_page(new_root);
         new_root_frame->is_dirty = true;
-        auto new_root_node = b_plus_tree_inner_node<K, V>(new_root_frame->get_data());
+        auto new_root_node = b_plus_tree_inner_node<K, V, PageSize>(new_root_frame->get_data());
 
         //this one will be the right node. look at b_plus_tree_leaf::split()
         auto const new_frame = &m_bp.request_page(new_page_id.value());
-        auto new_leaf_node = b_plus_tree_leaf_node<K, V_leaf>(new_frame->get_data());
+        auto new_leaf_node = b_plus_tree_leaf_node<K, V_leaf, PageSize>(new_frame->get_data());
 
-        new_root_node.max_size = b_plus_tree_inner_node<K, V_leaf>::MAX_NUMBER_OF_ELEMENTS;
+        new_root_node.max_size = b_plus_tree_inner_node<K, V_leaf, PageSize>::MAX_NUMBER_OF_ELEMENTS;
         new_root_node.current_size = 2;
         new_root_node.type = b_plus_tree_node_type::inner_node;
         new_root_node.previous_page_id = INVALID_PAGE_ID;
@@ -206,6 +224,9 @@ struct b_plus_tree {
         m_root_page_id = new_root;
 
         new_root_node.update_buffer_with_new_values();
+        // flush_pages() only drops the pins it takes itself
+        new_frame->decrease_pin_count();
+        new_root_frame->decrease_pin_count();
         return m_bp.flush_pages();
     }
 
@@ -219,7 +240,7 @@ struct b_plus_tree {
       auto const current_frame = m_frame_queue.back();
       current_frame->is_dirty = true;
 
-      auto inner_node = b_plus_tree_inner_node<K, V>(current_frame->get_data());
+      auto inner_node = b_plus_tree_inner_node<K, V, PageSize>(current_frame->get_data());
 
       auto const new_node_frame =
           &m_bp.request_page(new_page_id.value(), false);
@@ -227,15 +248,15 @@ struct b_plus_tree {
 
       if (new_node.type == b_plus_tree_node_type::inner_node) {
         auto previous_node =
-            b_plus_tree_inner_node<K, V>(current_frame->get_data());
+            b_plus_tree_inner_node<K, V, PageSize>(current_frame->get_data());
 
         auto new_inner_node =
-            b_plus_tree_inner_node<K, V>(new_node_frame->get_data());
+            b_plus_tree_inner_node<K, V, PageSize>(new_node_frame->get_data());
         inner_node.trivial_insert_inner_node(new_page_id.value(),
                                              new_inner_node, previous_node);
       } else {
         auto new_leaf_node =
-            b_plus_tree_leaf_node<K, V_leaf>(new_node_frame->get_data());
+            b_plus_tree_leaf_node<K, V_leaf, PageSize>(new_node_frame->get_data());
         inner_node.template trivial_insert_leaf_node<V_leaf>(
             new_page_id.value(), new_leaf_node);
       }
@@ -253,7 +274,7 @@ struct b_plus_tree {
       new_page_id = m_bp.allocate_new_page();
       auto const new_page = &m_bp.request_page(new_page_id.value());
       new_page->is_dirty = true;
-      auto new_inner_node = b_plus_tree_inner_node<K, V>(new_page->get_data());
+      auto new_inner_node = b_plus_tree_inner_node<K, V, PageSize>(new_page->get_data());
 
       inner_node.split_node(new_inner_node, previous_page_id);
 
@@ -65,6 +65,10 @@ struct b_plus_tree_node {
 
 };
 /*
+ * Nodes fill a page of PageSize bytes (the db file's page size) but for the
+ * disk manager's trailer, bigger pages mean more entries per node and a
+ * shallower tree.
+ *
  * Leaf page format (in order):
  *  ---------
  * | header |
@@ -85,10 +89,11 @@ struct b_plus_tree_node {
  * --------------------------
  */
 
-template <index_t K, value_t V>
+template <index_t K, value_t V, std::size_t PageSize = PAGE_SIZE>
 struct b_plus_tree_leaf_node final : public b_plus_tree_node {
+  static_assert(is_valid_page_size(PageSize));
   static constexpr auto MAX_NUMBER_OF_ELEMENTS =
-      ((hivedb::PAGE_SIZE - (sizeof(std::int64_t) * 4)) /
+      ((PageSize - PAGE_TRAILER_SIZE - (sizeof(std::int64_t) * 4)) /
        (sizeof(K) + sizeof(V)));
 
   static constexpr auto something_to_be_renamed = (MAX_NUMBER_OF_ELEMENTS + 1) % 2;
@@ -276,10 +281,11 @@ struct b_plus_tree_leaf_node final : public b_plus_tree_node {
  * | previous_page_id (8 bytes) |
  * ------------------------------
  */
-template <index_t K, value_t V>
+template <index_t K, value_t V, std::size_t PageSize = PAGE_SIZE>
 struct b_plus_tree_inner_node final : public b_plus_tree_node {
+  static_assert(is_valid_page_size(PageSize));
   static constexpr auto MAX_NUMBER_OF_ELEMENTS =
-      ((hivedb::PAGE_SIZE - (sizeof(std::int64_t) * 4)) /
+      ((PageSize - PAGE_TRAILER_SIZE - (sizeof(std::int64_t) * 4)) /
        (sizeof(K) + sizeof(V)));
   static constexpr auto something_to_be_renamed = MAX_NUMBER_OF_ELEMENTS % 2 ? 1 : 2;
 
@@ -358,7 +364,7 @@ struct b_plus_tree_inner_node final : public b_plus_tree_node {
 
   template <value_t V_leaf>
   void trivial_insert_leaf_node(const V& value,
-                                b_plus_tree_leaf_node<K, V_leaf>& new_node) {
+                                b_plus_tree_leaf_node<K, V_leaf, PageSize>& new_node) {
     ASSERT(can_insert_trivially());
 
     const auto key = *new_node.indexes(0);
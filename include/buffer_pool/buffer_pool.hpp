@@ -3,48 +3,97 @@
 #include <spdlog/spdlog.h>
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <buffer_pool/lru_k.hpp>
+#include <condition_variable>
 #include <cstdint>
+#include <cstring>
+#include <deque>
+#include <disk/disk_completion_queue.hpp>
 #include <disk/disk_scheduler.hpp>
+#include <disk/disk_stats.hpp>
 #include <filesystem>
 #include <libassert/assert.hpp>
 #include <list>
+#include <misc/aligned_buffer.hpp>
 #include <misc/config.hpp>
+#include <mutex>
 #include <numeric>
+#include <optional>
+#include <shared_mutex>
 #include <stdexcept>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
 namespace hivedb {
-// TODO: make this thread safe later
+// how many pieces the page table is split into, by page id
+static constexpr std::size_t PAGE_TABLE_SHARDS = 16;
+
+template <disk_manager_t T>
+struct buffer_pool;
+
+// A frame of the buffer pool and the page it holds.
+//
+// A pin keeps the page in its frame, the latch guards the page's data:
+// hold it shared to read the page and exclusively to change it. The frame
+// is a SharedLockable itself, so std::shared_lock and std::unique_lock
+// work on it. Latch only frames you have pinned.
 struct frame_header {
  public:
   frame_id_t frame_id{INVALID_FRAME_ID};
-  bool is_dirty{false};
+  std::atomic<bool> is_dirty{false};
 
  private:
-  std::int32_t m_pin_count{-99};
-  std::vector<char> m_data;
+  template <disk_manager_t T>
+  friend struct buffer_pool;
+
+  std::atomic<std::int32_t> m_pin_count{-99};
+  // The rest up to m_latch belongs to the buffer pool and only changes
+  // under the latch of the page table shard of the page.
+  // INVALID_PAGE_ID while the frame is empty
+  std::atomic<page_id_t> m_page_id{INVALID_PAGE_ID};
+  // The page's read is still in flight, nobody may look at the data. The
+  // read holds a pin until it's done.
+  std::atomic<bool> m_is_loading{false};
+  // read ahead and not requested since
+  std::atomic<bool> m_is_prefetched{false};
+
+  std::shared_mutex m_latch;
+  // points into the buffer pool's frame arena
+  char *m_data{nullptr};
   lru_k *m_replacer{nullptr};
 
  public:
-  explicit frame_header(frame_id_t, std::vector<char> &, lru_k *);
+  explicit frame_header(frame_id_t, char *, lru_k *);
 
   frame_header() = default;
   frame_header(const frame_header &) = delete;
   frame_header &operator=(const frame_header &) = delete;
-
-  frame_header(frame_header &&) = default;
-  frame_header &operator=(frame_header &&) = default;
+  frame_header(frame_header &&) = delete;
+  frame_header &operator=(frame_header &&) = delete;
   ~frame_header();
 
+  // Readies the frame for the next page it holds: clean and unpinned. The
+  // data is left as is, whoever installs the page fills it in.
+  void reset();
+
   void increase_pin_count();
   void decrease_pin_count();
 
   [[nodiscard]]
   std::int32_t get_pin_count() const;
 
+  void lock();
+  void unlock();
+  [[nodiscard]]
+  bool try_lock();
+  void lock_shared();
+  void unlock_shared();
+  [[nodiscard]]
+  bool try_lock_shared();
+
   [[nodiscard]]
   const char *get_data() const;
 
@@ -52,6 +101,18 @@ struct frame_header {
   char *get_data();
 };
 
+// Caches pages of the db file in a fixed number of frames.
+//
+// Safe to use from many threads at once. The page table is split into
+// PAGE_TABLE_SHARDS shards, each with its own latch, so lookups of
+// different pages rarely wait on each other; pin counts and the replacer's
+// access history are atomic, so a cache hit takes no other latch. Threads
+// faulting the same page share a single read: the first one maps the page
+// to its frame as loading, the others wait for that read to finish.
+//
+// Latches are taken in this order: a page table shard, then the replacer's
+// or the empty frames'. Frame latches are never taken while holding any of
+// them.
 template <disk_manager_t T>
 struct buffer_pool {
  public:
@@ -60,253 +121,743 @@ struct buffer_pool {
  private:
   static constexpr std::int32_t m_k = 10;
 
+  struct alignas(CACHE_LINE_SIZE) page_table_shard {
+    std::mutex latch;
+    std::unordered_map<page_id_t, frame_id_t> pages;
+  };
+
   disk_scheduler<T> m_scheduler;
+  // the db file's, every frame holds a page of this size
+  std::size_t m_page_size;
   lru_k m_frame_replacer;
 
-  page_id_t m_next_page;
+  std::atomic<page_id_t> m_next_page;
 
-  std::unordered_map<page_id_t, frame_id_t> m_page_table;
-  std::vector<frame_header> m_frames;
+  std::array<page_table_shard, PAGE_TABLE_SHARDS> m_page_table;
+  // built once, frame headers never move
+  std::deque<frame_header> m_frames;
+  std::mutex m_empty_frames_latch;
   std::list<frame_id_t> m_empty_frames;
 
+  // One aligned allocation backing every frame, so the pages can be handed
+  // to an O_DIRECT disk manager as they are. Page faults are read straight
+  // into their frame.
+  aligned_buffer m_frame_arena;
+
+  // prefetches the scheduler hasn't completed yet
+  std::mutex m_prefetch_latch;
+  std::condition_variable m_prefetch_cv;
+  std::size_t m_prefetches_in_flight{0};
+
+  [[nodiscard]]
+  page_table_shard &shard_of(page_id_t);
+
+  [[nodiscard]]
+  char *frame_data(frame_id_t);
+
+  [[nodiscard]]
+  std::optional<frame_id_t> take_empty_frame();
+  void give_back_frame(frame_id_t);
+
+  // Pins the page if it's cached, once it's loaded. Returns its frame.
+  [[nodiscard]]
+  std::optional<frame_id_t> pin_page(page_id_t);
+
+  // Maps page id to the frame, which the caller claimed, as loading and
+  // pinned by the read. Fails if somebody mapped the page meanwhile.
+  [[nodiscard]]
+  bool map_loading_page(page_id_t, frame_id_t);
+  // Makes the page available once its read completed, or takes it back out
+  // of the page table if the read failed. Drops the read's pin unless
+  // should_pin.
+  void finish_loading(page_id_t, frame_id_t, bool is_ok, bool should_pin);
+
+  // Takes the page out of the page table and readies its frame for the
+  // next one. Must hold the shard's latch, the page must not be pinned.
+  void unmap_page(page_table_shard &, page_id_t, frame_id_t);
+  // Takes the page out of its frame unless it's pinned or dirty, or moved
+  // on. The frame is then neither in the page table nor among the empty
+  // frames until the caller puts it in one of them.
+  [[nodiscard]]
+  bool try_evict(page_id_t, frame_id_t);
+  // Hands a victim we couldn't take back to the replacer.
+  void return_victim(frame_id_t);
+
+  // Writes the page out if it's dirty, the caller must have it pinned and
+  // latched (shared is enough). Returns whether that worked.
+  [[nodiscard]]
+  bool write_back(frame_header &, page_id_t, disk_request_priority);
+
+  // Frees up a frame for a page fault, writing back or evicting whatever
+  // page has to make room. The frame is neither in the page table nor
+  // among the empty frames until the caller puts it back in one of them.
+  [[nodiscard]]
+  frame_id_t claim_fault_frame();
+
+  // Frees up a frame for a prefetch without ever writing or stealing a
+  // pinned page, the frame of keep is left alone too.
+  [[nodiscard]]
+  std::optional<frame_id_t> claim_prefetch_frame(frame_id_t keep);
+  std::size_t prefetch_pages(page_id_t, std::size_t, frame_id_t keep);
+  // Runs on a scheduler worker, the tag is the frame.
+  static void on_prefetch_complete(void *, const disk_request &, bool);
+  // Reports an access to the scheduler and reads ahead whatever it
+  // suggests. frame_id holds the page that was just requested.
+  void readahead(page_id_t, frame_id_t);
+
+  // Schedules req and blocks until it completed, returns whether it worked.
+  [[nodiscard]]
+  bool run_request(disk_request &&);
+
  public:
   buffer_pool() = delete;
-  explicit buffer_pool(frame_id_t, const std::filesystem::path &path = "");
+  // anything after the path is forwarded to the disk manager
+  template <typename... Args>
+  explicit buffer_pool(frame_id_t, const std::filesystem::path &path = "",
+                       Args &&...);
 
   buffer_pool(const buffer_pool<T> &) = delete;
   buffer_pool &operator=(const buffer_pool<T> &) = delete;
   buffer_pool(buffer_pool<T> &&) = delete;
   buffer_pool &operator=(buffer_pool<T> &&) = delete;
-  ~buffer_pool() = default;
+  ~buffer_pool();
 
+  // Reuses the ids of deleted pages if the disk manager keeps track of them.
   [[nodiscard]]
-  constexpr page_id_t allocate_new_page();
+  page_id_t allocate_new_page();
+  // Drops the page without writing it and frees it on disk. It must not be
+  // pinned.
+  void delete_page(page_id_t);
 
   [[nodiscard]]
   frame_header &request_page(page_id_t, bool = true);
 
+  // Drops the page from its frame without writing it. Returns the frame,
+  // or INVALID_FRAME_ID if the page isn't cached or somebody has it pinned.
   frame_id_t evict_page(page_id_t);
-  bool flush_page(page_id_t, bool=true);
+  // Writes the page if it's dirty. With is_pinned the caller hands over the
+  // pin it requested the page with, which is dropped afterwards. With
+  // should_evict the page is evicted too, unless somebody still has it
+  // pinned. Don't hold the frame's latch while calling it.
+  bool flush_page(page_id_t, bool should_evict = true, bool is_pinned = true);
+  // Writes every dirty page, the writes go out together. Pages nobody has
+  // pinned are evicted afterwards, pins are left alone.
   bool flush_pages();
+
+  // Starts reading up to count pages from first on into free or clean
+  // unpinned frames, without pinning them. Pages that are cached already
+  // are skipped. Returns how many reads were scheduled, stops early once
+  // no frame can be freed up.
+  std::size_t prefetch_pages(page_id_t first, std::size_t count);
+
+  // Waits until every page flushed so far is durable on disk.
+  void sync();
+
+  // how many bytes of a frame's data belong to its page
+  [[nodiscard]]
+  std::size_t get_page_size() const;
+
+  [[nodiscard]]
+  disk_stats_snapshot get_disk_stats() const;
 };
 
 template <disk_manager_t T>
+template <typename... Args>
 buffer_pool<T>::buffer_pool(frame_id_t max_frms,
-                            const std::filesystem::path &path)
+                            const std::filesystem::path &path, Args &&...args)
     : max_frames(max_frms),
-      m_scheduler(path),
+      m_scheduler(path, std::forward<Args>(args)...),
+      m_page_size(m_scheduler.get_page_size()),
       m_frame_replacer(m_k, max_frames),
       m_next_page(0),
       m_empty_frames(max_frames, 0) {
   if (max_frames < 0) throw std::invalid_argument("max_frames must be >= 0");
 
-  m_frames.resize(max_frames);
   std::iota(m_empty_frames.begin(), m_empty_frames.end(), 0);
+
+  m_frame_arena =
+      aligned_buffer{static_cast<std::size_t>(max_frames) * m_page_size};
+  // every frame keeps its header and its slice of the arena for good
+  for (frame_id_t frame_id = 0; frame_id < max_frames; ++frame_id)
+    m_frames.emplace_back(frame_id, frame_data(frame_id), &m_frame_replacer);
+
+  if constexpr (page_allocating_disk_manager_t<T>)
+    m_next_page = m_scheduler.get_manager().page_id_end();
 }
 
 template <disk_manager_t T>
-constexpr page_id_t buffer_pool<T>::allocate_new_page() {
-  return m_next_page++;
+buffer_pool<T>::~buffer_pool() {
+  // the scheduler may still be reading into our frames
+  std::unique_lock ul{m_prefetch_latch};
+  m_prefetch_cv.wait(ul, [this] { return m_prefetches_in_flight == 0; });
 }
 
-// Requesting a page WILL INCREASE ITS PIN COUNT!
 template <disk_manager_t T>
-frame_header &buffer_pool<T>::request_page(page_id_t id, bool should_pin) {
-  spdlog::info("Requested page: {}", id);
-  ASSERT(id > -1);
-  if (const auto it = m_page_table.find(id); it != m_page_table.end()) {
-    // Found our page yippie
-    m_frame_replacer.recordAccess(it->second);
-    m_frame_replacer.setEvictable(it->second, false);
+typename buffer_pool<T>::page_table_shard &buffer_pool<T>::shard_of(
+    page_id_t id) {
+  return m_page_table[static_cast<std::size_t>(id) % PAGE_TABLE_SHARDS];
+}
 
-    auto &frame = m_frames.at(it->second);
-    if (should_pin) frame.increase_pin_count();
+template <disk_manager_t T>
+char *buffer_pool<T>::frame_data(frame_id_t frame_id) {
+  ASSERT(frame_id >= 0 && frame_id < max_frames);
+  return m_frame_arena.data() + frame_id * m_page_size;
+}
 
-    return frame;
-  }
+template <disk_manager_t T>
+std::optional<frame_id_t> buffer_pool<T>::take_empty_frame() {
+  std::scoped_lock sl{m_empty_frames_latch};
+  if (m_empty_frames.empty()) return std::nullopt;
 
-  // We hit a page fault :(
-  // First get the page from the disk
-  std::vector<char> buffer;
-  buffer.resize(PAGE_SIZE);
-  std::promise<bool> is_done_promise;
-  auto is_done = is_done_promise.get_future();
-
-  disk_request req{.type = disk_request_type::read,
-                   .data = buffer.data(),
-                   .page_id = id,
-                   .is_done = std::move(is_done_promise)};
-  m_scheduler.schedule(std::move(req));
+  const auto frame_id = m_empty_frames.front();
+  m_empty_frames.pop_front();
+  return frame_id;
+}
 
-  is_done.wait();
-  if (!is_done.get()) throw std::runtime_error("request_page() failed");
+template <disk_manager_t T>
+void buffer_pool<T>::give_back_frame(frame_id_t frame_id) {
+  std::scoped_lock sl{m_empty_frames_latch};
+  m_empty_frames.push_back(frame_id);
+}
 
-  // Do we have an empty space in the page table?
-  if (m_page_table.size() <
-      static_cast<decltype(m_page_table)::size_type>(max_frames)) {
-    ASSERT(!m_empty_frames.empty());
+template <disk_manager_t T>
+bool buffer_pool<T>::run_request(disk_request &&req) {
+  // Every thread waits on its own queue, so nobody reaps somebody else's
+  // completion. Kept around so a page fault doesn't allocate.
+  thread_local disk_completion_queue completions;
+  thread_local std::vector<disk_completion> completed;
+  completions.attach(req);
+  m_scheduler.schedule(std::move(req));
 
-    const auto frame_id = m_empty_frames.front();
-    m_page_table.emplace(id, frame_id);
-    m_empty_frames.pop_front();
+  completed.clear();
+  completions.wait(completed);
+  return completed.front().is_ok;
+}
 
-    ASSERT(m_frames.begin() + frame_id < m_frames.end());
-    m_frames[frame_id] = frame_header{frame_id, buffer, &m_frame_replacer};
-    m_frame_replacer.recordAccess(frame_id);
+template <disk_manager_t T>
+std::optional<frame_id_t> buffer_pool<T>::pin_page(page_id_t id) {
+  auto &shard = shard_of(id);
+  while (true) {
+    std::unique_lock shard_lock{shard.latch};
+    const auto it = shard.pages.find(id);
+    if (it == shard.pages.end()) return std::nullopt;
+
+    auto &frame = m_frames[it->second];
+    if (frame.m_is_loading) {
+      shard_lock.unlock();
+      frame.m_is_loading.wait(true);
+      continue;
+    }
 
-    auto &frame = m_frames[frame_id];
-    if (should_pin) frame.increase_pin_count();
-    return frame;
+    frame.increase_pin_count();
+    return it->second;
   }
+}
 
-  // We don't :(
-  // Maybe scan for a dirty unpinned page and write it
-  auto it = std::find_if(m_frames.begin(), m_frames.end(),
-                         [](const frame_header &frame) -> bool {
-                           return frame.is_dirty && frame.get_pin_count() == 0;
-                         });
+template <disk_manager_t T>
+bool buffer_pool<T>::map_loading_page(page_id_t id, frame_id_t frame_id) {
+  auto &shard = shard_of(id);
+  std::scoped_lock sl{shard.latch};
+  if (shard.pages.contains(id)) return false;
+
+  auto &frame = m_frames[frame_id];
+  frame.reset();
+  frame.m_page_id = id;
+  frame.m_is_loading = true;
+  frame.increase_pin_count();
+  shard.pages.emplace(id, frame_id);
+  return true;
+}
 
-  if (it != m_frames.end()) {
-    frame_id_t frame_id = std::distance(m_frames.begin(), it);
+template <disk_manager_t T>
+void buffer_pool<T>::finish_loading(page_id_t id, frame_id_t frame_id,
+                                    bool is_ok, bool should_pin) {
+  auto &shard = shard_of(id);
+  auto &frame = m_frames[frame_id];
 
-    const auto page_id_to_be_flushed_it =
-        std::find_if(m_page_table.begin(), m_page_table.end(),
-                     [frame_id](const auto &pair) -> bool {
-                       return pair.second == frame_id;
-                     });
+  std::unique_lock shard_lock{shard.latch};
+  if (is_ok) {
+    m_frame_replacer.recordAccess(frame_id);
+    if (should_pin) m_frame_replacer.setEvictable(frame_id, false);
+  } else {
+    shard.pages.erase(id);
+    frame.m_page_id = INVALID_PAGE_ID;
+    frame.reset();
+  }
+  // the read's pin goes before anybody waiting for it pins the frame
+  if (is_ok && !should_pin) frame.decrease_pin_count();
+  // whoever waited looks the page up again
+  frame.m_is_loading = false;
+  frame.m_is_loading.notify_all();
+  shard_lock.unlock();
+
+  if (!is_ok) give_back_frame(frame_id);
+}
 
-    ASSERT(page_id_to_be_flushed_it != m_page_table.end());
+template <disk_manager_t T>
+void buffer_pool<T>::unmap_page(page_table_shard &shard, page_id_t page_id,
+                                frame_id_t frame_id) {
+  spdlog::info("Evicting page {}", page_id);
+  shard.pages.erase(page_id);
+  // the replacer only forgets evictable frames
+  m_frame_replacer.setEvictable(frame_id, true);
+  m_frame_replacer.remove(frame_id);
 
-    const bool status = flush_page(page_id_to_be_flushed_it->first);
-    if (!status) throw std::runtime_error("flush_page() failed");
+  auto &frame = m_frames[frame_id];
+  ASSERT(frame.frame_id == frame_id);
+  frame.m_page_id = INVALID_PAGE_ID;
+  frame.reset();
+}
 
-    frame_id = m_empty_frames.front();
-    m_page_table.emplace(id, frame_id);
-    m_empty_frames.pop_front();
+template <disk_manager_t T>
+bool buffer_pool<T>::try_evict(page_id_t page_id, frame_id_t frame_id) {
+  if (page_id == INVALID_PAGE_ID) return false;
 
-    m_frame_replacer.recordAccess(frame_id);
+  auto &shard = shard_of(page_id);
+  std::scoped_lock sl{shard.latch};
+  const auto it = shard.pages.find(page_id);
+  if (it == shard.pages.end() || it->second != frame_id) return false;
 
-    ASSERT(m_frames.begin() + frame_id < m_frames.end());
-    m_frames[frame_id] = frame_header{frame_id, buffer, &m_frame_replacer};
-    if (should_pin) m_frames[frame_id].increase_pin_count();
+  const auto &frame = m_frames[frame_id];
+  if (frame.get_pin_count() > 0 || frame.is_dirty) return false;
 
-    m_frame_replacer.recordAccess(frame_id);
+  unmap_page(shard, page_id, frame_id);
+  return true;
+}
 
-    return m_frames[frame_id];
-  }
+template <disk_manager_t T>
+void buffer_pool<T>::return_victim(frame_id_t frame_id) {
+  const auto &frame = m_frames[frame_id];
+  const auto page_id = frame.m_page_id.load();
+  if (page_id == INVALID_PAGE_ID) return;
+
+  // whoever maps the frame next records it anyway
+  auto &shard = shard_of(page_id);
+  std::scoped_lock sl{shard.latch};
+  const auto it = shard.pages.find(page_id);
+  if (it == shard.pages.end() || it->second != frame_id) return;
+
+  m_frame_replacer.recordAccess(frame_id);
+  if (frame.get_pin_count() > 0)
+    m_frame_replacer.setEvictable(frame_id, false);
+}
 
-  // No dirty unpinned page to flush :(
-  // Time to find a victim
-  const auto frame_to_evict = m_frame_replacer.evict();
+template <disk_manager_t T>
+bool buffer_pool<T>::write_back(frame_header &frame, page_id_t page_id,
+                                disk_request_priority priority) {
+  if (!frame.is_dirty.exchange(false)) return true;
 
-  spdlog::info("Attempting to evict frame {}", frame_to_evict.has_value()
-                                                   ? frame_to_evict.value()
-                                                   : INVALID_FRAME_ID);
+  disk_request req{.type = disk_request_type::write,
+                   .data = frame.get_data(),
+                   .page_id = page_id,
+                   .is_done = std::nullopt,
+                   .priority = priority};
+  if (run_request(std::move(req))) return true;
+
+  frame.is_dirty = true;
+  return false;
+}
 
-  if (!frame_to_evict.has_value() ||
-      frame_to_evict.value() == INVALID_FRAME_ID) {
-    throw std::runtime_error(
-        "frame_replacer.evict() failed; got -1 or invalid frame");
+template <disk_manager_t T>
+void buffer_pool<T>::on_prefetch_complete(void *pool, const disk_request &req,
+                                          bool is_ok) {
+  auto &self = *static_cast<buffer_pool<T> *>(pool);
+  const auto frame_id = static_cast<frame_id_t>(req.tag);
+
+  // just bookkeeping, nothing here waits on I/O
+  if (is_ok) {
+    self.m_frames[frame_id].m_is_prefetched = true;
+  } else {
+    // not worth failing anyone over, a request for it will just fault
+    spdlog::warn("Prefetching page {} failed", req.page_id);
   }
+  self.finish_loading(req.page_id, frame_id, is_ok, false);
+
+  std::scoped_lock sl{self.m_prefetch_latch};
+  if (--self.m_prefetches_in_flight == 0) self.m_prefetch_cv.notify_all();
+}
 
-  if (m_frames.at(frame_to_evict.value()).get_pin_count() > 0) {
-    throw std::runtime_error(
-        "VICTIM IS PINNED! maybe this a oom? needs more testing.");
+template <disk_manager_t T>
+std::optional<frame_id_t> buffer_pool<T>::claim_prefetch_frame(
+    frame_id_t keep) {
+  if (const auto frame_id = take_empty_frame()) return frame_id;
+
+  // everything is pinned or still loading, nothing to take
+  if (m_frame_replacer.size() == 0) return std::nullopt;
+
+  const auto victim = m_frame_replacer.evict();
+  if (!victim.has_value() || victim.value() == INVALID_FRAME_ID)
+    return std::nullopt;
+
+  // a prefetch is a guess, not worth a write or a stolen page
+  const auto page_id = m_frames[victim.value()].m_page_id.load();
+  if (victim.value() == keep || !try_evict(page_id, victim.value())) {
+    return_victim(victim.value());
+    return std::nullopt;
   }
 
-  const auto page_id_to_be_removed =
-      std::find_if(m_page_table.begin(), m_page_table.end(),
-                   [frame_to_evict](const auto &pair) {
-                     return pair.second == frame_to_evict.value();
-                   });
+  return victim;
+}
 
-  ASSERT(page_id_to_be_removed != m_page_table.end());
+template <disk_manager_t T>
+std::size_t buffer_pool<T>::prefetch_pages(page_id_t first, std::size_t count) {
+  return prefetch_pages(first, count, INVALID_FRAME_ID);
+}
 
-  const auto frame_to_free = page_id_to_be_removed->second;
-  const auto freed_frame = evict_page(page_id_to_be_removed->first);
-  ASSERT(freed_frame == frame_to_free);
-  spdlog::info("Evicted frame {} successfully!", frame_to_evict.value());
+template <disk_manager_t T>
+std::size_t buffer_pool<T>::prefetch_pages(page_id_t first, std::size_t count,
+                                           frame_id_t keep) {
+  ASSERT(first > -1);
+  std::size_t scheduled = 0;
+  for (auto id = first; id < first + static_cast<page_id_t>(count); ++id) {
+    {
+      auto &shard = shard_of(id);
+      std::scoped_lock sl{shard.latch};
+      if (shard.pages.contains(id)) continue;
+    }
 
-  const auto frame_to_insert = m_empty_frames.front();
-  m_page_table.emplace(id, frame_to_insert);
-  m_empty_frames.pop_front();
+    const auto frame_id = claim_prefetch_frame(keep);
+    if (!frame_id.has_value()) break;
 
-  ASSERT(m_frames.begin() + freed_frame < m_frames.end());
-  m_frames[freed_frame] = frame_header{freed_frame, buffer, &m_frame_replacer};
-  if (should_pin) m_frames[freed_frame].increase_pin_count();
+    if (!map_loading_page(id, frame_id.value())) {
+      give_back_frame(frame_id.value());
+      continue;
+    }
+    spdlog::debug("Prefetching page {} into frame {}", id, frame_id.value());
+
+    {
+      std::scoped_lock sl{m_prefetch_latch};
+      ++m_prefetches_in_flight;
+    }
+    disk_request req{.type = disk_request_type::prefetch,
+                     .data = frame_data(frame_id.value()),
+                     .page_id = id,
+                     .is_done = std::nullopt,
+                     .priority = disk_request_priority::prefetch,
+                     .on_complete = on_prefetch_complete,
+                     .context = this,
+                     .tag = static_cast<std::uint64_t>(frame_id.value())};
+    m_scheduler.schedule(std::move(req));
+    ++scheduled;
+  }
 
-  m_frame_replacer.recordAccess(frame_to_evict.value());
+  return scheduled;
+}
 
-  return m_frames[freed_frame];
+template <disk_manager_t T>
+void buffer_pool<T>::readahead(page_id_t id, frame_id_t frame_id) {
+  const auto range = m_scheduler.record_access(id);
+  const auto next_page = m_next_page.load();
+  // never read ahead past the last page handed out
+  if (!range.has_value() || range->first >= next_page) return;
+
+  const auto count = std::min(
+      range->count, static_cast<std::size_t>(next_page - range->first));
+  prefetch_pages(range->first, count, frame_id);
 }
 
 template <disk_manager_t T>
-bool buffer_pool<T>::flush_pages() {
-  bool was_any_page_dirty = false;
-  std::vector<page_id_t> pages_to_evict;
-  pages_to_evict.reserve(m_frames.size());
-  for (const auto &[page_id, frame_id]: m_page_table) {
-    auto& frame = m_frames.at(frame_id);
-    if (frame.is_dirty) {
-      was_any_page_dirty = true;
-      flush_page(page_id, false);
-      pages_to_evict.push_back(page_id);
+page_id_t buffer_pool<T>::allocate_new_page() {
+  if constexpr (page_allocating_disk_manager_t<T>) {
+    const auto id = m_scheduler.get_manager().allocate_page_id();
+    // m_next_page stays the end of the ids in use, readahead goes by it
+    auto next_page = m_next_page.load();
+    while (next_page < id + 1 &&
+           !m_next_page.compare_exchange_weak(next_page, id + 1)) {
     }
+    return id;
+  } else {
+    return m_next_page.fetch_add(1);
   }
+}
 
-  std::for_each(pages_to_evict.begin(),
-    pages_to_evict.end(),
-    [this](const auto &page) {evict_page(page);});
+template <disk_manager_t T>
+void buffer_pool<T>::delete_page(page_id_t id) {
+  spdlog::info("Deleting page {}", id);
+  ASSERT(id > -1);
+
+  auto &shard = shard_of(id);
+  while (true) {
+    std::unique_lock shard_lock{shard.latch};
+    const auto it = shard.pages.find(id);
+    if (it == shard.pages.end()) break;
+
+    const auto frame_id = it->second;
+    auto &frame = m_frames[frame_id];
+    if (frame.m_is_loading) {
+      shard_lock.unlock();
+      frame.m_is_loading.wait(true);
+      continue;
+    }
+    if (frame.get_pin_count() > 0)
+      throw std::runtime_error("delete_page() on a pinned page");
+
+    unmap_page(shard, id, frame_id);
+    shard_lock.unlock();
+    give_back_frame(frame_id);
+    break;
+  }
 
-  return was_any_page_dirty;
+  // our writes are all done by now, so nothing for it is queued
+  if constexpr (page_allocating_disk_manager_t<T>)
+    m_scheduler.get_manager().delete_page(id);
 }
 
+// Requesting a page WILL INCREASE ITS PIN COUNT!
 template <disk_manager_t T>
-bool buffer_pool<T>::flush_page(page_id_t page_id, bool should_evict) {
-  spdlog::info("Flushing page {}", page_id);
-  const auto frame_id_it = m_page_table.find(page_id);
-  if (frame_id_it == m_page_table.end()) return false;
-  auto &frame = m_frames.at(frame_id_it->second);
+frame_header &buffer_pool<T>::request_page(page_id_t id, bool should_pin) {
+  // every cache hit goes through here, don't take the logger's latch
+  spdlog::debug("Requested page: {}", id);
+  ASSERT(id > -1);
+  auto &shard = shard_of(id);
+
+  while (true) {
+    std::unique_lock shard_lock{shard.latch};
+    if (const auto it = shard.pages.find(id); it != shard.pages.end()) {
+      const auto frame_id = it->second;
+      auto &frame = m_frames[frame_id];
+      if (frame.m_is_loading) {
+        // somebody is reading it in already, no need to read it twice
+        shard_lock.unlock();
+        frame.m_is_loading.wait(true);
+        continue;
+      }
+
+      // Found our page yippie
+      m_frame_replacer.recordAccess(frame_id);
+      if (should_pin) {
+        frame.increase_pin_count();
+        m_frame_replacer.setEvictable(frame_id, false);
+      }
+      const bool was_prefetched = frame.m_is_prefetched.exchange(false);
+      shard_lock.unlock();
+
+      // the scan got to what we read ahead, keep ahead of it
+      if (was_prefetched) readahead(id, frame_id);
+      return frame;
+    }
+    shard_lock.unlock();
+
+    // We hit a page fault :(
+    // Make room first, so the page is read right into its frame
+    const auto frame_id = claim_fault_frame();
+    if (!map_loading_page(id, frame_id)) {
+      // somebody faulted it in meanwhile, theirs will do
+      give_back_frame(frame_id);
+      continue;
+    }
 
-  ASSERT(frame.is_dirty);
-  auto is_done_promise = std::promise<bool>();
-  auto is_done = is_done_promise.get_future();
+    disk_request req{.type = disk_request_type::read,
+                     .data = frame_data(frame_id),
+                     .page_id = id,
+                     .is_done = std::nullopt,
+                     .priority = disk_request_priority::foreground_read};
+    const bool is_ok = run_request(std::move(req));
+    finish_loading(id, frame_id, is_ok, should_pin);
+    if (!is_ok) throw std::runtime_error("request_page() failed");
 
-  disk_request req{.type = disk_request_type::write,
-                   .data = frame.get_data(),
-                   .page_id = page_id,
-                   .is_done = std::move(is_done_promise)};
-  m_scheduler.schedule(std::move(req));
+    readahead(id, frame_id);
+    return m_frames[frame_id];
+  }
+}
 
-  is_done.wait();
-  if (!is_done.get())
-    throw std::runtime_error("flush_page() failed; tried to write");
-  frame.decrease_pin_count();
+template <disk_manager_t T>
+frame_id_t buffer_pool<T>::claim_fault_frame() {
+  // Other threads may pin, dirty or take whatever we pick meanwhile, then we
+  // just look again
+  while (true) {
+    // Do we have an empty frame?
+    if (const auto frame_id = take_empty_frame()) return frame_id.value();
+
+    // We don't :(
+    // Maybe scan for a dirty unpinned page and write it
+    const auto dirty_frame = std::find_if(
+        m_frames.begin(), m_frames.end(), [](const frame_header &frame) {
+          return frame.is_dirty && frame.get_pin_count() == 0 &&
+                 frame.m_page_id != INVALID_PAGE_ID;
+        });
+
+    if (dirty_frame != m_frames.end()) {
+      const auto frame_id = dirty_frame->frame_id;
+      const auto page_id = dirty_frame->m_page_id.load();
+      const auto pinned_frame = pin_page(page_id);
+      if (!pinned_frame.has_value()) continue;
+      if (pinned_frame.value() != frame_id) {
+        m_frames[pinned_frame.value()].decrease_pin_count();
+        continue;
+      }
+
+      // Somebody pinned and latched it meanwhile, and may be waiting on a
+      // latch of theirs. Don't wait for them, it's no victim anymore anyway
+      std::shared_lock latch{*dirty_frame, std::try_to_lock};
+      const bool is_ok =
+          !latch.owns_lock() ||
+          write_back(*dirty_frame, page_id,
+                     disk_request_priority::eviction_write);
+      if (latch.owns_lock()) latch.unlock();
+      dirty_frame->decrease_pin_count();
+      if (!is_ok) throw std::runtime_error("flush_page() failed");
+
+      if (try_evict(page_id, frame_id)) return frame_id;
+      continue;
+    }
+
+    // No dirty unpinned page to flush :(
+    // Time to find a victim
+    const auto frame_to_evict = m_frame_replacer.evict();
+
+    spdlog::info("Attempting to evict frame {}",
+                 frame_to_evict.has_value() ? frame_to_evict.value()
+                                            : INVALID_FRAME_ID);
+
+    if (!frame_to_evict.has_value() ||
+        frame_to_evict.value() == INVALID_FRAME_ID) {
+      throw std::runtime_error(
+          "frame_replacer.evict() failed; got -1 or invalid frame");
+    }
+
+    const auto page_id = m_frames[frame_to_evict.value()].m_page_id.load();
+    if (try_evict(page_id, frame_to_evict.value())) {
+      spdlog::info("Evicted frame {} successfully!", frame_to_evict.value());
+      return frame_to_evict.value();
+    }
+    // it got pinned or dirty since it became evictable
+    return_victim(frame_to_evict.value());
+  }
+}
+
+template <disk_manager_t T>
+bool buffer_pool<T>::flush_pages() {
+  // pinned, so they stay put while we write them
+  std::vector<std::pair<page_id_t, frame_id_t>> pages_to_flush;
+  for (auto &shard : m_page_table) {
+    std::scoped_lock sl{shard.latch};
+    for (const auto &[page_id, frame_id] : shard.pages) {
+      auto &frame = m_frames[frame_id];
+      if (!frame.is_dirty || frame.m_is_loading) continue;
+
+      frame.increase_pin_count();
+      pages_to_flush.emplace_back(page_id, frame_id);
+    }
+  }
+  if (pages_to_flush.empty()) return false;
+
+  // Schedule every write before waiting on any of them, so the disk
+  // manager sees them together and can merge neighbouring pages into one
+  // vectored write. In page id order since that's mostly file order too.
+  std::sort(pages_to_flush.begin(), pages_to_flush.end());
+
+  disk_completion_queue completions;
+  std::vector<disk_completion> completed;
+  std::vector<std::shared_lock<frame_header>> latches;
+  std::size_t in_flight = 0;
+  bool is_ok = true;
+  const auto wait_for_writes = [&] {
+    completed.clear();
+    if (in_flight > 0) completions.wait(completed, in_flight);
+    for (const auto &completion : completed) {
+      if (completion.is_ok) continue;
+
+      is_ok = false;
+      const auto it = std::lower_bound(
+          pages_to_flush.begin(), pages_to_flush.end(),
+          std::pair{completion.page_id, INVALID_FRAME_ID});
+      m_frames[it->second].is_dirty = true;
+    }
+    in_flight = 0;
+    latches.clear();
+  };
+
+  for (const auto &[page_id, frame_id] : pages_to_flush) {
+    auto &frame = m_frames[frame_id];
+    std::shared_lock latch{frame, std::try_to_lock};
+    if (!latch.owns_lock()) {
+      // whoever has it may be waiting for a page we latched, let go first
+      wait_for_writes();
+      latch.lock();
+    }
+    if (!frame.is_dirty.exchange(false)) continue;
+
+    spdlog::info("Flushing page {}", page_id);
+    disk_request req{.type = disk_request_type::write,
+                     .data = frame.get_data(),
+                     .page_id = page_id,
+                     .is_done = std::nullopt,
+                     .priority = disk_request_priority::background_flush};
+    completions.attach(req);
+    m_scheduler.schedule(std::move(req));
+    latches.push_back(std::move(latch));
+    ++in_flight;
+  }
+  wait_for_writes();
 
-  if (should_evict) {
-      const auto frame_to_free = frame.frame_id;
-      const auto freed_frame = evict_page(page_id);
-      ASSERT(frame_to_free == freed_frame);
+  for (const auto &[page_id, frame_id] : pages_to_flush) {
+    m_frames[frame_id].decrease_pin_count();
+    if (try_evict(page_id, frame_id)) give_back_frame(frame_id);
   }
+  if (!is_ok) throw std::runtime_error("flush_pages() failed; tried to write");
 
   return true;
 }
 
 template <disk_manager_t T>
-frame_id_t buffer_pool<T>::evict_page(page_id_t page_id) {
-  spdlog::info("Evicting page {}", page_id);
-  const auto frame_id_it = m_page_table.find(page_id);
-  ASSERT(frame_id_it != m_page_table.end());
-  const auto frame_id = frame_id_it->second;
+bool buffer_pool<T>::flush_page(page_id_t page_id, bool should_evict,
+                                bool is_pinned) {
+  spdlog::info("Flushing page {}", page_id);
+  const auto frame_id = pin_page(page_id);
+  if (!frame_id.has_value()) return false;
+  auto &frame = m_frames[frame_id.value()];
+
+  // flushing to make room means a page fault is waiting on us
+  std::shared_lock latch{frame};
+  const bool is_ok =
+      write_back(frame, page_id,
+                 should_evict ? disk_request_priority::eviction_write
+                              : disk_request_priority::background_flush);
+  latch.unlock();
+  frame.decrease_pin_count();
+  if (is_pinned) frame.decrease_pin_count();
+  if (!is_ok) throw std::runtime_error("flush_page() failed; tried to write");
 
-  m_frame_replacer.remove(frame_id);
-  m_page_table.erase(frame_id_it);
+  if (should_evict && try_evict(page_id, frame_id.value()))
+    give_back_frame(frame_id.value());
 
-  ASSERT(m_frames[frame_id].frame_id == frame_id);
-  m_frames[frame_id] = frame_header{};
+  return true;
+}
 
-  m_empty_frames.push_back(frame_id);
+template <disk_manager_t T>
+void buffer_pool<T>::sync() {
+  disk_request req{.type = disk_request_type::sync,
+                   .data = nullptr,
+                   .page_id = INVALID_PAGE_ID,
+                   .is_done = std::nullopt};
+  if (!run_request(std::move(req))) throw std::runtime_error("sync() failed");
+}
+
+template <disk_manager_t T>
+std::size_t buffer_pool<T>::get_page_size() const {
+  return m_page_size;
+}
 
+template <disk_manager_t T>
+disk_stats_snapshot buffer_pool<T>::get_disk_stats() const {
+  return m_scheduler.get_stats();
+}
+
+template <disk_manager_t T>
+frame_id_t buffer_pool<T>::evict_page(page_id_t page_id) {
+  auto &shard = shard_of(page_id);
+  std::unique_lock shard_lock{shard.latch};
+  const auto it = shard.pages.find(page_id);
+  // loading pages are pinned by their read
+  if (it == shard.pages.end() || m_frames[it->second].get_pin_count() > 0)
+    return INVALID_FRAME_ID;
+
+  const auto frame_id = it->second;
+  unmap_page(shard, page_id, frame_id);
+  shard_lock.unlock();
+
+  give_back_frame(frame_id);
   return frame_id;
 }
 }  // namespace hivedb
@@ -1,23 +1,55 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
-#include <map>
+#include <memory>
 #include <misc/config.hpp>
 #include <optional>
-#include <vector>
 
 namespace hivedb {
-struct lru_k_node {
-  std::vector<std::uint64_t> history;
-  bool is_evictable;
+// What the replacer knows about a frame. Each one has a cache line of its
+// own, so recording accesses to different frames never touches the same
+// memory.
+struct alignas(CACHE_LINE_SIZE) lru_k_node {
+  // accesses recorded since the replacer last forgot the frame, 0 while
+  // it doesn't track it
+  std::atomic<std::uint64_t> access_count{0};
+  std::atomic<bool> is_evictable{false};
 };
 
+// Thread safe without a latch. recordAccess(), setEvictable() and remove()
+// only touch the frame's own atomics (and the evictable count), so cache
+// hits don't wait on each other. Every frame keeps the timestamps
+// (cycle_clock ticks) of its last k accesses in a ring.
+//
+// evict() doesn't look at every frame, it walks a clock hand forward until
+// it saw EVICTION_SAMPLE_SIZE evictable frames and picks the LRU-K victim
+// among those, so a page fault costs the same however big the pool is.
+// Pools with no more evictable frames than that get exact LRU-K. The victim
+// is claimed by flipping its evictable flag, two evict() calls never return
+// the same frame.
+//
+// Calls racing with evict() may see it pick a frame that was accessed or
+// pinned just now, the buffer pool checks its victims again under the page
+// table latch anyway.
 struct lru_k {
+ public:
+  static constexpr std::size_t EVICTION_SAMPLE_SIZE = 32;
+
  private:
   const std::int32_t m_k;
   const std::int64_t m_size;
-  std::map<frame_id_t, lru_k_node> m_current_nodes;
-  std::uint64_t m_current_timestamp;
+  std::unique_ptr<lru_k_node[]> m_nodes;
+  // the last k access timestamps of frame n start at n * k
+  std::unique_ptr<std::atomic<std::uint64_t>[]> m_history;
+  // frames whose is_evictable is set, kept by whoever flips one
+  alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> m_evictable_count{0};
+  // where the next evict() starts looking
+  alignas(CACHE_LINE_SIZE) std::atomic<frame_id_t> m_hand{0};
+
+  [[nodiscard]]
+  std::atomic<std::uint64_t> *history_of(frame_id_t) const;
+  void forget(frame_id_t);
 
  public:
   explicit lru_k(std::int32_t k, frame_id_t size);
@@ -37,6 +69,7 @@ struct lru_k {
 
   void remove(frame_id_t);
 
+  // evictable frames, a snapshot, frames may change meanwhile
   [[nodiscard]]
   std::size_t size() const;
 };
@@ -0,0 +1,116 @@
+#pragma once
+#include <spdlog/spdlog.h>
+
+#include <atomic>
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <disk/disk_manager.hpp>
+#include <disk/disk_scheduler.hpp>
+#include <disk/throttled_worker.hpp>
+
+namespace hivedb {
+// Managers that can give the space of deleted pages back while in use.
+template <typename T>
+concept compactable_disk_manager_t =
+    disk_manager_t<T> && requires(T manager, std::size_t max_pages) {
+      { manager.compact(max_pages) } -> std::same_as<compaction_result>;
+    };
+
+struct disk_compactor_options {
+  // pages moved a second at most, see throttled_worker
+  std::size_t pages_per_second{256};
+  // pages moved in one go
+  std::size_t batch_size{16};
+  // how long to wait before looking again once there's nothing to move
+  std::chrono::milliseconds idle_interval{1000};
+};
+
+// Calls the manager's compact() over and over, moving batch_size pages at a
+// time and no more than pages_per_second of them. Once a call moves fewer
+// pages than asked for the file is as compact as it gets for now, so it
+// waits idle_interval for more pages to be deleted. The manager must
+// outlive the compactor.
+template <compactable_disk_manager_t T>
+struct disk_compactor {
+ private:
+  T &m_manager;
+  const disk_compactor_options m_options;
+
+  std::atomic<std::size_t> m_relocated_pages{0};
+  std::atomic<std::size_t> m_punched_pages{0};
+  std::atomic<std::size_t> m_trimmed_bytes{0};
+  std::atomic<std::size_t> m_completed_passes{0};
+
+  throttled_worker m_worker;
+
+  // one compact() call, true once there was nothing left to move
+  bool step();
+
+ public:
+  explicit disk_compactor(T &, const disk_compactor_options & = {});
+
+  disk_compactor(const disk_compactor &) = delete;
+  disk_compactor &operator=(const disk_compactor &) = delete;
+  disk_compactor(disk_compactor &&) = delete;
+  disk_compactor &operator=(disk_compactor &&) = delete;
+
+  ~disk_compactor() = default;
+
+  [[nodiscard]]
+  std::size_t relocated_pages() const;
+  [[nodiscard]]
+  std::size_t punched_pages() const;
+  [[nodiscard]]
+  std::size_t trimmed_bytes() const;
+
+  // how many times there was nothing left to move
+  [[nodiscard]]
+  std::size_t completed_passes() const;
+};
+
+template <compactable_disk_manager_t T>
+disk_compactor<T>::disk_compactor(T &manager,
+                                  const disk_compactor_options &options)
+    : m_manager(manager),
+      m_options(options),
+      m_worker(options.pages_per_second, options.batch_size,
+               options.idle_interval, [this]() { return step(); }) {}
+
+template <compactable_disk_manager_t T>
+bool disk_compactor<T>::step() {
+  compaction_result result{};
+  try {
+    result = m_manager.compact(m_options.batch_size);
+  } catch (const std::exception &err) {
+    spdlog::error("Compacting the db file failed: {}", err.what());
+  }
+  m_relocated_pages += result.relocated_pages;
+  m_punched_pages += result.punched_pages;
+  m_trimmed_bytes += result.trimmed_bytes;
+
+  if (result.relocated_pages >= m_options.batch_size) return false;
+  ++m_completed_passes;
+  return true;
+}
+
+template <compactable_disk_manager_t T>
+std::size_t disk_compactor<T>::relocated_pages() const {
+  return m_relocated_pages;
+}
+
+template <compactable_disk_manager_t T>
+std::size_t disk_compactor<T>::punched_pages() const {
+  return m_punched_pages;
+}
+
+template <compactable_disk_manager_t T>
+std::size_t disk_compactor<T>::trimmed_bytes() const {
+  return m_trimmed_bytes;
+}
+
+template <compactable_disk_manager_t T>
+std::size_t disk_compactor<T>::completed_passes() const {
+  return m_completed_passes;
+}
+}  // namespace hivedb
@@ -0,0 +1,52 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <disk/disk_request.hpp>
+#include <misc/config.hpp>
+#include <mutex>
+#include <vector>
+
+namespace hivedb {
+struct disk_completion {
+  page_id_t page_id;
+  std::uint64_t tag;
+  bool is_ok;
+};
+
+// Collects the completions of every request attached to it, so a caller
+// with many requests in flight pays one lock and at most one wakeup per
+// batch of completions instead of one promise (and futex) per page.
+struct disk_completion_queue {
+ private:
+  std::mutex m_latch;
+  std::condition_variable m_cv;
+  std::vector<disk_completion> m_completions;
+  // only notify when somebody actually sleeps
+  std::size_t m_waiters{0};
+
+  static void on_complete(void *, const disk_request &, bool);
+
+ public:
+  disk_completion_queue() = default;
+
+  disk_completion_queue(const disk_completion_queue &) = delete;
+  disk_completion_queue &operator=(const disk_completion_queue &) = delete;
+  disk_completion_queue(disk_completion_queue &&) = delete;
+  disk_completion_queue &operator=(disk_completion_queue &&) = delete;
+  ~disk_completion_queue() = default;
+
+  // Routes the completion of req to this queue, tagged with tag.
+  void attach(disk_request &, std::uint64_t tag = 0);
+
+  void push(const disk_completion &);
+
+  // Moves whatever completed so far into out, never blocks. Returns how
+  // many completions were added.
+  std::size_t poll(std::vector<disk_completion> &);
+
+  // Like poll(), but blocks until at least min_count completions were
+  // added.
+  std::size_t wait(std::vector<disk_completion> &, std::size_t min_count = 1);
+};
+}  // namespace hivedb
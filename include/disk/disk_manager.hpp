@@ -3,36 +3,281 @@
 //
 #pragma once
 
+#include <sys/uio.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <disk/disk_request.hpp>
 #include <disk/disk_scheduler.hpp>
+#include <disk/page_directory.hpp>
 #include <filesystem>
-#include <fstream>
+#include <misc/aligned_buffer.hpp>
 #include <misc/config.hpp>
-#include <unordered_map>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
+#include <thread>
+#include <unordered_set>
 #include <vector>
 
 namespace hivedb {
 static constexpr std::size_t DEFAULT_NUMBER_OF_PAGES = 16;
+// upper bound on how many pages go out in a single pwritev()
+static constexpr std::size_t MAX_COALESCED_PAGES = 64;
+// how many extents past the last one in use are fallocate()d in the
+// background, so claiming a new extent rarely waits on the filesystem
+static constexpr std::size_t PREALLOCATED_EXTENTS = 4;
+// upper bound on how many pages go through the double-write file at once
+static constexpr std::size_t DOUBLE_WRITE_PAGES = 64;
+
+// When do we pay for fdatasync?
+enum struct durability_mode {
+  // after every single page write
+  per_write,
+  // once per batch of requests handled by the disk scheduler
+  per_batch,
+  // only when sync() is called explicitly (e.g. on checkpoints)
+  manual,
+};
+
+enum struct io_mode {
+  // go through the kernel page cache
+  buffered,
+  // O_DIRECT, pages are only cached once (in the buffer pool). Falls back to
+  // buffered on filesystems that don't support it (e.g. tmpfs)
+  direct,
+};
+
+// What keeps a crash in the middle of a page write from losing the page?
+enum struct torn_write_protection {
+  // nothing, a torn page fails its checksum when it's read
+  none,
+  // pages are written (and synced) to a double-write file next to the db
+  // file before they go in place, opening the db file repairs torn pages
+  // from there
+  double_write,
+};
 
+// what a compact() call got done
+struct compaction_result {
+  std::size_t relocated_pages{0};
+  // freed pages whose space was given back to the filesystem
+  std::size_t punched_pages{0};
+  // how much shorter the file got
+  std::size_t trimmed_bytes{0};
+};
+
+// where the double-write file of a db file lives
+[[nodiscard]]
+std::filesystem::path get_double_write_path(const std::filesystem::path &);
+
+// Pages are located through a page_directory stored inside the db file, so
+// reopening a file finds every page written before without scanning it.
+//
+// Each file has its own page size (see page_directory), picked by whoever
+// creates it: 4 KiB suits point lookups, up to MAX_PAGE_SIZE means fewer,
+// larger I/Os for scans. Buffers handed to the manager must be
+// get_page_size() bytes.
+//
+// Every page written gets a CRC32C trailer (see page_checksum.hpp) that is
+// checked when it's read back, a mismatch fails the read. The trailer is
+// filled in on the side, the caller's buffer is never written to.
+//
+// With torn_write_protection::double_write every batch of writes is first
+// written sequentially to the double-write file and synced, only then are
+// the pages written in place. Before the next batch reuses the file the db
+// file is synced, so the file always holds an intact copy of every page
+// that may be half written. A clean shutdown removes it.
+//
+// The file grows an extent at a time with fallocate(), a background thread
+// keeps PREALLOCATED_EXTENTS of them ready ahead of the page directory.
+// compact() gives space back: it moves pages from the end of the file into
+// freed spots, punches holes where pages were freed and cuts the file
+// after the last page in use (see disk_compactor).
+//
+// Safe to call from several disk scheduler workers at once as long as they
+// don't touch the same page concurrently (the scheduler guarantees that).
 struct disk_manager {
  private:
-  std::size_t m_current_pages{DEFAULT_NUMBER_OF_PAGES};
-  std::unordered_map<page_id_t, offset_t> m_pages;
-  std::vector<offset_t> m_free_offsets;
-
-  std::fstream m_db_file;
+  io_mode m_io_mode;
+  int m_db_fd{-1};
   std::filesystem::path m_db_file_path;
+  // guards the directory and file growth, the page I/O itself runs outside
+  std::mutex m_directory_latch;
+  page_directory m_directory;
+  // the file's, fixed when it was created
+  std::size_t m_page_size;
+
+  durability_mode m_durability;
+  std::atomic<bool> m_has_unsynced_writes{false};
+
+  // everything below up to m_grower is guarded by m_growth_latch
+  std::mutex m_growth_latch;
+  std::condition_variable m_growth_cv;
+  // how much of the file is allocated on disk
+  offset_t m_allocated_end{0};
+  // how far the grower should take m_allocated_end
+  offset_t m_growth_target{0};
+  bool m_is_shutting_down{false};
+  std::thread m_grower;
+
+  torn_write_protection m_torn_write_protection;
+  std::filesystem::path m_double_write_path;
+  int m_double_write_fd{-1};
+  // one batch at a time goes through the double-write file
+  std::mutex m_double_write_latch;
+  std::size_t m_repaired_pages{0};
+
+  // Page I/O holds this shared from looking up the page's offset until the
+  // I/O is done, compact() holds it exclusively while it registers and
+  // switches over the pages it moves.
+  std::shared_mutex m_relocation_latch;
+  // one compact() at a time, guards m_vacated_offsets
+  std::mutex m_compaction_latch;
+  // old spots of moved pages, freed once the move is synced
+  std::vector<offset_t> m_vacated_offsets;
+  // guarded by m_directory_latch: the pages compact() is copying, those of
+  // them written or deleted meanwhile stay where they are
+  std::unordered_set<page_id_t> m_relocating_pages;
+  std::unordered_set<page_id_t> m_relocation_conflicts;
+  // Guarded by m_directory_latch: bit n is set while the n-th spot of the
+  // file is free and compact() punched a hole for it, a spot that is freed
+  // again loses its bit. Which free spots are punched isn't stored, after
+  // a reopen compact() punches every one of them once more.
+  std::vector<bool> m_punched_spots;
+
+  // both expect m_directory_latch to be held
+  [[nodiscard]]
+  offset_t allocate_new_page(page_kind);
+  void grow_file_if_needed();
+
+  // The spot at offset was just freed, so it has to be punched (again).
+  // Must hold m_directory_latch.
+  void forget_punched(offset_t);
+
+  // Allocates [m_allocated_end, end) on disk, must hold m_growth_latch.
+  void allocate_file_space(offset_t end);
+  void run_grower();
+
+  [[nodiscard]]
+  offset_t find_or_allocate(page_id_t, page_kind = page_kind::table);
 
+  // The page goes out as the request's buffer up to tail_size bytes before
+  // its end, then the staged tail, which ends in the trailer. That way the
+  // request's buffer is never written to, two writes may share one.
+  struct pending_write {
+    offset_t offset;
+    disk_request *req;
+    char *tail{nullptr};
+    std::size_t tail_size{0};
+  };
+
+  // Copies the tail of every write into per-thread scratch space and fills
+  // in its trailer there. O_DIRECT only takes whole aligned blocks, so the
+  // tails are IO_ALIGNMENT bytes then (the whole page for unaligned
+  // buffers), just the trailer otherwise.
+  void stage_writes(std::span<pending_write>);
+  // Adds the iovecs of a write to out, returns how many.
+  std::size_t gather_page(const pending_write &, iovec *out) const;
+
+  // the writes of a batch, sorted by offset, go out as few pwritev()s
+  void write_coalesced(std::span<pending_write>);
+
+  // Same, but every DOUBLE_WRITE_PAGES of them go through the double-write
+  // file first.
+  void write_double_written(std::span<pending_write>);
+  // Writes copies of the pages to the double-write file and syncs it. Must
+  // hold m_double_write_latch.
+  void write_double_write_copies(std::span<const pending_write>);
+  // Puts back the pages of the last batch in the double-write file that
+  // didn't make it in place in one piece.
+  void recover_torn_pages();
+
+  // the three steps of compact()
   [[nodiscard]]
-  offset_t allocate_new_page();
+  std::size_t relocate_last_pages(std::size_t);
+  [[nodiscard]]
+  std::size_t punch_freed_pages();
+  [[nodiscard]]
+  std::size_t trim_file();
 
   [[nodiscard]]
   std::size_t get_file_size();
 
  public:
-  explicit disk_manager(const std::filesystem::path &);
+  explicit disk_manager(const std::filesystem::path &,
+                        durability_mode = durability_mode::manual,
+                        io_mode = io_mode::buffered,
+                        torn_write_protection = torn_write_protection::none,
+                        std::size_t page_size = PAGE_SIZE);
+
+  disk_manager(const disk_manager &) = delete;
+  disk_manager &operator=(const disk_manager &) = delete;
+  disk_manager(disk_manager &&) = delete;
+  disk_manager &operator=(disk_manager &&) = delete;
+
+  ~disk_manager();
 
   void read_page(page_id_t, char *);
   void write_page(page_id_t, const char *);
+  // Writes only the first size bytes of the page in place, the way a crash
+  // in the middle of write_page() would leave it: no new trailer and no
+  // double-write copy. Under O_DIRECT size is rounded down to whole
+  // IO_ALIGNMENT blocks. For fault injection (see disk_manager_simulated).
+  void write_torn_page(page_id_t, const char *, std::size_t size);
+  // Gives the page's spot in the file and its id back for reuse.
   void delete_page(page_id_t);
+
+  // The lowest free page id, the ids of deleted pages come back first.
+  [[nodiscard]]
+  page_id_t allocate_page_id();
+  // every page id in use is below this
+  [[nodiscard]]
+  page_id_t page_id_end();
+
+  // Gives page id a place in the extents of kind. Pages written without
+  // calling this first are table pages, does nothing if id has a place
+  // already.
+  void allocate_page(page_id_t, page_kind);
+
+  // Called by the disk scheduler with everything a worker dequeued. Writes
+  // to adjacent offsets are merged into one vectored write, every request's
+  // promise is completed once its I/O is done.
+  void submit_batch(std::span<disk_request>);
+
+  // Makes every write issued so far (and the page directory) durable.
+  void sync();
+
+  // Called by the disk scheduler after it drained a batch of requests.
+  void end_batch();
+
+  // Moves up to max_pages pages from the end of the file into the lowest
+  // freed spots, punches holes (FALLOC_FL_PUNCH_HOLE) for the free spots
+  // that don't have one yet and truncates the file after the last page in use.
+  // Moved pages are synced before their old spots are freed.
+  //
+  // Runs alongside page I/O, which only waits while a moved page's
+  // directory entry is switched over. Writes to a page that is being
+  // moved win, the page just stays where it is.
+  compaction_result compact(std::size_t max_pages);
+
+  [[nodiscard]]
+  durability_mode get_durability_mode() const;
+
+  // what we ended up with, which may differ from what was asked for
+  [[nodiscard]]
+  io_mode get_io_mode() const;
+
+  // the page size the file was created with, which is not necessarily the
+  // one asked for
+  [[nodiscard]]
+  std::size_t get_page_size() const;
+
+  [[nodiscard]]
+  torn_write_protection get_torn_write_protection() const;
+
+  // how many torn pages opening the file repaired
+  [[nodiscard]]
+  std::size_t get_repaired_page_count() const;
 };
 }  // namespace hivedb
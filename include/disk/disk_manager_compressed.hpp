@@ -0,0 +1,120 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <disk/disk_manager.hpp>
+#include <disk/page_directory.hpp>
+#include <filesystem>
+#include <misc/config.hpp>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+namespace hivedb {
+// compressed pages are stored in slots of a multiple of this many bytes
+static constexpr std::size_t COMPRESSED_SLOT_UNIT = 512;
+static constexpr std::size_t SLOT_UNITS_PER_PAGE =
+    PAGE_SIZE / COMPRESSED_SLOT_UNIT;
+
+struct compression_stats {
+  // pages written compressed
+  std::size_t compressed_pages;
+  // pages written as they are because compressing them didn't pay
+  std::size_t raw_pages;
+};
+
+// Compresses every page with the in-tree LZ4 style codec (see
+// page_codec.hpp) and stores it in a slot of 512, 1024 or 2048 bytes.
+// Pages that don't fit 2 KiB compressed are stored raw in a whole page.
+//
+// Slots of one size are carved out of page sized chunks handed out by the
+// page directory, whose entries hold the slot's offset with its size in the
+// low bits. A page moving to a slot of another size is written there before
+// the directory points at it, and the slot it moved out of is only reused
+// after sync(), until then the directory on disk may still point at it.
+//
+// Closing the file leaves the free slots of partly used chunks behind in a
+// chain of pages (the slot map) the superblock points at:
+// -----------------------------------------------------------------------
+// | next_offset (8 bytes) | entry_count (8 bytes) | entry_0 | ... | trailer |
+// -----------------------------------------------------------------------
+// Opening reads them back, every chunk the map doesn't list is full, so the
+// directory isn't walked. The superblock stops pointing at the map once it's
+// read, after a crash there is none and the slots are worked out from the
+// whole directory instead, freeing the chunks and raw pages (and map pages)
+// whose freeing didn't make it to disk.
+//
+// The file is marked with PAGE_FEATURE_COMPRESSED, the other managers
+// refuse to open it. Checksums work like disk_manager's, the trailer is
+// filled in before compressing and checked after decompressing.
+//
+// Safe to call from several disk scheduler workers at once as long as they
+// don't touch the same page concurrently (the scheduler guarantees that).
+struct disk_manager_compressed {
+ private:
+  // slot sizes in units, raw pages take SLOT_UNITS_PER_PAGE
+  static constexpr std::array<std::size_t, 3> SLOT_CLASSES{1, 2, 4};
+
+  int m_db_fd{-1};
+  std::filesystem::path m_db_file_path;
+  // guards the directory and the slot bookkeeping below
+  std::mutex m_directory_latch;
+  page_directory m_directory;
+  // free slots of chunks that are partly in use, per class
+  std::array<std::set<offset_t>, SLOT_CLASSES.size()> m_free_slots;
+  // how many slots of each chunk are in use, a chunk missing here is full
+  std::unordered_map<offset_t, std::size_t> m_chunk_usage;
+  // entries of slots given up since the last sync(), only freed once the
+  // directory that no longer points at them is durable
+  std::vector<offset_t> m_pending_free_slots;
+  // where the slot map was read from, it's written there again on close
+  std::vector<offset_t> m_slot_map_pages;
+
+  durability_mode m_durability;
+  std::atomic<bool> m_has_unsynced_writes{false};
+  std::atomic<std::size_t> m_compressed_pages{0};
+  std::atomic<std::size_t> m_raw_pages{0};
+
+  // where units is in SLOT_CLASSES, SLOT_CLASSES.size() if it isn't there
+  [[nodiscard]]
+  static std::size_t class_index(std::size_t units);
+
+  // all of these expect m_directory_latch to be held
+  void load_slots();
+  // false if the slot map is missing or torn
+  [[nodiscard]]
+  bool load_slot_map();
+  void save_slot_map();
+  [[nodiscard]]
+  offset_t allocate_slot(std::size_t units);
+  void free_slot(offset_t entry);
+
+ public:
+  explicit disk_manager_compressed(const std::filesystem::path &,
+                                   durability_mode = durability_mode::manual);
+
+  disk_manager_compressed(const disk_manager_compressed &) = delete;
+  disk_manager_compressed &operator=(const disk_manager_compressed &) = delete;
+  disk_manager_compressed(disk_manager_compressed &&) = delete;
+  disk_manager_compressed &operator=(disk_manager_compressed &&) = delete;
+
+  ~disk_manager_compressed();
+
+  void read_page(page_id_t, char *);
+  void write_page(page_id_t, const char *);
+  void delete_page(page_id_t);
+
+  [[nodiscard]]
+  page_id_t allocate_page_id();
+  [[nodiscard]]
+  page_id_t page_id_end();
+
+  void sync();
+  void end_batch();
+
+  [[nodiscard]]
+  compression_stats get_stats() const;
+};
+}  // namespace hivedb
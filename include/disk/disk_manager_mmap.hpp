@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <disk/disk_manager.hpp>
+#include <disk/file_io.hpp>
+#include <disk/page_directory.hpp>
+#include <filesystem>
+#include <misc/config.hpp>
+#include <mutex>
+#include <shared_mutex>
+
+namespace hivedb {
+// Hints passed to madvise for the whole mapping.
+enum struct access_pattern {
+  normal,
+  // scans, the kernel reads ahead aggressively
+  sequential,
+  // point lookups, no readahead
+  random,
+};
+
+// Serves pages straight out of a shared mapping of the db file, so a page
+// fault in the buffer pool costs a memcpy instead of a syscall. Meant for
+// read mostly deployments. Uses the same on-disk format (superblock + page
+// directory) as disk_manager, so either one can open the other's files.
+//
+// Like disk_manager the file grows by PREALLOCATED_EXTENTS extents at a
+// time, but the space is reserved before it is mapped: a store into a hole
+// of a shared mapping raises SIGBUS once the filesystem is full, instead of
+// failing the write.
+struct disk_manager_mmap {
+ private:
+  file_descriptor m_db_fd;
+  std::filesystem::path m_db_file_path;
+  // guards the directory, always taken before m_mapping_latch
+  std::mutex m_directory_latch;
+  page_directory m_directory;
+
+  // shared for copying pages in and out, exclusive for remapping
+  std::shared_mutex m_mapping_latch;
+  char *m_mapping{nullptr};
+  std::size_t m_mapping_size{0};
+  access_pattern m_access_pattern;
+
+  std::atomic<bool> m_has_unsynced_writes{false};
+
+  // both expect m_directory_latch to be held
+  [[nodiscard]]
+  offset_t allocate_new_page();
+  // grows the file (and the mapping with it) to cover the directory's end
+  void grow_file_if_needed();
+  // makes sure [from, to) of the file has space on disk, holes included
+  void allocate_file_space(std::size_t from, std::size_t to);
+
+  // expects m_mapping_latch to be held exclusively
+  void map_file(std::size_t);
+  void advise(access_pattern);
+
+ public:
+  explicit disk_manager_mmap(const std::filesystem::path &,
+                             access_pattern = access_pattern::normal);
+
+  disk_manager_mmap(const disk_manager_mmap &) = delete;
+  disk_manager_mmap &operator=(const disk_manager_mmap &) = delete;
+  disk_manager_mmap(disk_manager_mmap &&) = delete;
+  disk_manager_mmap &operator=(disk_manager_mmap &&) = delete;
+
+  ~disk_manager_mmap();
+
+  void read_page(page_id_t, char *);
+  void write_page(page_id_t, const char *);
+  // Only the first size bytes of the page, without a new trailer. For fault
+  // injection (see disk_manager_simulated).
+  void write_torn_page(page_id_t, const char *, std::size_t size);
+  // Gives the page's spot in the file and its id back for reuse.
+  void delete_page(page_id_t);
+
+  // The lowest free page id, the ids of deleted pages come back first.
+  [[nodiscard]]
+  page_id_t allocate_page_id();
+  // every page id in use is below this
+  [[nodiscard]]
+  page_id_t page_id_end();
+
+  // msync()s the mapping, writes are otherwise only durable whenever the
+  // kernel decides to write the dirty pages back
+  void sync();
+  void end_batch();
+
+  void set_access_pattern(access_pattern);
+};
+}  // namespace hivedb
@@ -2,12 +2,14 @@
 #include <array>
 #include <filesystem>
 #include <misc/config.hpp>
+#include <mutex>
 #include <vector>
 
 namespace hivedb {
 struct disk_manager_mock {
  private:
   using mock_page = std::array<char, PAGE_SIZE>;
+  std::mutex m_latch;
   std::vector<mock_page> m_mock_file;
 
  public:
@@ -15,6 +17,7 @@ struct disk_manager_mock {
 
   void read_page(page_id_t, char *);
   void write_page(page_id_t, const char *);
+  void write_torn_page(page_id_t, const char *, std::size_t);
   void delete_page(page_id_t);
 };
 }  // namespace hivedb
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <disk/disk_manager.hpp>
+#include <disk/disk_request.hpp>
+#include <filesystem>
+#include <memory>
+#include <misc/config.hpp>
+#include <mutex>
+#include <span>
+#include <vector>
+
+namespace hivedb {
+// consecutive page ids that live in the same segment
+static constexpr page_id_t PAGES_PER_SEGMENT_STRIPE = 64;
+static constexpr std::size_t DEFAULT_SEGMENT_COUNT = 4;
+// 1 GiB segment files
+static constexpr page_id_t DEFAULT_PAGES_PER_SEGMENT = (1 << 30) / PAGE_SIZE;
+
+struct segment_options {
+  std::size_t segment_count{DEFAULT_SEGMENT_COUNT};
+  // a segment file never holds more pages than this, has to be a multiple
+  // of PAGES_PER_SEGMENT_STRIPE
+  page_id_t pages_per_segment{DEFAULT_PAGES_PER_SEGMENT};
+  // where the segment files go, round robin (think one per device). Next to
+  // the db file if empty.
+  std::vector<std::filesystem::path> directories{};
+
+  // handed to every segment's disk_manager
+  durability_mode durability{durability_mode::manual};
+  io_mode mode{io_mode::buffered};
+  torn_write_protection protection{torn_write_protection::none};
+};
+
+/*
+ * Spreads pages over segment_count segment files, each one a disk_manager
+ * of its own. Page ids are striped over the segments PAGES_PER_SEGMENT_STRIPE
+ * at a time:
+ *
+ *   segment  = id / PAGES_PER_SEGMENT_STRIPE % segment_count
+ *   local id = id / PAGES_PER_SEGMENT_STRIPE / segment_count
+ *                * PAGES_PER_SEGMENT_STRIPE + id % PAGES_PER_SEGMENT_STRIPE
+ *
+ * so runs of pages stay in one file while the file sizes stay within
+ * pages_per_segment. The db file itself only records the layout, opening it
+ * with a different one fails.
+ *
+ * The disk scheduler gives every segment workers of its own (see
+ * segmented_disk_manager_t). Same thread safety as disk_manager.
+ */
+struct disk_manager_segmented {
+ private:
+  std::filesystem::path m_db_file_path;
+  segment_options m_options;
+  std::vector<std::unique_ptr<disk_manager>> m_segments;
+
+  // new pages fill a stripe of one segment before moving to the next
+  std::mutex m_allocation_latch;
+  std::size_t m_allocation_segment{0};
+
+  // Writes the layout to a new db file, or checks it against an existing
+  // one.
+  void check_layout();
+
+  [[nodiscard]]
+  page_id_t to_local(page_id_t) const;
+  [[nodiscard]]
+  page_id_t to_global(std::size_t segment, page_id_t local_id) const;
+
+ public:
+  explicit disk_manager_segmented(const std::filesystem::path &,
+                                  segment_options = {});
+
+  disk_manager_segmented(const disk_manager_segmented &) = delete;
+  disk_manager_segmented &operator=(const disk_manager_segmented &) = delete;
+  disk_manager_segmented(disk_manager_segmented &&) = delete;
+  disk_manager_segmented &operator=(disk_manager_segmented &&) = delete;
+
+  ~disk_manager_segmented() = default;
+
+  void read_page(page_id_t, char *);
+  void write_page(page_id_t, const char *);
+  void write_torn_page(page_id_t, const char *, std::size_t);
+  void delete_page(page_id_t);
+
+  [[nodiscard]]
+  page_id_t allocate_page_id();
+  [[nodiscard]]
+  page_id_t page_id_end();
+
+  // Hands every segment its part of the batch.
+  void submit_batch(std::span<disk_request>);
+
+  void sync();
+  void end_batch();
+
+  [[nodiscard]]
+  std::size_t segment_count() const;
+  // the segment page id lives in, 0 for invalid ids
+  [[nodiscard]]
+  std::size_t segment_of(page_id_t) const;
+
+  [[nodiscard]]
+  std::filesystem::path get_segment_path(std::size_t) const;
+};
+}  // namespace hivedb
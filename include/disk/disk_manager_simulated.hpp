@@ -0,0 +1,383 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <disk/disk_scheduler.hpp>
+#include <filesystem>
+#include <misc/aligned_buffer.hpp>
+#include <misc/config.hpp>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace hivedb {
+// How long a simulated device takes to serve a request.
+struct device_model {
+  // what every request costs
+  std::chrono::nanoseconds read_latency{0};
+  std::chrono::nanoseconds write_latency{0};
+  std::chrono::nanoseconds sync_latency{0};
+  // mean of an exponentially distributed extra delay, the long tail every
+  // real device has
+  std::chrono::nanoseconds jitter{0};
+
+  // Spinning disks: a request that isn't for the page right after the
+  // previous one waits for the platter (half a rotation on average) and for
+  // the head, seeking over d pages takes
+  // full_seek * sqrt(d / full_seek_distance).
+  std::chrono::nanoseconds rotation{0};
+  std::chrono::nanoseconds full_seek{0};
+  page_id_t full_seek_distance{1};
+
+  // bytes per second the device moves at most, 0 for no limit
+  std::uint64_t bandwidth{0};
+  // how many requests it serves at once (think SSD channels)
+  std::size_t parallelism{1};
+};
+
+// a datacenter NVMe drive, roughly
+[[nodiscard]]
+inline device_model ssd_device_model() {
+  using namespace std::chrono_literals;
+  return device_model{.read_latency = 80us,
+                      .write_latency = 30us,
+                      .sync_latency = 1ms,
+                      .jitter = 10us,
+                      .bandwidth = 2'000'000'000,
+                      .parallelism = 8};
+}
+
+// a 7200 rpm disk of 1 TB
+[[nodiscard]]
+inline device_model hdd_device_model() {
+  using namespace std::chrono_literals;
+  return device_model{.read_latency = 100us,
+                      .write_latency = 100us,
+                      .sync_latency = 8ms,
+                      .jitter = 200us,
+                      .rotation = 4166us,
+                      .full_seek = 15ms,
+                      .full_seek_distance = page_id_t{1} << 28,
+                      .bandwidth = 150'000'000,
+                      .parallelism = 1};
+}
+
+// Managers that can leave a page half written behind their own back, the
+// way a crash in the middle of a write does.
+template <typename T>
+concept torn_writing_disk_manager_t =
+    disk_manager_t<T> &&
+    requires(T manager, page_id_t id, const char *buffer, std::size_t size) {
+      manager.write_torn_page(id, buffer, size);
+    };
+
+struct fault_model {
+  // chance a request fails without touching the page
+  double read_error_rate{0};
+  double write_error_rate{0};
+  // chance a write fails after only torn_write_size bytes of it made it,
+  // the rest of the page (trailer included) stays what it was before. Only
+  // managers that are torn_writing_disk_manager_t can do that, the others
+  // get a whole page that is the new start over the old rest.
+  double torn_write_rate{0};
+  std::size_t torn_write_size{PAGE_SIZE / 2};
+};
+
+enum struct latency_mode {
+  // requests take as long as the device would
+  sleep,
+  // requests return right away, the time they would have taken only adds
+  // up in get_device_time(). For tests of the model itself.
+  count_only,
+};
+
+struct simulation_options {
+  device_model device{};
+  fault_model faults{};
+  latency_mode mode{latency_mode::sleep};
+  // the same seed gives the same delays and faults for the same requests
+  std::uint64_t seed{0x5eed};
+};
+
+/*
+ * Wraps another disk manager and makes it behave like a given device: every
+ * request takes as long as device_model says and fails as often as
+ * fault_model says. The device is shared, a request waits for a free
+ * channel, so a busy device queues up like a real one.
+ *
+ * Reads and writes are served one at a time (no submit_batch()), the rest
+ * of T's interface is passed through as far as T has it.
+ */
+template <disk_manager_t T>
+struct disk_manager_simulated {
+ private:
+  enum struct operation { read, write, sync };
+
+  T m_manager;
+  const simulation_options m_options;
+
+  // guards everything below
+  std::mutex m_latch;
+  std::mt19937_64 m_random;
+  // when each channel of the device is done with what it was handed
+  std::vector<std::chrono::steady_clock::time_point> m_busy_until;
+  // where a disk's head is, right after the last page it served
+  page_id_t m_head{0};
+  std::chrono::nanoseconds m_device_time{0};
+  std::size_t m_injected_faults{0};
+
+  // How long the device takes for a request, must hold m_latch.
+  [[nodiscard]]
+  std::chrono::nanoseconds service_time(operation, page_id_t);
+  // Whether to inject a fault, must hold m_latch.
+  [[nodiscard]]
+  bool roll(double rate);
+
+  // Waits until the device served a request.
+  void use_device(operation, page_id_t);
+
+  // sleep_until() overshoots by tens of microseconds, so spin the end
+  static void wait_until(std::chrono::steady_clock::time_point);
+
+ public:
+  template <typename... Args>
+  explicit disk_manager_simulated(const std::filesystem::path &,
+                                  const simulation_options & = {},
+                                  Args &&...);
+
+  disk_manager_simulated(const disk_manager_simulated &) = delete;
+  disk_manager_simulated &operator=(const disk_manager_simulated &) = delete;
+  disk_manager_simulated(disk_manager_simulated &&) = delete;
+  disk_manager_simulated &operator=(disk_manager_simulated &&) = delete;
+
+  ~disk_manager_simulated() = default;
+
+  void read_page(page_id_t, char *);
+  void write_page(page_id_t, const char *);
+  void delete_page(page_id_t);
+
+  void sync()
+    requires syncable_disk_manager_t<T>;
+  void end_batch()
+    requires syncable_disk_manager_t<T>;
+
+  [[nodiscard]]
+  page_id_t allocate_page_id()
+    requires page_allocating_disk_manager_t<T>;
+  [[nodiscard]]
+  page_id_t page_id_end()
+    requires page_allocating_disk_manager_t<T>;
+
+  [[nodiscard]]
+  std::size_t get_page_size() const
+    requires page_sized_disk_manager_t<T>;
+
+  // how long the device was busy in total
+  [[nodiscard]]
+  std::chrono::nanoseconds get_device_time();
+  [[nodiscard]]
+  std::size_t get_injected_faults();
+
+  [[nodiscard]]
+  T &get_manager();
+};
+
+template <disk_manager_t T>
+template <typename... Args>
+disk_manager_simulated<T>::disk_manager_simulated(
+    const std::filesystem::path &db_path, const simulation_options &options,
+    Args &&...args)
+    : m_manager(db_path, std::forward<Args>(args)...),
+      m_options(options),
+      m_random(options.seed),
+      m_busy_until(std::max<std::size_t>(options.device.parallelism, 1)) {
+  if (options.device.full_seek_distance <= 0)
+    throw std::invalid_argument("full_seek_distance must be > 0");
+}
+
+template <disk_manager_t T>
+std::chrono::nanoseconds disk_manager_simulated<T>::service_time(
+    operation op, page_id_t id) {
+  using std::chrono::nanoseconds;
+  const auto &device = m_options.device;
+
+  auto time = op == operation::read    ? device.read_latency
+              : op == operation::write ? device.write_latency
+                                       : device.sync_latency;
+
+  if (op != operation::sync) {
+    if (id != m_head) {
+      const auto distance = static_cast<double>(id > m_head ? id - m_head
+                                                            : m_head - id);
+      const auto seek = std::sqrt(std::min(
+          1.0, distance / static_cast<double>(device.full_seek_distance)));
+      time += device.rotation +
+              nanoseconds{static_cast<nanoseconds::rep>(
+                  static_cast<double>(device.full_seek.count()) * seek)};
+    }
+    m_head = id + 1;
+
+    // every channel gets its share of the bandwidth
+    if (device.bandwidth > 0) {
+      time += nanoseconds{static_cast<nanoseconds::rep>(
+          page_size_of(m_manager) * m_busy_until.size() * 1'000'000'000ull /
+          device.bandwidth)};
+    }
+  }
+
+  if (device.jitter.count() > 0) {
+    std::exponential_distribution<double> jitter{
+        1.0 / static_cast<double>(device.jitter.count())};
+    time += nanoseconds{static_cast<nanoseconds::rep>(jitter(m_random))};
+  }
+  return time;
+}
+
+template <disk_manager_t T>
+bool disk_manager_simulated<T>::roll(double rate) {
+  if (rate <= 0) return false;
+  if (!std::bernoulli_distribution{std::min(rate, 1.0)}(m_random))
+    return false;
+
+  ++m_injected_faults;
+  return true;
+}
+
+template <disk_manager_t T>
+void disk_manager_simulated<T>::use_device(operation op, page_id_t id) {
+  std::unique_lock ul{m_latch};
+  const auto time = service_time(op, id);
+  m_device_time += time;
+  if (m_options.mode == latency_mode::count_only) return;
+
+  // the channel that frees up first takes it
+  auto channel = std::min_element(m_busy_until.begin(), m_busy_until.end());
+  *channel = std::max(*channel, std::chrono::steady_clock::now()) + time;
+  const auto done = *channel;
+  ul.unlock();
+
+  wait_until(done);
+}
+
+template <disk_manager_t T>
+void disk_manager_simulated<T>::wait_until(
+    std::chrono::steady_clock::time_point deadline) {
+  constexpr std::chrono::microseconds spin{100};
+  if (deadline - std::chrono::steady_clock::now() > spin)
+    std::this_thread::sleep_until(deadline - spin);
+  while (std::chrono::steady_clock::now() < deadline) std::this_thread::yield();
+}
+
+template <disk_manager_t T>
+void disk_manager_simulated<T>::read_page(page_id_t id, char *buffer) {
+  use_device(operation::read, id);
+
+  std::unique_lock ul{m_latch};
+  const bool is_failing = roll(m_options.faults.read_error_rate);
+  ul.unlock();
+  if (is_failing)
+    throw std::runtime_error("Injected read error on page_id:" +
+                             std::to_string(id));
+
+  m_manager.read_page(id, buffer);
+}
+
+template <disk_manager_t T>
+void disk_manager_simulated<T>::write_page(page_id_t id, const char *buffer) {
+  use_device(operation::write, id);
+
+  std::unique_lock ul{m_latch};
+  const bool is_failing = roll(m_options.faults.write_error_rate);
+  const bool is_torn = !is_failing && roll(m_options.faults.torn_write_rate);
+  ul.unlock();
+  if (is_failing)
+    throw std::runtime_error("Injected write error on page_id:" +
+                             std::to_string(id));
+
+  if (!is_torn) {
+    m_manager.write_page(id, buffer);
+    return;
+  }
+
+  if constexpr (torn_writing_disk_manager_t<T>) {
+    // the old trailer stays, so the page fails its checksum
+    m_manager.write_torn_page(id, buffer, m_options.faults.torn_write_size);
+  } else {
+    // the start of the new page over what was there before
+    const auto page_size = page_size_of(m_manager);
+    aligned_buffer page{page_size};
+    m_manager.read_page(id, page.data());
+    std::memcpy(page.data(), buffer,
+                std::min(m_options.faults.torn_write_size, page_size));
+    m_manager.write_page(id, page.data());
+  }
+  throw std::runtime_error("Injected torn write on page_id:" +
+                           std::to_string(id));
+}
+
+template <disk_manager_t T>
+void disk_manager_simulated<T>::delete_page(page_id_t id) {
+  m_manager.delete_page(id);
+}
+
+template <disk_manager_t T>
+void disk_manager_simulated<T>::sync()
+  requires syncable_disk_manager_t<T>
+{
+  use_device(operation::sync, INVALID_PAGE_ID);
+  m_manager.sync();
+}
+
+template <disk_manager_t T>
+void disk_manager_simulated<T>::end_batch()
+  requires syncable_disk_manager_t<T>
+{
+  m_manager.end_batch();
+}
+
+template <disk_manager_t T>
+page_id_t disk_manager_simulated<T>::allocate_page_id()
+  requires page_allocating_disk_manager_t<T>
+{
+  return m_manager.allocate_page_id();
+}
+
+template <disk_manager_t T>
+page_id_t disk_manager_simulated<T>::page_id_end()
+  requires page_allocating_disk_manager_t<T>
+{
+  return m_manager.page_id_end();
+}
+
+template <disk_manager_t T>
+std::size_t disk_manager_simulated<T>::get_page_size() const
+  requires page_sized_disk_manager_t<T>
+{
+  return m_manager.get_page_size();
+}
+
+template <disk_manager_t T>
+std::chrono::nanoseconds disk_manager_simulated<T>::get_device_time() {
+  std::scoped_lock sl{m_latch};
+  return m_device_time;
+}
+
+template <disk_manager_t T>
+std::size_t disk_manager_simulated<T>::get_injected_faults() {
+  std::scoped_lock sl{m_latch};
+  return m_injected_faults;
+}
+
+template <disk_manager_t T>
+T &disk_manager_simulated<T>::get_manager() {
+  return m_manager;
+}
+}  // namespace hivedb
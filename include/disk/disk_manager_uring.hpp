@@ -0,0 +1,135 @@
+#pragma once
+
+#include <linux/io_uring.h>
+
+#include <atomic>
+#include <cstdint>
+#include <disk/disk_request.hpp>
+#include <disk/file_io.hpp>
+#include <disk/page_directory.hpp>
+#include <filesystem>
+#include <memory>
+#include <misc/config.hpp>
+#include <mutex>
+#include <span>
+#include <vector>
+
+namespace hivedb {
+static constexpr std::uint32_t DEFAULT_URING_QUEUE_DEPTH = 64;
+
+// Page I/O through io_uring. Uses the same on-disk format (superblock + page
+// directory, checksummed pages) as disk_manager, so either one can open the
+// other's files. Compressed files and files with another page size are
+// refused, like disk_manager_mmap does.
+//
+// Every batch runs on a ring of its own, taken from a pool that grows to as
+// many rings as there are batches in flight at once (one per scheduler
+// worker), so workers never wait on each other's I/O. Only the directory
+// lookups of a batch happen under a latch.
+//
+// If the kernel refuses to give us a ring (old kernel, seccomp, ...) we fall
+// back to plain pread/pwrite so callers don't have to care.
+struct disk_manager_uring {
+ private:
+  // One io_uring instance, all of its state is mmap'ed from the kernel. Not
+  // thread safe, a batch has it to itself.
+  struct ring {
+    int ring_fd{-1};
+    std::uint32_t queue_depth{0};
+    void *sq_ring{nullptr};
+    void *cq_ring{nullptr};
+    std::size_t sq_ring_size{0};
+    std::size_t cq_ring_size{0};
+    io_uring_sqe *sqes{nullptr};
+    std::size_t sqes_size{0};
+
+    std::uint32_t *sq_head{nullptr};
+    std::uint32_t *sq_tail{nullptr};
+    std::uint32_t *sq_mask{nullptr};
+    std::uint32_t *sq_array{nullptr};
+    std::uint32_t *cq_head{nullptr};
+    std::uint32_t *cq_tail{nullptr};
+    std::uint32_t *cq_mask{nullptr};
+    io_uring_cqe *cqes{nullptr};
+
+    ring() = default;
+    ring(const ring &) = delete;
+    ring &operator=(const ring &) = delete;
+    ring(ring &&) = delete;
+    ring &operator=(ring &&) = delete;
+    ~ring();
+
+    // false if the kernel has no io_uring for us
+    [[nodiscard]]
+    bool setup(std::uint32_t queue_depth);
+
+    void queue(std::uint8_t opcode, int fd, offset_t offset, void *address,
+               std::uint32_t length, std::uint64_t user_data);
+
+    // submits everything queued and blocks until at least min_complete
+    // completions are available
+    void enter(std::uint32_t to_submit, std::uint32_t min_complete);
+
+    // calls on_complete(user_data, res) for every completion ready right now
+    template <typename F>
+    std::uint32_t reap(F &&on_complete);
+  };
+
+  file_descriptor m_db_fd;
+  std::filesystem::path m_db_file_path;
+  // guards the directory
+  std::mutex m_directory_latch;
+  page_directory m_directory;
+  std::atomic<bool> m_has_unsynced_writes{false};
+
+  std::uint32_t m_queue_depth;
+  bool m_is_using_uring{false};
+  // rings no batch is using right now
+  std::mutex m_rings_latch;
+  std::vector<std::unique_ptr<ring>> m_idle_rings;
+
+  // nullptr when we are falling back to pread/pwrite
+  [[nodiscard]]
+  std::unique_ptr<ring> acquire_ring();
+  void release_ring(std::unique_ptr<ring>);
+
+  // expects m_directory_latch to be held
+  [[nodiscard]]
+  offset_t find_or_allocate(page_id_t);
+
+ public:
+  explicit disk_manager_uring(const std::filesystem::path &,
+                              std::uint32_t = DEFAULT_URING_QUEUE_DEPTH);
+
+  disk_manager_uring(const disk_manager_uring &) = delete;
+  disk_manager_uring &operator=(const disk_manager_uring &) = delete;
+  disk_manager_uring(disk_manager_uring &&) = delete;
+  disk_manager_uring &operator=(disk_manager_uring &&) = delete;
+
+  ~disk_manager_uring();
+
+  void read_page(page_id_t, char *);
+  void write_page(page_id_t, const char *);
+  // Gives the page's spot in the file and its id back for reuse.
+  void delete_page(page_id_t);
+
+  // The lowest free page id, the ids of deleted pages come back first.
+  [[nodiscard]]
+  page_id_t allocate_page_id();
+  // every page id in use is below this
+  [[nodiscard]]
+  page_id_t page_id_end();
+
+  // Queues every request of the batch into a ring (up to queue_depth at a
+  // time), submits them with a single syscall and completes each request's
+  // promise as its CQE comes back.
+  void submit_batch(std::span<disk_request>);
+
+  void sync();
+  // every write is only made durable through sync()
+  void end_batch();
+
+  [[nodiscard]]
+  bool is_using_uring() const;
+};
+}  // namespace hivedb
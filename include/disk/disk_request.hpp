@@ -0,0 +1,94 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <misc/config.hpp>
+#include <optional>
+
+namespace hivedb {
+enum struct disk_request_type {
+  write,
+  read,
+
+  // make every write completed before this request durable
+  sync,
+
+  // a read nobody is waiting on yet, see readahead_detector
+  prefetch,
+};
+
+// Managers serve a prefetch exactly like a read.
+[[nodiscard]]
+constexpr bool is_read_request(disk_request_type type) {
+  return type == disk_request_type::read ||
+         type == disk_request_type::prefetch;
+}
+
+// Most urgent first. The disk scheduler serves higher classes first but
+// never lets a lower one wait forever.
+enum struct disk_request_priority {
+  // someone is blocked on this page right now
+  foreground_read,
+  // a page fault is waiting for this frame to be freed
+  eviction_write,
+  // checkpoints and other flushes nobody waits on
+  background_flush,
+  // pages we guess will be needed soon
+  prefetch,
+  // reads that only check a page is still intact, see disk_scrubber
+  scrub,
+};
+
+static constexpr std::size_t DISK_REQUEST_PRIORITY_COUNT = 5;
+
+struct disk_request;
+struct disk_stats;
+struct disk_trace_writer;
+
+// Adds a finished request's timings to stats, see disk_stats.
+void record_completion(disk_stats &, const disk_request &, bool is_ok);
+// Appends a finished request to trace, see disk_trace_writer.
+void record_trace(disk_trace_writer &, const disk_request &, bool is_ok);
+
+// Runs on a disk scheduler worker (or whoever completes the request), so it
+// should hand the result off rather than do real work. The request is only
+// valid for the duration of the call.
+using disk_completion_fn = void (*)(void *context, const disk_request &,
+                                    bool is_ok);
+
+// A request reports back either through is_done or through on_complete.
+// The callback avoids the promise's shared state allocation and lets the
+// caller collect completions in bulk (see disk_completion_queue).
+struct disk_request {
+  disk_request_type type;
+  char *data;
+  page_id_t page_id;
+  std::optional<std::promise<bool>> is_done;
+  disk_request_priority priority{disk_request_priority::foreground_read};
+
+  disk_completion_fn on_complete{nullptr};
+  void *context{nullptr};
+  // not looked at by anyone but the callback
+  std::uint64_t tag{0};
+
+  // set by the disk scheduler, in cycle_clock ticks
+  std::uint64_t enqueued_at{0};
+  std::uint64_t dispatched_at{0};
+  disk_stats *stats{nullptr};
+  disk_trace_writer *trace{nullptr};
+
+  // lets whoever gave up on a batch half way tell what is still pending
+  bool is_completed{false};
+
+  void complete(bool is_ok) {
+    is_completed = true;
+    if (stats) record_completion(*stats, *this, is_ok);
+    if (trace) record_trace(*trace, *this, is_ok);
+    if (on_complete) {
+      on_complete(context, *this, is_ok);
+    } else if (is_done.has_value()) {
+      is_done->set_value(is_ok);
+    }
+  }
+};
+}  // namespace hivedb
@@ -2,13 +2,40 @@
 // Created by Pam Bondi herself on 7/22/25.
 //
 #pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <concepts>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <disk/disk_manager.hpp>
+#include <disk/disk_request.hpp>
+#include <disk/disk_stats.hpp>
+#include <disk/disk_trace.hpp>
+#include <disk/readahead_detector.hpp>
 #include <filesystem>
+#include <functional>
+#include <iterator>
 #include <future>
-#include <misc/channel.hpp>
+#include <memory>
 #include <misc/config.hpp>
+#include <misc/cycle_clock.hpp>
+#include <misc/mpsc_ring.hpp>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <span>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
 #include <thread>
 #include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 namespace hivedb {
 template <typename T>
@@ -19,33 +46,249 @@ concept disk_manager_t =
       manager.delete_page(id);
     } && std::is_constructible_v<T, const std::filesystem::path &>;
 
-enum struct disk_request_type {
-  write,
-  read,
+// Managers that can keep several requests in flight at once. The scheduler
+// hands them everything it dequeued in one go and they are responsible for
+// calling complete() on every request.
+template <typename T>
+concept batched_disk_manager_t =
+    disk_manager_t<T> && requires(T manager, std::span<disk_request> batch) {
+      manager.submit_batch(batch);
+    };
 
-  // shutdown the thread
-  shutdown,
-};
+// Managers that decide on their own when to pay for durability.
+template <typename T>
+concept syncable_disk_manager_t =
+    disk_manager_t<T> && requires(T manager) {
+      manager.sync();
+      manager.end_batch();
+    };
+
+// Managers that keep track of which page ids are in use, so the ids of
+// deleted pages are handed out again (even after a restart).
+template <typename T>
+concept page_allocating_disk_manager_t =
+    disk_manager_t<T> && requires(T manager) {
+      { manager.allocate_page_id() } -> std::same_as<page_id_t>;
+      { manager.page_id_end() } -> std::same_as<page_id_t>;
+    };
+
+// Managers that spread pages over several files, possibly on different
+// devices. Every segment gets workers of its own, so a busy segment doesn't
+// hold up I/O to the others.
+template <typename T>
+concept segmented_disk_manager_t =
+    disk_manager_t<T> && requires(const T manager, page_id_t id) {
+      { manager.segment_count() } -> std::same_as<std::size_t>;
+      { manager.segment_of(id) } -> std::same_as<std::size_t>;
+    };
+
+// Managers whose files don't have to use PAGE_SIZE pages, buffers handed
+// to them must be get_page_size() bytes.
+template <typename T>
+concept page_sized_disk_manager_t =
+    disk_manager_t<T> && requires(const T manager) {
+      { manager.get_page_size() } -> std::same_as<std::size_t>;
+    };
 
-struct disk_request {
-  disk_request_type type;
-  char *data;
-  page_id_t page_id;
-  std::promise<bool> is_done;
+// how big the buffers of manager's requests have to be
+template <disk_manager_t T>
+[[nodiscard]]
+std::size_t page_size_of(const T &manager) {
+  if constexpr (page_sized_disk_manager_t<T>) {
+    return manager.get_page_size();
+  } else {
+    return PAGE_SIZE;
+  }
+}
+
+// upper bound on how many requests a worker dispatches at once
+static constexpr std::size_t MAX_DISK_BATCH_SIZE = 64;
+// a thief only takes a few requests so the owner keeps most of its queue
+static constexpr std::size_t MAX_DISK_STEAL_SIZE = 8;
+// consecutive page ids that land on the same worker, keeps runs of pages
+// together (think leaf scans) while spreading unrelated ones out
+static constexpr page_id_t PAGES_PER_STRIPE = 64;
+// how long an idle worker sleeps before looking at its siblings' queues
+static constexpr std::chrono::microseconds DISK_STEAL_INTERVAL{500};
+// requests a worker's inbox holds before schedule() has to wait for room
+static constexpr std::size_t DISK_INBOX_CAPACITY = 4096;
+// upper bound on how many sync requests share one fdatasync
+static constexpr std::size_t MAX_GROUP_COMMIT_SIZE = 256;
+// how many batches a priority class can be passed over before it gets to
+// go first, bounds how long prefetches and flushes can be starved
+static constexpr std::size_t MAX_DISK_STARVATION_ROUNDS = 4;
+
+struct disk_scheduler_options {
+  // per segment for segmented managers
+  std::size_t worker_count{1};
+  // How long a sync waits for others to join it before the fdatasync.
+  // Syncs arriving while one is running always share the next one, so this
+  // only buys more sharing at the cost of commit latency.
+  std::chrono::microseconds group_commit_window{0};
+  // a group this big goes without waiting out the window
+  std::size_t group_commit_size{MAX_GROUP_COMMIT_SIZE};
+  // Every request completed is appended to this file (see
+  // disk_trace_writer), so the workload can be replayed later with
+  // replay_disk_trace(). Empty for no trace.
+  std::filesystem::path trace_path{};
 };
 
+// Requests are routed to per-worker queues by page id, so requests for the
+// same page are always served in the order they were scheduled. Idle workers
+// steal from their siblings, but never a request whose page is already
+// being served by someone else.
+//
+// Within a queue higher priority classes are served first, a class that was
+// passed over MAX_DISK_STARVATION_ROUNDS times in a row goes ahead of them.
+//
+// Syncs that made it through every queue are committed in groups by a
+// thread of their own: a single manager sync() completes every sync that
+// arrived while the previous one ran (or within group_commit_window).
+//
+// Every request is timestamped when it's scheduled, taken by a worker and
+// completed, get_stats() has the histograms of both waits per request type.
+// With a trace_path the same timings of every single request go to a trace
+// file as well.
+//
+// Segmented managers get worker_count workers per segment, a request only
+// lands on the queue of a worker of its page's segment. Stealing still
+// crosses segments, an idle worker may as well help a busy device.
+//
+// schedule() never takes a lock, requests land in the worker's lock-free
+// inbox and the worker sorts them into its queue. The queue's latch is only
+// ever contended between its worker and thieves.
 template <disk_manager_t T>
 struct disk_scheduler {
  private:
+  // A sync is queued on every worker. Each worker passes it once everything
+  // queued in front of it is done, the last one through syncs the manager.
+  struct sync_barrier {
+    std::atomic<std::size_t> remaining;
+    // the sync request itself, completed by the last worker through
+    disk_request req;
+  };
+
+  struct queued_request {
+    disk_request req;
+    std::uint64_t sequence;
+    // how many syncs were scheduled on this queue before the request
+    std::uint64_t epoch;
+  };
+
+  // what schedule() hands a worker, exactly one of the two is set
+  struct inbox_entry {
+    disk_request req;
+    std::shared_ptr<sync_barrier> barrier;
+  };
+
+  struct worker_queue {
+    mpsc_ring<inbox_entry> inbox{DISK_INBOX_CAPACITY};
+
+    // everything below is only touched with latch held
+    std::mutex latch;
+    std::array<std::deque<queued_request>, DISK_REQUEST_PRIORITY_COUNT>
+        pending;
+    // batches in a row each class had requests but got nothing dispatched
+    std::array<std::size_t, DISK_REQUEST_PRIORITY_COUNT> skipped_rounds{};
+    // sequence numbers of the queued requests of each page, oldest first.
+    // Keeps a read from overtaking an older write to the same page that
+    // was queued with a lower priority.
+    std::unordered_map<page_id_t, std::deque<std::uint64_t>> page_order;
+    std::uint64_t next_sequence{0};
+    // pages of this queue currently being served, by the owner or a thief
+    std::unordered_set<page_id_t> in_flight;
+
+    // syncs that didn't go through yet, oldest first
+    std::deque<std::shared_ptr<sync_barrier>> barriers;
+    // epoch_sizes[i] is how many requests are queued between barriers[i - 1]
+    // and barriers[i], so there's always one more of these than barriers
+    std::deque<std::size_t> epoch_sizes{0};
+    std::uint64_t passed_barriers{0};
+
+    std::atomic<bool> is_shutting_down{false};
+
+    [[nodiscard]]
+    bool is_drained() const {
+      return barriers.empty() && epoch_sizes.front() == 0;
+    }
+  };
+
   T m_manager;
-  std::thread m_worker_thread;
-  channel<disk_request> m_requests_queue;
+  disk_stats m_stats;
+  std::unique_ptr<disk_trace_writer> m_trace;
+  std::size_t m_workers_per_segment;
+  std::vector<std::unique_ptr<worker_queue>> m_queues;
+  std::vector<std::thread> m_workers;
+
+  std::mutex m_readahead_latch;
+  readahead_detector m_readahead;
+
+  // group commit, everything up to m_syncer is guarded by m_sync_latch
+  std::chrono::microseconds m_group_commit_window;
+  std::size_t m_group_commit_size;
+  std::mutex m_sync_latch;
+  std::condition_variable m_sync_cv;
+  // syncs whose writes are all done, waiting for the next manager sync()
+  std::vector<disk_request> m_pending_syncs;
+  bool m_is_shutting_down{false};
+  std::thread m_syncer;
+
+  [[nodiscard]]
+  std::size_t queue_index(page_id_t) const;
+
+  void run_worker(std::size_t);
+
+  // Sorts what arrived in the worker's inbox into its queue. Must hold
+  // queue.latch, only the owning worker may call this.
+  void drain_inbox(worker_queue &, std::vector<inbox_entry> &);
+
+  // Moves dispatchable requests of queue into batch. Must hold queue.latch.
+  // Returns the barrier if the queue is sitting on one that may go through.
+  [[nodiscard]]
+  std::shared_ptr<sync_barrier> take_requests(worker_queue &,
+                                              std::vector<disk_request> &,
+                                              std::size_t);
+  void pass_barrier(std::shared_ptr<sync_barrier> &&);
+  void run_syncer();
+  void finish_requests(std::size_t, std::size_t,
+                       const std::vector<disk_request> &);
+
+  void process_batch(std::span<disk_request>);
 
  public:
-  explicit disk_scheduler(const std::filesystem::path &);
+  // anything after the path (and the options) is forwarded to the manager's
+  // constructor
+  template <typename... Args>
+    requires(!std::is_same_v<std::remove_cvref_t<Args>,
+                             disk_scheduler_options> && ...)
+  explicit disk_scheduler(const std::filesystem::path &, Args &&...);
+  template <typename... Args>
+  explicit disk_scheduler(const std::filesystem::path &,
+                          const disk_scheduler_options &, Args &&...);
 
   void schedule(disk_request &&);
 
+  // Tells the scheduler a reader wanted page id. Returns the pages worth
+  // reading ahead if this looks like a sequential scan, the caller owns the
+  // memory so it's up to it to schedule prefetches for them.
+  [[nodiscard]]
+  std::optional<page_range> record_access(page_id_t);
+
+  [[nodiscard]]
+  std::size_t worker_count() const;
+
+  [[nodiscard]]
+  disk_stats_snapshot get_stats() const;
+
+  // the size of every request's buffer, see page_size_of()
+  [[nodiscard]]
+  std::size_t get_page_size() const;
+
+  // For calls that bypass the queues, only safe with thread safe managers
+  // and for pages nothing is queued for.
+  [[nodiscard]]
+  T &get_manager();
+
   disk_scheduler(const disk_scheduler &) = delete;
   disk_scheduler &operator=(const disk_scheduler &) = delete;
   disk_scheduler(const disk_scheduler &&) = delete;
@@ -56,40 +299,389 @@ struct disk_scheduler {
 
 // put these up there
 template <disk_manager_t T>
-disk_scheduler<T>::disk_scheduler(const std::filesystem::path &db_path)
-    : m_manager(db_path), m_requests_queue() {
-  m_worker_thread = std::thread([this]() {
-    while (true) {
-      disk_request req = m_requests_queue.get();
-      switch (req.type) {
-        case disk_request_type::read:
-          m_manager.read_page(req.page_id, req.data);
-          req.is_done.set_value(true);
-          break;
-        case disk_request_type::write:
-          m_manager.write_page(req.page_id, req.data);
-          req.is_done.set_value(true);
-          break;
-        case disk_request_type::shutdown:
-          return;
-        default:
-          throw std::invalid_argument("invalid request type");
+template <typename... Args>
+  requires(!std::is_same_v<std::remove_cvref_t<Args>,
+                           disk_scheduler_options> && ...)
+disk_scheduler<T>::disk_scheduler(const std::filesystem::path &db_path,
+                                  Args &&...args)
+    : disk_scheduler(db_path, disk_scheduler_options{},
+                     std::forward<Args>(args)...) {}
+
+template <disk_manager_t T>
+template <typename... Args>
+disk_scheduler<T>::disk_scheduler(const std::filesystem::path &db_path,
+                                  const disk_scheduler_options &options,
+                                  Args &&...args)
+    : m_manager(db_path, std::forward<Args>(args)...),
+      m_stats(page_size_of(m_manager)),
+      m_workers_per_segment(options.worker_count),
+      m_group_commit_window(options.group_commit_window),
+      m_group_commit_size(options.group_commit_size) {
+  if (options.worker_count == 0)
+    throw std::invalid_argument("worker_count must be > 0");
+  if (options.group_commit_size == 0)
+    throw std::invalid_argument("group_commit_size must be > 0");
+  if (!options.trace_path.empty())
+    m_trace = std::make_unique<disk_trace_writer>(options.trace_path);
+
+  std::size_t queue_count = options.worker_count;
+  if constexpr (segmented_disk_manager_t<T>)
+    queue_count *= m_manager.segment_count();
+
+  for (std::size_t i = 0; i < queue_count; ++i)
+    m_queues.push_back(std::make_unique<worker_queue>());
+
+  m_syncer = std::thread([this]() { run_syncer(); });
+  for (std::size_t i = 0; i < queue_count; ++i)
+    m_workers.emplace_back([this, i]() { run_worker(i); });
+}
+
+template <disk_manager_t T>
+std::size_t disk_scheduler<T>::queue_index(page_id_t page_id) const {
+  if constexpr (segmented_disk_manager_t<T>) {
+    // the stripes of one segment are segment_count() apart, number them
+    // within the segment so they spread over all of its workers
+    const auto stripe = page_id / PAGES_PER_STRIPE /
+                        static_cast<page_id_t>(m_manager.segment_count());
+    return m_manager.segment_of(page_id) * m_workers_per_segment +
+           std::hash<page_id_t>{}(stripe) % m_workers_per_segment;
+  }
+  return std::hash<page_id_t>{}(page_id / PAGES_PER_STRIPE) % m_queues.size();
+}
+
+template <disk_manager_t T>
+void disk_scheduler<T>::run_worker(std::size_t index) {
+  auto &queue = *m_queues[index];
+  std::vector<inbox_entry> arrived;
+  arrived.reserve(MAX_DISK_BATCH_SIZE);
+  std::vector<disk_request> batch;
+  batch.reserve(MAX_DISK_BATCH_SIZE);
+
+  while (true) {
+    std::shared_ptr<sync_barrier> barrier;
+    std::size_t home = index;
+
+    {
+      // checked before draining, anything scheduled before the shutdown is
+      // in the inbox by then
+      const bool is_shutting_down = queue.is_shutting_down;
+
+      std::unique_lock ul{queue.latch};
+      drain_inbox(queue, arrived);
+      barrier = take_requests(queue, batch, MAX_DISK_BATCH_SIZE);
+      if (batch.empty() && !barrier) {
+        if (is_shutting_down && queue.is_drained()) return;
+        ul.unlock();
+
+        // nothing for us, see if a sibling has work to spare
+        for (std::size_t offset = 1; offset < m_queues.size(); ++offset) {
+          const auto victim = (index + offset) % m_queues.size();
+          auto &victim_queue = *m_queues[victim];
+
+          std::scoped_lock sl{victim_queue.latch};
+          barrier = take_requests(victim_queue, batch, MAX_DISK_STEAL_SIZE);
+          if (barrier || !batch.empty()) {
+            home = victim;
+            break;
+          }
+        }
+
+        if (batch.empty() && !barrier) {
+          queue.inbox.wait(DISK_STEAL_INTERVAL);
+          continue;
+        }
       }
     }
+
+    if (barrier) {
+      pass_barrier(std::move(barrier));
+      continue;
+    }
+
+    process_batch(batch);
+    finish_requests(index, home, batch);
+    batch.clear();
+  }
+}
+
+template <disk_manager_t T>
+void disk_scheduler<T>::drain_inbox(worker_queue &queue,
+                                    std::vector<inbox_entry> &arrived) {
+  while (queue.inbox.pop_batch(arrived, MAX_DISK_BATCH_SIZE) > 0) {
+    for (auto &entry : arrived) {
+      if (entry.barrier) {
+        queue.barriers.push_back(std::move(entry.barrier));
+        queue.epoch_sizes.push_back(0);
+        continue;
+      }
+
+      const auto page_id = entry.req.page_id;
+      const auto sequence = queue.next_sequence++;
+      queue.page_order[page_id].push_back(sequence);
+      queue.epoch_sizes.back()++;
+
+      auto &pending =
+          queue.pending[static_cast<std::size_t>(entry.req.priority)];
+      pending.push_back(queued_request{
+          .req = std::move(entry.req),
+          .sequence = sequence,
+          .epoch = queue.passed_barriers + queue.barriers.size()});
+    }
+    arrived.clear();
+  }
+}
+
+template <disk_manager_t T>
+std::shared_ptr<typename disk_scheduler<T>::sync_barrier>
+disk_scheduler<T>::take_requests(worker_queue &queue,
+                                 std::vector<disk_request> &batch,
+                                 std::size_t max_requests) {
+  // a barrier only goes through once everything in front of it is done
+  if (!queue.barriers.empty() && queue.epoch_sizes.front() == 0) {
+    if (!batch.empty() || !queue.in_flight.empty()) return nullptr;
+
+    auto barrier = std::move(queue.barriers.front());
+    queue.barriers.pop_front();
+    queue.epoch_sizes.pop_front();
+    queue.passed_barriers++;
+    return barrier;
+  }
+
+  // starved classes first, then everyone else by priority
+  std::array<std::size_t, DISK_REQUEST_PRIORITY_COUNT> order{};
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_partition(order.begin(), order.end(), [&queue](auto priority) {
+    return queue.skipped_rounds[priority] >= MAX_DISK_STARVATION_ROUNDS;
   });
+
+  for (const auto priority : order) {
+    auto &pending = queue.pending[priority];
+    const auto batch_size = batch.size();
+
+    for (auto it = pending.begin();
+         it != pending.end() && batch.size() < max_requests;) {
+      // nothing overtakes a sync
+      if (it->epoch != queue.passed_barriers) break;
+
+      // the page is being served right now or an older request for it is
+      // still queued, this one has to wait its turn
+      const auto page_id = it->req.page_id;
+      auto &page_order = queue.page_order.at(page_id);
+      if (queue.in_flight.contains(page_id) ||
+          page_order.front() != it->sequence) {
+        ++it;
+        continue;
+      }
+
+      page_order.pop_front();
+      if (page_order.empty()) queue.page_order.erase(page_id);
+      queue.epoch_sizes.front()--;
+      queue.in_flight.insert(page_id);
+      batch.push_back(std::move(it->req));
+      it = pending.erase(it);
+    }
+
+    if (batch.size() > batch_size) {
+      queue.skipped_rounds[priority] = 0;
+    } else if (!pending.empty()) {
+      queue.skipped_rounds[priority]++;
+    }
+  }
+
+  return nullptr;
+}
+
+template <disk_manager_t T>
+void disk_scheduler<T>::pass_barrier(std::shared_ptr<sync_barrier> &&barrier) {
+  if (barrier->remaining.fetch_sub(1) != 1) return;
+
+  // last one through, everything scheduled before the sync is done
+  barrier->req.dispatched_at = cycle_clock::now();
+  if constexpr (syncable_disk_manager_t<T>) {
+    {
+      std::scoped_lock sl{m_sync_latch};
+      m_pending_syncs.push_back(std::move(barrier->req));
+    }
+    m_sync_cv.notify_one();
+  } else {
+    barrier->req.complete(true);
+  }
+}
+
+template <disk_manager_t T>
+void disk_scheduler<T>::run_syncer() {
+  std::vector<disk_request> group;
+
+  std::unique_lock ul{m_sync_latch};
+  while (true) {
+    m_sync_cv.wait(ul, [this]() {
+      return m_is_shutting_down || !m_pending_syncs.empty();
+    });
+    // the workers are gone by then, so nothing is left to commit
+    if (m_pending_syncs.empty()) return;
+
+    if (m_group_commit_window.count() > 0) {
+      m_sync_cv.wait_for(ul, m_group_commit_window, [this]() {
+        return m_is_shutting_down ||
+               m_pending_syncs.size() >= m_group_commit_size;
+      });
+    }
+
+    const auto group_size = std::min(m_pending_syncs.size(),
+                                     m_group_commit_size);
+    std::move(m_pending_syncs.begin(), m_pending_syncs.begin() + group_size,
+              std::back_inserter(group));
+    m_pending_syncs.erase(m_pending_syncs.begin(),
+                          m_pending_syncs.begin() + group_size);
+    ul.unlock();
+
+    // syncs that come in meanwhile pile up for the next round
+    bool is_synced = true;
+    if constexpr (syncable_disk_manager_t<T>) {
+      try {
+        m_manager.sync();
+      } catch (const std::exception &err) {
+        spdlog::error("Group commit of {} syncs failed: {}", group.size(),
+                      err.what());
+        is_synced = false;
+      }
+    }
+    for (auto &req : group) req.complete(is_synced);
+    group.clear();
+
+    ul.lock();
+  }
+}
+
+template <disk_manager_t T>
+void disk_scheduler<T>::finish_requests(
+    std::size_t index, std::size_t home,
+    const std::vector<disk_request> &batch) {
+  auto &queue = *m_queues[home];
+  {
+    std::scoped_lock sl{queue.latch};
+    for (const auto &req : batch) queue.in_flight.erase(req.page_id);
+  }
+  // requests held back by these pages may go now
+  if (home != index) queue.inbox.notify();
+}
+
+template <disk_manager_t T>
+void disk_scheduler<T>::process_batch(std::span<disk_request> batch) {
+  if (batch.empty()) return;
+
+  const auto dispatched_at = cycle_clock::now();
+  for (auto &req : batch) req.dispatched_at = dispatched_at;
+  m_stats.record_dispatch(batch.size());
+
+  try {
+    if constexpr (batched_disk_manager_t<T>) {
+      m_manager.submit_batch(batch);
+    } else {
+      for (auto &req : batch) {
+        // a failed page fails its request, not the worker
+        try {
+          switch (req.type) {
+            case disk_request_type::read:
+            case disk_request_type::prefetch:
+              m_manager.read_page(req.page_id, req.data);
+              break;
+            case disk_request_type::write:
+              m_manager.write_page(req.page_id, req.data);
+              break;
+            default:
+              throw std::invalid_argument("invalid request type");
+          }
+        } catch (const std::exception &err) {
+          spdlog::error("Request for page {} failed: {}", req.page_id,
+                        err.what());
+          req.complete(false);
+          continue;
+        }
+        req.complete(true);
+      }
+    }
+
+    if constexpr (syncable_disk_manager_t<T>) m_manager.end_batch();
+  } catch (const std::exception &err) {
+    // a failed batch fails whatever it hadn't completed, not the worker
+    spdlog::error("Batch of {} requests failed: {}", batch.size(),
+                  err.what());
+    for (auto &req : batch) {
+      if (!req.is_completed) req.complete(false);
+    }
+  }
 }
 
 template <disk_manager_t T>
 void disk_scheduler<T>::schedule(disk_request &&req) {
-  m_requests_queue.put(std::move(req));
+  req.stats = &m_stats;
+  req.trace = m_trace.get();
+  req.enqueued_at = cycle_clock::now();
+
+  if (req.type == disk_request_type::sync) {
+    auto barrier = std::make_shared<sync_barrier>(m_queues.size(),
+                                                  std::move(req));
+    for (auto &queue : m_queues) {
+      queue->inbox.push(inbox_entry{
+          .req = disk_request{.type = disk_request_type::sync,
+                              .data = nullptr,
+                              .page_id = INVALID_PAGE_ID,
+                              .is_done = std::nullopt},
+          .barrier = barrier});
+    }
+    return;
+  }
+
+  m_stats.record_enqueue();
+  auto &queue = *m_queues[queue_index(req.page_id)];
+  queue.inbox.push(inbox_entry{.req = std::move(req), .barrier = nullptr});
+}
+
+template <disk_manager_t T>
+std::optional<page_range> disk_scheduler<T>::record_access(page_id_t id) {
+  std::scoped_lock sl{m_readahead_latch};
+  return m_readahead.record(id);
+}
+
+template <disk_manager_t T>
+std::size_t disk_scheduler<T>::worker_count() const {
+  return m_workers.size();
+}
+
+template <disk_manager_t T>
+disk_stats_snapshot disk_scheduler<T>::get_stats() const {
+  return m_stats.snapshot();
+}
+
+template <disk_manager_t T>
+std::size_t disk_scheduler<T>::get_page_size() const {
+  return page_size_of(m_manager);
+}
+
+template <disk_manager_t T>
+T &disk_scheduler<T>::get_manager() {
+  return m_manager;
 }
 
 template <disk_manager_t T>
 disk_scheduler<T>::~disk_scheduler() {
-  m_requests_queue.put(
-      disk_request{disk_request_type::shutdown, nullptr, 0, {}});
-  if (m_worker_thread.joinable()) {
-    m_worker_thread.join();
+  // everything queued before the shutdown still gets served
+  for (auto &queue : m_queues) {
+    queue->is_shutting_down = true;
+    queue->inbox.notify();
+  }
+
+  for (auto &worker : m_workers) {
+    if (worker.joinable()) worker.join();
+  }
+
+  // the workers may have handed over syncs right before they finished
+  {
+    std::scoped_lock sl{m_sync_latch};
+    m_is_shutting_down = true;
   }
+  m_sync_cv.notify_one();
+  if (m_syncer.joinable()) m_syncer.join();
 }
 }  // namespace hivedb
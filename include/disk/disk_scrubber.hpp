@@ -0,0 +1,145 @@
+#pragma once
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <disk/disk_completion_queue.hpp>
+#include <disk/disk_request.hpp>
+#include <disk/disk_scheduler.hpp>
+#include <disk/throttled_worker.hpp>
+#include <misc/aligned_buffer.hpp>
+#include <misc/config.hpp>
+#include <mutex>
+#include <vector>
+
+namespace hivedb {
+struct disk_scrubber_options {
+  // pages read a second at most, see throttled_worker
+  std::size_t pages_per_second{256};
+  // pages read in one go
+  std::size_t batch_size{16};
+};
+
+// Walks every page id of the file, over and over, reading the pages through
+// the disk scheduler with the lowest priority so the disk manager checks
+// them against their checksums. Pages that fail to read or verify are
+// logged and collected in corrupted_pages().
+template <page_allocating_disk_manager_t T>
+struct disk_scrubber {
+ private:
+  disk_scheduler<T> &m_scheduler;
+  const disk_scrubber_options m_options;
+
+  aligned_buffer m_buffers;
+  disk_completion_queue m_completions;
+
+  std::atomic<std::size_t> m_scrubbed_pages{0};
+  std::atomic<std::size_t> m_completed_passes{0};
+  // only touched by m_worker, the first page of the next batch
+  page_id_t m_next_page{0};
+
+  // guards m_corrupted_pages
+  std::mutex m_latch;
+  std::vector<page_id_t> m_corrupted_pages;
+
+  throttled_worker m_worker;
+
+  // scrubs the next batch of pages, never idle
+  bool step();
+
+  // Reads count pages from first on, returns once all of them completed.
+  void scrub(page_id_t first, std::size_t count);
+
+ public:
+  explicit disk_scrubber(disk_scheduler<T> &,
+                         const disk_scrubber_options & = {});
+
+  disk_scrubber(const disk_scrubber &) = delete;
+  disk_scrubber &operator=(const disk_scrubber &) = delete;
+  disk_scrubber(disk_scrubber &&) = delete;
+  disk_scrubber &operator=(disk_scrubber &&) = delete;
+
+  ~disk_scrubber() = default;
+
+  [[nodiscard]]
+  std::vector<page_id_t> corrupted_pages();
+
+  [[nodiscard]]
+  std::size_t scrubbed_pages() const;
+
+  // how many times every page of the file was looked at
+  [[nodiscard]]
+  std::size_t completed_passes() const;
+};
+
+template <page_allocating_disk_manager_t T>
+disk_scrubber<T>::disk_scrubber(disk_scheduler<T> &scheduler,
+                                const disk_scrubber_options &options)
+    : m_scheduler(scheduler),
+      m_options(options),
+      m_buffers(options.batch_size * scheduler.get_page_size()),
+      m_worker(options.pages_per_second, options.batch_size,
+               std::chrono::milliseconds{0}, [this]() { return step(); }) {}
+
+template <page_allocating_disk_manager_t T>
+bool disk_scrubber<T>::step() {
+  const auto end = m_scheduler.get_manager().page_id_end();
+  if (m_next_page >= end) {
+    if (m_next_page > 0) ++m_completed_passes;
+    m_next_page = 0;
+  }
+
+  const auto count = std::min(m_options.batch_size,
+                              static_cast<std::size_t>(end - m_next_page));
+  if (count > 0) scrub(m_next_page, count);
+  m_next_page += static_cast<page_id_t>(count);
+  return false;
+}
+
+template <page_allocating_disk_manager_t T>
+void disk_scrubber<T>::scrub(page_id_t first, std::size_t count) {
+  for (std::size_t i = 0; i < count; ++i) {
+    disk_request req{.type = disk_request_type::read,
+                     .data = m_buffers.data() + i * m_scheduler.get_page_size(),
+                     .page_id = first + static_cast<page_id_t>(i),
+                     .is_done = std::nullopt,
+                     .priority = disk_request_priority::scrub};
+    m_completions.attach(req);
+    m_scheduler.schedule(std::move(req));
+  }
+
+  std::vector<disk_completion> completed;
+  completed.reserve(count);
+  m_completions.wait(completed, count);
+  m_scrubbed_pages += count;
+
+  for (const auto &completion : completed) {
+    if (completion.is_ok) continue;
+
+    spdlog::error("Scrubbing found page {} corrupted", completion.page_id);
+    std::scoped_lock sl{m_latch};
+    if (std::find(m_corrupted_pages.begin(), m_corrupted_pages.end(),
+                  completion.page_id) == m_corrupted_pages.end()) {
+      m_corrupted_pages.push_back(completion.page_id);
+    }
+  }
+}
+
+template <page_allocating_disk_manager_t T>
+std::vector<page_id_t> disk_scrubber<T>::corrupted_pages() {
+  std::scoped_lock sl{m_latch};
+  return m_corrupted_pages;
+}
+
+template <page_allocating_disk_manager_t T>
+std::size_t disk_scrubber<T>::scrubbed_pages() const {
+  return m_scrubbed_pages;
+}
+
+template <page_allocating_disk_manager_t T>
+std::size_t disk_scrubber<T>::completed_passes() const {
+  return m_completed_passes;
+}
+}  // namespace hivedb
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <disk/disk_request.hpp>
+#include <memory>
+#include <misc/config.hpp>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace hivedb {
+// values below this many get a bucket each, every power of two above is
+// split into this many buckets, so a bucket is at most 1/8th off
+static constexpr std::size_t LATENCY_SUB_BUCKETS = 8;
+static constexpr std::size_t LATENCY_BUCKET_COUNT = 62 * LATENCY_SUB_BUCKETS;
+
+// What a latency_histogram held at some point, in nanoseconds.
+struct latency_snapshot {
+  std::array<std::uint64_t, LATENCY_BUCKET_COUNT> buckets{};
+  std::uint64_t count{0};
+  // sum of every value recorded
+  std::chrono::nanoseconds total{0};
+  double nanoseconds_per_tick{1.0};
+
+  // The upper bound of the bucket holding the p-th percentile, p in [0, 1].
+  [[nodiscard]]
+  std::chrono::nanoseconds percentile(double) const;
+  [[nodiscard]]
+  std::chrono::nanoseconds mean() const;
+};
+
+/*
+ * A log-linear histogram of cycle_clock ticks, in the spirit of HDR
+ * histograms: values below LATENCY_SUB_BUCKETS each get a bucket, every
+ * power of two above that is split into LATENCY_SUB_BUCKETS equal buckets.
+ *
+ * Only one thread may record, but anyone can take a snapshot meanwhile.
+ * Recording is a relaxed load and store of two counters, no lock prefix,
+ * disk_stats gives every thread histograms of its own.
+ */
+struct latency_histogram {
+ private:
+  std::array<std::atomic<std::uint64_t>, LATENCY_BUCKET_COUNT> m_buckets{};
+  std::atomic<std::uint64_t> m_total_ticks{0};
+
+ public:
+  void record(std::uint64_t ticks);
+
+  [[nodiscard]]
+  latency_snapshot snapshot() const;
+  // Adds what this histogram holds to snapshot.
+  void add_to(latency_snapshot &) const;
+
+  [[nodiscard]]
+  static std::size_t bucket_of(std::uint64_t);
+  // the smallest value that lands in bucket
+  [[nodiscard]]
+  static std::uint64_t bucket_start(std::size_t);
+};
+
+static constexpr std::size_t DISK_REQUEST_TYPE_COUNT = 4;
+
+struct request_type_snapshot {
+  std::uint64_t completed{0};
+  std::uint64_t failed{0};
+  // from schedule() until a worker took it
+  latency_snapshot queue_time;
+  // from the worker taking it until it completed
+  latency_snapshot device_time;
+};
+
+struct disk_stats_snapshot {
+  std::array<request_type_snapshot, DISK_REQUEST_TYPE_COUNT> types{};
+  // requests scheduled but not taken by a worker yet, syncs aren't counted
+  std::size_t queue_depth{0};
+  std::size_t max_queue_depth{0};
+  std::uint64_t bytes_read{0};
+  std::uint64_t bytes_written{0};
+  // since the stats were created
+  std::chrono::nanoseconds uptime{0};
+
+  [[nodiscard]]
+  const request_type_snapshot &get(disk_request_type) const;
+
+  // over the whole uptime
+  [[nodiscard]]
+  double bytes_per_second() const;
+  // between an earlier snapshot and this one
+  [[nodiscard]]
+  double bytes_per_second(const disk_stats_snapshot &earlier) const;
+};
+
+// What the disk scheduler knows about the requests it served. Requests
+// carry their timestamps and a pointer back here, complete() records them.
+//
+// Completions are recorded into a shard per thread, so recording never
+// bounces a cache line between workers. A snapshot adds the shards up.
+struct disk_stats {
+ private:
+  struct type_stats {
+    std::atomic<std::uint64_t> completed{0};
+    std::atomic<std::uint64_t> failed{0};
+    latency_histogram queue_time;
+    latency_histogram device_time;
+  };
+
+  // only ever written by owner
+  struct shard {
+    std::thread::id owner;
+    std::array<type_stats, DISK_REQUEST_TYPE_COUNT> types{};
+    std::atomic<std::uint64_t> bytes_read{0};
+    std::atomic<std::uint64_t> bytes_written{0};
+  };
+
+  // tells apart a disk_stats from an earlier one at the same address
+  std::uint64_t m_id;
+  mutable std::mutex m_shards_latch;
+  std::vector<std::unique_ptr<shard>> m_shards;
+
+  // the one requests go through concurrently, so these are shared
+  std::atomic<std::size_t> m_queue_depth{0};
+  std::atomic<std::size_t> m_max_queue_depth{0};
+  std::uint64_t m_created_at;
+  // every request moves a page of this many bytes
+  std::size_t m_page_size;
+
+  // the calling thread's shard, found through a thread local cache
+  [[nodiscard]]
+  shard &local_shard();
+
+  friend void record_completion(disk_stats &, const disk_request &, bool);
+
+ public:
+  explicit disk_stats(std::size_t page_size = PAGE_SIZE);
+
+  void record_enqueue();
+  void record_dispatch(std::size_t count);
+
+  [[nodiscard]]
+  disk_stats_snapshot snapshot() const;
+};
+}  // namespace hivedb
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <disk/disk_request.hpp>
+#include <filesystem>
+#include <misc/config.hpp>
+#include <mutex>
+#include <vector>
+
+namespace hivedb {
+// records kept in memory before they go to the trace file
+static constexpr std::size_t DISK_TRACE_BUFFER_RECORDS = 4096;
+static constexpr std::uint32_t DISK_TRACE_VERSION = 1;
+
+// One request as it went through the disk scheduler. Times are in
+// nanoseconds, enqueued_at counts from when the trace was started. Stored
+// in the trace file as is.
+struct disk_trace_record {
+  std::uint64_t enqueued_at;
+  // from schedule() until a worker took it, saturates at ~4s
+  std::uint32_t queue_time;
+  // from the worker taking it until it completed, saturates at ~4s
+  std::uint32_t device_time;
+  page_id_t page_id;
+  // a disk_request_type
+  std::uint8_t type;
+  // a disk_request_priority
+  std::uint8_t priority;
+  std::uint8_t is_ok;
+  std::uint8_t padding[5]{};
+};
+
+static_assert(sizeof(disk_trace_record) == 32);
+
+/*
+ * Appends every request completed through the disk scheduler to a trace
+ * file, see disk_scheduler_options::trace_path.
+ *
+ * The file is a small header followed by disk_trace_record after
+ * disk_trace_record, in the order the requests completed. Records are
+ * buffered and written DISK_TRACE_BUFFER_RECORDS at a time, whatever is
+ * left goes out when the writer is destroyed.
+ *
+ * Recording takes a lock shared by every worker, so tracing is for
+ * capturing a workload, not something to leave on.
+ */
+struct disk_trace_writer {
+ private:
+  int m_fd{-1};
+  offset_t m_end{0};
+  // cycle_clock ticks the trace's times count from
+  std::uint64_t m_started_at;
+  double m_nanoseconds_per_tick;
+
+  // guards everything below
+  std::mutex m_latch;
+  std::vector<disk_trace_record> m_buffer;
+  std::size_t m_record_count{0};
+
+  // must hold m_latch
+  void write_buffer();
+
+ public:
+  // Truncates the file if it exists.
+  explicit disk_trace_writer(const std::filesystem::path &);
+
+  disk_trace_writer(const disk_trace_writer &) = delete;
+  disk_trace_writer &operator=(const disk_trace_writer &) = delete;
+  disk_trace_writer(disk_trace_writer &&) = delete;
+  disk_trace_writer &operator=(disk_trace_writer &&) = delete;
+
+  ~disk_trace_writer();
+
+  void record(const disk_request &, bool is_ok);
+
+  // Writes out every record buffered so far.
+  void flush();
+
+  // how many requests were recorded
+  [[nodiscard]]
+  std::size_t record_count();
+};
+
+// Reads a whole trace file, ordered by when the requests were scheduled.
+[[nodiscard]]
+std::vector<disk_trace_record> read_disk_trace(const std::filesystem::path &);
+}  // namespace hivedb
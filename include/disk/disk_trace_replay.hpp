@@ -0,0 +1,123 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <disk/disk_completion_queue.hpp>
+#include <disk/disk_request.hpp>
+#include <disk/disk_scheduler.hpp>
+#include <disk/disk_trace.hpp>
+#include <misc/aligned_buffer.hpp>
+#include <misc/config.hpp>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace hivedb {
+struct disk_replay_options {
+  // 1 issues the requests at the pace they were recorded at, 2 twice as
+  // fast and so on. 0 issues every request as soon as there's room for it.
+  double speed{1.0};
+  // requests in flight at once, each of them needs a page buffer
+  std::size_t max_in_flight{256};
+};
+
+struct disk_replay_result {
+  std::size_t completed{0};
+  std::size_t failed{0};
+  // from the first request issued until the last one completed
+  std::chrono::nanoseconds elapsed{0};
+  // how far behind the trace's pace issuing fell at worst, a device that
+  // keeps up with the trace stays close to 0
+  std::chrono::nanoseconds max_lag{0};
+};
+
+// Issues the requests of a trace (see read_disk_trace()) against
+// scheduler's manager, with the types, page ids, priorities and spacing
+// they were recorded with. Writes carry a page of filler, so replay onto a
+// fresh file: reads of pages the trace never wrote fail on most managers
+// and are counted in failed.
+//
+// The scheduler's get_stats() has the latencies the replay saw.
+template <disk_manager_t T>
+disk_replay_result replay_disk_trace(disk_scheduler<T> &scheduler,
+                                     std::span<const disk_trace_record> trace,
+                                     const disk_replay_options &options = {}) {
+  using clock = std::chrono::steady_clock;
+  if (options.max_in_flight == 0)
+    throw std::invalid_argument("max_in_flight must be > 0");
+  if (options.speed < 0) throw std::invalid_argument("speed must be >= 0");
+
+  const auto page_size = scheduler.get_page_size();
+  aligned_buffer buffers{options.max_in_flight * page_size};
+  std::vector<std::size_t> free_buffers(options.max_in_flight);
+  for (std::size_t i = 0; i < free_buffers.size(); ++i)
+    free_buffers[i] = free_buffers.size() - 1 - i;
+
+  disk_completion_queue completions;
+  std::vector<disk_completion> completed;
+  disk_replay_result result{};
+  std::size_t in_flight = 0;
+
+  const auto collect = [&](std::size_t min_count) {
+    completions.wait(completed, min_count);
+    for (const auto &completion : completed) {
+      ++(completion.is_ok ? result.completed : result.failed);
+      free_buffers.push_back(completion.tag);
+    }
+    in_flight -= completed.size();
+    completed.clear();
+  };
+
+  // before anything is in flight, the completions point at the stack
+  for (const auto &record : trace) {
+    if (record.type > static_cast<std::uint8_t>(disk_request_type::prefetch) ||
+        record.priority >= DISK_REQUEST_PRIORITY_COUNT) {
+      throw std::runtime_error("invalid trace record!");
+    }
+  }
+
+  const auto started_at = clock::now();
+  const auto first_enqueued_at = trace.empty() ? 0 : trace.front().enqueued_at;
+  for (const auto &record : trace) {
+    auto due = started_at;
+    if (options.speed > 0) {
+      due += std::chrono::duration_cast<clock::duration>(
+          std::chrono::duration<double, std::nano>(
+              static_cast<double>(record.enqueued_at - first_enqueued_at) /
+              options.speed));
+      std::this_thread::sleep_until(due);
+    }
+    if (free_buffers.empty()) collect(1);
+    result.max_lag = std::max(
+        result.max_lag,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() -
+                                                             due));
+
+    const auto slot = free_buffers.back();
+    free_buffers.pop_back();
+    const auto type = static_cast<disk_request_type>(record.type);
+    auto *data = buffers.data() + slot * page_size;
+    if (type == disk_request_type::write)
+      std::memcpy(data, &record.page_id, sizeof(record.page_id));
+
+    disk_request req{
+        .type = type,
+        .data = type == disk_request_type::sync ? nullptr : data,
+        .page_id = record.page_id,
+        .is_done = std::nullopt,
+        .priority = static_cast<disk_request_priority>(record.priority)};
+    completions.attach(req, slot);
+    scheduler.schedule(std::move(req));
+    ++in_flight;
+  }
+
+  if (in_flight > 0) collect(in_flight);
+  result.elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      clock::now() - started_at);
+  return result;
+}
+}  // namespace hivedb
@@ -0,0 +1,41 @@
+#pragma once
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <cstddef>
+#include <misc/config.hpp>
+#include <span>
+
+namespace hivedb {
+// Positional helpers that retry on EINTR and short transfers.
+
+// Returns how many bytes were read (less than size only at EOF) or -1.
+ssize_t read_fully(int fd, char *buffer, std::size_t size, offset_t offset);
+
+bool write_fully(int fd, const char *buffer, std::size_t size,
+                 offset_t offset);
+
+// pwritev() of contiguous bytes starting at offset. Clobbers the iovecs.
+bool write_fully(int fd, std::span<iovec> buffers, offset_t offset);
+
+// Owns an open file descriptor and closes it when destroyed, so a
+// constructor that throws halfway through doesn't leak it.
+struct file_descriptor {
+ private:
+  int m_fd{-1};
+
+ public:
+  file_descriptor() = default;
+  explicit file_descriptor(int);
+
+  file_descriptor(const file_descriptor &) = delete;
+  file_descriptor &operator=(const file_descriptor &) = delete;
+  file_descriptor(file_descriptor &&) noexcept;
+  file_descriptor &operator=(file_descriptor &&) noexcept;
+
+  ~file_descriptor();
+
+  [[nodiscard]]
+  int get() const;
+};
+}  // namespace hivedb
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <misc/config.hpp>
+#include <optional>
+#include <vector>
+
+namespace hivedb {
+/*
+ * A set of free slots (page ids, or page sized spots in the file) kept in a
+ * chain of bitmap pages inside the db file:
+ * -----------------------------------------------------------------------
+ * | next_bitmap_offset (8 bytes) | word_0 | ... | word_n (8 bytes) |
+ * -----------------------------------------------------------------------
+ *
+ * A set bit means the slot is free. The whole chain is read by load() when
+ * the file is opened, it's one page per bits_per_page() slots. take() scans a word at a
+ * time from the lowest word that may still have a free bit, which only ever
+ * moves back when a slot below it is released, so allocation is amortized
+ * O(1).
+ *
+ * Growing the chain needs a page, the owner hands one in with add_page().
+ * Not thread safe.
+ */
+struct free_space_bitmap {
+ public:
+  // of a file with PAGE_SIZE pages, see bits_per_page()
+  static constexpr std::size_t WORDS_PER_PAGE =
+      (PAGE_SIZE - sizeof(offset_t)) / sizeof(std::uint64_t);
+  static constexpr std::size_t BITS_PER_PAGE = WORDS_PER_PAGE * 64;
+
+ private:
+  struct bitmap_page {
+    offset_t offset;
+    offset_t next_offset{0};
+    bool is_dirty{false};
+  };
+
+  int m_db_fd;
+  std::size_t m_page_size;
+  std::size_t m_words_per_page;
+  std::vector<bitmap_page> m_pages;
+  std::vector<std::uint64_t> m_words;
+  std::size_t m_free_count{0};
+  // no word in front of this one has a free bit
+  std::size_t m_first_candidate{0};
+
+  void load_page(offset_t);
+  void mark_dirty(std::size_t);
+
+ public:
+  // page_size is the db file's, see page_directory
+  explicit free_space_bitmap(int, std::size_t page_size = PAGE_SIZE);
+
+  free_space_bitmap(const free_space_bitmap &) = delete;
+  free_space_bitmap &operator=(const free_space_bitmap &) = delete;
+  free_space_bitmap(free_space_bitmap &&) = delete;
+  free_space_bitmap &operator=(free_space_bitmap &&) = delete;
+  ~free_space_bitmap() = default;
+
+  // Reads the chain starting at first_offset, 0 means there's none yet.
+  void load(offset_t first_offset);
+
+  // Takes the lowest free slot, if there is any.
+  [[nodiscard]]
+  std::optional<std::size_t> take();
+
+  // Both need a page covering the slot, see capacity().
+  void release(std::size_t);
+  void mark_used(std::size_t);
+
+  [[nodiscard]]
+  bool is_free(std::size_t) const;
+  // The lowest free slot at or past slot, a word at a time.
+  [[nodiscard]]
+  std::optional<std::size_t> next_free(std::size_t slot) const;
+
+  [[nodiscard]]
+  std::size_t free_count() const;
+
+  // How many slots the chain covers so far.
+  [[nodiscard]]
+  std::size_t capacity() const;
+
+  // slots covered by a single page of the chain
+  [[nodiscard]]
+  std::size_t bits_per_page() const;
+
+  // where the pages of the chain are in the file
+  [[nodiscard]]
+  std::vector<offset_t> page_offsets() const;
+
+  // Extends the chain by the page at offset, which covers another
+  // bits_per_page() slots (all of them used).
+  void add_page(offset_t);
+
+  void flush();
+};
+}  // namespace hivedb
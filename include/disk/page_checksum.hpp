@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <misc/config.hpp>
+
+namespace hivedb {
+// marks pages that carry a checksum, zeroed pages (and those of files
+// written before we had them) don't
+static constexpr std::uint32_t PAGE_TRAILER_MAGIC = 0x4b484350;  // PCHK
+
+/*
+ * The last PAGE_TRAILER_SIZE bytes of every page the disk manager writes:
+ * -----------------------------------------------------------------------
+ * | crc32c of the page id and the usable bytes (4 bytes) | magic (4 bytes) |
+ * -----------------------------------------------------------------------
+ * Folding in the page id catches pages that were written to the wrong spot.
+ */
+struct page_trailer {
+  std::uint32_t checksum;
+  std::uint32_t magic;
+};
+static_assert(sizeof(page_trailer) == PAGE_TRAILER_SIZE);
+
+// CRC32C (Castagnoli) of size bytes, continuing from crc like zlib's
+// crc32() does. Uses SSE4.2 when the CPU has it.
+[[nodiscard]]
+std::uint32_t crc32c(std::uint32_t crc, const char *, std::size_t);
+
+// Same thing with the lookup table fallback only.
+[[nodiscard]]
+std::uint32_t crc32c_portable(std::uint32_t crc, const char *, std::size_t);
+
+// Fills in the trailer of a page that is about to be written, the trailer
+// sits at the end of page_size bytes.
+void stamp_page(page_id_t, char *, std::size_t page_size = PAGE_SIZE);
+// The trailer stamp_page() would give the page, leaving the page alone.
+[[nodiscard]]
+page_trailer make_page_trailer(page_id_t, const char *,
+                               std::size_t page_size = PAGE_SIZE);
+
+// Whether the page matches its trailer. All zero pages pass, other pages
+// without a trailer only do if is_trailer_required is false (files from
+// before PAGE_FEATURE_CHECKSUMS).
+[[nodiscard]]
+bool verify_page(page_id_t, const char *, std::size_t page_size = PAGE_SIZE,
+                 bool is_trailer_required = true);
+}  // namespace hivedb
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+
+namespace hivedb {
+/*
+ * A small LZ4 style block codec for pages. The output is a sequence of
+ * | token | literal length+ | literals | offset (2 bytes) | match length+ |
+ * where the token's high nibble is the literal length and its low one the
+ * match length - 4, a nibble of 15 is continued by bytes of 255 until one
+ * is smaller. The last sequence has literals only.
+ *
+ * Matches are found through a 4096 entry hash table of 4 byte sequences,
+ * one probe per position, so compression runs in a single pass over the
+ * page with no allocation.
+ */
+
+// Compresses size bytes of src into dst. Returns the compressed size, or 0
+// if it wouldn't fit in capacity bytes.
+[[nodiscard]]
+std::size_t compress_block(const char *src, std::size_t size, char *dst,
+                           std::size_t capacity);
+
+// Decompresses size bytes of src into exactly dst_size bytes of dst.
+// Returns false on malformed input instead of reading or writing out of
+// bounds.
+[[nodiscard]]
+bool decompress_block(const char *src, std::size_t size, char *dst,
+                      std::size_t dst_size);
+}  // namespace hivedb
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <disk/free_space_bitmap.hpp>
+#include <map>
+#include <misc/config.hpp>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace hivedb {
+static constexpr std::uint64_t PAGE_DIRECTORY_MAGIC = 0x3130424445564948;  // HIVEDB01
+static constexpr std::uint32_t PAGE_DIRECTORY_VERSION = 5;
+// The directory's entries are disk_manager_compressed slots rather than
+// plain page offsets, no other manager can read the file.
+static constexpr std::uint32_t PAGE_FEATURE_COMPRESSED = 1;
+// Every page written to the file carries a checksum trailer (see
+// page_checksum.hpp). Files from before trailers existed don't have it.
+static constexpr std::uint32_t PAGE_FEATURE_CHECKSUMS = 2;
+// pages are handed out in runs of this many, per page kind
+static constexpr std::size_t PAGES_PER_EXTENT = 64;
+// of a file with PAGE_SIZE pages, see page_directory::extent_size()
+static constexpr offset_t EXTENT_SIZE = PAGES_PER_EXTENT * PAGE_SIZE;
+
+// What a page is used for. Each kind fills its own extent, so a scan over
+// one kind doesn't have to skip over the other on disk.
+enum struct page_kind {
+  table,
+  // b+tree nodes, and the directory's own pages
+  index,
+};
+static constexpr std::size_t PAGE_KIND_COUNT = 2;
+
+/*
+ * Persistent page_id -> file offset map.
+ *
+ * The first page of the file is the superblock:
+ * -----------------------------------------------------------------------
+ * | magic (8 bytes) | version (4 bytes) | page_size (4 bytes) |
+ * -----------------------------------------------------------------------
+ * | end_offset (8 bytes) | first_directory_offset (8 bytes) |
+ * -----------------------------------------------------------------------
+ * | per page kind: next_offset (8 bytes) | extent_end (8 bytes) |
+ * -----------------------------------------------------------------------
+ * | free_offsets_offset (8 bytes) | free_page_ids_offset (8 bytes) |
+ * -----------------------------------------------------------------------
+ * | page_id_end (8 bytes) | features (4 bytes) | slot_map_offset (8 bytes) |
+ * -----------------------------------------------------------------------
+ *
+ * The page size is picked when the file is created, every page of the file
+ * (the superblock, directory and bitmap pages included) is that big. The
+ * superblock only fills the first PAGE_SIZE bytes, so it's read before the
+ * page size is known.
+ *
+ * Directory pages form a chain, the n-th one holds the offsets of page ids
+ * [n * entries_per_page(), (n + 1) * entries_per_page()):
+ * -----------------------------------------------------------------------
+ * | next_directory_offset (8 bytes) | offset_0 | ... | offset_n (8 bytes) |
+ * -----------------------------------------------------------------------
+ *
+ * An offset of 0 means "no page" since that's where the superblock lives.
+ * New pages come out of the current extent of their kind, a kind that used
+ * its extent up claims the next extent_size() bytes at end_offset. Version 1
+ * files had no extents, they read as all zeroes which means "no extent yet".
+ *
+ * Deleted pages give their spot in the file and their page id back to two
+ * free_space_bitmap chains, so both get reused after a restart too. Every
+ * page id handed out so far is below page_id_end. slot_map_offset is
+ * disk_manager_compressed's, see there.
+ * Opening a file only reads the superblock, directory pages are paged in the
+ * first time one of their page ids is touched.
+ */
+struct page_directory {
+ public:
+  // of a file with PAGE_SIZE pages, see entries_per_page()
+  static constexpr std::size_t ENTRIES_PER_PAGE =
+      (PAGE_SIZE - sizeof(offset_t)) / sizeof(offset_t);
+
+ private:
+  struct extent {
+    offset_t next_offset;
+    offset_t end_offset;
+  };
+
+  struct superblock {
+    std::uint64_t magic;
+    std::uint32_t version;
+    std::uint32_t page_size;
+    offset_t end_offset;
+    offset_t first_directory_offset;
+    std::array<extent, PAGE_KIND_COUNT> extents;
+    offset_t free_offsets_offset;
+    offset_t free_page_ids_offset;
+    page_id_t page_id_end;
+    std::uint32_t features;
+    offset_t slot_map_offset;
+  };
+
+  struct directory_page {
+    offset_t offset;
+    offset_t next_offset{0};
+    std::vector<offset_t> entries;
+    bool is_dirty{false};
+  };
+
+  int m_db_fd;
+  superblock m_superblock{};
+  bool m_is_superblock_dirty{false};
+  // both follow from m_superblock.page_size
+  std::size_t m_page_size;
+  std::size_t m_entries_per_page;
+
+  // the prefix of the chain we walked so far
+  std::vector<directory_page> m_directory_pages;
+
+  // offset -> page id of every page, so last_pages() doesn't have to walk
+  // the directory. Built by the first last_pages() call, kept up to date by
+  // set() and erase() from then on.
+  std::map<offset_t, page_id_t> m_pages_by_offset;
+  bool m_is_offset_index_built{false};
+
+  // spots in the file, slot n is the page at offset (n + 1) * m_page_size
+  free_space_bitmap m_free_offsets;
+  free_space_bitmap m_free_page_ids;
+
+  // The superblock as it is on disk. A new file's reads as all zeroes but
+  // for page_size, which is the one asked for.
+  [[nodiscard]]
+  static superblock read_superblock(int, std::size_t page_size);
+
+  void load_directory_page(directory_page &);
+  void write_directory_page(const directory_page &);
+  void write_superblock();
+
+  // next page of the current extent of kind, never a freed one
+  [[nodiscard]]
+  offset_t take_from_extent(page_kind);
+  // grows the chain of bitmap until it covers slot
+  void cover(free_space_bitmap &, offset_t &first_offset, std::size_t slot);
+  // what page_id_end has to be for files from before it was kept
+  [[nodiscard]]
+  page_id_t find_page_id_end();
+
+  [[nodiscard]]
+  directory_page *get_directory_page(std::size_t, bool);
+
+ public:
+  // page_size is only used when the file is new, an existing file keeps the
+  // page size it was created with (see page_size()).
+  explicit page_directory(int, std::size_t page_size = PAGE_SIZE);
+
+  page_directory(const page_directory &) = delete;
+  page_directory &operator=(const page_directory &) = delete;
+  page_directory(page_directory &&) = delete;
+  page_directory &operator=(page_directory &&) = delete;
+  ~page_directory() = default;
+
+  [[nodiscard]]
+  std::optional<offset_t> find(page_id_t);
+  void set(page_id_t, offset_t);
+  void erase(page_id_t);
+
+  // Hands out a page sized slot in the file, reusing freed ones first.
+  [[nodiscard]]
+  offset_t allocate_offset(page_kind = page_kind::table);
+  void free_offset(offset_t);
+  // Takes the lowest freed spot in the file, as long as it's below limit.
+  [[nodiscard]]
+  std::optional<offset_t> take_free_offset_below(offset_t limit);
+  // Takes the freed spot at offset, allocate_offset() skips it until it is
+  // freed again.
+  void take_free_offset(offset_t);
+  [[nodiscard]]
+  bool is_free_offset(offset_t) const;
+  // The lowest freed spot at or past offset.
+  [[nodiscard]]
+  std::optional<offset_t> next_free_offset(offset_t) const;
+
+  // Every spot handed out by allocate_offset() for a page, that is all of
+  // them below end_offset() but the free ones, the directory's and bitmaps'
+  // own pages and extent space not claimed yet. Walks the whole directory.
+  [[nodiscard]]
+  std::vector<offset_t> allocated_offsets();
+
+  // The count pages stored furthest into the file, as (page id, offset)
+  // pairs, the last one first. Only the first call walks the whole
+  // directory, see m_pages_by_offset.
+  [[nodiscard]]
+  std::vector<std::pair<page_id_t, offset_t>> last_pages(std::size_t count);
+
+  // Moves end_offset back over the freed spots and unused extent space at
+  // the end of the file, so the file can be cut there. Returns the new
+  // end_offset.
+  offset_t trim_end();
+
+  // Hands out an unused page id, reusing freed ones first.
+  [[nodiscard]]
+  page_id_t allocate_page_id();
+  void free_page_id(page_id_t);
+
+  // Every page id handed out (or set()) so far is below this.
+  [[nodiscard]]
+  page_id_t page_id_end() const;
+
+  // the page size the file was created with
+  [[nodiscard]]
+  std::size_t page_size() const;
+  // page ids covered by one directory page
+  [[nodiscard]]
+  std::size_t entries_per_page() const;
+  // how many bytes a page kind claims at a time
+  [[nodiscard]]
+  offset_t extent_size() const;
+
+  // PAGE_FEATURE_* flags the file was created with
+  [[nodiscard]]
+  std::uint32_t features() const;
+  void set_features(std::uint32_t);
+
+  // First page of disk_manager_compressed's map of free slots, 0 if there's
+  // none. The directory only keeps it, the pages are the manager's.
+  [[nodiscard]]
+  offset_t slot_map_offset() const;
+  void set_slot_map_offset(offset_t);
+
+  // whether nothing was ever stored in the file
+  [[nodiscard]]
+  bool is_empty() const;
+
+  // Everything past this offset is unused. Moves a whole extent at a time,
+  // so the file may be grown ahead of it.
+  [[nodiscard]]
+  offset_t end_offset() const;
+
+  // Writes the superblock and every dirty directory and bitmap page back.
+  void flush();
+};
+}  // namespace hivedb
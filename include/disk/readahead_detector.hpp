@@ -0,0 +1,52 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <misc/config.hpp>
+#include <optional>
+
+namespace hivedb {
+// ascending accesses in a row before a stream gets read ahead
+static constexpr std::size_t READAHEAD_TRIGGER = 2;
+static constexpr std::size_t MIN_READAHEAD_PAGES = 4;
+static constexpr std::size_t MAX_READAHEAD_PAGES = 64;
+// how many interleaved scans we can follow at once
+static constexpr std::size_t READAHEAD_STREAMS = 8;
+
+struct page_range {
+  page_id_t first;
+  std::size_t count;
+};
+
+// Spots runs of ascending page ids and says what to read ahead of them.
+//
+// Each stream keeps half its window in front of the reader: once the reader
+// gets within half a window of the end of what was read ahead, the next
+// chunk is requested and the window doubles (up to MAX_READAHEAD_PAGES).
+// Anything that doesn't continue a stream takes over the least recently
+// used one and starts again at MIN_READAHEAD_PAGES.
+//
+// Not thread safe.
+struct readahead_detector {
+ private:
+  struct stream {
+    page_id_t last{INVALID_PAGE_ID};
+    // one past the last page read ahead so far
+    page_id_t end{0};
+    std::size_t run_length{0};
+    std::size_t window{MIN_READAHEAD_PAGES};
+    std::uint64_t last_used{0};
+  };
+
+  std::array<stream, READAHEAD_STREAMS> m_streams{};
+  std::uint64_t m_clock{0};
+
+  [[nodiscard]]
+  stream &find_stream(page_id_t);
+
+ public:
+  // Feeds one access by a reader, returns the pages to read ahead if any.
+  [[nodiscard]]
+  std::optional<page_range> record(page_id_t);
+};
+}  // namespace hivedb
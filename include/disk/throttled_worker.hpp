@@ -0,0 +1,48 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace hivedb {
+// Background work on the disk (scrubbing, compaction) done a batch at a time
+// on a thread of its own. step() is called over and over, no more than
+// pages_per_second / batch_size times a second, which keeps the work from
+// competing with real work for the disk. A step that returns true found
+// nothing to do and the next one waits idle_interval instead.
+//
+// Starts right away and stops (waiting for the step in progress) when
+// destroyed. Owners make it their last member, so it is gone before anything
+// step() uses.
+struct throttled_worker {
+ private:
+  std::function<bool()> m_step;
+  // how long a batch has to take at the configured rate
+  std::chrono::steady_clock::duration m_batch_interval;
+  std::chrono::milliseconds m_idle_interval;
+
+  // guards everything below
+  std::mutex m_latch;
+  std::condition_variable m_cv;
+  bool m_is_stopping{false};
+
+  std::thread m_thread;
+
+  void run();
+
+ public:
+  throttled_worker(std::size_t pages_per_second, std::size_t batch_size,
+                   std::chrono::milliseconds idle_interval,
+                   std::function<bool()> step);
+
+  throttled_worker(const throttled_worker &) = delete;
+  throttled_worker &operator=(const throttled_worker &) = delete;
+  throttled_worker(throttled_worker &&) = delete;
+  throttled_worker &operator=(throttled_worker &&) = delete;
+
+  ~throttled_worker();
+};
+}  // namespace hivedb
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+#include <misc/config.hpp>
+
+namespace hivedb {
+// Heap memory aligned for O_DIRECT I/O. Used for everything that may end up
+// being handed to the kernel directly: buffer pool frames, directory pages...
+struct aligned_buffer {
+ private:
+  char *m_data{nullptr};
+  std::size_t m_size{0};
+
+ public:
+  aligned_buffer() = default;
+  // size is rounded up to a multiple of IO_ALIGNMENT and zero filled
+  explicit aligned_buffer(std::size_t);
+
+  aligned_buffer(const aligned_buffer &) = delete;
+  aligned_buffer &operator=(const aligned_buffer &) = delete;
+  aligned_buffer(aligned_buffer &&) noexcept;
+  aligned_buffer &operator=(aligned_buffer &&) noexcept;
+
+  ~aligned_buffer();
+
+  [[nodiscard]]
+  char *data();
+
+  [[nodiscard]]
+  const char *data() const;
+
+  [[nodiscard]]
+  std::size_t size() const;
+
+  [[nodiscard]]
+  static bool is_aligned(const void *);
+};
+}  // namespace hivedb
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <bit>
+#include <cstddef>
 #include <cstdint>
 
 namespace hivedb {
@@ -7,7 +9,26 @@ using page_id_t = std::int64_t;
 using offset_t = std::size_t;
 using frame_id_t = std::int64_t;
 
+// the page size of files created without asking for another one
 static constexpr std::int32_t PAGE_SIZE = 4096;
+// largest page size a file can be created with
+static constexpr std::int32_t MAX_PAGE_SIZE = 64 * 1024;
+// the end of every page is reserved for the disk manager's checksum
+static constexpr std::int32_t PAGE_TRAILER_SIZE = 8;
+// what's left of a page for whoever stores data in it
+static constexpr std::int32_t PAGE_USABLE_SIZE = PAGE_SIZE - PAGE_TRAILER_SIZE;
+// what O_DIRECT expects buffers, offsets and sizes to be aligned to
+static constexpr std::size_t IO_ALIGNMENT = 4096;
+// keeps data written by different threads from sharing a cache line
+static constexpr std::size_t CACHE_LINE_SIZE = 64;
 static constexpr frame_id_t INVALID_FRAME_ID = -1;
 static constexpr page_id_t INVALID_PAGE_ID = -1;
+
+// a power of two between PAGE_SIZE and MAX_PAGE_SIZE
+[[nodiscard]]
+constexpr bool is_valid_page_size(std::size_t size) {
+  return size >= static_cast<std::size_t>(PAGE_SIZE) &&
+         size <= static_cast<std::size_t>(MAX_PAGE_SIZE) &&
+         std::has_single_bit(size);
+}
 }  // namespace hivedb
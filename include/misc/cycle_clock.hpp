@@ -0,0 +1,30 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+namespace hivedb {
+// A timestamp that costs a few cycles rather than a clock_gettime(). Ticks
+// are TSC cycles on x86-64 (invariant on anything we run on) and
+// nanoseconds elsewhere, only differences of them mean anything.
+struct cycle_clock {
+  [[nodiscard]]
+  static std::uint64_t now() {
+#if defined(__x86_64__)
+    return __rdtsc();
+#else
+    return static_cast<std::uint64_t>(
+        std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+  }
+
+  // Measured against steady_clock the first time it's asked for, which
+  // takes a couple of milliseconds.
+  [[nodiscard]]
+  static double nanoseconds_per_tick();
+};
+}  // namespace hivedb
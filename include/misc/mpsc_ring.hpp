@@ -0,0 +1,224 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <misc/config.hpp>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace hivedb {
+// spin budget bounds of the consumer's adaptive spin-then-park
+static constexpr std::size_t MIN_RING_SPIN_COUNT = 16;
+static constexpr std::size_t MAX_RING_SPIN_COUNT = 4096;
+
+/*
+ * Bounded lock-free multi-producer / single-consumer queue.
+ *
+ * Every slot carries a sequence number that says whose turn it is: a slot
+ * at position pos is free for the producer that claims pos once its
+ * sequence is pos, and holds a value for the consumer once it is pos + 1.
+ * Producers claim positions with a CAS on the tail, the consumer owns the
+ * head outright.
+ *
+ * The consumer waits by spinning for a while and then parking on a
+ * condition variable. Producers only touch the mutex when the consumer is
+ * actually parked, so in the busy case pushing is a CAS and two stores.
+ */
+template <typename T>
+struct mpsc_ring {
+ private:
+  struct alignas(CACHE_LINE_SIZE) slot {
+    std::atomic<std::uint64_t> sequence;
+    alignas(T) std::byte storage[sizeof(T)];
+
+    T *value() { return std::launder(reinterpret_cast<T *>(storage)); }
+  };
+
+  std::unique_ptr<slot[]> m_slots;
+  const std::uint64_t m_mask;
+
+  alignas(CACHE_LINE_SIZE) std::atomic<std::uint64_t> m_tail{0};
+  alignas(CACHE_LINE_SIZE) std::uint64_t m_head{0};
+  // adapts to how long items usually take to show up
+  std::size_t m_spin_count{MIN_RING_SPIN_COUNT};
+
+  alignas(CACHE_LINE_SIZE) std::atomic<bool> m_is_parked{false};
+  // set by notify(), makes the next wait() return even if nothing arrived
+  std::atomic<bool> m_is_signaled{false};
+  std::mutex m_park_latch;
+  std::condition_variable m_park_cv;
+
+  [[nodiscard]]
+  bool has_item() const;
+  void wake_consumer();
+
+ public:
+  // capacity is rounded up to a power of two
+  explicit mpsc_ring(std::size_t);
+
+  mpsc_ring(const mpsc_ring &) = delete;
+  mpsc_ring &operator=(const mpsc_ring &) = delete;
+  mpsc_ring(mpsc_ring &&) = delete;
+  mpsc_ring &operator=(mpsc_ring &&) = delete;
+
+  ~mpsc_ring();
+
+  // Any thread. Leaves value untouched and returns false if the ring is full.
+  [[nodiscard]]
+  bool try_push(T &&);
+  // Any thread. Yields until there is room.
+  void push(T &&);
+
+  // Consumer only.
+  [[nodiscard]]
+  std::optional<T> try_pop();
+  // Consumer only. Moves up to max_items into out, returns how many.
+  std::size_t pop_batch(std::vector<T> &, std::size_t);
+
+  // Consumer only. Returns once an item is available, notify() was called
+  // or timeout passed, whichever comes first.
+  void wait(std::chrono::microseconds);
+
+  // Any thread. Wakes the consumer up even though nothing was pushed.
+  void notify();
+
+  [[nodiscard]]
+  std::size_t capacity() const;
+};
+
+template <typename T>
+mpsc_ring<T>::mpsc_ring(std::size_t capacity)
+    : m_mask(std::bit_ceil(std::max<std::size_t>(capacity, 2)) - 1) {
+  if (capacity == 0) throw std::invalid_argument("capacity must be > 0");
+
+  m_slots = std::make_unique<slot[]>(m_mask + 1);
+  for (std::uint64_t i = 0; i <= m_mask; ++i)
+    m_slots[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+template <typename T>
+mpsc_ring<T>::~mpsc_ring() {
+  while (try_pop().has_value()) {
+  }
+}
+
+template <typename T>
+bool mpsc_ring<T>::try_push(T &&value) {
+  auto pos = m_tail.load(std::memory_order_relaxed);
+  slot *target;
+  while (true) {
+    target = &m_slots[pos & m_mask];
+    const auto sequence = target->sequence.load(std::memory_order_acquire);
+    const auto diff = static_cast<std::int64_t>(sequence - pos);
+
+    if (diff == 0) {
+      if (m_tail.compare_exchange_weak(pos, pos + 1,
+                                       std::memory_order_relaxed))
+        break;
+    } else if (diff < 0) {
+      // the consumer hasn't freed this slot yet
+      return false;
+    } else {
+      pos = m_tail.load(std::memory_order_relaxed);
+    }
+  }
+
+  new (target->storage) T(std::move(value));
+  target->sequence.store(pos + 1, std::memory_order_release);
+
+  wake_consumer();
+  return true;
+}
+
+template <typename T>
+void mpsc_ring<T>::push(T &&value) {
+  while (!try_push(std::move(value))) std::this_thread::yield();
+}
+
+template <typename T>
+std::optional<T> mpsc_ring<T>::try_pop() {
+  auto &target = m_slots[m_head & m_mask];
+  if (target.sequence.load(std::memory_order_acquire) != m_head + 1)
+    return std::nullopt;
+
+  std::optional<T> value{std::move(*target.value())};
+  std::destroy_at(target.value());
+  // hand the slot to whoever claims it on the next lap
+  target.sequence.store(m_head + m_mask + 1, std::memory_order_release);
+  m_head++;
+  return value;
+}
+
+template <typename T>
+std::size_t mpsc_ring<T>::pop_batch(std::vector<T> &out,
+                                    std::size_t max_items) {
+  std::size_t count = 0;
+  while (count < max_items) {
+    auto value = try_pop();
+    if (!value.has_value()) break;
+    out.push_back(std::move(value.value()));
+    count++;
+  }
+  return count;
+}
+
+template <typename T>
+bool mpsc_ring<T>::has_item() const {
+  return m_slots[m_head & m_mask].sequence.load(std::memory_order_acquire) ==
+         m_head + 1;
+}
+
+template <typename T>
+void mpsc_ring<T>::wait(std::chrono::microseconds timeout) {
+  for (std::size_t i = 0; i < m_spin_count; ++i) {
+    if (has_item() || m_is_signaled.exchange(false)) {
+      // items tend to show up while we spin, spin a bit longer next time
+      m_spin_count = std::min(m_spin_count * 2, MAX_RING_SPIN_COUNT);
+      return;
+    }
+  }
+  m_spin_count = std::max(m_spin_count / 2, MIN_RING_SPIN_COUNT);
+
+  std::unique_lock ul{m_park_latch};
+  m_is_parked.store(true);
+  // pairs with the fence in wake_consumer(), either we see their item or
+  // they see us parked
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  m_park_cv.wait_for(ul, timeout, [this] {
+    return has_item() || m_is_signaled.exchange(false);
+  });
+  m_is_parked.store(false);
+}
+
+template <typename T>
+void mpsc_ring<T>::wake_consumer() {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (!m_is_parked.load()) return;
+
+  // taking the latch makes sure the consumer is either still checking the
+  // predicate (and will see our item) or already asleep
+  { std::scoped_lock sl{m_park_latch}; }
+  m_park_cv.notify_one();
+}
+
+template <typename T>
+void mpsc_ring<T>::notify() {
+  m_is_signaled.store(true);
+  wake_consumer();
+}
+
+template <typename T>
+std::size_t mpsc_ring<T>::capacity() const {
+  return m_mask + 1;
+}
+}  // namespace hivedb
@@ -8,18 +8,32 @@
 #include "buffer_pool/lru_k.hpp"
 
 namespace hivedb {
-frame_header::frame_header(frame_id_t id, std::vector<char> &data,
-                           lru_k *replacer)
+frame_header::frame_header(frame_id_t id, char *data, lru_k *replacer)
     : frame_id(id),
       is_dirty(false),
       m_pin_count(0),
-      m_data(std::move(data)),
+      m_data(data),
       m_replacer(replacer) {}
-void frame_header::increase_pin_count() { m_pin_count += 1; }
-void frame_header::decrease_pin_count() { m_pin_count -= 1; }
+void frame_header::reset() {
+  is_dirty = false;
+  m_pin_count = 0;
+  m_is_prefetched = false;
+}
+void frame_header::increase_pin_count() { m_pin_count.fetch_add(1); }
+void frame_header::decrease_pin_count() {
+  // the last one out lets the replacer have the frame back
+  if (m_pin_count.fetch_sub(1) == 1 && m_replacer)
+    m_replacer->setEvictable(frame_id, true);
+}
 std::int32_t frame_header::get_pin_count() const { return m_pin_count; }
-const char *frame_header::get_data() const { return m_data.data(); }
-char *frame_header::get_data() { return m_data.data(); }
+void frame_header::lock() { m_latch.lock(); }
+void frame_header::unlock() { m_latch.unlock(); }
+bool frame_header::try_lock() { return m_latch.try_lock(); }
+void frame_header::lock_shared() { m_latch.lock_shared(); }
+void frame_header::unlock_shared() { m_latch.unlock_shared(); }
+bool frame_header::try_lock_shared() { return m_latch.try_lock_shared(); }
+const char *frame_header::get_data() const { return m_data; }
+char *frame_header::get_data() { return m_data; }
 frame_header::~frame_header() {
   if (m_replacer) {
     m_replacer->setEvictable(frame_id, true);
@@ -3,110 +3,130 @@
 //
 #include <spdlog/spdlog.h>
 
-#include <algorithm>
 #include <buffer_pool/lru_k.hpp>
+#include <limits>
 #include <misc/config.hpp>
-#include <numeric>
+#include <misc/cycle_clock.hpp>
 #include <stdexcept>
 
 namespace hivedb {
 lru_k::lru_k(std::int32_t k, frame_id_t size)
-    : m_k(k), m_size(size), m_current_nodes(), m_current_timestamp(0) {
-  if (k < 0 || size < 0)
+    : m_k(k), m_size(size) {
+  if (k <= 0 || size < 0)
     throw std::invalid_argument("k or size must be positive");
+
+  m_nodes = std::make_unique<lru_k_node[]>(static_cast<std::size_t>(size));
+  m_history = std::make_unique<std::atomic<std::uint64_t>[]>(
+      static_cast<std::size_t>(size) * static_cast<std::size_t>(k));
+}
+
+std::atomic<std::uint64_t> *lru_k::history_of(frame_id_t id) const {
+  return &m_history[static_cast<std::size_t>(id) *
+                    static_cast<std::size_t>(m_k)];
+}
+
+void lru_k::forget(frame_id_t id) {
+  auto &node = m_nodes[id];
+  if (node.is_evictable.exchange(false, std::memory_order_relaxed))
+    m_evictable_count.fetch_sub(1, std::memory_order_relaxed);
+  node.access_count.store(0, std::memory_order_relaxed);
 }
 
 void lru_k::recordAccess(frame_id_t id) {
-  if (id >= m_size)
+  if (id < 0 || id >= m_size)
     throw std::invalid_argument("record_access: id is out of range");
 
-  spdlog::info("Recording access for frame {}", id);
-  const auto it = m_current_nodes.find(id);
-  if (it == m_current_nodes.end()) {
-    std::vector<std::uint64_t> history{};
-    history.push_back(m_current_timestamp++);
-    m_current_nodes.insert({id, {history, true}});
-    return;
-  }
-  auto &[_, node] = *it;
-  node.history.push_back(m_current_timestamp++);
+  auto &node = m_nodes[id];
+  const auto count = node.access_count.fetch_add(1, std::memory_order_relaxed);
+  history_of(id)[count % static_cast<std::uint64_t>(m_k)].store(
+      cycle_clock::now(), std::memory_order_relaxed);
+  // frames the replacer starts tracking are evictable until told otherwise
+  if (count == 0 &&
+      !node.is_evictable.exchange(true, std::memory_order_relaxed))
+    m_evictable_count.fetch_add(1, std::memory_order_relaxed);
 }
 
 void lru_k::setEvictable(frame_id_t id, bool set_evictable) {
-  if (id >= m_size)
+  if (id < 0 || id >= m_size)
     throw std::invalid_argument("set_evictable: id is out of range");
 
-  spdlog::info("Setting frame {} to evictable status {}", id, set_evictable);
-  const auto it = m_current_nodes.find(id);
-  if (it == m_current_nodes.end()) return;
-
-  auto &[_, node] = *it;
-  node.is_evictable = set_evictable;
+  auto &node = m_nodes[id];
+  if (node.access_count.load(std::memory_order_relaxed) == 0) return;
+  if (node.is_evictable.exchange(set_evictable, std::memory_order_relaxed) ==
+      set_evictable)
+    return;
+  if (set_evictable) {
+    m_evictable_count.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    m_evictable_count.fetch_sub(1, std::memory_order_relaxed);
+  }
 }
 
 std::optional<frame_id_t> lru_k::evict() {
-  if (m_current_nodes.empty()) return std::nullopt;
-
-  spdlog::info("Attempting to evict a frame...");
-  const auto it = std::find_if(
-      m_current_nodes.begin(), m_current_nodes.end(), [this](const auto &i) {
-        const auto &[_, node] = i;
-        return node.is_evictable &&
-               node.history.size() <
-                   static_cast<decltype(m_current_nodes)::size_type>(m_k);
-      });
-
-  if (it != m_current_nodes.end()) {
-    const auto [frame_id, _] = *it;
-    m_current_nodes.erase(it);
-    spdlog::info("Trivial eviction, evicted {}", frame_id);
-    return frame_id;
-  }
-
-  std::size_t max_distance = 0;
-  frame_id_t id = INVALID_FRAME_ID;
-
-  // time to find a victim, god speed we don't hit a pinned frame
-  for (const auto &[frame_id, node] : m_current_nodes) {
-    if (!node.is_evictable) continue;
-    const auto old_timestamp =
-        node.history[node.history.size() + 1 -
-                     static_cast<std::vector<uint64_t>::size_type>(m_k)];
-    const auto diff = m_current_timestamp - old_timestamp;
-    if (diff > max_distance) {
-      max_distance = diff;
+  // frames with fewer than k accesses have an infinite backward k-distance
+  // and go first, the one accessed first among them. Otherwise the one
+  // whose k-th most recent access is the oldest.
+  const auto k = static_cast<std::uint64_t>(m_k);
+  while (m_evictable_count.load(std::memory_order_relaxed) > 0) {
+    bool is_infinite = false;
+    std::uint64_t oldest = std::numeric_limits<std::uint64_t>::max();
+    frame_id_t id = INVALID_FRAME_ID;
+
+    // racing evict() calls may look at the same frames, claiming the victim
+    // below sorts that out
+    const auto start = m_hand.load(std::memory_order_relaxed);
+    std::size_t sampled = 0;
+    frame_id_t scanned = 0;
+    for (; scanned < m_size && sampled < EVICTION_SAMPLE_SIZE; ++scanned) {
+      const auto frame_id = (start + scanned) % m_size;
+      const auto &node = m_nodes[frame_id];
+      const auto count = node.access_count.load(std::memory_order_relaxed);
+      if (count == 0 || !node.is_evictable.load(std::memory_order_relaxed))
+        continue;
+      ++sampled;
+
+      // the ring's next slot to be overwritten holds the k-th most recent
+      const auto *history = history_of(frame_id);
+      const bool has_infinite_distance = count < k;
+      const auto timestamp =
+          history[has_infinite_distance ? 0 : count % k].load(
+              std::memory_order_relaxed);
+      if (is_infinite && !has_infinite_distance) continue;
+      if (has_infinite_distance == is_infinite && timestamp >= oldest)
+        continue;
+
+      is_infinite = has_infinite_distance;
+      oldest = timestamp;
       id = frame_id;
     }
+    m_hand.store((start + scanned) % m_size, std::memory_order_relaxed);
+
+    // every evictable frame got pinned or evicted meanwhile
+    if (id == INVALID_FRAME_ID) return std::nullopt;
+
+    auto &node = m_nodes[id];
+    bool is_evictable = true;
+    if (!node.is_evictable.compare_exchange_strong(
+            is_evictable, false, std::memory_order_relaxed))
+      continue;
+    m_evictable_count.fetch_sub(1, std::memory_order_relaxed);
+    node.access_count.store(0, std::memory_order_relaxed);
+    spdlog::info("Found {}! evicting it now...", id);
+    return id;
   }
-
-  // sanity check
-  if (id == INVALID_FRAME_ID) {
-    spdlog::error("COULDN'T FIND FRAME TO EVICT!");
-    return std::nullopt;
-  }
-
-  m_current_nodes.erase(id);
-
-  spdlog::info("Found {}! evicting it now...", id);
-  return id;
+  return std::nullopt;
 }
+
 void lru_k::remove(frame_id_t id) {
-  if (id >= m_size) throw std::invalid_argument("remove: id is out of range");
-
-  if (const auto it = m_current_nodes.find(id); it != m_current_nodes.end()) {
-    const auto &[_, node] = *it;
-    if (node.is_evictable) {
-      m_current_nodes.erase(id);
-      spdlog::info("Removing frame {}", id);
-      return;
-    }
-  }
+  if (id < 0 || id >= m_size)
+    throw std::invalid_argument("remove: id is out of range");
+
+  // only evictable frames are forgotten
+  if (!m_nodes[id].is_evictable.load(std::memory_order_relaxed)) return;
+  forget(id);
 }
 
 std::size_t lru_k::size() const {
-  return std::accumulate(m_current_nodes.begin(), m_current_nodes.end(), 0,
-                         [](auto acc, const auto &item) {
-                           return acc + item.second.is_evictable;
-                         });
+  return m_evictable_count.load(std::memory_order_relaxed);
 }
 }  // namespace hivedb
@@ -0,0 +1,47 @@
+#include <disk/disk_completion_queue.hpp>
+
+namespace hivedb {
+void disk_completion_queue::on_complete(void *queue, const disk_request &req,
+                                        bool is_ok) {
+  static_cast<disk_completion_queue *>(queue)->push(
+      disk_completion{.page_id = req.page_id, .tag = req.tag, .is_ok = is_ok});
+}
+
+void disk_completion_queue::attach(disk_request &req, std::uint64_t tag) {
+  req.on_complete = on_complete;
+  req.context = this;
+  req.tag = tag;
+}
+
+void disk_completion_queue::push(const disk_completion &completion) {
+  // notified under the latch, a waiter that returns right after may destroy
+  // the queue (e.g. one that lives on its stack)
+  std::scoped_lock sl{m_latch};
+  m_completions.push_back(completion);
+  if (m_waiters > 0) m_cv.notify_one();
+}
+
+std::size_t disk_completion_queue::poll(std::vector<disk_completion> &out) {
+  std::scoped_lock sl{m_latch};
+  const auto count = m_completions.size();
+  out.insert(out.end(), m_completions.begin(), m_completions.end());
+  m_completions.clear();
+  return count;
+}
+
+std::size_t disk_completion_queue::wait(std::vector<disk_completion> &out,
+                                        std::size_t min_count) {
+  std::size_t count = 0;
+  std::unique_lock ul{m_latch};
+  while (true) {
+    count += m_completions.size();
+    out.insert(out.end(), m_completions.begin(), m_completions.end());
+    m_completions.clear();
+    if (count >= min_count) return count;
+
+    m_waiters++;
+    m_cv.wait(ul, [this] { return !m_completions.empty(); });
+    m_waiters--;
+  }
+}
+}  // namespace hivedb
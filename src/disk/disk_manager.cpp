@@ -1,114 +1,907 @@
+#include <fcntl.h>
 #include <spdlog/spdlog.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <array>
 #include <cerrno>
 #include <cstddef>
+#include <cstdint>
 #include <cstring>
 #include <disk/disk_manager.hpp>
+#include <disk/file_io.hpp>
+#include <disk/page_checksum.hpp>
 #include <filesystem>
 #include <misc/config.hpp>
 #include <stdexcept>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace hivedb {
+namespace {
+// Opens (or creates) the db file. Downgrades mode to buffered if the
+// filesystem doesn't do O_DIRECT, some reject it at open() and some only
+// once we actually read, so probe with a read of the first page.
+int open_db_file(const std::filesystem::path &db_path, io_mode &mode) {
+  if (mode == io_mode::direct) {
+    const int fd = open(db_path.c_str(), O_RDWR | O_CREAT | O_DIRECT, 0644);
+    if (fd != -1) {
+      aligned_buffer probe{PAGE_SIZE};
+      if (pread(fd, probe.data(), PAGE_SIZE, 0) >= 0) return fd;
+      close(fd);
+    }
 
-disk_manager::disk_manager(const std::filesystem::path &db_path)
-    : m_db_file(), m_db_file_path(db_path) {
-  m_db_file.open(db_path, std::ios::binary | std::ios::in | std::ios::out);
-  if (!m_db_file.is_open()) {
-    // create the file if opening failed
-    m_db_file.open(db_path, std::ios::trunc | std::ios::binary | std::ios::in |
-                                std::ios::out);
-    if (!m_db_file.is_open())
-      throw std::runtime_error("failed create the file!");
+    spdlog::warn("O_DIRECT is not supported for {} (errno {}), falling back "
+                 "to buffered I/O",
+                 db_path.string(), errno);
+    mode = io_mode::buffered;
   }
 
-  // the first page (or the + 1) is reserved for the system/root of the b+tree
-  std::filesystem::resize_file(db_path, (m_current_pages + 1) * PAGE_SIZE);
+  // create the file if it doesn't exist yet
+  const int fd = open(db_path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd == -1) throw std::runtime_error("failed create the file!");
+  return fd;
+}
+
+// O_DIRECT needs aligned memory, unaligned callers go through this
+char *bounce_buffer() {
+  thread_local aligned_buffer buffer{MAX_PAGE_SIZE};
+  return buffer.data();
+}
+
+// holds the staged tails of a batch's writes, see stage_writes()
+char *staging_buffer(std::size_t size) {
+  thread_local aligned_buffer buffer;
+  if (buffer.size() < size) buffer = aligned_buffer{size};
+  return buffer.data();
+}
+
+constexpr std::uint64_t DOUBLE_WRITE_MAGIC =
+    0x5744424445564948;  // HIVEDBDW
+
+/*
+ * The double-write file is a header page followed by copies of the pages
+ * of the last batch, in the order of the header's entries:
+ * -----------------------------------------------------------------------
+ * | magic (8 bytes) | count (4 bytes) | crc32c of the header (4 bytes) |
+ * -----------------------------------------------------------------------
+ * | page id (8 bytes) | offset (8 bytes) | crc32c of the copy (4 bytes) |
+ * -----------------------------------------------------------------------
+ * The header's checksum covers everything but itself, the copies
+ * have one of their own since a torn copy may still have a valid trailer.
+ */
+struct double_write_entry {
+  page_id_t page_id;
+  offset_t offset;
+  std::uint32_t checksum;
+};
+
+struct double_write_header {
+  std::uint64_t magic;
+  std::uint32_t count;
+  std::uint32_t checksum;
+  std::array<double_write_entry, DOUBLE_WRITE_PAGES> entries;
+};
+static_assert(sizeof(double_write_header) <= PAGE_SIZE);
+
+// taken over the header as it sits in the page, padding included
+std::uint32_t header_checksum(const char *header_page) {
+  constexpr auto checksum_offset = offsetof(double_write_header, checksum);
+  constexpr auto rest_offset = checksum_offset + sizeof(std::uint32_t);
+  const auto crc = crc32c(0, header_page, checksum_offset);
+  return crc32c(crc, header_page + rest_offset,
+                sizeof(double_write_header) - rest_offset);
+}
+}  // namespace
+
+std::filesystem::path get_double_write_path(
+    const std::filesystem::path &db_path) {
+  return db_path.string() + ".dblwr";
+}
+
+disk_manager::disk_manager(const std::filesystem::path &db_path,
+                           durability_mode durability, io_mode mode,
+                           torn_write_protection protection,
+                           std::size_t page_size)
+    : m_io_mode(mode),
+      m_db_fd(open_db_file(db_path, m_io_mode)),
+      m_db_file_path(db_path),
+      m_directory(m_db_fd, page_size),
+      m_page_size(m_directory.page_size()),
+      m_durability(durability),
+      m_torn_write_protection(protection),
+      m_double_write_path(get_double_write_path(db_path)) {
+  if (m_directory.features() & PAGE_FEATURE_COMPRESSED) {
+    close(m_db_fd);
+    throw std::runtime_error(
+        "The db file is compressed, open it with disk_manager_compressed!");
+  }
+
+  if (m_torn_write_protection == torn_write_protection::double_write) {
+    m_double_write_fd = open(m_double_write_path.c_str(), O_RDWR | O_CREAT,
+                             0644);
+    if (m_double_write_fd == -1) {
+      close(m_db_fd);
+      throw std::runtime_error("failed to create the double-write file!");
+    }
+
+    try {
+      recover_torn_pages();
+    } catch (...) {
+      close(m_double_write_fd);
+      close(m_db_fd);
+      throw;
+    }
+  }
+
+  m_allocated_end = m_growth_target = get_file_size();
+  {
+    std::scoped_lock sl{m_directory_latch};
+    grow_file_if_needed();
+  }
+  m_grower = std::thread([this]() { run_grower(); });
+}
+
+disk_manager::~disk_manager() {
+  {
+    std::scoped_lock sl{m_growth_latch};
+    m_is_shutting_down = true;
+  }
+  m_growth_cv.notify_one();
+  if (m_grower.joinable()) m_grower.join();
+
+  if (m_db_fd == -1) return;
+
+  try {
+    m_directory.flush();
+    if (m_has_unsynced_writes && m_durability != durability_mode::manual) {
+      fdatasync(m_db_fd);
+    }
+  } catch (const std::exception &err) {
+    spdlog::error("Failed to flush the page directory: {}", err.what());
+  }
+
+  if (m_double_write_fd != -1) {
+    // the copies may only go once every page is safely in place
+    if (!m_has_unsynced_writes || fdatasync(m_db_fd) == 0)
+      unlink(m_double_write_path.c_str());
+    close(m_double_write_fd);
+  }
+  close(m_db_fd);
 }
 
 void disk_manager::write_page(page_id_t id, const char *buffer) {
   if (id < 0)
     throw std::runtime_error("Invalid id detected!: " + std::to_string(id));
-  offset_t offset =
-      m_pages.find(id) != m_pages.end() ? allocate_new_page() : m_pages[id];
 
-  m_db_file.seekg(static_cast<std::fstream::off_type>(offset));
-  m_db_file.write(buffer, PAGE_SIZE);
+  // a batch of one, the buffer is only ever read from
+  bool is_written = false;
+  disk_request req{
+      .type = disk_request_type::write,
+      .data = const_cast<char *>(buffer),
+      .page_id = id,
+      .is_done = std::nullopt,
+      .on_complete = [](void *context, const disk_request &, bool is_ok) {
+        *static_cast<bool *>(context) = is_ok;
+      },
+      .context = &is_written};
 
-  if (m_db_file.bad()) {
-    throw std::runtime_error("Error writing page_id:" + std::to_string(id));
+  std::shared_lock rl{m_relocation_latch};
+  pending_write write{.offset = find_or_allocate(id), .req = &req};
+  stage_writes(std::span{&write, 1});
+  if (m_torn_write_protection == torn_write_protection::double_write) {
+    write_double_written(std::span{&write, 1});
+  } else {
+    write_coalesced(std::span{&write, 1});
   }
 
-  m_pages[id] = offset;
+  if (!is_written)
+    throw std::runtime_error("Error writing page_id:" + std::to_string(id));
+}
+
+void disk_manager::write_torn_page(page_id_t id, const char *buffer,
+                                   std::size_t size) {
+  if (id < 0)
+    throw std::runtime_error("Invalid id detected!: " + std::to_string(id));
+
+  size = std::min(size, m_page_size);
+  if (m_io_mode == io_mode::direct) size -= size % IO_ALIGNMENT;
+  if (size == 0) return;
 
-  m_db_file.flush();
+  std::shared_lock rl{m_relocation_latch};
+  const auto offset = find_or_allocate(id);
+  // O_DIRECT only takes aligned buffers
+  aligned_buffer prefix{size};
+  std::memcpy(prefix.data(), buffer, size);
+  if (!write_fully(m_db_fd, prefix.data(), size, offset))
+    throw std::runtime_error("Error writing page_id:" + std::to_string(id));
+  m_has_unsynced_writes = true;
 }
 
 void disk_manager::read_page(page_id_t id, char *buffer) {
   if (id < 0)
     throw std::runtime_error("Invalid id detected!: " + std::to_string(id));
 
-  offset_t offset =
-      m_pages.find(id) == m_pages.end() ? allocate_new_page() : m_pages[id];
+  // a page that was never written reads as zeroes
+  std::shared_lock rl{m_relocation_latch};
+  std::unique_lock ul{m_directory_latch};
+  const auto offset = m_directory.find(id);
+  ul.unlock();
+  if (!offset.has_value()) {
+    std::memset(buffer, 0, m_page_size);
+    return;
+  }
 
   const auto file_size = get_file_size();
-  if (offset > file_size) {
+  if (offset.value() > file_size) {
     throw std::runtime_error(
         "Offset was bigger (somehow) than file size! offset: " +
-        std::to_string(offset) + " file_size: " + std::to_string(file_size));
+        std::to_string(offset.value()) +
+        " file_size: " + std::to_string(file_size));
   }
 
-  m_pages[id] = offset;
+  const bool use_bounce_buffer =
+      m_io_mode == io_mode::direct && !aligned_buffer::is_aligned(buffer);
+  char *destination = use_bounce_buffer ? bounce_buffer() : buffer;
 
-  m_db_file.seekg(static_cast<std::fstream::off_type>(offset));
-  m_db_file.read(buffer, PAGE_SIZE);
-
-  if (m_db_file.bad()) {
+  const auto read_count =
+      read_fully(m_db_fd, destination, m_page_size, offset.value());
+  if (read_count < 0)
     throw std::runtime_error("Error reading page_id:" + std::to_string(id));
-  }
+  if (use_bounce_buffer) std::memcpy(buffer, destination, read_count);
 
-  const auto read_count = m_db_file.gcount();
-  if (PAGE_SIZE > read_count) {
+  if (static_cast<ssize_t>(m_page_size) > read_count) {
     spdlog::info("warning: couldn't read full page! read: {}", read_count);
-    std::memset(buffer + read_count, 0, PAGE_SIZE - read_count);
+    std::memset(buffer + read_count, 0, m_page_size - read_count);
   }
+
+  if (!verify_page(id, buffer, m_page_size,
+                   m_directory.features() & PAGE_FEATURE_CHECKSUMS))
+    throw std::runtime_error("Checksum mismatch on page_id:" +
+                             std::to_string(id));
 }
 
 void disk_manager::delete_page(page_id_t id) {
   if (id < 0)
     throw std::runtime_error("Invalid id detected!: " + std::to_string(id));
-  if (m_pages.find(id) == m_pages.end())
-    throw std::runtime_error("Invalid id detected!: " + std::to_string(id));
 
-  offset_t offset = m_pages[id];
+  std::shared_lock rl{m_relocation_latch};
+  std::unique_lock ul{m_directory_latch};
+  const auto offset = m_directory.find(id);
+  if (!offset.has_value()) {
+    // handed out but never written, only the id has to go back
+    if (id >= m_directory.page_id_end())
+      throw std::runtime_error("Invalid id detected!: " + std::to_string(id));
+    m_directory.free_page_id(id);
+    grow_file_if_needed();
+    return;
+  }
+  ul.unlock();
 
-  m_db_file.seekg(static_cast<std::fstream::off_type>(offset));
-  m_db_file.write(nullptr, PAGE_SIZE);
+  alignas(IO_ALIGNMENT) static constexpr std::array<char, MAX_PAGE_SIZE>
+      zeroed_page{};
+  if (!write_fully(m_db_fd, zeroed_page.data(), m_page_size, offset.value()))
+    throw std::runtime_error("Error deleting page_id:" + std::to_string(id));
 
-  m_free_offsets.push_back(offset);
-  m_pages.erase(id);
+  // only hand the offset out again once we are done writing to it
+  ul.lock();
+  if (m_relocating_pages.contains(id)) m_relocation_conflicts.insert(id);
+  m_directory.erase(id);
+  m_directory.free_offset(offset.value());
+  m_directory.free_page_id(id);
+  forget_punched(offset.value());
+  // the free space bitmaps may have needed another page
+  grow_file_if_needed();
+  ul.unlock();
+  m_has_unsynced_writes = true;
 }
 
-offset_t disk_manager::allocate_new_page() {
-  if (!m_free_offsets.empty()) {
-    auto offset = m_free_offsets.back();
-    m_free_offsets.pop_back();
-    return offset;
+page_id_t disk_manager::allocate_page_id() {
+  std::scoped_lock sl{m_directory_latch};
+  return m_directory.allocate_page_id();
+}
+
+page_id_t disk_manager::page_id_end() {
+  std::scoped_lock sl{m_directory_latch};
+  return m_directory.page_id_end();
+}
+
+void disk_manager::submit_batch(std::span<disk_request> batch) {
+  std::vector<pending_write> writes;
+  writes.reserve(batch.size());
+
+  for (auto &req : batch) {
+    try {
+      switch (req.type) {
+        case disk_request_type::read:
+        case disk_request_type::prefetch:
+          read_page(req.page_id, req.data);
+          req.complete(true);
+          break;
+        case disk_request_type::write:
+          writes.push_back(pending_write{.offset = 0, .req = &req});
+          break;
+        default:
+          throw std::invalid_argument("invalid request type");
+      }
+    } catch (const std::exception &err) {
+      spdlog::error("Request for page {} failed: {}", req.page_id, err.what());
+      req.complete(false);
+    }
+  }
+
+  if (writes.empty()) return;
+
+  // the pages must not move between finding their offsets and the writes
+  std::shared_lock rl{m_relocation_latch};
+  std::erase_if(writes, [this](auto &write) {
+    try {
+      write.offset = find_or_allocate(write.req->page_id);
+      return false;
+    } catch (const std::exception &err) {
+      spdlog::error("Request for page {} failed: {}", write.req->page_id,
+                    err.what());
+      write.req->complete(false);
+      return true;
+    }
+  });
+  stage_writes(writes);
+
+  // the scheduler never puts two requests for the same page in one batch,
+  // so the writes can go out in any order
+  std::sort(writes.begin(), writes.end(),
+            [](const auto &lhs, const auto &rhs) {
+              return lhs.offset < rhs.offset;
+            });
+  if (m_torn_write_protection == torn_write_protection::double_write) {
+    write_double_written(writes);
+  } else {
+    write_coalesced(writes);
+  }
+}
+
+void disk_manager::stage_writes(std::span<pending_write> writes) {
+  const auto tail_size_of = [this](const pending_write &write) -> std::size_t {
+    if (m_io_mode == io_mode::buffered) return PAGE_TRAILER_SIZE;
+    // O_DIRECT can't take unaligned buffers, those are copied whole
+    return aligned_buffer::is_aligned(write.req->data) ? IO_ALIGNMENT
+                                                       : m_page_size;
+  };
+
+  std::size_t staged_size = 0;
+  for (const auto &write : writes) staged_size += tail_size_of(write);
+  char *staged = staging_buffer(staged_size);
+
+  for (auto &write : writes) {
+    const auto tail_size = tail_size_of(write);
+    const auto *page = write.req->data;
+    std::memcpy(staged, page + m_page_size - tail_size,
+                tail_size - PAGE_TRAILER_SIZE);
+    const auto trailer =
+        make_page_trailer(write.req->page_id, page, m_page_size);
+    std::memcpy(staged + tail_size - PAGE_TRAILER_SIZE, &trailer,
+                sizeof(trailer));
+
+    write.tail = staged;
+    write.tail_size = tail_size;
+    staged += tail_size;
+  }
+}
+
+std::size_t disk_manager::gather_page(const pending_write &write,
+                                      iovec *out) const {
+  std::size_t count = 0;
+  if (write.tail_size < m_page_size) {
+    out[count++] = iovec{.iov_base = write.req->data,
+                         .iov_len = m_page_size - write.tail_size};
+  }
+  out[count++] = iovec{.iov_base = write.tail, .iov_len = write.tail_size};
+  return count;
+}
+
+void disk_manager::write_coalesced(std::span<pending_write> writes) {
+  // up to two per page, see gather_page()
+  std::array<iovec, 2 * MAX_COALESCED_PAGES> buffers{};
+
+  while (!writes.empty()) {
+    // extend the run as long as the next page sits right behind this one
+    std::size_t count = 1;
+    while (count < writes.size() && count < MAX_COALESCED_PAGES &&
+           writes[count].offset == writes[count - 1].offset + m_page_size) {
+      ++count;
+    }
+
+    std::size_t buffer_count = 0;
+    for (std::size_t i = 0; i < count; ++i)
+      buffer_count += gather_page(writes[i], buffers.data() + buffer_count);
+
+    bool is_written = write_fully(
+        m_db_fd, std::span{buffers.data(), buffer_count}, writes[0].offset);
+    if (!is_written) {
+      spdlog::error("Writing {} pages at offset {} failed, ERRNO: {}", count,
+                    writes[0].offset, errno);
+    } else {
+      m_has_unsynced_writes = true;
+      if (m_durability == durability_mode::per_write) {
+        try {
+          sync();
+        } catch (const std::exception &err) {
+          spdlog::error("{}", err.what());
+          is_written = false;
+        }
+      }
+    }
+
+    for (std::size_t i = 0; i < count; ++i)
+      writes[i].req->complete(is_written);
+    writes = writes.subspan(count);
   }
+}
+
+void disk_manager::write_double_written(std::span<pending_write> writes) {
+  while (!writes.empty()) {
+    const auto chunk =
+        writes.first(std::min(writes.size(), DOUBLE_WRITE_PAGES));
+    writes = writes.subspan(chunk.size());
+
+    std::scoped_lock sl{m_double_write_latch};
+    try {
+      write_double_write_copies(chunk);
+    } catch (const std::exception &err) {
+      // nothing was written in place, the pages on disk are still whole
+      spdlog::error("{}", err.what());
+      for (auto &write : chunk) write.req->complete(false);
+      continue;
+    }
+    write_coalesced(chunk);
+  }
+}
 
-  if (m_pages.size() + 1 >= m_current_pages) {
-    m_current_pages *= 2;
-    std::filesystem::resize_file(m_db_file_path,
-                                 (m_current_pages + 1) * PAGE_SIZE);
+void disk_manager::write_double_write_copies(
+    std::span<const pending_write> writes) {
+  // the copies of the previous batch are all that stands between its pages
+  // and a torn write until they are synced in place
+  if (m_has_unsynced_writes.exchange(false) && fdatasync(m_db_fd) == -1) {
+    m_has_unsynced_writes = true;
+    throw std::runtime_error("Failed to sync the db file! ERRNO: " +
+                             std::to_string(errno));
   }
 
-  return m_pages.size() * PAGE_SIZE;
+  double_write_header header{};
+  header.magic = DOUBLE_WRITE_MAGIC;
+  header.count = static_cast<std::uint32_t>(writes.size());
+  for (std::size_t i = 0; i < writes.size(); ++i) {
+    const auto &write = writes[i];
+    const auto head_crc =
+        crc32c(0, write.req->data, m_page_size - write.tail_size);
+    header.entries[i] = double_write_entry{
+        .page_id = write.req->page_id,
+        .offset = write.offset,
+        .checksum = crc32c(head_crc, write.tail, write.tail_size)};
+  }
+
+  thread_local aligned_buffer header_page{MAX_PAGE_SIZE};
+  std::memset(header_page.data(), 0, m_page_size);
+  std::memcpy(header_page.data(), &header, sizeof(header));
+  header.checksum = header_checksum(header_page.data());
+  std::memcpy(header_page.data() + offsetof(double_write_header, checksum),
+              &header.checksum, sizeof(header.checksum));
+
+  std::array<iovec, 2 * DOUBLE_WRITE_PAGES + 1> buffers{};
+  buffers[0] = iovec{.iov_base = header_page.data(), .iov_len = m_page_size};
+  std::size_t buffer_count = 1;
+  for (const auto &write : writes)
+    buffer_count += gather_page(write, buffers.data() + buffer_count);
+
+  if (!write_fully(m_double_write_fd, std::span{buffers.data(), buffer_count},
+                   0)) {
+    throw std::runtime_error("Failed to write the double-write file! ERRNO: " +
+                             std::to_string(errno));
+  }
+  if (fdatasync(m_double_write_fd) == -1) {
+    throw std::runtime_error("Failed to sync the double-write file! ERRNO: " +
+                             std::to_string(errno));
+  }
 }
+
+void disk_manager::recover_torn_pages() {
+  aligned_buffer header_page{m_page_size};
+  const auto read_count =
+      read_fully(m_double_write_fd, header_page.data(), m_page_size, 0);
+  if (read_count < 0)
+    throw std::runtime_error("Failed to read the double-write file!");
+  // nothing ever went through it
+  if (static_cast<std::size_t>(read_count) < sizeof(double_write_header))
+    return;
+
+  double_write_header header;
+  std::memcpy(&header, header_page.data(), sizeof(header));
+  // a torn header means the crash came before anything was written in place
+  if (header.magic != DOUBLE_WRITE_MAGIC ||
+      header.count > DOUBLE_WRITE_PAGES ||
+      header.checksum != header_checksum(header_page.data())) {
+    return;
+  }
+
+  aligned_buffer copy{m_page_size};
+  aligned_buffer page{m_page_size};
+  for (std::size_t i = 0; i < header.count; ++i) {
+    const auto &entry = header.entries[i];
+    const auto copy_offset = (i + 1) * m_page_size;
+    if (read_fully(m_double_write_fd, copy.data(), m_page_size,
+                   copy_offset) !=
+            static_cast<ssize_t>(m_page_size) ||
+        crc32c(0, copy.data(), m_page_size) != entry.checksum) {
+      continue;
+    }
+
+    // the page moved (or is gone) since, its old spot isn't ours to touch
+    if (m_directory.find(entry.page_id) != entry.offset) continue;
+
+    const auto page_count =
+        read_fully(m_db_fd, page.data(), m_page_size, entry.offset);
+    if (page_count < 0)
+      throw std::runtime_error("Error reading page_id:" +
+                               std::to_string(entry.page_id));
+    if (page_count == static_cast<ssize_t>(m_page_size) &&
+        std::memcmp(page.data(), copy.data(), m_page_size) == 0) {
+      continue;
+    }
+
+    spdlog::warn("Repairing torn page {} from the double-write file",
+                 entry.page_id);
+    if (!write_fully(m_db_fd, copy.data(), m_page_size, entry.offset))
+      throw std::runtime_error("Error writing page_id:" +
+                               std::to_string(entry.page_id));
+    ++m_repaired_pages;
+  }
+
+  if (m_repaired_pages > 0 && fdatasync(m_db_fd) == -1) {
+    throw std::runtime_error("Failed to sync the db file! ERRNO: " +
+                             std::to_string(errno));
+  }
+}
+
+void disk_manager::sync() {
+  {
+    std::scoped_lock sl{m_directory_latch};
+    m_directory.flush();
+  }
+  if (!m_has_unsynced_writes.exchange(false)) return;
+
+  if (fdatasync(m_db_fd) == -1) {
+    m_has_unsynced_writes = true;
+    throw std::runtime_error("Failed to sync the db file! ERRNO: " +
+                             std::to_string(errno));
+  }
+}
+
+void disk_manager::end_batch() {
+  if (m_durability == durability_mode::per_batch) sync();
+}
+
+compaction_result disk_manager::compact(std::size_t max_pages) {
+  std::scoped_lock cl{m_compaction_latch};
+  compaction_result result{};
+  if (max_pages > 0) result.relocated_pages = relocate_last_pages(max_pages);
+  result.punched_pages = punch_freed_pages();
+  result.trimmed_bytes = trim_file();
+  return result;
+}
+
+std::size_t disk_manager::relocate_last_pages(std::size_t max_pages) {
+  struct relocation {
+    page_id_t page_id;
+    offset_t from;
+    offset_t to;
+    bool is_copied;
+  };
+  std::vector<relocation> relocations;
+
+  {
+    // with nothing in flight, any write to a page from here on goes
+    // through find_or_allocate() and shows up as a conflict
+    std::unique_lock rl{m_relocation_latch};
+    std::scoped_lock sl{m_directory_latch};
+    for (const auto &[id, from] : m_directory.last_pages(max_pages)) {
+      const auto to = m_directory.take_free_offset_below(from);
+      if (!to.has_value()) break;
+
+      relocations.push_back(relocation{
+          .page_id = id, .from = from, .to = to.value(), .is_copied = false});
+      m_relocating_pages.insert(id);
+    }
+  }
+
+  // the copies go out alongside page I/O
+  aligned_buffer page{m_page_size};
+  for (auto &relocation : relocations) {
+    relocation.is_copied =
+        read_fully(m_db_fd, page.data(), m_page_size, relocation.from) ==
+            static_cast<ssize_t>(m_page_size) &&
+        verify_page(relocation.page_id, page.data(), m_page_size,
+                    m_directory.features() & PAGE_FEATURE_CHECKSUMS) &&
+        write_fully(m_db_fd, page.data(), m_page_size, relocation.to);
+  }
+  // the directory may only point at copies that are on disk
+  const bool is_durable = !relocations.empty() && fdatasync(m_db_fd) == 0;
+
+  std::size_t relocated = 0;
+  {
+    // readers that found the old spots are done with them once we have it
+    std::unique_lock rl{m_relocation_latch};
+    std::scoped_lock sl{m_directory_latch};
+    for (const auto &relocation : relocations) {
+      if (is_durable && relocation.is_copied &&
+          !m_relocation_conflicts.contains(relocation.page_id) &&
+          m_directory.find(relocation.page_id) == relocation.from) {
+        m_directory.set(relocation.page_id, relocation.to);
+        m_vacated_offsets.push_back(relocation.from);
+        ++relocated;
+      } else {
+        m_directory.free_offset(relocation.to);
+        forget_punched(relocation.to);
+      }
+    }
+    m_relocating_pages.clear();
+    m_relocation_conflicts.clear();
+  }
+
+  if (m_vacated_offsets.empty()) return relocated;
+
+  // a crash must find the pages at their new spots before the old ones can
+  // be reused, if this fails they are freed after the next compact()
+  m_has_unsynced_writes = true;
+  sync();
+
+  std::scoped_lock sl{m_directory_latch};
+  for (const auto offset : m_vacated_offsets) {
+    m_directory.free_offset(offset);
+    forget_punched(offset);
+  }
+  m_vacated_offsets.clear();
+  // the free space bitmap may have needed another page
+  grow_file_if_needed();
+  return relocated;
+}
+
+void disk_manager::forget_punched(offset_t offset) {
+  const auto spot = offset / m_page_size - 1;
+  if (spot < m_punched_spots.size()) m_punched_spots[spot] = false;
+}
+
+std::size_t disk_manager::punch_freed_pages() {
+  struct hole {
+    offset_t offset;
+    std::size_t count;
+  };
+  std::vector<hole> holes;
+
+  {
+    std::scoped_lock sl{m_directory_latch};
+    const auto end = m_directory.end_offset();
+    const auto is_punched = [this](offset_t offset) {
+      const auto spot = offset / m_page_size - 1;
+      return spot < m_punched_spots.size() && m_punched_spots[spot];
+    };
+
+    auto next = m_directory.next_free_offset(m_page_size);
+    // past the end trim_file() cuts anyway
+    while (next.has_value() && next.value() < end) {
+      const auto start = next.value();
+      if (is_punched(start)) {
+        next = m_directory.next_free_offset(start + m_page_size);
+        continue;
+      }
+
+      // one call per run of adjacent spots
+      std::size_t count = 1;
+      next = m_directory.next_free_offset(start + m_page_size);
+      while (next.has_value() &&
+             next.value() == start + count * m_page_size &&
+             next.value() < end && !is_punched(next.value())) {
+        ++count;
+        next = m_directory.next_free_offset(next.value() + m_page_size);
+      }
+      holes.push_back(hole{.offset = start, .count = count});
+    }
+
+    // a spot must not be handed out while we punch it
+    for (const auto &hole : holes) {
+      for (std::size_t i = 0; i < hole.count; ++i)
+        m_directory.take_free_offset(hole.offset + i * m_page_size);
+    }
+  }
+
+  // the punching goes out alongside page I/O
+  std::size_t punched_holes = 0;
+  int error = 0;
+  for (; punched_holes < holes.size(); ++punched_holes) {
+    const auto &hole = holes[punched_holes];
+    if (fallocate(m_db_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                  static_cast<off_t>(hole.offset),
+                  static_cast<off_t>(hole.count * m_page_size)) == -1) {
+      error = errno;
+      break;
+    }
+  }
+
+  std::size_t punched = 0;
+  {
+    std::scoped_lock sl{m_directory_latch};
+    for (std::size_t i = 0; i < holes.size(); ++i) {
+      const auto &hole = holes[i];
+      for (std::size_t j = 0; j < hole.count; ++j)
+        m_directory.free_offset(hole.offset + j * m_page_size);
+      if (i >= punched_holes) continue;
+
+      const auto first_spot = hole.offset / m_page_size - 1;
+      if (m_punched_spots.size() < first_spot + hole.count)
+        m_punched_spots.resize(first_spot + hole.count, false);
+      std::fill_n(
+          m_punched_spots.begin() + static_cast<std::ptrdiff_t>(first_spot),
+          hole.count, true);
+      punched += hole.count;
+    }
+  }
+
+  // the filesystem can't, the spots stay allocated until reused
+  if (error != 0 && error != EOPNOTSUPP) {
+    throw std::runtime_error("Failed to punch a hole in the db file! "
+                             "ERRNO: " +
+                             std::to_string(error));
+  }
+  return punched;
+}
+
+std::size_t disk_manager::trim_file() {
+  {
+    std::scoped_lock sl{m_directory_latch};
+    const auto old_end = m_directory.end_offset();
+    if (m_directory.trim_end() == old_end) return 0;
+    m_directory.flush();
+  }
+
+  // the superblock has to know the space is gone before it is, page I/O
+  // goes on meanwhile
+  if (fdatasync(m_db_fd) == -1) {
+    throw std::runtime_error("Failed to sync the db file! ERRNO: " +
+                             std::to_string(errno));
+  }
+
+  // Pages may have been allocated past the new end since, cut after them.
+  // Whoever allocates from here on waits in grow_file_if_needed() until
+  // the file is cut, then grows it again.
+  std::unique_lock ul{m_directory_latch};
+  std::scoped_lock gl{m_growth_latch};
+  const auto end = m_directory.end_offset();
+  ul.unlock();
+
+  const auto file_end = std::max(m_allocated_end, get_file_size());
+  if (file_end <= end) return 0;
+  if (ftruncate(m_db_fd, static_cast<off_t>(end)) == -1) {
+    throw std::runtime_error("Failed to truncate the db file! ERRNO: " +
+                             std::to_string(errno));
+  }
+  m_allocated_end = m_growth_target = end;
+  return file_end - end;
+}
+
+durability_mode disk_manager::get_durability_mode() const {
+  return m_durability;
+}
+
+io_mode disk_manager::get_io_mode() const { return m_io_mode; }
+
+std::size_t disk_manager::get_page_size() const { return m_page_size; }
+
+torn_write_protection disk_manager::get_torn_write_protection() const {
+  return m_torn_write_protection;
+}
+
+std::size_t disk_manager::get_repaired_page_count() const {
+  return m_repaired_pages;
+}
+
+void disk_manager::allocate_page(page_id_t id, page_kind kind) {
+  static_cast<void>(find_or_allocate(id, kind));
+}
+
+offset_t disk_manager::find_or_allocate(page_id_t id, page_kind kind) {
+  if (id < 0)
+    throw std::runtime_error("Invalid id detected!: " + std::to_string(id));
+
+  std::scoped_lock sl{m_directory_latch};
+  // whoever asks for the offset of a page is about to write it
+  if (!m_relocating_pages.empty() && m_relocating_pages.contains(id))
+    m_relocation_conflicts.insert(id);
+
+  const auto existing_offset = m_directory.find(id);
+  if (existing_offset.has_value()) return existing_offset.value();
+
+  const auto offset = allocate_new_page(kind);
+  m_directory.set(id, offset);
+  return offset;
+}
+
+offset_t disk_manager::allocate_new_page(page_kind kind) {
+  const auto offset = m_directory.allocate_offset(kind);
+  grow_file_if_needed();
+  return offset;
+}
+
+void disk_manager::grow_file_if_needed() {
+  // directory pages are handed out from the same space, so go by the end
+  // offset rather than by how many pages we think we have
+  const auto needed_end = m_directory.end_offset();
+  const auto wanted_end =
+      needed_end + PREALLOCATED_EXTENTS * m_directory.extent_size();
+
+  std::unique_lock ul{m_growth_latch};
+  // the grower fell behind (or never ran yet), this extent can't wait
+  if (m_allocated_end < needed_end) allocate_file_space(needed_end);
+
+  if (m_growth_target >= wanted_end) return;
+  m_growth_target = wanted_end;
+  ul.unlock();
+  m_growth_cv.notify_one();
+}
+
+void disk_manager::allocate_file_space(offset_t end) {
+  if (end <= m_allocated_end) return;
+
+  const auto length = static_cast<off_t>(end - m_allocated_end);
+  if (fallocate(m_db_fd, 0, static_cast<off_t>(m_allocated_end), length) ==
+      -1) {
+    if (errno != EOPNOTSUPP) {
+      throw std::runtime_error("Failed to allocate file space! ERRNO: " +
+                               std::to_string(errno));
+    }
+
+    // the filesystem can't preallocate, settle for a sparse file
+    if (ftruncate(m_db_fd, static_cast<off_t>(end)) == -1) {
+      throw std::runtime_error("Failed to grow the db file! ERRNO: " +
+                               std::to_string(errno));
+    }
+  }
+
+  m_allocated_end = end;
+}
+
+void disk_manager::run_grower() {
+  std::unique_lock ul{m_growth_latch};
+  while (true) {
+    m_growth_cv.wait(ul, [this]() {
+      return m_is_shutting_down || m_allocated_end < m_growth_target;
+    });
+    if (m_is_shutting_down) return;
+
+    // an extent at a time so a writer that needs the next one right away
+    // doesn't wait on all of them
+    const auto end = std::min(m_growth_target,
+                              m_allocated_end + m_directory.extent_size());
+    try {
+      allocate_file_space(end);
+    } catch (const std::exception &err) {
+      // leave it to grow_file_if_needed(), which can report the error
+      spdlog::warn("Preallocating the db file failed: {}", err.what());
+      m_growth_target = m_allocated_end;
+    }
+
+    // let writers that need the latch get in between extents
+    ul.unlock();
+    std::this_thread::yield();
+    ul.lock();
+  }
+}
+
 std::size_t disk_manager::get_file_size() {
   struct stat st{};
 
-  int status = stat(m_db_file_path.c_str(), &st);
+  int status = fstat(m_db_fd, &st);
   if (status == -1) {
     throw std::runtime_error("Failed to fetch the file size! ERRNO: " +
                              std::to_string(errno));
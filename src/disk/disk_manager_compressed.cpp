@@ -0,0 +1,474 @@
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <disk/disk_manager_compressed.hpp>
+#include <disk/file_io.hpp>
+#include <disk/page_checksum.hpp>
+#include <disk/page_codec.hpp>
+#include <map>
+#include <misc/aligned_buffer.hpp>
+#include <misc/config.hpp>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace hivedb {
+namespace {
+// a compressed slot starts with the compressed size
+using compressed_size_t = std::uint16_t;
+
+int open_db_file(const std::filesystem::path &db_path) {
+  const int fd = open(db_path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd == -1) throw std::runtime_error("failed create the file!");
+  return fd;
+}
+
+// Directory entries are the slot's offset, which is a multiple of
+// COMPRESSED_SLOT_UNIT, with its size in units - 1 in the low bits.
+offset_t slot_offset(offset_t entry) {
+  return entry & ~(COMPRESSED_SLOT_UNIT - 1);
+}
+
+std::size_t slot_units(offset_t entry) {
+  return (entry & (COMPRESSED_SLOT_UNIT - 1)) + 1;
+}
+
+offset_t make_entry(offset_t offset, std::size_t units) {
+  return offset | (units - 1);
+}
+
+offset_t chunk_of(offset_t offset) { return offset - offset % PAGE_SIZE; }
+
+// the slot map's pages are stamped with it, no page has it
+constexpr page_id_t SLOT_MAP_PAGE_ID = -1;
+constexpr std::size_t SLOT_MAP_HEADER_SIZE = 2 * sizeof(offset_t);
+constexpr std::size_t SLOT_MAP_ENTRIES_PER_PAGE =
+    (PAGE_USABLE_SIZE - SLOT_MAP_HEADER_SIZE) / sizeof(offset_t);
+
+// scratch space for a page on its way in or out
+char *page_buffer() {
+  thread_local aligned_buffer buffer{PAGE_SIZE};
+  return buffer.data();
+}
+
+char *slot_buffer() {
+  thread_local aligned_buffer buffer{PAGE_SIZE};
+  return buffer.data();
+}
+}  // namespace
+
+disk_manager_compressed::disk_manager_compressed(
+    const std::filesystem::path &db_path, durability_mode durability)
+    : m_db_fd(open_db_file(db_path)),
+      m_db_file_path(db_path),
+      m_directory(m_db_fd),
+      m_durability(durability) {
+  if (m_directory.page_size() != static_cast<std::size_t>(PAGE_SIZE)) {
+    close(m_db_fd);
+    throw std::runtime_error("The db file was created with page size " +
+                             std::to_string(m_directory.page_size()) +
+                             ", open it with disk_manager!");
+  }
+  if (m_directory.is_empty())
+    m_directory.set_features(m_directory.features() | PAGE_FEATURE_COMPRESSED);
+
+  if (!(m_directory.features() & PAGE_FEATURE_COMPRESSED)) {
+    close(m_db_fd);
+    throw std::runtime_error("The db file isn't compressed!");
+  }
+
+  std::scoped_lock sl{m_directory_latch};
+  if (m_directory.slot_map_offset() == 0) {
+    load_slots();
+    return;
+  }
+
+  if (!load_slot_map()) {
+    spdlog::warn("The slot map is torn, walking the page directory");
+    load_slots();
+  }
+  // The slots it lists get handed out from now on, a crash must not find
+  // the map again.
+  m_directory.set_slot_map_offset(0);
+  m_directory.flush();
+  if (fdatasync(m_db_fd) == -1) {
+    close(m_db_fd);
+    throw std::runtime_error("Failed to sync the db file! ERRNO: " +
+                             std::to_string(errno));
+  }
+}
+
+disk_manager_compressed::~disk_manager_compressed() {
+  // frees the slots given up since the last sync() for good, so the map
+  // has them
+  try {
+    sync();
+    std::scoped_lock sl{m_directory_latch};
+    save_slot_map();
+    m_directory.flush();
+    if (fdatasync(m_db_fd) == -1) {
+      throw std::runtime_error("Failed to sync the db file! ERRNO: " +
+                               std::to_string(errno));
+    }
+  } catch (const std::exception &err) {
+    spdlog::error("Failed to save the slot map: {}", err.what());
+  }
+  close(m_db_fd);
+}
+
+void disk_manager_compressed::load_slots() {
+  // used slots of every chunk, and how big that chunk's slots are
+  std::map<offset_t, std::pair<std::size_t, std::vector<offset_t>>> chunks;
+  std::unordered_set<offset_t> raw_pages;
+  for (page_id_t id = 0; id < m_directory.page_id_end(); ++id) {
+    const auto entry = m_directory.find(id);
+    if (!entry.has_value()) continue;
+
+    const auto offset = slot_offset(entry.value());
+    if (slot_units(entry.value()) == SLOT_UNITS_PER_PAGE) {
+      raw_pages.insert(offset);
+      continue;
+    }
+
+    auto &[units, used] = chunks[chunk_of(offset)];
+    units = slot_units(entry.value());
+    used.push_back(offset);
+  }
+
+  for (const auto &[chunk, usage] : chunks) {
+    const auto &[units, used] = usage;
+    const auto index = class_index(units);
+    if (index == SLOT_CLASSES.size())
+      throw std::runtime_error("The db file has an unknown slot size!");
+
+    m_chunk_usage[chunk] = used.size();
+    for (std::size_t unit = 0; unit < SLOT_UNITS_PER_PAGE; unit += units) {
+      const auto offset = chunk + unit * COMPRESSED_SLOT_UNIT;
+      if (std::find(used.begin(), used.end(), offset) == used.end())
+        m_free_slots[index].insert(offset);
+    }
+  }
+
+  // Chunks and raw pages given up since the last sync() are still
+  // allocated on disk after a crash, nothing points at them anymore though.
+  std::size_t leaked_spots = 0;
+  for (const auto offset : m_directory.allocated_offsets()) {
+    if (chunks.contains(offset) || raw_pages.contains(offset)) continue;
+    m_directory.free_offset(offset);
+    ++leaked_spots;
+  }
+  if (leaked_spots > 0)
+    spdlog::info("Freed {} spots no page was stored in", leaked_spots);
+}
+
+bool disk_manager_compressed::load_slot_map() {
+  std::vector<offset_t> pages;
+  std::vector<offset_t> entries;
+  char *page = page_buffer();
+  for (auto offset = m_directory.slot_map_offset(); offset != 0;) {
+    // a torn chain may well loop
+    if (offset % PAGE_SIZE != 0 || offset >= m_directory.end_offset() ||
+        pages.size() * PAGE_SIZE >= m_directory.end_offset())
+      return false;
+    if (read_fully(m_db_fd, page, PAGE_SIZE, offset) != PAGE_SIZE)
+      return false;
+
+    page_trailer trailer;
+    std::memcpy(&trailer, page + PAGE_USABLE_SIZE, sizeof(trailer));
+    if (trailer.magic != PAGE_TRAILER_MAGIC ||
+        !verify_page(SLOT_MAP_PAGE_ID, page))
+      return false;
+
+    offset_t entry_count;
+    std::memcpy(&entry_count, page + sizeof(offset_t), sizeof(entry_count));
+    if (entry_count > SLOT_MAP_ENTRIES_PER_PAGE) return false;
+
+    pages.push_back(offset);
+    const auto first = entries.size();
+    entries.resize(first + entry_count);
+    std::memcpy(entries.data() + first, page + SLOT_MAP_HEADER_SIZE,
+                entry_count * sizeof(offset_t));
+    std::memcpy(&offset, page, sizeof(offset));
+  }
+
+  for (const auto entry : entries) {
+    const auto units = slot_units(entry);
+    const auto index = class_index(units);
+    if (index == SLOT_CLASSES.size())
+      throw std::runtime_error("The db file has an unknown slot size!");
+
+    const auto offset = slot_offset(entry);
+    m_free_slots[index].insert(offset);
+    --m_chunk_usage.try_emplace(chunk_of(offset), SLOT_UNITS_PER_PAGE / units)
+          .first->second;
+  }
+  m_slot_map_pages = std::move(pages);
+  return true;
+}
+
+void disk_manager_compressed::save_slot_map() {
+  std::vector<offset_t> entries;
+  for (std::size_t index = 0; index < SLOT_CLASSES.size(); ++index) {
+    for (const auto offset : m_free_slots[index])
+      entries.push_back(make_entry(offset, SLOT_CLASSES[index]));
+  }
+
+  // an empty map still says every chunk is full
+  const auto page_count = std::max<std::size_t>(
+      1, (entries.size() + SLOT_MAP_ENTRIES_PER_PAGE - 1) /
+             SLOT_MAP_ENTRIES_PER_PAGE);
+  auto &pages = m_slot_map_pages;
+  while (pages.size() < page_count)
+    pages.push_back(m_directory.allocate_offset(page_kind::index));
+  for (; pages.size() > page_count; pages.pop_back())
+    m_directory.free_offset(pages.back());
+
+  char *page = page_buffer();
+  for (std::size_t i = 0; i < pages.size(); ++i) {
+    const auto first = std::min(i * SLOT_MAP_ENTRIES_PER_PAGE, entries.size());
+    const offset_t entry_count =
+        std::min(SLOT_MAP_ENTRIES_PER_PAGE, entries.size() - first);
+    const offset_t next_offset = i + 1 < pages.size() ? pages[i + 1] : 0;
+
+    std::memset(page, 0, PAGE_SIZE);
+    std::memcpy(page, &next_offset, sizeof(next_offset));
+    std::memcpy(page + sizeof(offset_t), &entry_count, sizeof(entry_count));
+    std::memcpy(page + SLOT_MAP_HEADER_SIZE, entries.data() + first,
+                entry_count * sizeof(offset_t));
+    stamp_page(SLOT_MAP_PAGE_ID, page);
+    if (!write_fully(m_db_fd, page, PAGE_SIZE, pages[i]))
+      throw std::runtime_error("Failed to write the slot map!");
+  }
+  m_directory.set_slot_map_offset(pages.front());
+}
+
+std::size_t disk_manager_compressed::class_index(std::size_t units) {
+  return static_cast<std::size_t>(
+      std::find(SLOT_CLASSES.begin(), SLOT_CLASSES.end(), units) -
+      SLOT_CLASSES.begin());
+}
+
+offset_t disk_manager_compressed::allocate_slot(std::size_t units) {
+  if (units == SLOT_UNITS_PER_PAGE)
+    return m_directory.allocate_offset(page_kind::table);
+
+  auto &free_slots = m_free_slots[class_index(units)];
+  if (!free_slots.empty()) {
+    // lowest first, keeps the pages of a chunk together
+    const auto offset = *free_slots.begin();
+    free_slots.erase(free_slots.begin());
+    ++m_chunk_usage[chunk_of(offset)];
+    return offset;
+  }
+
+  const auto chunk = m_directory.allocate_offset(page_kind::table);
+  for (auto unit = units; unit < SLOT_UNITS_PER_PAGE; unit += units)
+    free_slots.insert(chunk + unit * COMPRESSED_SLOT_UNIT);
+  m_chunk_usage[chunk] = 1;
+  return chunk;
+}
+
+void disk_manager_compressed::free_slot(offset_t entry) {
+  const auto offset = slot_offset(entry);
+  const auto units = slot_units(entry);
+  if (units == SLOT_UNITS_PER_PAGE) {
+    m_directory.free_offset(offset);
+    return;
+  }
+
+  auto &free_slots = m_free_slots[class_index(units)];
+  const auto chunk = chunk_of(offset);
+  // chunks the slot map didn't list are full
+  auto usage =
+      m_chunk_usage.try_emplace(chunk, SLOT_UNITS_PER_PAGE / units).first;
+  if (--usage->second > 0) {
+    free_slots.insert(offset);
+    return;
+  }
+
+  // the whole chunk is free, give it back to the directory
+  m_chunk_usage.erase(usage);
+  free_slots.erase(free_slots.lower_bound(chunk),
+                   free_slots.lower_bound(chunk + PAGE_SIZE));
+  m_directory.free_offset(chunk);
+}
+
+void disk_manager_compressed::write_page(page_id_t id, const char *buffer) {
+  if (id < 0)
+    throw std::runtime_error("Invalid id detected!: " + std::to_string(id));
+
+  // stamped before compressing so the checksum also covers the codec
+  char *page = page_buffer();
+  std::memcpy(page, buffer, PAGE_USABLE_SIZE);
+  stamp_page(id, page);
+
+  char *slot = slot_buffer();
+  const auto max_compressed_size =
+      SLOT_CLASSES.back() * COMPRESSED_SLOT_UNIT - sizeof(compressed_size_t);
+  const auto compressed_size =
+      compress_block(page, PAGE_SIZE, slot + sizeof(compressed_size_t),
+                     max_compressed_size);
+
+  // doesn't pay, store it raw
+  std::size_t units = SLOT_UNITS_PER_PAGE;
+  const char *data = page;
+  if (compressed_size > 0) {
+    const auto stored_size = compressed_size + sizeof(compressed_size_t);
+    units = *std::find_if(SLOT_CLASSES.begin(), SLOT_CLASSES.end(),
+                          [stored_size](std::size_t slot_class) {
+                            return slot_class * COMPRESSED_SLOT_UNIT >=
+                                   stored_size;
+                          });
+    const auto size = static_cast<compressed_size_t>(compressed_size);
+    std::memcpy(slot, &size, sizeof(size));
+    data = slot;
+  }
+
+  offset_t offset;
+  bool is_moving = false;
+  {
+    std::scoped_lock sl{m_directory_latch};
+    const auto existing_entry = m_directory.find(id);
+    if (existing_entry.has_value() &&
+        slot_units(existing_entry.value()) == units) {
+      offset = slot_offset(existing_entry.value());
+    } else {
+      offset = allocate_slot(units);
+      is_moving = true;
+    }
+  }
+
+  // A moved page is only pointed at its new slot once the slot holds it,
+  // a sync() in between must not make the directory point at garbage.
+  if (!write_fully(m_db_fd, data, units * COMPRESSED_SLOT_UNIT, offset)) {
+    if (is_moving) {
+      std::scoped_lock sl{m_directory_latch};
+      free_slot(make_entry(offset, units));
+    }
+    throw std::runtime_error("Error writing page_id:" + std::to_string(id));
+  }
+
+  if (is_moving) {
+    std::scoped_lock sl{m_directory_latch};
+    // the directory on disk still points there until the next sync()
+    if (const auto existing_entry = m_directory.find(id);
+        existing_entry.has_value())
+      m_pending_free_slots.push_back(existing_entry.value());
+    m_directory.set(id, make_entry(offset, units));
+  }
+
+  if (units == SLOT_UNITS_PER_PAGE) {
+    ++m_raw_pages;
+  } else {
+    ++m_compressed_pages;
+  }
+  m_has_unsynced_writes = true;
+
+  if (m_durability == durability_mode::per_write) sync();
+}
+
+void disk_manager_compressed::read_page(page_id_t id, char *buffer) {
+  if (id < 0)
+    throw std::runtime_error("Invalid id detected!: " + std::to_string(id));
+
+  // a page that was never written reads as zeroes
+  std::unique_lock ul{m_directory_latch};
+  const auto entry = m_directory.find(id);
+  ul.unlock();
+  if (!entry.has_value()) {
+    std::memset(buffer, 0, PAGE_SIZE);
+    return;
+  }
+
+  const auto offset = slot_offset(entry.value());
+  const auto units = slot_units(entry.value());
+  const auto slot_size = units * COMPRESSED_SLOT_UNIT;
+  char *slot = units == SLOT_UNITS_PER_PAGE ? buffer : slot_buffer();
+
+  const auto read_count = read_fully(m_db_fd, slot, slot_size, offset);
+  if (read_count < 0)
+    throw std::runtime_error("Error reading page_id:" + std::to_string(id));
+  std::memset(slot + read_count, 0, slot_size - read_count);
+
+  if (units != SLOT_UNITS_PER_PAGE) {
+    compressed_size_t size;
+    std::memcpy(&size, slot, sizeof(size));
+    if (size + sizeof(size) > slot_size ||
+        !decompress_block(slot + sizeof(size), size, buffer, PAGE_SIZE)) {
+      throw std::runtime_error("Corrupted compressed page_id:" +
+                               std::to_string(id));
+    }
+  }
+
+  if (!verify_page(id, buffer, PAGE_SIZE,
+                   m_directory.features() & PAGE_FEATURE_CHECKSUMS))
+    throw std::runtime_error("Checksum mismatch on page_id:" +
+                             std::to_string(id));
+}
+
+void disk_manager_compressed::delete_page(page_id_t id) {
+  if (id < 0)
+    throw std::runtime_error("Invalid id detected!: " + std::to_string(id));
+
+  std::scoped_lock sl{m_directory_latch};
+  if (id >= m_directory.page_id_end())
+    throw std::runtime_error("Invalid id detected!: " + std::to_string(id));
+
+  // nothing reads a freed slot, so unlike disk_manager we don't zero it
+  if (const auto entry = m_directory.find(id); entry.has_value()) {
+    m_directory.erase(id);
+    m_pending_free_slots.push_back(entry.value());
+  }
+  m_directory.free_page_id(id);
+  m_has_unsynced_writes = true;
+}
+
+page_id_t disk_manager_compressed::allocate_page_id() {
+  std::scoped_lock sl{m_directory_latch};
+  return m_directory.allocate_page_id();
+}
+
+page_id_t disk_manager_compressed::page_id_end() {
+  std::scoped_lock sl{m_directory_latch};
+  return m_directory.page_id_end();
+}
+
+void disk_manager_compressed::sync() {
+  std::vector<offset_t> flushed_slots;
+  {
+    std::scoped_lock sl{m_directory_latch};
+    m_directory.flush();
+    // the directory just written no longer points at these
+    flushed_slots = std::exchange(m_pending_free_slots, {});
+  }
+  if (!m_has_unsynced_writes.exchange(false) && flushed_slots.empty()) return;
+
+  if (fdatasync(m_db_fd) == -1) {
+    m_has_unsynced_writes = true;
+    std::scoped_lock sl{m_directory_latch};
+    m_pending_free_slots.insert(m_pending_free_slots.end(),
+                                flushed_slots.begin(), flushed_slots.end());
+    throw std::runtime_error("Failed to sync the db file! ERRNO: " +
+                             std::to_string(errno));
+  }
+
+  std::scoped_lock sl{m_directory_latch};
+  for (const auto entry : flushed_slots) free_slot(entry);
+}
+
+void disk_manager_compressed::end_batch() {
+  if (m_durability == durability_mode::per_batch) sync();
+}
+
+compression_stats disk_manager_compressed::get_stats() const {
+  return compression_stats{.compressed_pages = m_compressed_pages,
+                           .raw_pages = m_raw_pages};
+}
+}  // namespace hivedb
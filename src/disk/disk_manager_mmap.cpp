@@ -0,0 +1,271 @@
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <disk/disk_manager_mmap.hpp>
+#include <disk/page_checksum.hpp>
+#include <misc/config.hpp>
+#include <stdexcept>
+#include <string>
+
+namespace hivedb {
+namespace {
+int open_db_file(const std::filesystem::path &db_path) {
+  // create the file if it doesn't exist yet
+  const int fd = open(db_path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd == -1) throw std::runtime_error("failed create the file!");
+  return fd;
+}
+
+int to_madvise_advice(access_pattern pattern) {
+  switch (pattern) {
+    case access_pattern::sequential:
+      return MADV_SEQUENTIAL;
+    case access_pattern::random:
+      return MADV_RANDOM;
+    default:
+      return MADV_NORMAL;
+  }
+}
+}  // namespace
+
+disk_manager_mmap::disk_manager_mmap(const std::filesystem::path &db_path,
+                                     access_pattern pattern)
+    : m_db_fd(open_db_file(db_path)),
+      m_db_file_path(db_path),
+      m_directory(m_db_fd.get()),
+      m_access_pattern(pattern) {
+  if (m_directory.features() & PAGE_FEATURE_COMPRESSED) {
+    throw std::runtime_error(
+        "The db file is compressed, open it with disk_manager_compressed!");
+  }
+  if (m_directory.page_size() != static_cast<std::size_t>(PAGE_SIZE)) {
+    throw std::runtime_error("The db file was created with page size " +
+                             std::to_string(m_directory.page_size()) +
+                             ", open it with disk_manager!");
+  }
+
+  struct stat st{};
+  if (fstat(m_db_fd.get(), &st) == -1) {
+    throw std::runtime_error("Failed to fetch the file size! ERRNO: " +
+                             std::to_string(errno));
+  }
+
+  // files grown by older versions may be sparse, fill in their holes too
+  const auto file_size =
+      std::max(static_cast<std::size_t>(st.st_size),
+               m_directory.end_offset() +
+                   PREALLOCATED_EXTENTS * m_directory.extent_size());
+  allocate_file_space(0, file_size);
+  map_file(file_size);
+}
+
+disk_manager_mmap::~disk_manager_mmap() {
+  try {
+    m_directory.flush();
+  } catch (const std::exception &err) {
+    spdlog::error("Failed to flush the page directory: {}", err.what());
+  }
+
+  if (m_mapping) munmap(m_mapping, m_mapping_size);
+}
+
+void disk_manager_mmap::map_file(std::size_t size) {
+  void *mapping = m_mapping == nullptr
+                      ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                             m_db_fd.get(), 0)
+                      : mremap(m_mapping, m_mapping_size, size, MREMAP_MAYMOVE);
+  if (mapping == MAP_FAILED) {
+    throw std::runtime_error("Failed to map the db file! ERRNO: " +
+                             std::to_string(errno));
+  }
+
+  m_mapping = static_cast<char *>(mapping);
+  m_mapping_size = size;
+
+  // hints don't survive a remap to a different address
+  advise(m_access_pattern);
+}
+
+void disk_manager_mmap::advise(access_pattern pattern) {
+  m_access_pattern = pattern;
+  if (madvise(m_mapping, m_mapping_size, to_madvise_advice(pattern)) == -1) {
+    spdlog::warn("madvise failed, ERRNO: {}", errno);
+  }
+}
+
+void disk_manager_mmap::set_access_pattern(access_pattern pattern) {
+  std::unique_lock ul{m_mapping_latch};
+  advise(pattern);
+}
+
+void disk_manager_mmap::read_page(page_id_t id, char *buffer) {
+  if (id < 0)
+    throw std::runtime_error("Invalid id detected!: " + std::to_string(id));
+
+  // a page that was never written reads as zeroes
+  std::unique_lock ul{m_directory_latch};
+  const auto offset = m_directory.find(id);
+  ul.unlock();
+  if (!offset.has_value()) {
+    std::memset(buffer, 0, PAGE_SIZE);
+    return;
+  }
+
+  std::shared_lock sl{m_mapping_latch};
+  if (offset.value() + PAGE_SIZE > m_mapping_size) {
+    throw std::runtime_error(
+        "Offset was bigger (somehow) than file size! offset: " +
+        std::to_string(offset.value()) +
+        " file_size: " + std::to_string(m_mapping_size));
+  }
+
+  std::memcpy(buffer, m_mapping + offset.value(), PAGE_SIZE);
+  sl.unlock();
+
+  if (!verify_page(id, buffer, PAGE_SIZE,
+                   m_directory.features() & PAGE_FEATURE_CHECKSUMS))
+    throw std::runtime_error("Checksum mismatch on page_id:" +
+                             std::to_string(id));
+}
+
+void disk_manager_mmap::write_page(page_id_t id, const char *buffer) {
+  if (id < 0)
+    throw std::runtime_error("Invalid id detected!: " + std::to_string(id));
+
+  offset_t offset;
+  {
+    std::scoped_lock sl{m_directory_latch};
+    const auto existing_offset = m_directory.find(id);
+    if (existing_offset.has_value()) {
+      offset = existing_offset.value();
+    } else {
+      offset = allocate_new_page();
+      m_directory.set(id, offset);
+    }
+  }
+
+  std::shared_lock sl{m_mapping_latch};
+  std::memcpy(m_mapping + offset, buffer, PAGE_USABLE_SIZE);
+  stamp_page(id, m_mapping + offset);
+  m_has_unsynced_writes = true;
+}
+
+void disk_manager_mmap::write_torn_page(page_id_t id, const char *buffer,
+                                        std::size_t size) {
+  if (id < 0)
+    throw std::runtime_error("Invalid id detected!: " + std::to_string(id));
+
+  offset_t offset;
+  {
+    std::scoped_lock sl{m_directory_latch};
+    const auto existing_offset = m_directory.find(id);
+    if (existing_offset.has_value()) {
+      offset = existing_offset.value();
+    } else {
+      offset = allocate_new_page();
+      m_directory.set(id, offset);
+    }
+  }
+
+  std::shared_lock sl{m_mapping_latch};
+  std::memcpy(m_mapping + offset, buffer,
+              std::min(size, static_cast<std::size_t>(PAGE_SIZE)));
+  m_has_unsynced_writes = true;
+}
+
+void disk_manager_mmap::delete_page(page_id_t id) {
+  if (id < 0)
+    throw std::runtime_error("Invalid id detected!: " + std::to_string(id));
+
+  std::unique_lock ul{m_directory_latch};
+  const auto offset = m_directory.find(id);
+  if (!offset.has_value()) {
+    // handed out but never written, only the id has to go back
+    if (id >= m_directory.page_id_end())
+      throw std::runtime_error("Invalid id detected!: " + std::to_string(id));
+    m_directory.free_page_id(id);
+    grow_file_if_needed();
+    return;
+  }
+  ul.unlock();
+
+  {
+    std::shared_lock sl{m_mapping_latch};
+    std::memset(m_mapping + offset.value(), 0, PAGE_SIZE);
+  }
+
+  // only hand the offset out again once we are done writing to it
+  ul.lock();
+  m_directory.erase(id);
+  m_directory.free_offset(offset.value());
+  m_directory.free_page_id(id);
+  grow_file_if_needed();
+  ul.unlock();
+  m_has_unsynced_writes = true;
+}
+
+page_id_t disk_manager_mmap::allocate_page_id() {
+  std::scoped_lock sl{m_directory_latch};
+  return m_directory.allocate_page_id();
+}
+
+page_id_t disk_manager_mmap::page_id_end() {
+  std::scoped_lock sl{m_directory_latch};
+  return m_directory.page_id_end();
+}
+
+void disk_manager_mmap::sync() {
+  {
+    std::scoped_lock sl{m_directory_latch};
+    m_directory.flush();
+  }
+  if (!m_has_unsynced_writes.exchange(false)) return;
+
+  std::shared_lock sl{m_mapping_latch};
+  if (msync(m_mapping, m_mapping_size, MS_SYNC) == -1 ||
+      fdatasync(m_db_fd.get()) == -1) {
+    m_has_unsynced_writes = true;
+    throw std::runtime_error("Failed to sync the db file! ERRNO: " +
+                             std::to_string(errno));
+  }
+}
+
+void disk_manager_mmap::end_batch() {}
+
+offset_t disk_manager_mmap::allocate_new_page() {
+  const auto offset = m_directory.allocate_offset();
+  grow_file_if_needed();
+  return offset;
+}
+
+void disk_manager_mmap::grow_file_if_needed() {
+  // directory pages are handed out from the same space, so go by the end
+  // offset rather than by how many pages we think we have
+  if (m_directory.end_offset() <= m_mapping_size) return;
+
+  const auto file_size =
+      m_directory.end_offset() +
+      PREALLOCATED_EXTENTS * m_directory.extent_size();
+  std::unique_lock ul{m_mapping_latch};
+  allocate_file_space(m_mapping_size, file_size);
+  map_file(file_size);
+}
+
+void disk_manager_mmap::allocate_file_space(std::size_t from,
+                                            std::size_t to) {
+  // unlike fallocate() this writes zeroes where the filesystem can't
+  // preallocate, the mapping must never sit over a hole
+  if (const int err = posix_fallocate(m_db_fd.get(), static_cast<off_t>(from),
+                                      static_cast<off_t>(to - from));
+      err != 0) {
+    throw std::runtime_error("Failed to allocate file space! ERRNO: " +
+                             std::to_string(err));
+  }
+}
+}  // namespace hivedb
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstring>
 #include <disk/disk_manager_mock.hpp>
 #include <misc/config.hpp>
@@ -10,6 +11,8 @@ void disk_manager_mock::read_page(page_id_t id, char *buffer) {
     return;
   }
 
+  std::scoped_lock sl{m_latch};
+
   if (static_cast<decltype(m_mock_file)::size_type>(id) >= m_mock_file.size()) {
     m_mock_file.resize(m_mock_file.size() + 6);
   }
@@ -23,6 +26,8 @@ void disk_manager_mock::write_page(page_id_t id, const char *buffer) {
     return;
   }
 
+  std::scoped_lock sl{m_latch};
+
   if (static_cast<decltype(m_mock_file)::size_type>(id) >= m_mock_file.size()) {
     m_mock_file.resize(m_mock_file.size() + 6);
   }
@@ -31,5 +36,21 @@ void disk_manager_mock::write_page(page_id_t id, const char *buffer) {
   std::memcpy(&page[0], buffer, PAGE_SIZE);
 };
 
+void disk_manager_mock::write_torn_page(page_id_t id, const char *buffer,
+                                        std::size_t size) {
+  if (id < 0) {
+    return;
+  }
+
+  std::scoped_lock sl{m_latch};
+
+  if (static_cast<decltype(m_mock_file)::size_type>(id) >= m_mock_file.size()) {
+    m_mock_file.resize(m_mock_file.size() + 6);
+  }
+
+  auto &page = m_mock_file[id];
+  std::memcpy(&page[0], buffer, std::min(size, page.size()));
+};
+
 void delete_page(page_id_t){};
 }  // namespace hivedb
@@ -0,0 +1,220 @@
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <disk/disk_manager_segmented.hpp>
+#include <disk/file_io.hpp>
+#include <stdexcept>
+#include <string>
+
+namespace hivedb {
+namespace {
+constexpr std::uint64_t SEGMENT_LAYOUT_MAGIC =
+    0x4753424445564948;  // HIVEDBSG
+
+// all the db file holds
+struct segment_layout {
+  std::uint64_t magic;
+  std::uint64_t segment_count;
+  std::int64_t pages_per_segment;
+};
+
+void forward_completion(void *original, const disk_request &, bool is_ok) {
+  static_cast<disk_request *>(original)->complete(is_ok);
+}
+}  // namespace
+
+disk_manager_segmented::disk_manager_segmented(
+    const std::filesystem::path &db_path, segment_options options)
+    : m_db_file_path(db_path), m_options(std::move(options)) {
+  if (m_options.segment_count == 0)
+    throw std::invalid_argument("segment_count must be > 0");
+  if (m_options.pages_per_segment <= 0 ||
+      m_options.pages_per_segment % PAGES_PER_SEGMENT_STRIPE != 0) {
+    throw std::invalid_argument(
+        "pages_per_segment must be a positive multiple of "
+        "PAGES_PER_SEGMENT_STRIPE");
+  }
+
+  check_layout();
+
+  for (std::size_t i = 0; i < m_options.segment_count; ++i) {
+    m_segments.push_back(std::make_unique<disk_manager>(
+        get_segment_path(i), m_options.durability, m_options.mode,
+        m_options.protection));
+  }
+}
+
+void disk_manager_segmented::check_layout() {
+  const int fd = open(m_db_file_path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd == -1) throw std::runtime_error("failed create the file!");
+
+  const segment_layout expected{
+      .magic = SEGMENT_LAYOUT_MAGIC,
+      .segment_count = m_options.segment_count,
+      .pages_per_segment = m_options.pages_per_segment};
+
+  segment_layout layout{};
+  const auto read_count = read_fully(fd, reinterpret_cast<char *>(&layout),
+                                     sizeof(layout), 0);
+  if (read_count == 0) {
+    const bool is_written =
+        write_fully(fd, reinterpret_cast<const char *>(&expected),
+                    sizeof(expected), 0) &&
+        fdatasync(fd) == 0;
+    close(fd);
+    if (!is_written)
+      throw std::runtime_error("Failed to write the segment layout! ERRNO: " +
+                               std::to_string(errno));
+    return;
+  }
+  close(fd);
+
+  if (read_count != static_cast<ssize_t>(sizeof(layout)) ||
+      layout.magic != SEGMENT_LAYOUT_MAGIC) {
+    throw std::runtime_error("The db file isn't a segmented one!");
+  }
+  if (layout.segment_count != expected.segment_count ||
+      layout.pages_per_segment != expected.pages_per_segment) {
+    throw std::runtime_error(
+        "The db file was created with " +
+        std::to_string(layout.segment_count) + " segments of " +
+        std::to_string(layout.pages_per_segment) + " pages!");
+  }
+}
+
+std::filesystem::path disk_manager_segmented::get_segment_path(
+    std::size_t segment) const {
+  const auto directory =
+      m_options.directories.empty()
+          ? m_db_file_path.parent_path()
+          : m_options.directories[segment % m_options.directories.size()];
+  return directory / (m_db_file_path.filename().string() + "." +
+                      std::to_string(segment));
+}
+
+std::size_t disk_manager_segmented::segment_count() const {
+  return m_segments.size();
+}
+
+std::size_t disk_manager_segmented::segment_of(page_id_t id) const {
+  if (id < 0) return 0;
+  return static_cast<std::size_t>(id / PAGES_PER_SEGMENT_STRIPE) %
+         m_options.segment_count;
+}
+
+page_id_t disk_manager_segmented::to_local(page_id_t id) const {
+  if (id < 0)
+    throw std::runtime_error("Invalid id detected!: " + std::to_string(id));
+
+  const auto segment_count = static_cast<page_id_t>(m_options.segment_count);
+  const auto local_id =
+      id / PAGES_PER_SEGMENT_STRIPE / segment_count * PAGES_PER_SEGMENT_STRIPE +
+      id % PAGES_PER_SEGMENT_STRIPE;
+  if (local_id >= m_options.pages_per_segment)
+    throw std::runtime_error("Page id past the end of its segment!: " +
+                             std::to_string(id));
+  return local_id;
+}
+
+page_id_t disk_manager_segmented::to_global(std::size_t segment,
+                                            page_id_t local_id) const {
+  const auto segment_count = static_cast<page_id_t>(m_options.segment_count);
+  const auto stripe = local_id / PAGES_PER_SEGMENT_STRIPE * segment_count +
+                      static_cast<page_id_t>(segment);
+  return stripe * PAGES_PER_SEGMENT_STRIPE +
+         local_id % PAGES_PER_SEGMENT_STRIPE;
+}
+
+void disk_manager_segmented::read_page(page_id_t id, char *buffer) {
+  m_segments[segment_of(id)]->read_page(to_local(id), buffer);
+}
+
+void disk_manager_segmented::write_page(page_id_t id, const char *buffer) {
+  m_segments[segment_of(id)]->write_page(to_local(id), buffer);
+}
+
+void disk_manager_segmented::write_torn_page(page_id_t id, const char *buffer,
+                                             std::size_t size) {
+  m_segments[segment_of(id)]->write_torn_page(to_local(id), buffer, size);
+}
+
+void disk_manager_segmented::delete_page(page_id_t id) {
+  m_segments[segment_of(id)]->delete_page(to_local(id));
+}
+
+page_id_t disk_manager_segmented::allocate_page_id() {
+  std::scoped_lock sl{m_allocation_latch};
+  for (std::size_t attempt = 0; attempt < m_segments.size(); ++attempt) {
+    const auto segment = m_allocation_segment;
+    auto &manager = *m_segments[segment];
+
+    const auto local_id = manager.allocate_page_id();
+    if (local_id >= m_options.pages_per_segment) {
+      // full, give the id back and try the next one
+      manager.delete_page(local_id);
+      m_allocation_segment = (segment + 1) % m_segments.size();
+      continue;
+    }
+
+    if ((local_id + 1) % PAGES_PER_SEGMENT_STRIPE == 0)
+      m_allocation_segment = (segment + 1) % m_segments.size();
+    return to_global(segment, local_id);
+  }
+
+  throw std::runtime_error("Every segment is full!");
+}
+
+page_id_t disk_manager_segmented::page_id_end() {
+  page_id_t end = 0;
+  for (std::size_t segment = 0; segment < m_segments.size(); ++segment) {
+    // a full segment's end may be past its capacity, see allocate_page_id()
+    const auto local_end = std::min(m_segments[segment]->page_id_end(),
+                                    m_options.pages_per_segment);
+    if (local_end > 0)
+      end = std::max(end, to_global(segment, local_end - 1) + 1);
+  }
+  return end;
+}
+
+void disk_manager_segmented::submit_batch(std::span<disk_request> batch) {
+  // the segments see their own page ids, the originals are completed once
+  // the segment is done with the copy
+  std::vector<disk_request> segment_batch;
+  segment_batch.reserve(batch.size());
+
+  for (std::size_t segment = 0; segment < m_segments.size(); ++segment) {
+    segment_batch.clear();
+    for (auto &req : batch) {
+      if (segment_of(req.page_id) != segment) continue;
+
+      try {
+        segment_batch.push_back(disk_request{.type = req.type,
+                                             .data = req.data,
+                                             .page_id = to_local(req.page_id),
+                                             .is_done = std::nullopt,
+                                             .priority = req.priority,
+                                             .on_complete = forward_completion,
+                                             .context = &req});
+      } catch (const std::exception &err) {
+        spdlog::error("Request for page {} failed: {}", req.page_id,
+                      err.what());
+        req.complete(false);
+      }
+    }
+
+    if (!segment_batch.empty()) m_segments[segment]->submit_batch(segment_batch);
+  }
+}
+
+void disk_manager_segmented::sync() {
+  for (auto &segment : m_segments) segment->sync();
+}
+
+void disk_manager_segmented::end_batch() {
+  for (auto &segment : m_segments) segment->end_batch();
+}
+}  // namespace hivedb
@@ -0,0 +1,449 @@
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <disk/disk_manager_uring.hpp>
+#include <disk/page_checksum.hpp>
+#include <misc/config.hpp>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace hivedb {
+namespace {
+int open_db_file(const std::filesystem::path &db_path) {
+  // create the file if it doesn't exist yet
+  const int fd = open(db_path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd == -1) throw std::runtime_error("failed create the file!");
+  return fd;
+}
+
+std::uint32_t *ring_field(void *ring, std::uint32_t offset) {
+  return reinterpret_cast<std::uint32_t *>(static_cast<char *>(ring) + offset);
+}
+
+void store_result(void *is_ok, const disk_request &, bool result) {
+  *static_cast<bool *>(is_ok) = result;
+}
+}  // namespace
+
+disk_manager_uring::disk_manager_uring(const std::filesystem::path &db_path,
+                                       std::uint32_t queue_depth)
+    : m_db_fd(open_db_file(db_path)),
+      m_db_file_path(db_path),
+      m_directory(m_db_fd.get()),
+      m_queue_depth(queue_depth) {
+  if (queue_depth == 0)
+    throw std::invalid_argument("queue_depth must be > 0");
+  if (m_directory.features() & PAGE_FEATURE_COMPRESSED) {
+    throw std::runtime_error(
+        "The db file is compressed, open it with disk_manager_compressed!");
+  }
+  if (m_directory.page_size() != static_cast<std::size_t>(PAGE_SIZE)) {
+    throw std::runtime_error("The db file was created with page size " +
+                             std::to_string(m_directory.page_size()) +
+                             ", open it with disk_manager!");
+  }
+
+  auto first_ring = std::make_unique<ring>();
+  if (first_ring->setup(m_queue_depth)) {
+    m_is_using_uring = true;
+    m_idle_rings.push_back(std::move(first_ring));
+  }
+}
+
+disk_manager_uring::~disk_manager_uring() {
+  try {
+    m_directory.flush();
+  } catch (const std::exception &err) {
+    spdlog::error("Failed to flush the page directory: {}", err.what());
+  }
+}
+
+disk_manager_uring::ring::~ring() {
+  if (sqes) munmap(sqes, sqes_size);
+  if (cq_ring && cq_ring != sq_ring) munmap(cq_ring, cq_ring_size);
+  if (sq_ring) munmap(sq_ring, sq_ring_size);
+  if (ring_fd != -1) close(ring_fd);
+}
+
+bool disk_manager_uring::ring::setup(std::uint32_t depth) {
+  io_uring_params params{};
+  ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, depth, &params));
+  if (ring_fd < 0) {
+    spdlog::warn("io_uring_setup failed (errno {}), using pread/pwrite",
+                 errno);
+    ring_fd = -1;
+    return false;
+  }
+  queue_depth = params.sq_entries;
+
+  sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(__u32);
+  cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+  // newer kernels let us map both rings with a single mmap
+  const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap)
+    sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+
+  sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+  if (sq_ring == MAP_FAILED) {
+    sq_ring = nullptr;
+    throw std::runtime_error("failed to mmap the io_uring submission ring");
+  }
+
+  if (single_mmap) {
+    cq_ring = sq_ring;
+  } else {
+    cq_ring = mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+    if (cq_ring == MAP_FAILED) {
+      cq_ring = nullptr;
+      throw std::runtime_error("failed to mmap the io_uring completion ring");
+    }
+  }
+
+  sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+  void *mapped_sqes = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+  if (mapped_sqes == MAP_FAILED)
+    throw std::runtime_error("failed to mmap the io_uring sqes");
+  sqes = static_cast<io_uring_sqe *>(mapped_sqes);
+
+  sq_head = ring_field(sq_ring, params.sq_off.head);
+  sq_tail = ring_field(sq_ring, params.sq_off.tail);
+  sq_mask = ring_field(sq_ring, params.sq_off.ring_mask);
+  sq_array = ring_field(sq_ring, params.sq_off.array);
+
+  cq_head = ring_field(cq_ring, params.cq_off.head);
+  cq_tail = ring_field(cq_ring, params.cq_off.tail);
+  cq_mask = ring_field(cq_ring, params.cq_off.ring_mask);
+  cqes = reinterpret_cast<io_uring_cqe *>(static_cast<char *>(cq_ring) +
+                                          params.cq_off.cqes);
+  return true;
+}
+
+void disk_manager_uring::ring::queue(std::uint8_t opcode, int fd,
+                                    offset_t offset, void *address,
+                                    std::uint32_t length,
+                                    std::uint64_t user_data) {
+  // we are the only ones moving the tail, the kernel only reads it
+  const auto tail = *sq_tail;
+  const auto index = tail & *sq_mask;
+
+  auto &sqe = sqes[index];
+  std::memset(&sqe, 0, sizeof(sqe));
+  sqe.opcode = opcode;
+  sqe.fd = fd;
+  sqe.off = offset;
+  sqe.addr = reinterpret_cast<__u64>(address);
+  sqe.len = length;
+  sqe.user_data = user_data;
+
+  sq_array[index] = index;
+  std::atomic_ref{*sq_tail}.store(tail + 1, std::memory_order_release);
+}
+
+void disk_manager_uring::ring::enter(std::uint32_t to_submit,
+                                     std::uint32_t min_complete) {
+  while (true) {
+    const auto flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0u;
+    const auto ret = syscall(__NR_io_uring_enter, ring_fd, to_submit,
+                             min_complete, flags, nullptr, 0);
+    if (ret < 0 && errno == EINTR) continue;
+    if (ret < 0)
+      throw std::runtime_error("io_uring_enter failed! ERRNO: " +
+                               std::to_string(errno));
+
+    // the kernel may consume fewer SQEs than asked, the rest are still
+    // sitting in the ring so just go again for them
+    const auto submitted = static_cast<std::uint32_t>(ret);
+    if (submitted >= to_submit) return;
+    to_submit -= submitted;
+  }
+}
+
+template <typename F>
+std::uint32_t disk_manager_uring::ring::reap(F &&on_complete) {
+  auto head = *cq_head;
+  const auto tail = std::atomic_ref{*cq_tail}.load(std::memory_order_acquire);
+
+  std::uint32_t reaped = 0;
+  while (head != tail) {
+    const auto &cqe = cqes[head & *cq_mask];
+    on_complete(cqe.user_data, cqe.res);
+    ++head;
+    ++reaped;
+  }
+
+  std::atomic_ref{*cq_head}.store(head, std::memory_order_release);
+  return reaped;
+}
+
+std::unique_ptr<disk_manager_uring::ring> disk_manager_uring::acquire_ring() {
+  if (!m_is_using_uring) return nullptr;
+  {
+    std::scoped_lock sl{m_rings_latch};
+    if (!m_idle_rings.empty()) {
+      auto idle_ring = std::move(m_idle_rings.back());
+      m_idle_rings.pop_back();
+      return idle_ring;
+    }
+  }
+
+  // every ring is busy with another batch, this one gets a new one
+  auto new_ring = std::make_unique<ring>();
+  if (!new_ring->setup(m_queue_depth)) return nullptr;
+  return new_ring;
+}
+
+void disk_manager_uring::release_ring(std::unique_ptr<ring> idle_ring) {
+  std::scoped_lock sl{m_rings_latch};
+  m_idle_rings.push_back(std::move(idle_ring));
+}
+
+offset_t disk_manager_uring::find_or_allocate(page_id_t id) {
+  if (const auto offset = m_directory.find(id); offset.has_value())
+    return offset.value();
+
+  const auto offset = m_directory.allocate_offset();
+  m_directory.set(id, offset);
+  return offset;
+}
+
+void disk_manager_uring::submit_batch(std::span<disk_request> batch) {
+  for (const auto &req : batch) {
+    if (req.page_id < 0)
+      throw std::runtime_error("Invalid id detected!: " +
+                               std::to_string(req.page_id));
+    if (!is_read_request(req.type) && req.type != disk_request_type::write)
+      throw std::invalid_argument("invalid request type");
+  }
+
+  // Where each request goes. Writes take their trailer from here rather
+  // than stamping it into the caller's buffer.
+  struct pending_io {
+    offset_t offset;
+    page_trailer trailer;
+    std::array<iovec, 2> buffers;
+  };
+  std::vector<pending_io> pending(batch.size());
+  bool has_writes = false;
+  {
+    std::scoped_lock sl{m_directory_latch};
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+      const auto &req = batch[i];
+      if (req.type == disk_request_type::write) {
+        pending[i].offset = find_or_allocate(req.page_id);
+        has_writes = true;
+      } else {
+        pending[i].offset = m_directory.find(req.page_id).value_or(0);
+      }
+    }
+  }
+
+  const bool is_trailer_required =
+      m_directory.features() & PAGE_FEATURE_CHECKSUMS;
+  const auto finish_read = [&](disk_request &req, std::size_t read_count) {
+    // reading past the end of the file means the page was never written
+    std::memset(req.data + read_count, 0, PAGE_SIZE - read_count);
+    if (!verify_page(req.page_id, req.data, PAGE_SIZE, is_trailer_required)) {
+      spdlog::error("Checksum mismatch on page_id:{}", req.page_id);
+      req.complete(false);
+      return;
+    }
+    req.complete(true);
+  };
+  const auto write_synchronously = [this](pending_io &io) {
+    // write_fully() clobbers the iovecs
+    auto buffers = io.buffers;
+    return write_fully(m_db_fd.get(), buffers, io.offset);
+  };
+
+  std::vector<std::size_t> to_queue;
+  to_queue.reserve(batch.size());
+  for (std::size_t i = 0; i < batch.size(); ++i) {
+    auto &req = batch[i];
+    auto &io = pending[i];
+    if (req.type == disk_request_type::write) {
+      io.trailer = make_page_trailer(req.page_id, req.data);
+      io.buffers = {iovec{.iov_base = req.data, .iov_len = PAGE_USABLE_SIZE},
+                    iovec{.iov_base = &io.trailer,
+                          .iov_len = sizeof(io.trailer)}};
+    } else if (io.offset == 0) {
+      // a page that was never written reads as zeroes
+      std::memset(req.data, 0, PAGE_SIZE);
+      req.complete(true);
+      continue;
+    }
+    to_queue.push_back(i);
+  }
+
+  auto batch_ring = acquire_ring();
+  if (!batch_ring) {
+    for (const auto index : to_queue) {
+      auto &req = batch[index];
+      if (req.type == disk_request_type::write) {
+        req.complete(write_synchronously(pending[index]));
+        continue;
+      }
+
+      const auto read_count =
+          read_fully(m_db_fd.get(), req.data, PAGE_SIZE, pending[index].offset);
+      if (read_count < 0) {
+        req.complete(false);
+      } else {
+        finish_read(req, static_cast<std::size_t>(read_count));
+      }
+    }
+    if (has_writes) m_has_unsynced_writes = true;
+    return;
+  }
+
+  // if anything below throws the ring still has requests in flight, it is
+  // dropped rather than handed to the next batch
+  std::size_t next = 0;
+  std::uint32_t in_flight = 0;
+  while (next < to_queue.size() || in_flight > 0) {
+    std::uint32_t queued = 0;
+    while (next < to_queue.size() &&
+           in_flight + queued < batch_ring->queue_depth) {
+      const auto index = to_queue[next];
+      auto &req = batch[index];
+      auto &io = pending[index];
+      if (req.type == disk_request_type::write) {
+        batch_ring->queue(IORING_OP_WRITEV, m_db_fd.get(), io.offset,
+                          io.buffers.data(),
+                          static_cast<std::uint32_t>(io.buffers.size()),
+                          index);
+      } else {
+        batch_ring->queue(IORING_OP_READ, m_db_fd.get(), io.offset, req.data,
+                          PAGE_SIZE, index);
+      }
+      ++next;
+      ++queued;
+    }
+
+    batch_ring->enter(queued, 1);
+    in_flight += queued;
+
+    in_flight -= batch_ring->reap([&](std::uint64_t index, std::int32_t res) {
+      auto &req = batch[index];
+      if (res < 0) {
+        spdlog::error("io_uring request for page {} failed: {}", req.page_id,
+                      std::strerror(-res));
+        req.complete(false);
+        return;
+      }
+
+      const auto done = static_cast<std::size_t>(res);
+      if (is_read_request(req.type)) {
+        finish_read(req, done);
+        return;
+      }
+      // a short write, go again for the whole page
+      req.complete(done == PAGE_SIZE || write_synchronously(pending[index]));
+    });
+  }
+
+  release_ring(std::move(batch_ring));
+  if (has_writes) m_has_unsynced_writes = true;
+}
+
+void disk_manager_uring::read_page(page_id_t id, char *buffer) {
+  // submit_batch() only returns once the request completed
+  bool is_ok = false;
+  disk_request req{.type = disk_request_type::read,
+                   .data = buffer,
+                   .page_id = id,
+                   .is_done = std::nullopt,
+                   .on_complete = store_result,
+                   .context = &is_ok};
+  submit_batch(std::span{&req, 1});
+
+  if (!is_ok)
+    throw std::runtime_error("Error reading page_id:" + std::to_string(id));
+}
+
+void disk_manager_uring::write_page(page_id_t id, const char *buffer) {
+  // the buffer of a write request is only ever read from
+  bool is_ok = false;
+  disk_request req{.type = disk_request_type::write,
+                   .data = const_cast<char *>(buffer),
+                   .page_id = id,
+                   .is_done = std::nullopt,
+                   .on_complete = store_result,
+                   .context = &is_ok};
+  submit_batch(std::span{&req, 1});
+
+  if (!is_ok)
+    throw std::runtime_error("Error writing page_id:" + std::to_string(id));
+}
+
+void disk_manager_uring::delete_page(page_id_t id) {
+  if (id < 0)
+    throw std::runtime_error("Invalid id detected!: " + std::to_string(id));
+
+  std::unique_lock ul{m_directory_latch};
+  const auto offset = m_directory.find(id);
+  if (!offset.has_value()) {
+    // handed out but never written, only the id has to go back
+    if (id >= m_directory.page_id_end())
+      throw std::runtime_error("Invalid id detected!: " + std::to_string(id));
+    m_directory.free_page_id(id);
+    return;
+  }
+  ul.unlock();
+
+  static constexpr std::array<char, PAGE_SIZE> zeroed_page{};
+  if (!write_fully(m_db_fd.get(), zeroed_page.data(), PAGE_SIZE,
+                   offset.value()))
+    throw std::runtime_error("Error deleting page_id:" + std::to_string(id));
+
+  // only hand the offset out again once we are done writing to it
+  ul.lock();
+  m_directory.erase(id);
+  m_directory.free_offset(offset.value());
+  m_directory.free_page_id(id);
+  ul.unlock();
+  m_has_unsynced_writes = true;
+}
+
+page_id_t disk_manager_uring::allocate_page_id() {
+  std::scoped_lock sl{m_directory_latch};
+  return m_directory.allocate_page_id();
+}
+
+page_id_t disk_manager_uring::page_id_end() {
+  std::scoped_lock sl{m_directory_latch};
+  return m_directory.page_id_end();
+}
+
+void disk_manager_uring::sync() {
+  {
+    std::scoped_lock sl{m_directory_latch};
+    m_directory.flush();
+  }
+  if (!m_has_unsynced_writes.exchange(false)) return;
+
+  if (fdatasync(m_db_fd.get()) == -1) {
+    m_has_unsynced_writes = true;
+    throw std::runtime_error("Failed to sync the db file! ERRNO: " +
+                             std::to_string(errno));
+  }
+}
+
+void disk_manager_uring::end_batch() {}
+
+bool disk_manager_uring::is_using_uring() const { return m_is_using_uring; }
+}  // namespace hivedb
@@ -0,0 +1,208 @@
+#include <algorithm>
+#include <bit>
+#include <iterator>
+#include <disk/disk_stats.hpp>
+#include <misc/cycle_clock.hpp>
+
+namespace hivedb {
+namespace {
+constexpr std::size_t SUB_BUCKET_BITS = std::countr_zero(LATENCY_SUB_BUCKETS);
+
+// the single writer's increment, no need for a locked add
+void add(std::atomic<std::uint64_t> &counter, std::uint64_t value) {
+  counter.store(counter.load(std::memory_order_relaxed) + value,
+                std::memory_order_relaxed);
+}
+
+std::atomic<std::uint64_t> next_stats_id{1};
+
+std::chrono::nanoseconds to_nanoseconds(double ticks,
+                                        double nanoseconds_per_tick) {
+  return std::chrono::nanoseconds{
+      static_cast<std::int64_t>(ticks * nanoseconds_per_tick)};
+}
+}  // namespace
+
+std::size_t latency_histogram::bucket_of(std::uint64_t value) {
+  if (value < LATENCY_SUB_BUCKETS) return value;
+
+  // the top SUB_BUCKET_BITS + 1 bits pick the bucket
+  const auto exponent = static_cast<std::size_t>(std::bit_width(value)) - 1;
+  const auto sub_bucket =
+      (value >> (exponent - SUB_BUCKET_BITS)) & (LATENCY_SUB_BUCKETS - 1);
+  return (exponent - SUB_BUCKET_BITS + 1) * LATENCY_SUB_BUCKETS + sub_bucket;
+}
+
+std::uint64_t latency_histogram::bucket_start(std::size_t bucket) {
+  if (bucket < LATENCY_SUB_BUCKETS) return bucket;
+
+  const auto exponent = bucket / LATENCY_SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+  const auto sub_bucket = bucket % LATENCY_SUB_BUCKETS;
+  return (LATENCY_SUB_BUCKETS + sub_bucket) << (exponent - SUB_BUCKET_BITS);
+}
+
+void latency_histogram::record(std::uint64_t ticks) {
+  add(m_buckets[bucket_of(ticks)], 1);
+  add(m_total_ticks, ticks);
+}
+
+latency_snapshot latency_histogram::snapshot() const {
+  latency_snapshot snapshot{};
+  snapshot.nanoseconds_per_tick = cycle_clock::nanoseconds_per_tick();
+  add_to(snapshot);
+  return snapshot;
+}
+
+void latency_histogram::add_to(latency_snapshot &snapshot) const {
+  for (std::size_t bucket = 0; bucket < LATENCY_BUCKET_COUNT; ++bucket) {
+    const auto count = m_buckets[bucket].load(std::memory_order_relaxed);
+    snapshot.buckets[bucket] += count;
+    snapshot.count += count;
+  }
+  snapshot.total += to_nanoseconds(
+      static_cast<double>(m_total_ticks.load(std::memory_order_relaxed)),
+      snapshot.nanoseconds_per_tick);
+}
+
+std::chrono::nanoseconds latency_snapshot::percentile(double p) const {
+  if (count == 0) return std::chrono::nanoseconds{0};
+
+  const auto rank = std::max<std::uint64_t>(
+      1, static_cast<std::uint64_t>(std::clamp(p, 0.0, 1.0) *
+                                    static_cast<double>(count)));
+  std::uint64_t seen = 0;
+  for (std::size_t bucket = 0; bucket < LATENCY_BUCKET_COUNT; ++bucket) {
+    seen += buckets[bucket];
+    if (seen < rank) continue;
+
+    const auto end = bucket + 1 < LATENCY_BUCKET_COUNT
+                         ? latency_histogram::bucket_start(bucket + 1)
+                         : latency_histogram::bucket_start(bucket);
+    return to_nanoseconds(static_cast<double>(end), nanoseconds_per_tick);
+  }
+  return to_nanoseconds(
+      static_cast<double>(
+          latency_histogram::bucket_start(LATENCY_BUCKET_COUNT - 1)),
+      nanoseconds_per_tick);
+}
+
+std::chrono::nanoseconds latency_snapshot::mean() const {
+  if (count == 0) return std::chrono::nanoseconds{0};
+  return total / count;
+}
+
+const request_type_snapshot &disk_stats_snapshot::get(
+    disk_request_type type) const {
+  return types[static_cast<std::size_t>(type)];
+}
+
+double disk_stats_snapshot::bytes_per_second() const {
+  return bytes_per_second(disk_stats_snapshot{});
+}
+
+double disk_stats_snapshot::bytes_per_second(
+    const disk_stats_snapshot &earlier) const {
+  const auto elapsed =
+      std::chrono::duration<double>(uptime - earlier.uptime).count();
+  if (elapsed <= 0) return 0;
+
+  const auto bytes = (bytes_read - earlier.bytes_read) +
+                     (bytes_written - earlier.bytes_written);
+  return static_cast<double>(bytes) / elapsed;
+}
+
+disk_stats::disk_stats(std::size_t page_size)
+    : m_id(next_stats_id.fetch_add(1)),
+      m_created_at(cycle_clock::now()),
+      m_page_size(page_size) {}
+
+disk_stats::shard &disk_stats::local_shard() {
+  // a thread mostly records into a single disk_stats
+  thread_local std::uint64_t cached_id = 0;
+  thread_local shard *cached_shard = nullptr;
+  if (cached_id == m_id) return *cached_shard;
+
+  std::scoped_lock sl{m_shards_latch};
+  const auto owner = std::this_thread::get_id();
+  auto it = std::find_if(m_shards.begin(), m_shards.end(),
+                         [owner](const auto &s) { return s->owner == owner; });
+  if (it == m_shards.end()) {
+    m_shards.push_back(std::make_unique<shard>());
+    m_shards.back()->owner = owner;
+    it = std::prev(m_shards.end());
+  }
+
+  cached_id = m_id;
+  cached_shard = it->get();
+  return *cached_shard;
+}
+
+void disk_stats::record_enqueue() {
+  const auto depth = m_queue_depth.fetch_add(1, std::memory_order_relaxed) + 1;
+  // only a new high pays for the compare and swap
+  auto max_depth = m_max_queue_depth.load(std::memory_order_relaxed);
+  while (depth > max_depth && !m_max_queue_depth.compare_exchange_weak(
+                                  max_depth, depth, std::memory_order_relaxed)) {
+  }
+}
+
+void disk_stats::record_dispatch(std::size_t count) {
+  m_queue_depth.fetch_sub(count, std::memory_order_relaxed);
+}
+
+void record_completion(disk_stats &stats, const disk_request &req,
+                       bool is_ok) {
+  const auto now = cycle_clock::now();
+  auto &shard = stats.local_shard();
+  auto &type_stats = shard.types[static_cast<std::size_t>(req.type)];
+  if (!is_ok) {
+    add(type_stats.failed, 1);
+    return;
+  }
+
+  add(type_stats.completed, 1);
+  type_stats.queue_time.record(req.dispatched_at - req.enqueued_at);
+  type_stats.device_time.record(now - req.dispatched_at);
+
+  if (is_read_request(req.type)) {
+    add(shard.bytes_read, stats.m_page_size);
+  } else if (req.type == disk_request_type::write) {
+    add(shard.bytes_written, stats.m_page_size);
+  }
+}
+
+disk_stats_snapshot disk_stats::snapshot() const {
+  disk_stats_snapshot snapshot{};
+  const auto nanoseconds_per_tick = cycle_clock::nanoseconds_per_tick();
+  for (auto &type_snapshot : snapshot.types) {
+    type_snapshot.queue_time.nanoseconds_per_tick = nanoseconds_per_tick;
+    type_snapshot.device_time.nanoseconds_per_tick = nanoseconds_per_tick;
+  }
+
+  {
+    std::scoped_lock sl{m_shards_latch};
+    for (const auto &shard : m_shards) {
+      for (std::size_t type = 0; type < DISK_REQUEST_TYPE_COUNT; ++type) {
+        const auto &type_stats = shard->types[type];
+        auto &type_snapshot = snapshot.types[type];
+        type_snapshot.completed +=
+            type_stats.completed.load(std::memory_order_relaxed);
+        type_snapshot.failed +=
+            type_stats.failed.load(std::memory_order_relaxed);
+        type_stats.queue_time.add_to(type_snapshot.queue_time);
+        type_stats.device_time.add_to(type_snapshot.device_time);
+      }
+      snapshot.bytes_read += shard->bytes_read.load(std::memory_order_relaxed);
+      snapshot.bytes_written +=
+          shard->bytes_written.load(std::memory_order_relaxed);
+    }
+  }
+
+  snapshot.queue_depth = m_queue_depth.load(std::memory_order_relaxed);
+  snapshot.max_queue_depth = m_max_queue_depth.load(std::memory_order_relaxed);
+  snapshot.uptime = to_nanoseconds(
+      static_cast<double>(cycle_clock::now() - m_created_at),
+      nanoseconds_per_tick);
+  return snapshot;
+}
+}  // namespace hivedb
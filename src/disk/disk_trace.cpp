@@ -0,0 +1,148 @@
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <disk/disk_trace.hpp>
+#include <disk/file_io.hpp>
+#include <limits>
+#include <misc/cycle_clock.hpp>
+#include <stdexcept>
+
+namespace hivedb {
+namespace {
+constexpr std::array<char, 8> TRACE_MAGIC{'H', 'I', 'V', 'E', 'T', 'R', 'C', 'E'};
+
+struct trace_header {
+  std::array<char, 8> magic;
+  std::uint32_t version;
+  std::uint32_t record_size;
+};
+
+std::uint32_t to_nanoseconds(std::uint64_t ticks, double nanoseconds_per_tick) {
+  const auto nanoseconds = static_cast<double>(ticks) * nanoseconds_per_tick;
+  return nanoseconds >= std::numeric_limits<std::uint32_t>::max()
+             ? std::numeric_limits<std::uint32_t>::max()
+             : static_cast<std::uint32_t>(nanoseconds);
+}
+}  // namespace
+
+disk_trace_writer::disk_trace_writer(const std::filesystem::path &path)
+    : m_started_at(cycle_clock::now()),
+      m_nanoseconds_per_tick(cycle_clock::nanoseconds_per_tick()) {
+  m_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (m_fd == -1)
+    throw std::runtime_error("failed to create the trace file " +
+                             path.string());
+
+  const trace_header header{.magic = TRACE_MAGIC,
+                            .version = DISK_TRACE_VERSION,
+                            .record_size = sizeof(disk_trace_record)};
+  if (!write_fully(m_fd, reinterpret_cast<const char *>(&header),
+                   sizeof(header), 0)) {
+    close(m_fd);
+    throw std::runtime_error("failed to write the trace header!");
+  }
+  m_end = sizeof(header);
+  m_buffer.reserve(DISK_TRACE_BUFFER_RECORDS);
+}
+
+disk_trace_writer::~disk_trace_writer() {
+  flush();
+  close(m_fd);
+}
+
+void disk_trace_writer::record(const disk_request &req, bool is_ok) {
+  const auto now = cycle_clock::now();
+  const auto enqueued_at = std::max(req.enqueued_at, m_started_at);
+  const auto dispatched_at = std::max(req.dispatched_at, enqueued_at);
+
+  disk_trace_record record{
+      .enqueued_at = static_cast<std::uint64_t>(
+          static_cast<double>(enqueued_at - m_started_at) *
+          m_nanoseconds_per_tick),
+      .queue_time =
+          to_nanoseconds(dispatched_at - enqueued_at, m_nanoseconds_per_tick),
+      .device_time = to_nanoseconds(now - std::min(now, dispatched_at),
+                                    m_nanoseconds_per_tick),
+      .page_id = req.page_id,
+      .type = static_cast<std::uint8_t>(req.type),
+      .priority = static_cast<std::uint8_t>(req.priority),
+      .is_ok = is_ok};
+
+  std::scoped_lock sl{m_latch};
+  m_buffer.push_back(record);
+  ++m_record_count;
+  if (m_buffer.size() >= DISK_TRACE_BUFFER_RECORDS) write_buffer();
+}
+
+void disk_trace_writer::write_buffer() {
+  if (m_buffer.empty()) return;
+
+  const auto size = m_buffer.size() * sizeof(disk_trace_record);
+  // runs on a worker, losing part of a trace is no reason to fail a request
+  if (!write_fully(m_fd, reinterpret_cast<const char *>(m_buffer.data()),
+                   size, m_end)) {
+    spdlog::error("Failed to write {} trace records", m_buffer.size());
+  } else {
+    m_end += size;
+  }
+  m_buffer.clear();
+}
+
+void disk_trace_writer::flush() {
+  std::scoped_lock sl{m_latch};
+  write_buffer();
+}
+
+std::size_t disk_trace_writer::record_count() {
+  std::scoped_lock sl{m_latch};
+  return m_record_count;
+}
+
+void record_trace(disk_trace_writer &trace, const disk_request &req,
+                  bool is_ok) {
+  trace.record(req, is_ok);
+}
+
+std::vector<disk_trace_record> read_disk_trace(
+    const std::filesystem::path &path) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd == -1)
+    throw std::runtime_error("failed to open the trace file " + path.string());
+
+  struct stat stat_buffer{};
+  trace_header header{};
+  if (fstat(fd, &stat_buffer) == -1 ||
+      read_fully(fd, reinterpret_cast<char *>(&header), sizeof(header), 0) !=
+          sizeof(header)) {
+    close(fd);
+    throw std::runtime_error("failed to read the trace header!");
+  }
+  if (header.magic != TRACE_MAGIC || header.version != DISK_TRACE_VERSION ||
+      header.record_size != sizeof(disk_trace_record)) {
+    close(fd);
+    throw std::runtime_error(path.string() + " isn't a disk trace!");
+  }
+
+  // a trace cut short by a crash ends in half a record, drop it
+  const auto size = static_cast<std::size_t>(stat_buffer.st_size);
+  std::vector<disk_trace_record> records(
+      (size - sizeof(header)) / sizeof(disk_trace_record));
+  const auto records_size = records.size() * sizeof(disk_trace_record);
+  const auto ret = read_fully(fd, reinterpret_cast<char *>(records.data()),
+                              records_size, sizeof(header));
+  close(fd);
+  if (ret < 0 || static_cast<std::size_t>(ret) != records_size)
+    throw std::runtime_error("failed to read the trace records!");
+
+  std::stable_sort(records.begin(), records.end(),
+                   [](const auto &lhs, const auto &rhs) {
+                     return lhs.enqueued_at < rhs.enqueued_at;
+                   });
+  return records;
+}
+}  // namespace hivedb
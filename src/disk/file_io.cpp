@@ -0,0 +1,77 @@
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <disk/file_io.hpp>
+#include <utility>
+
+namespace hivedb {
+ssize_t read_fully(int fd, char *buffer, std::size_t size, offset_t offset) {
+  std::size_t done = 0;
+  while (done < size) {
+    const auto ret = pread(fd, buffer + done, size - done,
+                           static_cast<off_t>(offset + done));
+    if (ret < 0 && errno == EINTR) continue;
+    if (ret < 0) return -1;
+    if (ret == 0) break;
+    done += ret;
+  }
+  return static_cast<ssize_t>(done);
+}
+
+bool write_fully(int fd, const char *buffer, std::size_t size,
+                 offset_t offset) {
+  std::size_t done = 0;
+  while (done < size) {
+    const auto ret = pwrite(fd, buffer + done, size - done,
+                            static_cast<off_t>(offset + done));
+    if (ret < 0 && errno == EINTR) continue;
+    if (ret <= 0) return false;
+    done += ret;
+  }
+  return true;
+}
+
+bool write_fully(int fd, std::span<iovec> buffers, offset_t offset) {
+  while (!buffers.empty()) {
+    const auto ret = pwritev(fd, buffers.data(),
+                             static_cast<int>(buffers.size()),
+                             static_cast<off_t>(offset));
+    if (ret < 0 && errno == EINTR) continue;
+    if (ret <= 0) return false;
+    offset += ret;
+
+    // skip what made it to the file, the first iovec may be cut in half
+    auto written = static_cast<std::size_t>(ret);
+    while (!buffers.empty() && written >= buffers.front().iov_len) {
+      written -= buffers.front().iov_len;
+      buffers = buffers.subspan(1);
+    }
+    if (written > 0) {
+      buffers.front().iov_base =
+          static_cast<char *>(buffers.front().iov_base) + written;
+      buffers.front().iov_len -= written;
+    }
+  }
+  return true;
+}
+
+file_descriptor::file_descriptor(int fd) : m_fd(fd) {}
+
+file_descriptor::file_descriptor(file_descriptor &&other) noexcept
+    : m_fd(std::exchange(other.m_fd, -1)) {}
+
+file_descriptor &file_descriptor::operator=(file_descriptor &&other) noexcept {
+  if (this == &other) return *this;
+
+  if (m_fd != -1) close(m_fd);
+  m_fd = std::exchange(other.m_fd, -1);
+  return *this;
+}
+
+file_descriptor::~file_descriptor() {
+  if (m_fd != -1) close(m_fd);
+}
+
+int file_descriptor::get() const { return m_fd; }
+}  // namespace hivedb
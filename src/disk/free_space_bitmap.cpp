@@ -0,0 +1,153 @@
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <disk/file_io.hpp>
+#include <disk/free_space_bitmap.hpp>
+#include <misc/aligned_buffer.hpp>
+#include <misc/config.hpp>
+#include <stdexcept>
+#include <string>
+
+namespace hivedb {
+namespace {
+constexpr std::size_t BITS_PER_WORD = 64;
+}  // namespace
+
+free_space_bitmap::free_space_bitmap(int db_fd, std::size_t page_size)
+    : m_db_fd(db_fd),
+      m_page_size(page_size),
+      m_words_per_page((page_size - sizeof(offset_t)) /
+                       sizeof(std::uint64_t)) {}
+
+void free_space_bitmap::load(offset_t first_offset) {
+  for (auto offset = first_offset; offset != 0;
+       offset = m_pages.back().next_offset) {
+    load_page(offset);
+  }
+}
+
+void free_space_bitmap::load_page(offset_t offset) {
+  aligned_buffer buffer{m_page_size};
+  if (read_fully(m_db_fd, buffer.data(), m_page_size, offset) < 0) {
+    throw std::runtime_error("Failed to read bitmap page at offset " +
+                             std::to_string(offset));
+  }
+
+  bitmap_page page{.offset = offset, .next_offset = 0, .is_dirty = false};
+  std::memcpy(&page.next_offset, buffer.data(), sizeof(offset_t));
+  m_pages.push_back(page);
+
+  const auto first_word = m_words.size();
+  m_words.resize(first_word + m_words_per_page);
+  std::memcpy(m_words.data() + first_word, buffer.data() + sizeof(offset_t),
+              m_words_per_page * sizeof(std::uint64_t));
+  for (auto i = first_word; i < m_words.size(); ++i)
+    m_free_count += std::popcount(m_words[i]);
+}
+
+void free_space_bitmap::mark_dirty(std::size_t slot) {
+  m_pages[slot / bits_per_page()].is_dirty = true;
+}
+
+std::optional<std::size_t> free_space_bitmap::take() {
+  if (m_free_count == 0) return std::nullopt;
+
+  while (m_words[m_first_candidate] == 0) ++m_first_candidate;
+
+  auto &word = m_words[m_first_candidate];
+  const auto slot = m_first_candidate * BITS_PER_WORD +
+                    static_cast<std::size_t>(std::countr_zero(word));
+  // clears the lowest set bit
+  word &= word - 1;
+  --m_free_count;
+  mark_dirty(slot);
+  return slot;
+}
+
+void free_space_bitmap::release(std::size_t slot) {
+  if (slot >= capacity())
+    throw std::out_of_range("slot " + std::to_string(slot) +
+                            " is not covered by the bitmap");
+  if (is_free(slot)) return;
+
+  m_words[slot / BITS_PER_WORD] |= std::uint64_t{1} << (slot % BITS_PER_WORD);
+  ++m_free_count;
+  m_first_candidate = std::min(m_first_candidate, slot / BITS_PER_WORD);
+  mark_dirty(slot);
+}
+
+void free_space_bitmap::mark_used(std::size_t slot) {
+  if (slot >= capacity() || !is_free(slot)) return;
+
+  m_words[slot / BITS_PER_WORD] &=
+      ~(std::uint64_t{1} << (slot % BITS_PER_WORD));
+  --m_free_count;
+  mark_dirty(slot);
+}
+
+bool free_space_bitmap::is_free(std::size_t slot) const {
+  if (slot >= capacity()) return false;
+  return (m_words[slot / BITS_PER_WORD] >> (slot % BITS_PER_WORD)) & 1;
+}
+
+std::optional<std::size_t> free_space_bitmap::next_free(
+    std::size_t slot) const {
+  if (slot >= capacity()) return std::nullopt;
+
+  auto index = slot / BITS_PER_WORD;
+  // the bits in front of slot don't count
+  auto word = m_words[index] & (~std::uint64_t{0} << (slot % BITS_PER_WORD));
+  while (word == 0) {
+    if (++index == m_words.size()) return std::nullopt;
+    word = m_words[index];
+  }
+  return index * BITS_PER_WORD +
+         static_cast<std::size_t>(std::countr_zero(word));
+}
+
+std::size_t free_space_bitmap::free_count() const { return m_free_count; }
+
+std::size_t free_space_bitmap::bits_per_page() const {
+  return m_words_per_page * BITS_PER_WORD;
+}
+
+std::size_t free_space_bitmap::capacity() const {
+  return m_words.size() * BITS_PER_WORD;
+}
+
+std::vector<offset_t> free_space_bitmap::page_offsets() const {
+  std::vector<offset_t> offsets;
+  offsets.reserve(m_pages.size());
+  for (const auto &page : m_pages) offsets.push_back(page.offset);
+  return offsets;
+}
+
+void free_space_bitmap::add_page(offset_t offset) {
+  if (!m_pages.empty()) {
+    m_pages.back().next_offset = offset;
+    m_pages.back().is_dirty = true;
+  }
+
+  m_pages.push_back(
+      bitmap_page{.offset = offset, .next_offset = 0, .is_dirty = true});
+  m_words.resize(m_words.size() + m_words_per_page, 0);
+}
+
+void free_space_bitmap::flush() {
+  aligned_buffer buffer{m_page_size};
+  for (std::size_t i = 0; i < m_pages.size(); ++i) {
+    auto &page = m_pages[i];
+    if (!page.is_dirty) continue;
+
+    std::memcpy(buffer.data(), &page.next_offset, sizeof(offset_t));
+    std::memcpy(buffer.data() + sizeof(offset_t),
+                m_words.data() + i * m_words_per_page,
+                m_words_per_page * sizeof(std::uint64_t));
+    if (!write_fully(m_db_fd, buffer.data(), m_page_size, page.offset)) {
+      throw std::runtime_error("Failed to write bitmap page at offset " +
+                               std::to_string(page.offset));
+    }
+    page.is_dirty = false;
+  }
+}
+}  // namespace hivedb
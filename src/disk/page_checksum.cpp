@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <disk/page_checksum.hpp>
+#include <misc/config.hpp>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+namespace hivedb {
+namespace {
+// reflected Castagnoli polynomial
+constexpr std::uint32_t CRC32C_POLYNOMIAL = 0x82f63b78;
+// The hardware path runs three streams of this many bytes side by side.
+// crc32 has a latency of 3 cycles but issues every cycle, so one stream
+// alone leaves two thirds of it idle. Three of them cover everything a
+// page trailer checksums but the last 8 bytes.
+constexpr std::size_t STREAM_SIZE = 1360;
+static_assert(3 * STREAM_SIZE + 8 == PAGE_USABLE_SIZE);
+
+struct crc32c_tables {
+  // slicing by 8, bytes[k][b] is the crc of b followed by k zero bytes
+  std::array<std::array<std::uint32_t, 256>, 8> bytes{};
+  // moves a crc past STREAM_SIZE zero bytes, one byte of it at a time
+  std::array<std::array<std::uint32_t, 256>, 4> shift{};
+
+  crc32c_tables() {
+    for (std::uint32_t b = 0; b < 256; ++b) {
+      auto crc = b;
+      for (int i = 0; i < 8; ++i)
+        crc = (crc >> 1) ^ (CRC32C_POLYNOMIAL & (0 - (crc & 1)));
+      bytes[0][b] = crc;
+    }
+    for (std::size_t k = 1; k < bytes.size(); ++k) {
+      for (std::size_t b = 0; b < 256; ++b) {
+        const auto previous = bytes[k - 1][b];
+        bytes[k][b] = (previous >> 8) ^ bytes[0][previous & 0xff];
+      }
+    }
+
+    // the shift is linear, so work it out for every bit and combine
+    std::array<std::uint32_t, 32> shifted_bits{};
+    for (std::size_t bit = 0; bit < shifted_bits.size(); ++bit) {
+      auto crc = std::uint32_t{1} << bit;
+      for (std::size_t i = 0; i < STREAM_SIZE; ++i)
+        crc = bytes[0][crc & 0xff] ^ (crc >> 8);
+      shifted_bits[bit] = crc;
+    }
+    for (std::size_t k = 0; k < shift.size(); ++k) {
+      for (std::size_t b = 0; b < 256; ++b) {
+        std::uint32_t crc = 0;
+        for (std::size_t bit = 0; bit < 8; ++bit) {
+          if (b & (std::size_t{1} << bit)) crc ^= shifted_bits[8 * k + bit];
+        }
+        shift[k][b] = crc;
+      }
+    }
+  }
+};
+
+const crc32c_tables &tables() {
+  static const crc32c_tables instance;
+  return instance;
+}
+
+// Both work on the raw register, the caller does the inversions.
+std::uint32_t portable_update(std::uint32_t crc, const unsigned char *data,
+                              std::size_t size) {
+  const auto &t = tables().bytes;
+  for (; size >= 8; size -= 8, data += 8) {
+    std::uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+    word ^= crc;
+    crc = t[7][word & 0xff] ^ t[6][(word >> 8) & 0xff] ^
+          t[5][(word >> 16) & 0xff] ^ t[4][(word >> 24) & 0xff] ^
+          t[3][(word >> 32) & 0xff] ^ t[2][(word >> 40) & 0xff] ^
+          t[1][(word >> 48) & 0xff] ^ t[0][word >> 56];
+  }
+  for (; size > 0; --size, ++data) crc = t[0][(crc ^ *data) & 0xff] ^ (crc >> 8);
+  return crc;
+}
+
+#if defined(__x86_64__)
+std::uint32_t shift_stream(std::uint32_t crc) {
+  const auto &t = tables().shift;
+  return t[0][crc & 0xff] ^ t[1][(crc >> 8) & 0xff] ^
+         t[2][(crc >> 16) & 0xff] ^ t[3][crc >> 24];
+}
+
+__attribute__((target("sse4.2"))) std::uint32_t hardware_update(
+    std::uint32_t crc, const unsigned char *data, std::size_t size) {
+  while (size >= 3 * STREAM_SIZE) {
+    std::uint64_t crc0 = crc;
+    std::uint64_t crc1 = 0;
+    std::uint64_t crc2 = 0;
+    for (std::size_t i = 0; i < STREAM_SIZE; i += 8) {
+      std::uint64_t word0;
+      std::uint64_t word1;
+      std::uint64_t word2;
+      std::memcpy(&word0, data + i, sizeof(word0));
+      std::memcpy(&word1, data + STREAM_SIZE + i, sizeof(word1));
+      std::memcpy(&word2, data + 2 * STREAM_SIZE + i, sizeof(word2));
+      crc0 = _mm_crc32_u64(crc0, word0);
+      crc1 = _mm_crc32_u64(crc1, word1);
+      crc2 = _mm_crc32_u64(crc2, word2);
+    }
+
+    // crc(a || b) is crc(a) moved past |b| zero bytes, xored with crc(b)
+    crc = shift_stream(static_cast<std::uint32_t>(crc0)) ^
+          static_cast<std::uint32_t>(crc1);
+    crc = shift_stream(crc) ^ static_cast<std::uint32_t>(crc2);
+    data += 3 * STREAM_SIZE;
+    size -= 3 * STREAM_SIZE;
+  }
+
+  std::uint64_t crc64 = crc;
+  for (; size >= 8; size -= 8, data += 8) {
+    std::uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+    crc64 = _mm_crc32_u64(crc64, word);
+  }
+  crc = static_cast<std::uint32_t>(crc64);
+  for (; size > 0; --size, ++data) crc = _mm_crc32_u8(crc, *data);
+  return crc;
+}
+
+const bool HAS_SSE42 = __builtin_cpu_supports("sse4.2");
+#endif
+
+std::uint32_t page_checksum(page_id_t id, const char *page,
+                            std::size_t usable_size) {
+  const auto crc = crc32c(0, page, usable_size);
+  return crc32c(crc, reinterpret_cast<const char *>(&id), sizeof(id));
+}
+}  // namespace
+
+std::uint32_t crc32c(std::uint32_t crc, const char *data, std::size_t size) {
+  const auto *bytes = reinterpret_cast<const unsigned char *>(data);
+#if defined(__x86_64__)
+  if (HAS_SSE42) return ~hardware_update(~crc, bytes, size);
+#endif
+  return ~portable_update(~crc, bytes, size);
+}
+
+std::uint32_t crc32c_portable(std::uint32_t crc, const char *data,
+                              std::size_t size) {
+  return ~portable_update(~crc, reinterpret_cast<const unsigned char *>(data),
+                          size);
+}
+
+void stamp_page(page_id_t id, char *page, std::size_t page_size) {
+  const auto trailer = make_page_trailer(id, page, page_size);
+  std::memcpy(page + page_size - PAGE_TRAILER_SIZE, &trailer, sizeof(trailer));
+}
+
+page_trailer make_page_trailer(page_id_t id, const char *page,
+                               std::size_t page_size) {
+  return page_trailer{
+      .checksum = page_checksum(id, page, page_size - PAGE_TRAILER_SIZE),
+      .magic = PAGE_TRAILER_MAGIC};
+}
+
+bool verify_page(page_id_t id, const char *page, std::size_t page_size,
+                 bool is_trailer_required) {
+  const auto usable_size = page_size - PAGE_TRAILER_SIZE;
+  page_trailer trailer;
+  std::memcpy(&trailer, page + usable_size, sizeof(trailer));
+  if (trailer.magic == PAGE_TRAILER_MAGIC)
+    return trailer.checksum == page_checksum(id, page, usable_size);
+
+  // a lost last sector or a flipped magic byte must not switch the check
+  // off, only pages that were never written (or deleted) go without
+  if (!is_trailer_required) return true;
+  return std::all_of(page, page + page_size,
+                     [](char byte) { return byte == 0; });
+}
+}  // namespace hivedb
@@ -0,0 +1,180 @@
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <disk/page_codec.hpp>
+
+namespace hivedb {
+namespace {
+constexpr std::size_t MIN_MATCH = 4;
+// the last bytes are always literals, so matching never reads past the end
+constexpr std::size_t LAST_LITERALS = 5;
+// no match starts this close to the end
+constexpr std::size_t MATCH_LIMIT = 12;
+constexpr std::size_t MAX_OFFSET = 65535;
+constexpr int HASH_BITS = 12;
+
+std::uint32_t read32(const unsigned char *data) {
+  std::uint32_t value;
+  std::memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+std::uint32_t hash(std::uint32_t sequence) {
+  return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// Writes the rest of a length that didn't fit its nibble.
+bool write_length(std::size_t length, unsigned char *&out,
+                  const unsigned char *out_end) {
+  for (; length >= 255; length -= 255) {
+    if (out == out_end) return false;
+    *out++ = 255;
+  }
+  if (out == out_end) return false;
+  *out++ = static_cast<unsigned char>(length);
+  return true;
+}
+
+bool read_length(std::size_t &length, const unsigned char *&in,
+                 const unsigned char *in_end) {
+  unsigned char byte;
+  do {
+    if (in == in_end) return false;
+    byte = *in++;
+    length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+// Emits literals [anchor, anchor + literal_count) and, if match_length
+// isn't 0, a match of it at offset.
+bool write_sequence(const unsigned char *anchor, std::size_t literal_count,
+                    std::size_t offset, std::size_t match_length,
+                    unsigned char *&out, const unsigned char *out_end) {
+  if (out == out_end) return false;
+  unsigned char *token = out++;
+
+  const auto literal_nibble = literal_count < 15 ? literal_count : 15;
+  if (literal_count >= 15 && !write_length(literal_count - 15, out, out_end))
+    return false;
+  if (static_cast<std::size_t>(out_end - out) < literal_count) return false;
+  std::memcpy(out, anchor, literal_count);
+  out += literal_count;
+
+  std::size_t match_nibble = 0;
+  if (match_length > 0) {
+    if (out_end - out < 2) return false;
+    *out++ = static_cast<unsigned char>(offset & 0xff);
+    *out++ = static_cast<unsigned char>(offset >> 8);
+
+    const auto extra = match_length - MIN_MATCH;
+    match_nibble = extra < 15 ? extra : 15;
+    if (extra >= 15 && !write_length(extra - 15, out, out_end)) return false;
+  }
+
+  *token = static_cast<unsigned char>((literal_nibble << 4) | match_nibble);
+  return true;
+}
+}  // namespace
+
+std::size_t compress_block(const char *src, std::size_t size, char *dst,
+                           std::size_t capacity) {
+  const auto *in = reinterpret_cast<const unsigned char *>(src);
+  const auto *in_end = in + size;
+  auto *out = reinterpret_cast<unsigned char *>(dst);
+  const auto *out_end = out + capacity;
+
+  // offsets + 1 into src, 0 means empty
+  std::array<std::uint32_t, std::size_t{1} << HASH_BITS> table{};
+
+  const auto *anchor = in;
+  if (size >= MATCH_LIMIT) {
+    const auto *match_limit = in_end - MATCH_LIMIT;
+    const auto *ip = in;
+    while (ip <= match_limit) {
+      const auto sequence = read32(ip);
+      auto &slot = table[hash(sequence)];
+      const auto *candidate = slot ? in + slot - 1 : nullptr;
+      slot = static_cast<std::uint32_t>(ip - in) + 1;
+
+      if (!candidate || static_cast<std::size_t>(ip - candidate) > MAX_OFFSET ||
+          read32(candidate) != sequence) {
+        ++ip;
+        continue;
+      }
+
+      // extend forwards, stopping short of the trailing literals
+      const auto *match_end = ip + MIN_MATCH;
+      const auto *ref = candidate + MIN_MATCH;
+      while (match_end < in_end - LAST_LITERALS && *match_end == *ref) {
+        ++match_end;
+        ++ref;
+      }
+      // and backwards over literals we didn't emit yet
+      while (ip > anchor && candidate > in && ip[-1] == candidate[-1]) {
+        --ip;
+        --candidate;
+      }
+
+      if (!write_sequence(anchor, static_cast<std::size_t>(ip - anchor),
+                          static_cast<std::size_t>(ip - candidate),
+                          static_cast<std::size_t>(match_end - ip), out,
+                          out_end)) {
+        return 0;
+      }
+      ip = anchor = match_end;
+    }
+  }
+
+  if (!write_sequence(anchor, static_cast<std::size_t>(in_end - anchor), 0, 0,
+                      out, out_end)) {
+    return 0;
+  }
+  return static_cast<std::size_t>(out - reinterpret_cast<unsigned char *>(dst));
+}
+
+bool decompress_block(const char *src, std::size_t size, char *dst,
+                      std::size_t dst_size) {
+  const auto *in = reinterpret_cast<const unsigned char *>(src);
+  const auto *in_end = in + size;
+  auto *out = reinterpret_cast<unsigned char *>(dst);
+  auto *out_begin = out;
+  const auto *out_end = out + dst_size;
+
+  while (in < in_end) {
+    const auto token = *in++;
+
+    std::size_t literal_count = token >> 4;
+    if (literal_count == 15 && !read_length(literal_count, in, in_end))
+      return false;
+    if (static_cast<std::size_t>(in_end - in) < literal_count ||
+        static_cast<std::size_t>(out_end - out) < literal_count) {
+      return false;
+    }
+    std::memcpy(out, in, literal_count);
+    in += literal_count;
+    out += literal_count;
+
+    // the last sequence has no match
+    if (in == in_end) break;
+
+    if (in_end - in < 2) return false;
+    const std::size_t offset = in[0] | (std::size_t{in[1]} << 8);
+    in += 2;
+    if (offset == 0 || offset > static_cast<std::size_t>(out - out_begin))
+      return false;
+
+    std::size_t match_length = token & 0x0f;
+    if (match_length == 15 && !read_length(match_length, in, in_end))
+      return false;
+    match_length += MIN_MATCH;
+    if (static_cast<std::size_t>(out_end - out) < match_length) return false;
+
+    // byte by byte, matches may overlap what they produce
+    const auto *ref = out - offset;
+    for (std::size_t i = 0; i < match_length; ++i) *out++ = *ref++;
+  }
+
+  return out == out_end;
+}
+}  // namespace hivedb
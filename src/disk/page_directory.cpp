@@ -0,0 +1,424 @@
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cstring>
+#include <disk/file_io.hpp>
+#include <disk/page_directory.hpp>
+#include <misc/aligned_buffer.hpp>
+#include <misc/config.hpp>
+#include <stdexcept>
+#include <string>
+
+namespace hivedb {
+page_directory::page_directory(int db_fd, std::size_t page_size)
+    : m_db_fd(db_fd),
+      m_superblock(read_superblock(db_fd, page_size)),
+      m_page_size(m_superblock.page_size),
+      m_entries_per_page((m_page_size - sizeof(offset_t)) /
+                         sizeof(offset_t)),
+      m_free_offsets(db_fd, m_page_size),
+      m_free_page_ids(db_fd, m_page_size) {
+  // brand new (or never initialized) file
+  if (m_superblock.magic == 0) {
+    m_superblock = superblock{.magic = PAGE_DIRECTORY_MAGIC,
+                              .version = PAGE_DIRECTORY_VERSION,
+                              .page_size = m_superblock.page_size,
+                              .end_offset = m_page_size,
+                              .first_directory_offset = 0,
+                              .extents = {},
+                              .free_offsets_offset = 0,
+                              .free_page_ids_offset = 0,
+                              .page_id_end = 0,
+                              .features = PAGE_FEATURE_CHECKSUMS,
+                              .slot_map_offset = 0};
+    write_superblock();
+    return;
+  }
+
+  m_free_offsets.load(m_superblock.free_offsets_offset);
+  m_free_page_ids.load(m_superblock.free_page_ids_offset);
+
+  if (m_superblock.version < PAGE_DIRECTORY_VERSION) {
+    // everything added since was zeroed padding before, which is right for
+    // all of it but page_id_end
+    if (m_superblock.version < 3) m_superblock.page_id_end = find_page_id_end();
+    m_superblock.version = PAGE_DIRECTORY_VERSION;
+    m_is_superblock_dirty = true;
+  }
+
+  spdlog::info("Opened page directory, end offset: {}",
+               m_superblock.end_offset);
+}
+
+std::optional<offset_t> page_directory::find(page_id_t id) {
+  const auto *directory = get_directory_page(id / m_entries_per_page, false);
+  if (!directory) return std::nullopt;
+
+  const auto offset = directory->entries[id % m_entries_per_page];
+  if (offset == 0) return std::nullopt;
+  return offset;
+}
+
+void page_directory::set(page_id_t id, offset_t offset) {
+  auto *directory = get_directory_page(id / m_entries_per_page, true);
+  auto &entry = directory->entries[id % m_entries_per_page];
+  if (m_is_offset_index_built) {
+    if (entry != 0) m_pages_by_offset.erase(entry);
+    m_pages_by_offset[offset] = id;
+  }
+  entry = offset;
+  directory->is_dirty = true;
+
+  // ids don't have to come from allocate_page_id(), keep track of them
+  // either way
+  m_free_page_ids.mark_used(static_cast<std::size_t>(id));
+  if (id >= m_superblock.page_id_end) {
+    m_superblock.page_id_end = id + 1;
+    m_is_superblock_dirty = true;
+  }
+}
+
+void page_directory::erase(page_id_t id) {
+  auto *directory = get_directory_page(id / m_entries_per_page, false);
+  if (!directory) return;
+
+  auto &entry = directory->entries[id % m_entries_per_page];
+  if (m_is_offset_index_built && entry != 0) m_pages_by_offset.erase(entry);
+  entry = 0;
+  directory->is_dirty = true;
+}
+
+offset_t page_directory::allocate_offset(page_kind kind) {
+  if (const auto slot = m_free_offsets.take(); slot.has_value())
+    return (slot.value() + 1) * m_page_size;
+
+  return take_from_extent(kind);
+}
+
+offset_t page_directory::take_from_extent(page_kind kind) {
+  auto &current = m_superblock.extents[static_cast<std::size_t>(kind)];
+  if (current.next_offset == current.end_offset) {
+    current = extent{.next_offset = m_superblock.end_offset,
+                     .end_offset = m_superblock.end_offset + extent_size()};
+    m_superblock.end_offset += extent_size();
+  }
+
+  const auto offset = current.next_offset;
+  current.next_offset += m_page_size;
+  m_is_superblock_dirty = true;
+  return offset;
+}
+
+void page_directory::free_offset(offset_t offset) {
+  const auto slot = offset / m_page_size - 1;
+  cover(m_free_offsets, m_superblock.free_offsets_offset, slot);
+  m_free_offsets.release(slot);
+}
+
+std::optional<offset_t> page_directory::take_free_offset_below(
+    offset_t limit) {
+  const auto slot = m_free_offsets.take();
+  if (!slot.has_value()) return std::nullopt;
+
+  const auto offset = (slot.value() + 1) * m_page_size;
+  if (offset < limit) return offset;
+  m_free_offsets.release(slot.value());
+  return std::nullopt;
+}
+
+void page_directory::take_free_offset(offset_t offset) {
+  m_free_offsets.mark_used(offset / m_page_size - 1);
+}
+
+bool page_directory::is_free_offset(offset_t offset) const {
+  return offset >= m_page_size &&
+         m_free_offsets.is_free(offset / m_page_size - 1);
+}
+
+std::optional<offset_t> page_directory::next_free_offset(
+    offset_t offset) const {
+  const auto slot = m_free_offsets.next_free(
+      offset < m_page_size ? 0 : (offset + m_page_size - 1) / m_page_size - 1);
+  if (!slot.has_value()) return std::nullopt;
+  return (slot.value() + 1) * m_page_size;
+}
+
+std::vector<offset_t> page_directory::allocated_offsets() {
+  std::vector<offset_t> own_pages = m_free_offsets.page_offsets();
+  const auto page_id_pages = m_free_page_ids.page_offsets();
+  own_pages.insert(own_pages.end(), page_id_pages.begin(), page_id_pages.end());
+  for (std::size_t index = 0; get_directory_page(index, false); ++index)
+    own_pages.push_back(m_directory_pages[index].offset);
+  std::sort(own_pages.begin(), own_pages.end());
+
+  std::vector<offset_t> offsets;
+  for (auto offset = m_page_size; offset < m_superblock.end_offset;
+       offset += m_page_size) {
+    if (is_free_offset(offset) ||
+        std::binary_search(own_pages.begin(), own_pages.end(), offset))
+      continue;
+    const bool is_unclaimed = std::any_of(
+        m_superblock.extents.begin(), m_superblock.extents.end(),
+        [offset](const extent &current) {
+          return offset >= current.next_offset && offset < current.end_offset;
+        });
+    if (!is_unclaimed) offsets.push_back(offset);
+  }
+  return offsets;
+}
+
+std::vector<std::pair<page_id_t, offset_t>> page_directory::last_pages(
+    std::size_t count) {
+  if (!m_is_offset_index_built) {
+    for (std::size_t index = 0;; ++index) {
+      const auto *directory = get_directory_page(index, false);
+      if (!directory) break;
+
+      for (std::size_t i = 0; i < m_entries_per_page; ++i) {
+        if (directory->entries[i] == 0) continue;
+        m_pages_by_offset.emplace(
+            directory->entries[i],
+            static_cast<page_id_t>(index * m_entries_per_page + i));
+      }
+    }
+    m_is_offset_index_built = true;
+  }
+
+  std::vector<std::pair<page_id_t, offset_t>> pages;
+  pages.reserve(std::min(count, m_pages_by_offset.size()));
+  for (auto it = m_pages_by_offset.rbegin();
+       it != m_pages_by_offset.rend() && pages.size() < count; ++it) {
+    pages.emplace_back(it->second, it->first);
+  }
+  return pages;
+}
+
+offset_t page_directory::trim_end() {
+  const auto is_unused = [this](offset_t offset) {
+    if (is_free_offset(offset)) return true;
+    return std::any_of(m_superblock.extents.begin(), m_superblock.extents.end(),
+                       [offset](const extent &current) {
+                         return offset >= current.next_offset &&
+                                offset < current.end_offset;
+                       });
+  };
+
+  const auto old_end = m_superblock.end_offset;
+  auto end = old_end;
+  while (end > m_page_size && is_unused(end - m_page_size)) end -= m_page_size;
+  if (end == old_end) return end;
+
+  // what's past the end comes out of a fresh extent when the file grows
+  // back, it must not be handed out as a freed spot too
+  for (auto offset = end; offset < old_end; offset += m_page_size)
+    m_free_offsets.mark_used(offset / m_page_size - 1);
+  for (auto &current : m_superblock.extents) {
+    if (current.end_offset <= end) continue;
+    if (current.next_offset >= end) {
+      current = extent{};
+    } else {
+      current.end_offset = end;
+    }
+  }
+
+  m_superblock.end_offset = end;
+  m_is_superblock_dirty = true;
+  return end;
+}
+
+page_id_t page_directory::allocate_page_id() {
+  if (const auto slot = m_free_page_ids.take(); slot.has_value())
+    return static_cast<page_id_t>(slot.value());
+
+  m_is_superblock_dirty = true;
+  return m_superblock.page_id_end++;
+}
+
+void page_directory::free_page_id(page_id_t id) {
+  if (id < 0 || id >= m_superblock.page_id_end)
+    throw std::out_of_range("page id " + std::to_string(id) +
+                            " was never handed out");
+
+  const auto slot = static_cast<std::size_t>(id);
+  cover(m_free_page_ids, m_superblock.free_page_ids_offset, slot);
+  m_free_page_ids.release(slot);
+}
+
+page_id_t page_directory::page_id_end() const {
+  return m_superblock.page_id_end;
+}
+
+std::size_t page_directory::page_size() const { return m_page_size; }
+
+std::size_t page_directory::entries_per_page() const {
+  return m_entries_per_page;
+}
+
+offset_t page_directory::extent_size() const {
+  return PAGES_PER_EXTENT * m_page_size;
+}
+
+std::uint32_t page_directory::features() const { return m_superblock.features; }
+
+void page_directory::set_features(std::uint32_t features) {
+  m_superblock.features = features;
+  m_is_superblock_dirty = true;
+}
+
+offset_t page_directory::slot_map_offset() const {
+  return m_superblock.slot_map_offset;
+}
+
+void page_directory::set_slot_map_offset(offset_t offset) {
+  m_superblock.slot_map_offset = offset;
+  m_is_superblock_dirty = true;
+}
+
+bool page_directory::is_empty() const {
+  return m_superblock.page_id_end == 0 &&
+         m_superblock.end_offset == m_page_size;
+}
+
+void page_directory::cover(free_space_bitmap &bitmap, offset_t &first_offset,
+                           std::size_t slot) {
+  while (bitmap.capacity() <= slot) {
+    // a freed spot could be the one we are about to free up, so bitmap pages
+    // always come fresh out of an extent
+    const auto offset = take_from_extent(page_kind::index);
+    if (bitmap.capacity() == 0) {
+      first_offset = offset;
+      m_is_superblock_dirty = true;
+    }
+    bitmap.add_page(offset);
+  }
+}
+
+page_id_t page_directory::find_page_id_end() {
+  page_id_t end = 0;
+  for (std::size_t index = 0;; ++index) {
+    const auto *directory = get_directory_page(index, false);
+    if (!directory) return end;
+
+    for (std::size_t i = 0; i < m_entries_per_page; ++i) {
+      if (directory->entries[i] != 0)
+        end = static_cast<page_id_t>(index * m_entries_per_page + i + 1);
+    }
+  }
+}
+
+offset_t page_directory::end_offset() const { return m_superblock.end_offset; }
+
+void page_directory::flush() {
+  for (auto &directory : m_directory_pages) {
+    if (!directory.is_dirty) continue;
+    write_directory_page(directory);
+    directory.is_dirty = false;
+  }
+
+  m_free_offsets.flush();
+  m_free_page_ids.flush();
+  if (m_is_superblock_dirty) write_superblock();
+}
+
+page_directory::directory_page *page_directory::get_directory_page(
+    std::size_t index, bool should_create) {
+  while (m_directory_pages.size() <= index) {
+    offset_t next_offset = m_directory_pages.empty()
+                               ? m_superblock.first_directory_offset
+                               : m_directory_pages.back().next_offset;
+
+    if (next_offset != 0) {
+      directory_page directory{.offset = next_offset,
+                               .next_offset = 0,
+                               .entries = {},
+                               .is_dirty = false};
+      load_directory_page(directory);
+      m_directory_pages.push_back(std::move(directory));
+      continue;
+    }
+
+    if (!should_create) return nullptr;
+
+    // grow the chain by one page
+    next_offset = allocate_offset(page_kind::index);
+    if (m_directory_pages.empty()) {
+      m_superblock.first_directory_offset = next_offset;
+      m_is_superblock_dirty = true;
+    } else {
+      m_directory_pages.back().next_offset = next_offset;
+      m_directory_pages.back().is_dirty = true;
+    }
+
+    m_directory_pages.push_back(
+        directory_page{.offset = next_offset,
+                       .next_offset = 0,
+                       .entries = std::vector<offset_t>(m_entries_per_page, 0),
+                       .is_dirty = true});
+  }
+
+  return &m_directory_pages[index];
+}
+
+page_directory::superblock page_directory::read_superblock(
+    int db_fd, std::size_t page_size) {
+  aligned_buffer buffer{PAGE_SIZE};
+  const auto read_count = read_fully(db_fd, buffer.data(), PAGE_SIZE, 0);
+  if (read_count < 0)
+    throw std::runtime_error("Failed to read the superblock!");
+
+  superblock block;
+  std::memcpy(&block, buffer.data(), sizeof(block));
+  if (block.magic == 0) {
+    if (!is_valid_page_size(page_size)) {
+      throw std::invalid_argument("Invalid page size " +
+                                  std::to_string(page_size));
+    }
+    block.page_size = static_cast<std::uint32_t>(page_size);
+    return block;
+  }
+
+  if (block.magic != PAGE_DIRECTORY_MAGIC || block.version == 0 ||
+      block.version > PAGE_DIRECTORY_VERSION) {
+    throw std::runtime_error("The db file has an unknown format!");
+  }
+  if (!is_valid_page_size(block.page_size)) {
+    throw std::runtime_error("The db file has an invalid page size " +
+                             std::to_string(block.page_size));
+  }
+  return block;
+}
+
+void page_directory::load_directory_page(directory_page &directory) {
+  aligned_buffer buffer{m_page_size};
+  if (read_fully(m_db_fd, buffer.data(), m_page_size, directory.offset) < 0) {
+    throw std::runtime_error("Failed to read directory page at offset " +
+                             std::to_string(directory.offset));
+  }
+
+  directory.entries.resize(m_entries_per_page);
+  std::memcpy(&directory.next_offset, buffer.data(), sizeof(offset_t));
+  std::memcpy(directory.entries.data(), buffer.data() + sizeof(offset_t),
+              m_entries_per_page * sizeof(offset_t));
+}
+
+void page_directory::write_directory_page(const directory_page &directory) {
+  aligned_buffer buffer{m_page_size};
+  std::memcpy(buffer.data(), &directory.next_offset, sizeof(offset_t));
+  std::memcpy(buffer.data() + sizeof(offset_t), directory.entries.data(),
+              m_entries_per_page * sizeof(offset_t));
+
+  if (!write_fully(m_db_fd, buffer.data(), m_page_size, directory.offset)) {
+    throw std::runtime_error("Failed to write directory page at offset " +
+                             std::to_string(directory.offset));
+  }
+}
+
+void page_directory::write_superblock() {
+  aligned_buffer buffer{m_page_size};
+  std::memcpy(buffer.data(), &m_superblock, sizeof(m_superblock));
+
+  if (!write_fully(m_db_fd, buffer.data(), m_page_size, 0))
+    throw std::runtime_error("Failed to write the superblock!");
+  m_is_superblock_dirty = false;
+}
+}  // namespace hivedb
@@ -0,0 +1,57 @@
+#include <algorithm>
+#include <disk/readahead_detector.hpp>
+
+namespace hivedb {
+readahead_detector::stream &readahead_detector::find_stream(page_id_t id) {
+  // continues a stream if it's the next page or lands in what was read ahead
+  for (auto &candidate : m_streams) {
+    if (candidate.last == INVALID_PAGE_ID) continue;
+    if (id == candidate.last + 1 ||
+        (id > candidate.last && id < candidate.end)) {
+      return candidate;
+    }
+  }
+
+  auto &victim = *std::min_element(
+      m_streams.begin(), m_streams.end(),
+      [](const auto &lhs, const auto &rhs) {
+        return lhs.last_used < rhs.last_used;
+      });
+  victim = stream{.last = INVALID_PAGE_ID,
+                  .end = id,
+                  .run_length = 0,
+                  .window = MIN_READAHEAD_PAGES,
+                  .last_used = 0};
+  return victim;
+}
+
+std::optional<page_range> readahead_detector::record(page_id_t id) {
+  if (id < 0) return std::nullopt;
+
+  // the same page again says nothing about direction
+  for (auto &candidate : m_streams) {
+    if (candidate.last == id) {
+      candidate.last_used = ++m_clock;
+      return std::nullopt;
+    }
+  }
+
+  auto &current = find_stream(id);
+  current.last = id;
+  current.last_used = ++m_clock;
+  current.run_length++;
+  if (current.run_length < READAHEAD_TRIGGER) return std::nullopt;
+
+  const auto window = static_cast<page_id_t>(current.window);
+  if (current.end > id + window / 2) return std::nullopt;
+
+  // the reader caught up with pages we read ahead, it can use more
+  if (current.end > id + 1)
+    current.window = std::min(current.window * 2, MAX_READAHEAD_PAGES);
+
+  const auto first = std::max(current.end, id + 1);
+  current.end = id + 1 + static_cast<page_id_t>(current.window);
+  return page_range{.first = first,
+                    .count = static_cast<std::size_t>(current.end - first)};
+}
+}  // namespace hivedb
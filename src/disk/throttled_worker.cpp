@@ -0,0 +1,52 @@
+#include <algorithm>
+#include <disk/throttled_worker.hpp>
+#include <stdexcept>
+#include <utility>
+
+namespace hivedb {
+throttled_worker::throttled_worker(std::size_t pages_per_second,
+                                   std::size_t batch_size,
+                                   std::chrono::milliseconds idle_interval,
+                                   std::function<bool()> step)
+    : m_step(std::move(step)), m_idle_interval(idle_interval) {
+  if (pages_per_second == 0 || batch_size == 0) {
+    throw std::invalid_argument(
+        "pages_per_second and batch_size must be > 0");
+  }
+
+  m_batch_interval =
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(static_cast<double>(batch_size) /
+                                        static_cast<double>(pages_per_second)));
+  m_thread = std::thread([this]() { run(); });
+}
+
+throttled_worker::~throttled_worker() {
+  {
+    std::scoped_lock sl{m_latch};
+    m_is_stopping = true;
+  }
+  m_cv.notify_one();
+  if (m_thread.joinable()) m_thread.join();
+}
+
+void throttled_worker::run() {
+  using clock = std::chrono::steady_clock;
+
+  auto deadline = clock::now();
+  while (true) {
+    if (m_step()) {
+      deadline = clock::now() + m_idle_interval;
+    } else {
+      // after a stall just carry on at the normal rate, don't burst to
+      // catch up
+      deadline = std::max(deadline + m_batch_interval,
+                          clock::now() - m_batch_interval);
+    }
+
+    std::unique_lock ul{m_latch};
+    if (m_cv.wait_until(ul, deadline, [this]() { return m_is_stopping; }))
+      return;
+  }
+}
+}  // namespace hivedb
@@ -0,0 +1,40 @@
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <misc/aligned_buffer.hpp>
+#include <new>
+#include <utility>
+
+namespace hivedb {
+aligned_buffer::aligned_buffer(std::size_t size)
+    : m_size((size + IO_ALIGNMENT - 1) / IO_ALIGNMENT * IO_ALIGNMENT) {
+  if (m_size == 0) return;
+
+  m_data = static_cast<char *>(std::aligned_alloc(IO_ALIGNMENT, m_size));
+  if (!m_data) throw std::bad_alloc();
+  std::memset(m_data, 0, m_size);
+}
+
+aligned_buffer::aligned_buffer(aligned_buffer &&other) noexcept
+    : m_data(std::exchange(other.m_data, nullptr)),
+      m_size(std::exchange(other.m_size, 0)) {}
+
+aligned_buffer &aligned_buffer::operator=(aligned_buffer &&other) noexcept {
+  if (this == &other) return *this;
+
+  std::free(m_data);
+  m_data = std::exchange(other.m_data, nullptr);
+  m_size = std::exchange(other.m_size, 0);
+  return *this;
+}
+
+aligned_buffer::~aligned_buffer() { std::free(m_data); }
+
+char *aligned_buffer::data() { return m_data; }
+const char *aligned_buffer::data() const { return m_data; }
+std::size_t aligned_buffer::size() const { return m_size; }
+
+bool aligned_buffer::is_aligned(const void *ptr) {
+  return reinterpret_cast<std::uintptr_t>(ptr) % IO_ALIGNMENT == 0;
+}
+}  // namespace hivedb
@@ -0,0 +1,27 @@
+#include <misc/cycle_clock.hpp>
+#include <thread>
+
+namespace hivedb {
+namespace {
+double calibrate() {
+#if defined(__x86_64__)
+  const auto start_time = std::chrono::steady_clock::now();
+  const auto start_ticks = cycle_clock::now();
+  std::this_thread::sleep_for(std::chrono::milliseconds{2});
+  const auto end_ticks = cycle_clock::now();
+  const auto end_time = std::chrono::steady_clock::now();
+
+  const auto elapsed = std::chrono::duration<double, std::nano>(
+      end_time - start_time);
+  return elapsed.count() / static_cast<double>(end_ticks - start_ticks);
+#else
+  return 1.0;
+#endif
+}
+}  // namespace
+
+double cycle_clock::nanoseconds_per_tick() {
+  static const double nanoseconds = calibrate();
+  return nanoseconds;
+}
+}  // namespace hivedb
@@ -0,0 +1,99 @@
+// Replays a disk trace recorded with disk_scheduler_options::trace_path
+// against one of the disk managers and prints what it saw, so the managers
+// can be compared on exactly the same I/O pattern.
+//
+//   trace_replay <trace> <db file> [file|mmap|uring] [speed] [workers]
+#include <chrono>
+#include <cstddef>
+#include <disk/disk_manager.hpp>
+#include <disk/disk_manager_mmap.hpp>
+#include <disk/disk_manager_uring.hpp>
+#include <disk/disk_scheduler.hpp>
+#include <disk/disk_stats.hpp>
+#include <disk/disk_trace.hpp>
+#include <disk/disk_trace_replay.hpp>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+constexpr const char *USAGE =
+    "usage: trace_replay <trace> <db file> [file|mmap|uring] [speed] "
+    "[workers]\n"
+    "  speed 1 replays at the recorded pace, 0 as fast as possible\n";
+
+constexpr const char *TYPE_NAMES[] = {"write", "read", "sync", "prefetch"};
+
+template <hivedb::disk_manager_t T>
+void replay(const std::vector<hivedb::disk_trace_record> &trace,
+            const std::filesystem::path &db_path, double speed,
+            std::size_t workers) {
+  hivedb::disk_scheduler<T> scheduler{
+      db_path, hivedb::disk_scheduler_options{.worker_count = workers}};
+  const auto result =
+      hivedb::replay_disk_trace(scheduler, trace, {.speed = speed});
+  const auto stats = scheduler.get_stats();
+
+  const auto elapsed =
+      std::chrono::duration<double>(result.elapsed).count();
+  std::cout << result.completed << " requests completed, " << result.failed
+            << " failed in " << elapsed << "s\n";
+  std::cout << "fell behind the trace by up to "
+            << std::chrono::duration<double, std::milli>(result.max_lag).count()
+            << "ms, max queue depth " << stats.max_queue_depth << "\n";
+  std::cout << "throughput "
+            << static_cast<double>(stats.bytes_read + stats.bytes_written) /
+                   elapsed / (1 << 20)
+            << " MiB/s\n";
+
+  for (std::size_t type = 0; type < hivedb::DISK_REQUEST_TYPE_COUNT; ++type) {
+    const auto &type_stats = stats.types[type];
+    if (type_stats.completed == 0) continue;
+
+    const auto us = [](std::chrono::nanoseconds time) {
+      return std::chrono::duration<double, std::micro>(time).count();
+    };
+    std::cout << TYPE_NAMES[type] << ": " << type_stats.completed
+              << " served in p50 " << us(type_stats.device_time.percentile(0.5))
+              << "us p99 " << us(type_stats.device_time.percentile(0.99))
+              << "us p99.9 " << us(type_stats.device_time.percentile(0.999))
+              << "us, queued p99 "
+              << us(type_stats.queue_time.percentile(0.99)) << "us\n";
+  }
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 3 || argc > 6) {
+    std::cerr << USAGE;
+    return 1;
+  }
+
+  try {
+    const std::filesystem::path trace_path = argv[1];
+    const std::filesystem::path db_path = argv[2];
+    const std::string manager = argc > 3 ? argv[3] : "file";
+    const double speed = argc > 4 ? std::stod(argv[4]) : 1.0;
+    const std::size_t workers = argc > 5 ? std::stoul(argv[5]) : 1;
+
+    const auto trace = hivedb::read_disk_trace(trace_path);
+    std::cout << "replaying " << trace.size() << " requests on " << manager
+              << "\n";
+
+    if (manager == "file") {
+      replay<hivedb::disk_manager>(trace, db_path, speed, workers);
+    } else if (manager == "mmap") {
+      replay<hivedb::disk_manager_mmap>(trace, db_path, speed, workers);
+    } else if (manager == "uring") {
+      replay<hivedb::disk_manager_uring>(trace, db_path, speed, workers);
+    } else {
+      std::cerr << USAGE;
+      return 1;
+    }
+  } catch (std::exception &err) {
+    std::cerr << err.what() << "\n";
+    return 1;
+  }
+}
@@ -226,3 +226,21 @@ TEST_CASE("b_plus_tree trivial leaf test", "[b_plus_tree]") {
 //         FAIL(err.what());
 //     }
 // }
+
+TEST_CASE("b_plus_tree nodes fill the page size they are built for", "[b_plus_tree_node]") {
+    using small_leaf = hivedb::b_plus_tree_leaf_node<int_key, int_key>;
+    using large_leaf = hivedb::b_plus_tree_leaf_node<int_key, int_key, 64 * 1024>;
+    using large_inner = hivedb::b_plus_tree_inner_node<int_key, int_key, 64 * 1024>;
+
+    constexpr auto entry_size = 2 * sizeof(int_key);
+    STATIC_REQUIRE(small_leaf::MAX_NUMBER_OF_ELEMENTS == (hivedb::PAGE_USABLE_SIZE - 32) / entry_size);
+    STATIC_REQUIRE(large_leaf::MAX_NUMBER_OF_ELEMENTS == (64 * 1024 - hivedb::PAGE_TRAILER_SIZE - 32) / entry_size);
+    STATIC_REQUIRE(large_inner::MAX_NUMBER_OF_ELEMENTS == large_leaf::MAX_NUMBER_OF_ELEMENTS);
+    // the values come right after the keys, and the last one still fits
+    STATIC_REQUIRE(32 + large_leaf::MAX_NUMBER_OF_ELEMENTS * entry_size <= 64 * 1024 - hivedb::PAGE_TRAILER_SIZE);
+
+    // a tree refuses a file whose pages don't match its nodes
+    REQUIRE_THROWS_AS((hivedb::b_plus_tree<hivedb::disk_manager_mock, int_key, int_key, int_key, 64 * 1024>{
+                          hivedb::INVALID_PAGE_ID, 4, ""}),
+                      std::runtime_error);
+}
@@ -1,9 +1,24 @@
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
 #include <exception>
+#include <latch>
+#include <mutex>
+#include <random>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
 #include <catch_amalgamated.hpp>
 
 #include <buffer_pool/buffer_pool.hpp>
+#include <disk/disk_manager.hpp>
 #include <disk/disk_manager_mock.hpp>
+#include <disk/disk_manager_simulated.hpp>
+#include <misc/temporary_file_wrapper.hpp>
 #include <misc/config.hpp>
 
 
@@ -92,3 +107,313 @@ TEST_CASE("Buffer pool test", "[buffer_pool]") {
         FAIL(err.what());
     }
 }
+
+TEST_CASE("Buffer pool hands aligned frames to O_DIRECT", "[buffer_pool_direct]") {
+    hivedb::temporary_file_wrapper fw;
+    hivedb::buffer_pool<hivedb::disk_manager> bp{2, fw.get_path(),
+                                                 hivedb::durability_mode::manual,
+                                                 hivedb::io_mode::direct};
+    constexpr std::string_view dummy_data = "ilovejoe";
+
+    for (hivedb::page_id_t id = 0; id < 4; ++id) {
+        auto& frame = bp.request_page(bp.allocate_new_page());
+        REQUIRE(hivedb::aligned_buffer::is_aligned(frame.get_data()));
+
+        const auto data = std::string{dummy_data} + std::to_string(id);
+        std::memcpy(frame.get_data(), data.c_str(), data.size() + 1);
+        frame.is_dirty = true;
+        REQUIRE(bp.flush_page(id));
+    }
+
+    for (hivedb::page_id_t id = 0; id < 4; ++id) {
+        auto& frame = bp.request_page(id);
+        REQUIRE(std::string{frame.get_data()} == std::string{dummy_data} + std::to_string(id));
+        frame.decrease_pin_count();
+    }
+}
+
+TEST_CASE("Buffer pool reads ahead of sequential scans", "[buffer_pool]") {
+    constexpr hivedb::page_id_t page_count = 64;
+    hivedb::temporary_file_wrapper fw;
+    hivedb::buffer_pool<hivedb::disk_manager> bp{16, fw.get_path(),
+                                                 hivedb::durability_mode::manual};
+
+    for (hivedb::page_id_t id = 0; id < page_count; ++id) {
+        auto& frame = bp.request_page(bp.allocate_new_page());
+        const auto data = "page" + std::to_string(id);
+        std::memcpy(frame.get_data(), data.c_str(), data.size() + 1);
+        frame.is_dirty = true;
+        REQUIRE(bp.flush_page(id));
+    }
+
+    // every page has to come back right, whether it faulted or was read ahead
+    for (hivedb::page_id_t id = 0; id < page_count; ++id) {
+        auto& frame = bp.request_page(id);
+        REQUIRE(frame.get_pin_count() == 1);
+        REQUIRE(std::string{frame.get_data()} == "page" + std::to_string(id));
+        frame.decrease_pin_count();
+    }
+
+    // a prefetch skips cached pages and never pins
+    REQUIRE(bp.prefetch_pages(page_count - 1, 1) == 0);
+    REQUIRE(bp.prefetch_pages(0, 4) == 4);
+    auto& frame = bp.request_page(2);
+    REQUIRE(frame.get_pin_count() == 1);
+    REQUIRE(std::string{frame.get_data()} == "page2");
+}
+
+TEST_CASE("Buffer pool reuses the ids of deleted pages", "[buffer_pool]") {
+    hivedb::temporary_file_wrapper fw;
+    {
+        hivedb::buffer_pool<hivedb::disk_manager> bp{4, fw.get_path()};
+        for (hivedb::page_id_t id = 0; id < 8; ++id) {
+            REQUIRE(bp.allocate_new_page() == id);
+            auto& frame = bp.request_page(id);
+            frame.is_dirty = true;
+            REQUIRE(bp.flush_page(id));
+        }
+
+        auto& frame = bp.request_page(5);
+        REQUIRE_THROWS(bp.delete_page(5));
+        frame.decrease_pin_count();
+        bp.delete_page(5);
+        bp.delete_page(2);
+        REQUIRE(bp.allocate_new_page() == 2);
+    }
+
+    // and after a restart
+    hivedb::buffer_pool<hivedb::disk_manager> bp{4, fw.get_path()};
+    REQUIRE(bp.allocate_new_page() == 5);
+    REQUIRE(bp.allocate_new_page() == 8);
+}
+
+TEST_CASE("Buffer pool frames take the file's page size", "[buffer_pool]") {
+    constexpr std::size_t page_size = 16 * 1024;
+    hivedb::temporary_file_wrapper fw;
+    hivedb::buffer_pool<hivedb::disk_manager> bp{2, fw.get_path(), hivedb::durability_mode::manual,
+                                                 hivedb::io_mode::direct,
+                                                 hivedb::torn_write_protection::none, page_size};
+    REQUIRE(bp.get_page_size() == page_size);
+
+    // the end of every page survives being evicted and read back in
+    for (hivedb::page_id_t id = 0; id < 6; ++id) {
+        auto& frame = bp.request_page(bp.allocate_new_page());
+        std::fill_n(frame.get_data(), page_size - hivedb::PAGE_TRAILER_SIZE, static_cast<char>('a' + id));
+        frame.is_dirty = true;
+        REQUIRE(bp.flush_page(id));
+    }
+    for (hivedb::page_id_t id = 0; id < 6; ++id) {
+        auto& frame = bp.request_page(id);
+        REQUIRE(frame.get_data()[0] == 'a' + id);
+        REQUIRE(frame.get_data()[page_size - hivedb::PAGE_TRAILER_SIZE - 1] == 'a' + id);
+        frame.decrease_pin_count();
+    }
+}
+
+TEST_CASE("Buffer pool reads page faults right into their frame", "[buffer_pool]") {
+    hivedb::temporary_file_wrapper fw;
+    hivedb::buffer_pool<hivedb::disk_manager> bp{2, fw.get_path()};
+
+    for (hivedb::page_id_t id = 0; id < 8; ++id) {
+        auto& frame = bp.request_page(bp.allocate_new_page());
+        const auto data = "page" + std::to_string(id);
+        std::memcpy(frame.get_data(), data.c_str(), data.size() + 1);
+        frame.is_dirty = true;
+        REQUIRE(bp.flush_page(id));
+    }
+
+    // every fault lands in one of the two frames, whether it had to evict or not
+    std::set<const char*> frame_data;
+    for (hivedb::page_id_t id = 7; id >= 0; --id) {
+        auto& frame = bp.request_page(id);
+        REQUIRE(std::string{frame.get_data()} == "page" + std::to_string(id));
+        REQUIRE(frame.get_pin_count() == 1);
+        REQUIRE_FALSE(frame.is_dirty);
+        frame_data.insert(frame.get_data());
+        frame.decrease_pin_count();
+    }
+    REQUIRE(frame_data.size() == 2);
+}
+
+TEST_CASE("Buffer pool gets the frame of a failed page fault back", "[buffer_pool]") {
+    hivedb::buffer_pool<hivedb::disk_manager_simulated<hivedb::disk_manager_mock>> bp{
+        2, "", hivedb::simulation_options{.faults = {.read_error_rate = 1.0}, .mode = hivedb::latency_mode::count_only}};
+
+    // a lost frame would run the pool out of them after two of these
+    for (hivedb::page_id_t id = 0; id < 8; ++id) {
+        REQUIRE_THROWS_WITH(bp.request_page(bp.allocate_new_page()), "request_page() failed");
+    }
+}
+
+TEST_CASE("Buffer pool reads a page once for every thread faulting it", "[buffer_pool_concurrency]") {
+    using namespace std::chrono_literals;
+    // slow enough that every thread asks while the read is in flight
+    hivedb::buffer_pool<hivedb::disk_manager_simulated<hivedb::disk_manager_mock>> bp{
+        4, "", hivedb::simulation_options{.device = {.read_latency = 50ms}}};
+
+    constexpr auto thread_count = 8;
+    std::latch start{thread_count};
+    std::vector<const char*> frame_data(thread_count);
+    std::vector<std::thread> threads;
+    for (auto i = 0; i < thread_count; ++i) {
+        threads.emplace_back([&, i] {
+            start.arrive_and_wait();
+            auto& frame = bp.request_page(0);
+            frame_data[i] = frame.get_data();
+            frame.decrease_pin_count();
+        });
+    }
+    for (auto& thread : threads) thread.join();
+
+    REQUIRE(bp.get_disk_stats().get(hivedb::disk_request_type::read).completed == 1);
+    REQUIRE(std::all_of(frame_data.begin(), frame_data.end(),
+                        [&](const char* data) { return data == frame_data.front(); }));
+    REQUIRE(bp.request_page(0).get_pin_count() == 1);
+}
+
+TEST_CASE("Buffer pool serves many threads at once", "[buffer_pool_concurrency]") {
+    constexpr hivedb::page_id_t page_count = 64;
+    constexpr auto thread_count = 4;
+    constexpr auto updates_per_thread = 500;
+    hivedb::temporary_file_wrapper fw;
+    hivedb::buffer_pool<hivedb::disk_manager> bp{8, fw.get_path()};
+
+    // every page holds its id and how often it was updated
+    for (hivedb::page_id_t id = 0; id < page_count; ++id) {
+        auto& frame = bp.request_page(bp.allocate_new_page());
+        std::memcpy(frame.get_data(), &id, sizeof(id));
+        std::memset(frame.get_data() + sizeof(id), 0, sizeof(std::uint64_t));
+        frame.is_dirty = true;
+        REQUIRE(bp.flush_page(id));
+    }
+
+    std::latch start{thread_count};
+    std::vector<std::thread> threads;
+    std::mutex failures_latch;
+    std::vector<std::string> failures;
+    for (auto i = 0; i < thread_count; ++i) {
+        threads.emplace_back([&, i] {
+            std::mt19937 rng{static_cast<std::mt19937::result_type>(i)};
+            std::uniform_int_distribution<hivedb::page_id_t> pages{0, page_count - 1};
+            start.arrive_and_wait();
+            try {
+                for (auto update = 0; update < updates_per_thread; ++update) {
+                    const auto id = pages(rng);
+                    auto& frame = bp.request_page(id);
+                    {
+                        std::unique_lock latch{frame};
+                        hivedb::page_id_t stored{};
+                        std::memcpy(&stored, frame.get_data(), sizeof(stored));
+                        if (stored != id) throw std::runtime_error("page " + std::to_string(id) + " holds " + std::to_string(stored));
+
+                        std::uint64_t updates{};
+                        std::memcpy(&updates, frame.get_data() + sizeof(id), sizeof(updates));
+                        ++updates;
+                        std::memcpy(frame.get_data() + sizeof(id), &updates, sizeof(updates));
+                        frame.is_dirty = true;
+                    }
+                    frame.decrease_pin_count();
+                }
+            } catch (const std::exception& err) {
+                std::scoped_lock sl{failures_latch};
+                failures.emplace_back(err.what());
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    REQUIRE(failures.empty());
+
+    // no update got lost on the way to disk and back
+    bp.flush_pages();
+    std::uint64_t total_updates = 0;
+    for (hivedb::page_id_t id = 0; id < page_count; ++id) {
+        auto& frame = bp.request_page(id);
+        std::shared_lock latch{frame};
+        hivedb::page_id_t stored{};
+        std::memcpy(&stored, frame.get_data(), sizeof(stored));
+        REQUIRE(stored == id);
+
+        std::uint64_t updates{};
+        std::memcpy(&updates, frame.get_data() + sizeof(id), sizeof(updates));
+        total_updates += updates;
+        latch.unlock();
+        frame.decrease_pin_count();
+    }
+    REQUIRE(total_updates == thread_count * updates_per_thread);
+}
+
+TEST_CASE("Buffer pool flushes pages other threads have pinned", "[buffer_pool_concurrency]") {
+    constexpr auto thread_count = 4;
+    constexpr auto flush_count = 20;
+    hivedb::temporary_file_wrapper fw;
+    hivedb::buffer_pool<hivedb::disk_manager> bp{8, fw.get_path()};
+    for (auto i = 0; i < thread_count; ++i) (void)bp.allocate_new_page();
+
+    // every thread keeps its page pinned and dirty while the flushes run
+    std::latch pinned{thread_count + 1};
+    std::atomic<bool> is_flushing{true};
+    std::vector<std::int32_t> pin_counts(thread_count);
+    std::vector<std::thread> threads;
+    for (auto i = 0; i < thread_count; ++i) {
+        threads.emplace_back([&, i] {
+            const hivedb::page_id_t id = i;
+            auto& frame = bp.request_page(id);
+            pinned.arrive_and_wait();
+            std::uint64_t updates = 0;
+            while (is_flushing) {
+                std::unique_lock latch{frame};
+                ++updates;
+                std::memcpy(frame.get_data(), &updates, sizeof(updates));
+                frame.is_dirty = true;
+            }
+            pin_counts[i] = frame.get_pin_count();
+            frame.decrease_pin_count();
+        });
+    }
+
+    pinned.arrive_and_wait();
+    for (auto flush = 0; flush < flush_count; ++flush) bp.flush_pages();
+    is_flushing = false;
+    for (auto& thread : threads) thread.join();
+
+    // nobody's pin got dropped for them, so nobody's frame got evicted
+    REQUIRE(std::all_of(pin_counts.begin(), pin_counts.end(), [](std::int32_t count) { return count == 1; }));
+    for (hivedb::page_id_t id = 0; id < thread_count; ++id) {
+        auto& frame = bp.request_page(id);
+        REQUIRE(frame.get_pin_count() == 1);
+        frame.decrease_pin_count();
+    }
+}
+
+// Every thread does as many hits, so with hits that don't wait on each
+// other the time stays flat as threads are added.
+// Run with: ./tests "[benchmark]"
+TEST_CASE("Buffer pool cache hits from many threads benchmark", "[.][benchmark]") {
+    constexpr hivedb::page_id_t page_count = 64;
+    constexpr auto hits_per_thread = 100000;
+    hivedb::temporary_file_wrapper fw;
+    hivedb::buffer_pool<hivedb::disk_manager> bp{page_count, fw.get_path()};
+    for (hivedb::page_id_t id = 0; id < page_count; ++id) {
+        bp.request_page(bp.allocate_new_page()).decrease_pin_count();
+    }
+
+    const auto hit_from = [&](int thread_count) {
+        std::vector<std::thread> threads;
+        for (auto i = 0; i < thread_count; ++i) {
+            threads.emplace_back([&, i] {
+                // pages of its own, so only the hit path itself is shared
+                for (auto hit = 0; hit < hits_per_thread; ++hit) {
+                    const auto id = static_cast<hivedb::page_id_t>((hit * thread_count + i) % page_count);
+                    bp.request_page(id).decrease_pin_count();
+                }
+            });
+        }
+        for (auto& thread : threads) thread.join();
+        return thread_count;
+    };
+
+    BENCHMARK("1 thread") { return hit_from(1); };
+    BENCHMARK("2 threads") { return hit_from(2); };
+    BENCHMARK("4 threads") { return hit_from(4); };
+    BENCHMARK("8 threads") { return hit_from(8); };
+}
@@ -1,7 +1,13 @@
 #include <catch_amalgamated.hpp>
 
+#include <atomic>
 #include <buffer_pool/lru_k.hpp>
+#include <latch>
 #include <misc/config.hpp>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
 
 TEST_CASE("LRU k test", "[lru_k]") {
     std::optional<hivedb::frame_id_t> frame;
@@ -100,3 +106,68 @@ TEST_CASE("LRU k test", "[lru_k]") {
     REQUIRE(false == frame.has_value());
     REQUIRE(0 == replacer.size());
 }
+
+TEST_CASE("LRU k records accesses from many threads", "[lru_k]") {
+    constexpr auto thread_count = 4;
+    constexpr hivedb::frame_id_t frames_per_thread = 16;
+    hivedb::lru_k replacer(2, thread_count * frames_per_thread);
+    for (hivedb::frame_id_t id = 0; id < thread_count * frames_per_thread; id += 2) {
+        replacer.recordAccess(id);
+        replacer.setEvictable(id, false);
+    }
+
+    // every thread keeps its frames busy while the main thread evicts, only
+    // its odd frames are ever evictable
+    std::latch start{thread_count + 1};
+    std::atomic<bool> is_done{false};
+    std::vector<std::thread> threads;
+    for (auto i = 0; i < thread_count; ++i) {
+        threads.emplace_back([&, i] {
+            start.arrive_and_wait();
+            while (!is_done) {
+                for (hivedb::frame_id_t frame = 0; frame < frames_per_thread; ++frame) {
+                    const auto id = i * frames_per_thread + frame;
+                    replacer.recordAccess(id);
+                    replacer.setEvictable(id, id % 2 == 1);
+                }
+            }
+        });
+    }
+
+    start.arrive_and_wait();
+    for (auto i = 0; i < 1000; ++i) {
+        const auto frame = replacer.evict();
+        // racing with recordAccess() may find nothing for a moment
+        if (frame.has_value()) REQUIRE(frame.value() % 2 == 1);
+    }
+    is_done = true;
+    for (auto& thread : threads) thread.join();
+
+    REQUIRE(replacer.size() <= thread_count * frames_per_thread / 2);
+}
+
+TEST_CASE("LRU k hands every frame of a big pool to a single evict", "[lru_k]") {
+    constexpr auto thread_count = 4;
+    constexpr hivedb::frame_id_t max_frames = 64 * hivedb::lru_k::EVICTION_SAMPLE_SIZE;
+    hivedb::lru_k replacer(2, max_frames);
+    for (hivedb::frame_id_t id = 0; id < max_frames; ++id) replacer.recordAccess(id);
+    REQUIRE(replacer.size() == max_frames);
+
+    std::latch start{thread_count};
+    std::mutex evicted_latch;
+    std::set<hivedb::frame_id_t> evicted;
+    std::vector<std::thread> threads;
+    for (auto i = 0; i < thread_count; ++i) {
+        threads.emplace_back([&] {
+            start.arrive_and_wait();
+            while (const auto frame = replacer.evict()) {
+                std::scoped_lock sl{evicted_latch};
+                REQUIRE(evicted.insert(frame.value()).second);
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+
+    REQUIRE(evicted.size() == max_frames);
+    REQUIRE(replacer.size() == 0);
+}
@@ -0,0 +1,196 @@
+#include <sys/stat.h>
+
+#include <catch_amalgamated.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <disk/disk_compactor.hpp>
+#include <disk/disk_manager.hpp>
+#include <disk/disk_scheduler.hpp>
+#include <disk/page_directory.hpp>
+#include <filesystem>
+#include <future>
+#include <misc/config.hpp>
+#include <misc/temporary_file_wrapper.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace {
+void write_text(hivedb::disk_manager& manager, hivedb::page_id_t id, const std::string& text) {
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+    std::memcpy(buffer.data(), text.c_str(), text.size() + 1);
+    manager.write_page(id, buffer.data());
+}
+
+std::string read_text(hivedb::disk_manager& manager, hivedb::page_id_t id) {
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+    manager.read_page(id, buffer.data());
+    return std::string{buffer.data()};
+}
+
+// bytes the filesystem actually holds for the file
+std::uintmax_t allocated_size(const std::filesystem::path& path) {
+    struct stat st{};
+    REQUIRE(stat(path.c_str(), &st) == 0);
+    return static_cast<std::uintmax_t>(st.st_blocks) * 512;
+}
+
+// the grower preallocates extents in the background, wait for it so sizes
+// taken afterwards only change because of the test
+void wait_for_grower(const std::filesystem::path& path) {
+    auto size = std::filesystem::file_size(path);
+    for (int unchanged = 0; unchanged < 5;) {
+        std::this_thread::sleep_for(2ms);
+        const auto current = std::filesystem::file_size(path);
+        unchanged = current == size ? unchanged + 1 : 0;
+        size = current;
+    }
+}
+}  // namespace
+
+TEST_CASE("Compaction moves pages off the end of the file and cuts it", "[disk_compactor]") {
+    hivedb::temporary_file_wrapper fw;
+
+    std::uintmax_t compacted_size = 0;
+    {
+        hivedb::disk_manager manager{fw.get_path()};
+        for (hivedb::page_id_t id = 0; id < 1000; ++id) write_text(manager, id, "page " + std::to_string(id));
+        manager.sync();
+        const auto full_size = std::filesystem::file_size(fw.get_path());
+
+        for (hivedb::page_id_t id = 0; id < 900; ++id) manager.delete_page(id);
+
+        const auto result = manager.compact(1000);
+        REQUIRE(result.relocated_pages == 100);
+        REQUIRE(result.trimmed_bytes > 0);
+        compacted_size = std::filesystem::file_size(fw.get_path());
+        REQUIRE(compacted_size < full_size / 4);
+
+        // nothing left to move
+        REQUIRE(manager.compact(1000).relocated_pages == 0);
+        for (hivedb::page_id_t id = 900; id < 1000; ++id) REQUIRE(read_text(manager, id) == "page " + std::to_string(id));
+    }
+
+    // the moves made it to disk, and the file grows back from its new end
+    hivedb::disk_manager manager{fw.get_path()};
+    REQUIRE(std::filesystem::file_size(fw.get_path()) <=
+            compacted_size + hivedb::PREALLOCATED_EXTENTS * hivedb::EXTENT_SIZE);
+    for (hivedb::page_id_t id = 900; id < 1000; ++id) REQUIRE(read_text(manager, id) == "page " + std::to_string(id));
+
+    for (hivedb::page_id_t id = 1000; id < 1500; ++id) write_text(manager, id, "new page " + std::to_string(id));
+    for (hivedb::page_id_t id = 900; id < 1000; ++id) REQUIRE(read_text(manager, id) == "page " + std::to_string(id));
+    for (hivedb::page_id_t id = 1000; id < 1500; ++id) REQUIRE(read_text(manager, id) == "new page " + std::to_string(id));
+}
+
+TEST_CASE("Compaction punches holes for freed pages", "[disk_compactor]") {
+    hivedb::temporary_file_wrapper fw;
+    hivedb::disk_manager manager{fw.get_path()};
+
+    for (hivedb::page_id_t id = 0; id < 256; ++id) write_text(manager, id, "page " + std::to_string(id));
+    manager.sync();
+    wait_for_grower(fw.get_path());
+    const auto file_size = std::filesystem::file_size(fw.get_path());
+    const auto before = allocated_size(fw.get_path());
+
+    for (hivedb::page_id_t id = 64; id < 128; ++id) manager.delete_page(id);
+
+    // no moving, the freed pages sit in the middle of the file
+    const auto result = manager.compact(0);
+    REQUIRE(result.punched_pages == 64);
+    REQUIRE(result.trimmed_bytes == 0);
+    REQUIRE(std::filesystem::file_size(fw.get_path()) == file_size);
+    // give or take a block of the filesystem's own bookkeeping
+    REQUIRE(allocated_size(fw.get_path()) <= before - 62 * hivedb::PAGE_SIZE);
+
+    // punched spots are handed out again like any freed one
+    REQUIRE(manager.compact(0).punched_pages == 0);
+    for (hivedb::page_id_t id = 64; id < 128; ++id) write_text(manager, id, "again " + std::to_string(id));
+    REQUIRE(std::filesystem::file_size(fw.get_path()) == file_size);
+    for (hivedb::page_id_t id = 0; id < 256; ++id) {
+        const auto prefix = id >= 64 && id < 128 ? "again " : "page ";
+        REQUIRE(read_text(manager, id) == prefix + std::to_string(id));
+    }
+}
+
+TEST_CASE("Compaction punches holes for pages freed before a reopen", "[disk_compactor]") {
+    hivedb::temporary_file_wrapper fw;
+    std::uintmax_t before = 0;
+    {
+        hivedb::disk_manager manager{fw.get_path()};
+        for (hivedb::page_id_t id = 0; id < 256; ++id) write_text(manager, id, "page " + std::to_string(id));
+        manager.sync();
+        wait_for_grower(fw.get_path());
+        before = allocated_size(fw.get_path());
+
+        for (hivedb::page_id_t id = 64; id < 128; ++id) manager.delete_page(id);
+        manager.sync();
+    }
+
+    // the freed spots come from the free space bitmap, which survives
+    hivedb::disk_manager manager{fw.get_path()};
+    wait_for_grower(fw.get_path());
+    REQUIRE(manager.compact(0).punched_pages == 64);
+    REQUIRE(allocated_size(fw.get_path()) <= before - 62 * hivedb::PAGE_SIZE);
+    REQUIRE(manager.compact(0).punched_pages == 0);
+
+    // a spot freed again is punched again
+    write_text(manager, 64, "again");
+    manager.delete_page(64);
+    REQUIRE(manager.compact(0).punched_pages == 1);
+}
+
+TEST_CASE("Compactor runs alongside writes", "[disk_compactor]") {
+    hivedb::temporary_file_wrapper fw;
+    hivedb::disk_scheduler<hivedb::disk_manager> scheduler{fw.get_path(), hivedb::disk_scheduler_options{.worker_count = 2}};
+    auto& manager = scheduler.get_manager();
+
+    constexpr hivedb::page_id_t page_count = 512;
+    constexpr hivedb::page_id_t kept_from = 384;
+    for (hivedb::page_id_t id = 0; id < page_count; ++id) write_text(manager, id, "page " + std::to_string(id));
+    for (hivedb::page_id_t id = 0; id < kept_from; ++id) manager.delete_page(id);
+    const auto file_size = std::filesystem::file_size(fw.get_path());
+
+    // the pages being moved keep getting rewritten through the scheduler
+    std::vector<std::array<char, hivedb::PAGE_SIZE>> buffers(page_count - kept_from);
+    std::size_t rounds = 0;
+    {
+        hivedb::disk_compactor compactor{manager, {.pages_per_second = 20000, .batch_size = 8, .idle_interval = 5ms}};
+
+        // relocations racing a write are given up and retried, so a pass may
+        // end without moving anything
+        const auto deadline = std::chrono::steady_clock::now() + 5s;
+        while (compactor.completed_passes() == 0 || compactor.relocated_pages() == 0 ||
+               compactor.trimmed_bytes() == 0 || rounds < 20) {
+            REQUIRE(std::chrono::steady_clock::now() < deadline);
+
+            std::vector<std::future<bool>> done;
+            for (hivedb::page_id_t id = kept_from; id < page_count; ++id) {
+                auto& buffer = buffers[id - kept_from];
+                const auto text = "round " + std::to_string(rounds) + " page " + std::to_string(id);
+                std::memcpy(buffer.data(), text.c_str(), text.size() + 1);
+
+                std::promise<bool> promise;
+                done.push_back(promise.get_future());
+                scheduler.schedule(hivedb::disk_request{.type = hivedb::disk_request_type::write,
+                                                        .data = buffer.data(),
+                                                        .page_id = id,
+                                                        .is_done = std::move(promise),
+                                                        .priority = hivedb::disk_request_priority::background_flush});
+            }
+            for (auto& future : done) REQUIRE(future.get());
+            ++rounds;
+        }
+
+        REQUIRE(compactor.relocated_pages() > 0);
+        REQUIRE(compactor.trimmed_bytes() > 0);
+    }
+
+    REQUIRE(std::filesystem::file_size(fw.get_path()) < file_size);
+    for (hivedb::page_id_t id = kept_from; id < page_count; ++id) {
+        REQUIRE(read_text(manager, id) == "round " + std::to_string(rounds - 1) + " page " + std::to_string(id));
+    }
+}
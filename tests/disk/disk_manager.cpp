@@ -1,6 +1,19 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
 #include <exception>
+#include <filesystem>
+#include <future>
+#include <stdexcept>
+#include <vector>
 
 #include <disk/disk_manager.hpp>
+#include <disk/disk_manager_mmap.hpp>
+#include <disk/page_directory.hpp>
+#include <disk/disk_scheduler.hpp>
+#include <misc/aligned_buffer.hpp>
 #include <misc/temporary_file_wrapper.hpp>
 #include <catch_amalgamated.hpp>
 
@@ -48,3 +61,511 @@ TEST_CASE("Disk manager simple tests", "[disk_manager_simple]") {
     manager.read_page(0, &buffer[0]);
     REQUIRE(std::string_view{buffer.data()} == page_3_data);
 }
+
+TEST_CASE("Disk manager durability modes", "[disk_manager_durability]") {
+    using namespace std::chrono_literals;
+    constexpr std::string_view data = "durable joe";
+
+    for (const auto mode : {hivedb::durability_mode::per_write,
+                            hivedb::durability_mode::per_batch,
+                            hivedb::durability_mode::manual}) {
+        hivedb::temporary_file_wrapper fw;
+        hivedb::disk_scheduler<hivedb::disk_manager> scheduler{fw.get_path(), mode};
+
+        std::array<char, hivedb::PAGE_SIZE> buffer{};
+        std::memcpy(&buffer[0], data.data(), data.size());
+
+        std::promise<bool> write_promise;
+        auto write_done = write_promise.get_future();
+        scheduler.schedule(hivedb::disk_request{
+            .type = hivedb::disk_request_type::write,
+            .data = buffer.data(),
+            .page_id = 0,
+            .is_done = std::move(write_promise)
+        });
+
+        std::promise<bool> sync_promise;
+        auto sync_done = sync_promise.get_future();
+        scheduler.schedule(hivedb::disk_request{
+            .type = hivedb::disk_request_type::sync,
+            .data = nullptr,
+            .page_id = hivedb::INVALID_PAGE_ID,
+            .is_done = std::move(sync_promise)
+        });
+
+        REQUIRE(write_done.get());
+        REQUIRE(sync_done.get());
+
+        buffer.fill(0);
+        std::promise<bool> read_promise;
+        auto read_done = read_promise.get_future();
+        scheduler.schedule(hivedb::disk_request{
+            .type = hivedb::disk_request_type::read,
+            .data = buffer.data(),
+            .page_id = 0,
+            .is_done = std::move(read_promise)
+        });
+        REQUIRE(read_done.get());
+        REQUIRE(std::string_view{buffer.data()} == data);
+    }
+}
+
+TEST_CASE("Disk manager reopens an existing file", "[disk_manager_reopen]") {
+    // enough pages to need a few directory pages
+    constexpr auto number_of_pages = 3 * hivedb::page_directory::ENTRIES_PER_PAGE;
+    hivedb::temporary_file_wrapper fw;
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+
+    {
+        hivedb::disk_manager manager{fw.get_path()};
+        for (std::size_t i = 0; i < number_of_pages; ++i) {
+            const auto data = "page number " + std::to_string(i);
+            std::memcpy(&buffer[0], data.c_str(), data.size() + 1);
+            manager.write_page(static_cast<hivedb::page_id_t>(i), &buffer[0]);
+        }
+        manager.delete_page(7);
+    }
+
+    hivedb::disk_manager manager{fw.get_path()};
+    for (std::size_t i = 0; i < number_of_pages; ++i) {
+        buffer.fill('x');
+        manager.read_page(static_cast<hivedb::page_id_t>(i), &buffer[0]);
+        if (i == 7) {
+            REQUIRE(buffer[0] == 0);
+            continue;
+        }
+        REQUIRE(std::string{buffer.data()} == "page number " + std::to_string(i));
+    }
+
+    // new pages don't clobber the ones we found on disk
+    constexpr std::string_view new_page = "brand new page";
+    std::memset(&buffer[0], 0, hivedb::PAGE_SIZE);
+    std::memcpy(&buffer[0], new_page.data(), new_page.size());
+    manager.write_page(number_of_pages, &buffer[0]);
+
+    manager.read_page(0, &buffer[0]);
+    REQUIRE(std::string{buffer.data()} == "page number 0");
+    manager.read_page(number_of_pages, &buffer[0]);
+    REQUIRE(std::string_view{buffer.data()} == new_page);
+}
+
+TEST_CASE("Disk manager with O_DIRECT", "[disk_manager_direct]") {
+    hivedb::temporary_file_wrapper fw;
+    constexpr std::string_view data = "no double caching for joe";
+
+    {
+        hivedb::disk_manager manager{fw.get_path(), hivedb::durability_mode::manual,
+                                     hivedb::io_mode::direct};
+
+        // aligned buffers go straight to the kernel
+        hivedb::aligned_buffer aligned{hivedb::PAGE_SIZE};
+        std::memcpy(aligned.data(), data.data(), data.size());
+        manager.write_page(0, aligned.data());
+
+        // unaligned ones get bounced
+        std::vector<char> storage(hivedb::PAGE_SIZE + 1, 0);
+        char* unaligned = storage.data() + 1;
+        std::memcpy(unaligned, data.data(), data.size());
+        manager.write_page(1, unaligned);
+
+        std::memset(aligned.data(), 0, hivedb::PAGE_SIZE);
+        manager.read_page(1, aligned.data());
+        REQUIRE(std::string_view{aligned.data()} == data);
+
+        std::memset(unaligned, 0, hivedb::PAGE_SIZE);
+        manager.read_page(0, unaligned);
+        REQUIRE(std::string_view{unaligned} == data);
+    }
+
+    // and the file is readable by a buffered manager afterwards
+    hivedb::disk_manager manager{fw.get_path()};
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+    manager.read_page(0, &buffer[0]);
+    REQUIRE(std::string_view{buffer.data()} == data);
+}
+
+TEST_CASE("Disk manager coalesces adjacent writes", "[disk_manager_coalescing]") {
+    constexpr hivedb::page_id_t number_of_pages = 48;
+    hivedb::temporary_file_wrapper fw;
+
+    // one aligned buffer per page, like the buffer pool's frame arena
+    hivedb::aligned_buffer pages{number_of_pages * hivedb::PAGE_SIZE};
+    for (hivedb::page_id_t id = 0; id < number_of_pages; ++id) {
+        std::memset(pages.data() + id * hivedb::PAGE_SIZE, 'a' + id % 26, hivedb::PAGE_SIZE);
+    }
+
+    {
+        hivedb::disk_manager manager{fw.get_path()};
+
+        // out of order, with a hole in the middle and a read mixed in
+        std::vector<hivedb::disk_request> batch;
+        std::vector<std::future<bool>> futures;
+        std::array<char, hivedb::PAGE_SIZE> read_buffer{};
+        for (hivedb::page_id_t id = number_of_pages - 1; id >= 0; --id) {
+            if (id == number_of_pages / 2) continue;
+
+            std::promise<bool> is_done;
+            futures.push_back(is_done.get_future());
+            batch.push_back(hivedb::disk_request{
+                .type = hivedb::disk_request_type::write,
+                .data = pages.data() + id * hivedb::PAGE_SIZE,
+                .page_id = id,
+                .is_done = std::move(is_done)
+            });
+        }
+        std::promise<bool> is_read;
+        futures.push_back(is_read.get_future());
+        batch.push_back(hivedb::disk_request{
+            .type = hivedb::disk_request_type::read,
+            .data = read_buffer.data(),
+            .page_id = number_of_pages / 2,
+            .is_done = std::move(is_read)
+        });
+
+        manager.submit_batch(batch);
+        for (auto& future : futures) REQUIRE(future.get());
+        REQUIRE(read_buffer[0] == 0);
+        manager.sync();
+    }
+
+    hivedb::disk_manager manager{fw.get_path()};
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+    for (hivedb::page_id_t id = 0; id < number_of_pages; ++id) {
+        manager.read_page(id, buffer.data());
+        const char expected = id == number_of_pages / 2 ? 0 : 'a' + id % 26;
+        REQUIRE(buffer[0] == expected);
+        REQUIRE(buffer[hivedb::PAGE_USABLE_SIZE - 1] == expected);
+    }
+}
+
+TEST_CASE("Disk manager leaves the buffers of batched writes alone", "[disk_manager_coalescing]") {
+    constexpr hivedb::page_id_t number_of_pages = 8;
+    hivedb::temporary_file_wrapper fw;
+    auto io_mode = hivedb::io_mode::buffered;
+    auto protection = hivedb::torn_write_protection::none;
+    SECTION("buffered") {}
+    SECTION("direct") { io_mode = hivedb::io_mode::direct; }
+    SECTION("double-written") { protection = hivedb::torn_write_protection::double_write; }
+    hivedb::disk_manager manager{fw.get_path(), hivedb::durability_mode::manual, io_mode, protection};
+
+    // every write of the batch shares one buffer, trailer bytes included
+    hivedb::aligned_buffer page{hivedb::PAGE_SIZE};
+    std::memset(page.data(), 'x', hivedb::PAGE_SIZE);
+    std::vector<hivedb::disk_request> batch;
+    std::vector<std::future<bool>> futures;
+    for (hivedb::page_id_t id = 0; id < number_of_pages; ++id) {
+        std::promise<bool> is_done;
+        futures.push_back(is_done.get_future());
+        batch.push_back(hivedb::disk_request{
+            .type = hivedb::disk_request_type::write, .data = page.data(), .page_id = id, .is_done = std::move(is_done)});
+    }
+    manager.submit_batch(batch);
+    for (auto& future : futures) REQUIRE(future.get());
+
+    REQUIRE(std::all_of(page.data(), page.data() + hivedb::PAGE_SIZE, [](char c) { return c == 'x'; }));
+    // each page got a trailer of its own
+    hivedb::aligned_buffer buffer{hivedb::PAGE_SIZE};
+    for (hivedb::page_id_t id = 0; id < number_of_pages; ++id) {
+        manager.read_page(id, buffer.data());
+        REQUIRE(buffer.data()[0] == 'x');
+        REQUIRE(buffer.data()[hivedb::PAGE_USABLE_SIZE - 1] == 'x');
+    }
+}
+
+TEST_CASE("Page directory hands out pages from per kind extents", "[disk_manager_extents]") {
+    hivedb::temporary_file_wrapper fw;
+    const int fd = open(fw.get_path().c_str(), O_RDWR);
+    REQUIRE(fd != -1);
+
+    std::vector<hivedb::offset_t> table_offsets;
+    {
+        hivedb::page_directory directory{fd};
+        for (int i = 0; i < 3; ++i)
+            table_offsets.push_back(directory.allocate_offset(hivedb::page_kind::table));
+        const auto index_offset = directory.allocate_offset(hivedb::page_kind::index);
+        table_offsets.push_back(directory.allocate_offset(hivedb::page_kind::table));
+
+        // the index page didn't land in the middle of the table pages
+        for (std::size_t i = 1; i < table_offsets.size(); ++i)
+            REQUIRE(table_offsets[i] == table_offsets[i - 1] + hivedb::PAGE_SIZE);
+        REQUIRE((index_offset < table_offsets.front() ||
+                 index_offset >= table_offsets.front() + hivedb::EXTENT_SIZE));
+        REQUIRE(directory.end_offset() == hivedb::PAGE_SIZE + 2 * hivedb::EXTENT_SIZE);
+        directory.flush();
+    }
+
+    // a reopened directory keeps filling the extent it was working on
+    hivedb::page_directory directory{fd};
+    REQUIRE(directory.allocate_offset(hivedb::page_kind::table) ==
+            table_offsets.back() + hivedb::PAGE_SIZE);
+    close(fd);
+}
+
+TEST_CASE("Disk manager preallocates the file in extents", "[disk_manager_extents]") {
+    hivedb::temporary_file_wrapper fw;
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+
+    {
+        hivedb::disk_manager manager{fw.get_path()};
+        for (hivedb::page_id_t id = 0; id < 200; ++id) {
+            const auto kind = id % 2 == 0 ? hivedb::page_kind::table : hivedb::page_kind::index;
+            manager.allocate_page(id, kind);
+
+            const auto data = "page number " + std::to_string(id);
+            std::memcpy(&buffer[0], data.c_str(), data.size() + 1);
+            manager.write_page(id, &buffer[0]);
+        }
+
+        // whatever was handed out is backed by the file, in whole extents
+        const auto file_size = std::filesystem::file_size(fw.get_path());
+        REQUIRE(file_size >= hivedb::PAGE_SIZE + 4 * hivedb::EXTENT_SIZE);
+        REQUIRE((file_size - hivedb::PAGE_SIZE) % hivedb::EXTENT_SIZE == 0);
+    }
+
+    hivedb::disk_manager manager{fw.get_path()};
+    for (hivedb::page_id_t id = 0; id < 200; ++id) {
+        manager.read_page(id, &buffer[0]);
+        REQUIRE(std::string{buffer.data()} == "page number " + std::to_string(id));
+    }
+}
+
+TEST_CASE("Disk manager reuses deleted pages after a restart", "[disk_manager_free_space]") {
+    hivedb::temporary_file_wrapper fw;
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+    constexpr hivedb::page_id_t number_of_pages = 100;
+
+    std::uintmax_t file_size = 0;
+    {
+        hivedb::disk_manager manager{fw.get_path()};
+        for (hivedb::page_id_t i = 0; i < number_of_pages; ++i) {
+            const auto id = manager.allocate_page_id();
+            REQUIRE(id == i);
+            manager.write_page(id, &buffer[0]);
+        }
+
+        manager.delete_page(42);
+        manager.delete_page(7);
+        // never written, only the id goes back
+        REQUIRE(manager.allocate_page_id() == 7);
+        manager.delete_page(7);
+        REQUIRE_THROWS(manager.delete_page(number_of_pages));
+        manager.sync();
+        file_size = std::filesystem::file_size(fw.get_path());
+    }
+
+    hivedb::disk_manager manager{fw.get_path()};
+    REQUIRE(manager.page_id_end() == number_of_pages);
+    REQUIRE(manager.allocate_page_id() == 7);
+    REQUIRE(manager.allocate_page_id() == 42);
+    REQUIRE(manager.allocate_page_id() == number_of_pages);
+
+    // the deleted pages' spots in the file are taken before growing it
+    const std::string_view data = "recycled";
+    std::memcpy(&buffer[0], data.data(), data.size());
+    manager.write_page(7, &buffer[0]);
+    manager.write_page(42, &buffer[0]);
+    REQUIRE(std::filesystem::file_size(fw.get_path()) == file_size);
+
+    manager.read_page(42, &buffer[0]);
+    REQUIRE(std::string_view{buffer.data(), data.size()} == data);
+}
+
+TEST_CASE("Disk manager repairs torn pages from the double-write file", "[disk_manager_double_write]") {
+    constexpr hivedb::page_id_t number_of_pages = 8;
+    hivedb::temporary_file_wrapper fw;
+    const auto double_write_path = hivedb::get_double_write_path(fw.get_path());
+    const auto saved_path = double_write_path.string() + ".saved";
+
+    hivedb::aligned_buffer pages{number_of_pages * hivedb::PAGE_SIZE};
+    {
+        hivedb::disk_manager manager{fw.get_path(), hivedb::durability_mode::manual,
+                                     hivedb::io_mode::buffered,
+                                     hivedb::torn_write_protection::double_write};
+        std::array<char, hivedb::PAGE_SIZE> buffer{};
+        for (hivedb::page_id_t id = 0; id < number_of_pages; ++id) {
+            buffer.fill('a');
+            manager.write_page(id, buffer.data());
+        }
+        manager.sync();
+
+        std::vector<hivedb::disk_request> batch;
+        std::vector<std::future<bool>> futures;
+        for (hivedb::page_id_t id = 0; id < number_of_pages; ++id) {
+            std::memset(pages.data() + id * hivedb::PAGE_SIZE, 'b' + id, hivedb::PAGE_SIZE);
+            std::promise<bool> is_done;
+            futures.push_back(is_done.get_future());
+            batch.push_back(hivedb::disk_request{
+                .type = hivedb::disk_request_type::write,
+                .data = pages.data() + id * hivedb::PAGE_SIZE,
+                .page_id = id,
+                .is_done = std::move(is_done)
+            });
+        }
+        manager.submit_batch(batch);
+        for (auto& future : futures) REQUIRE(future.get());
+        manager.sync();
+
+        // what a crash right after the batch would have left behind
+        std::filesystem::copy_file(double_write_path, saved_path);
+    }
+    // a clean shutdown doesn't need it anymore
+    REQUIRE_FALSE(std::filesystem::exists(double_write_path));
+    std::filesystem::rename(saved_path, double_write_path);
+
+    // tear page 3: only the second half of it made it
+    {
+        hivedb::disk_manager manager{fw.get_path()};
+        std::array<char, hivedb::PAGE_SIZE> buffer{};
+        manager.read_page(3, buffer.data());
+        REQUIRE(buffer[0] == 'b' + 3);
+    }
+    {
+        std::vector<char> contents(std::filesystem::file_size(fw.get_path()));
+        const int fd = open(fw.get_path().c_str(), O_RDWR);
+        REQUIRE(pread(fd, contents.data(), contents.size(), 0) == static_cast<ssize_t>(contents.size()));
+
+        std::size_t page_offset = 0;
+        for (std::size_t offset = hivedb::PAGE_SIZE; offset < contents.size(); offset += hivedb::PAGE_SIZE) {
+            if (contents[offset] == 'b' + 3 && contents[offset + hivedb::PAGE_SIZE / 2] == 'b' + 3) {
+                page_offset = offset;
+            }
+        }
+        REQUIRE(page_offset != 0);
+
+        const std::vector<char> old_half(hivedb::PAGE_SIZE / 2, 'a');
+        REQUIRE(pwrite(fd, old_half.data(), old_half.size(), page_offset) ==
+                static_cast<ssize_t>(old_half.size()));
+        close(fd);
+    }
+
+    {
+        // without the double-write file it's only detected
+        hivedb::disk_manager manager{fw.get_path()};
+        std::array<char, hivedb::PAGE_SIZE> buffer{};
+        REQUIRE_THROWS_AS(manager.read_page(3, buffer.data()), std::runtime_error);
+    }
+
+    hivedb::disk_manager manager{fw.get_path(), hivedb::durability_mode::manual,
+                                 hivedb::io_mode::buffered,
+                                 hivedb::torn_write_protection::double_write};
+    REQUIRE(manager.get_repaired_page_count() == 1);
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+    for (hivedb::page_id_t id = 0; id < number_of_pages; ++id) {
+        manager.read_page(id, buffer.data());
+        REQUIRE(buffer[0] == 'b' + id);
+        REQUIRE(buffer[hivedb::PAGE_USABLE_SIZE - 1] == 'b' + id);
+    }
+}
+
+TEST_CASE("Disk manager double-writes unaligned pages with the rest of the batch", "[disk_manager_double_write]") {
+    constexpr hivedb::page_id_t number_of_pages = 8;
+    hivedb::temporary_file_wrapper fw;
+    hivedb::disk_manager manager{fw.get_path(), hivedb::durability_mode::manual,
+                                 hivedb::io_mode::direct,
+                                 hivedb::torn_write_protection::double_write};
+
+    // every other page sits one byte off the alignment O_DIRECT wants
+    hivedb::aligned_buffer storage{(number_of_pages + 1) * hivedb::PAGE_SIZE};
+    std::vector<hivedb::disk_request> batch;
+    std::vector<std::future<bool>> futures;
+    for (hivedb::page_id_t id = 0; id < number_of_pages; ++id) {
+        char* data = storage.data() + id * hivedb::PAGE_SIZE + id % 2;
+        std::memset(data, 'a' + id, hivedb::PAGE_SIZE);
+        std::promise<bool> is_done;
+        futures.push_back(is_done.get_future());
+        batch.push_back(hivedb::disk_request{
+            .type = hivedb::disk_request_type::write, .data = data, .page_id = id, .is_done = std::move(is_done)});
+    }
+    manager.submit_batch(batch);
+    for (auto& future : futures) REQUIRE(future.get());
+
+    // one round through the double-write file took all of them
+    std::uint32_t count = 0;
+    const int fd = open(hivedb::get_double_write_path(fw.get_path()).c_str(), O_RDONLY);
+    REQUIRE(fd != -1);
+    REQUIRE(pread(fd, &count, sizeof(count), sizeof(std::uint64_t)) == sizeof(count));
+    close(fd);
+    REQUIRE(count == number_of_pages);
+
+    hivedb::aligned_buffer buffer{hivedb::PAGE_SIZE};
+    for (hivedb::page_id_t id = 0; id < number_of_pages; ++id) {
+        manager.read_page(id, buffer.data());
+        REQUIRE(buffer.data()[0] == 'a' + id);
+        REQUIRE(buffer.data()[hivedb::PAGE_USABLE_SIZE - 1] == 'a' + id);
+    }
+}
+
+TEST_CASE("Disk manager keeps the page size a file was created with", "[disk_manager_page_size]") {
+    constexpr std::size_t page_size = 64 * 1024;
+    constexpr hivedb::page_id_t number_of_pages = 200;
+    hivedb::temporary_file_wrapper fw;
+    std::vector<char> buffer(page_size);
+
+    {
+        hivedb::disk_manager manager{fw.get_path(), hivedb::durability_mode::manual,
+                                     hivedb::io_mode::buffered,
+                                     hivedb::torn_write_protection::double_write, page_size};
+        REQUIRE(manager.get_page_size() == page_size);
+        for (hivedb::page_id_t id = 0; id < number_of_pages; ++id) {
+            std::fill(buffer.begin(), buffer.end(), static_cast<char>('a' + id % 26));
+            manager.write_page(id, buffer.data());
+        }
+        manager.delete_page(7);
+        manager.sync();
+    }
+
+    // the file's page size wins over the default
+    hivedb::disk_manager manager{fw.get_path()};
+    REQUIRE(manager.get_page_size() == page_size);
+    for (hivedb::page_id_t id = 0; id < number_of_pages; ++id) {
+        manager.read_page(id, buffer.data());
+        const char expected = id == 7 ? 0 : static_cast<char>('a' + id % 26);
+        REQUIRE(buffer[0] == expected);
+        REQUIRE(buffer[page_size - hivedb::PAGE_TRAILER_SIZE - 1] == expected);
+    }
+
+    // the freed spot is a whole page of the file's size
+    std::fill(buffer.begin(), buffer.end(), 'z');
+    manager.write_page(number_of_pages, buffer.data());
+    manager.read_page(number_of_pages, buffer.data());
+    REQUIRE(buffer[page_size - hivedb::PAGE_TRAILER_SIZE - 1] == 'z');
+}
+
+TEST_CASE("Disk manager rejects page sizes it can't handle", "[disk_manager_page_size]") {
+    hivedb::temporary_file_wrapper fw;
+    REQUIRE_THROWS_AS(hivedb::disk_manager(fw.get_path(), hivedb::durability_mode::manual,
+                                           hivedb::io_mode::buffered,
+                                           hivedb::torn_write_protection::none, 3000),
+                      std::invalid_argument);
+    REQUIRE_THROWS_AS(hivedb::disk_manager(fw.get_path(), hivedb::durability_mode::manual,
+                                           hivedb::io_mode::buffered,
+                                           hivedb::torn_write_protection::none, 2 * hivedb::MAX_PAGE_SIZE),
+                      std::invalid_argument);
+
+    {
+        hivedb::disk_manager manager{fw.get_path(), hivedb::durability_mode::manual,
+                                     hivedb::io_mode::buffered,
+                                     hivedb::torn_write_protection::none, 16 * 1024};
+    }
+    // managers that only know PAGE_SIZE pages don't open the file
+    REQUIRE_THROWS_AS(hivedb::disk_manager_mmap(fw.get_path()), std::runtime_error);
+}
+
+TEST_CASE("Disk scheduler sizes its stats by the file's pages", "[disk_manager_page_size]") {
+    constexpr std::size_t page_size = 32 * 1024;
+    hivedb::temporary_file_wrapper fw;
+    hivedb::disk_scheduler<hivedb::disk_manager> scheduler{fw.get_path(), hivedb::durability_mode::manual,
+                                                           hivedb::io_mode::buffered,
+                                                           hivedb::torn_write_protection::none, page_size};
+    REQUIRE(scheduler.get_page_size() == page_size);
+
+    hivedb::aligned_buffer buffer{page_size};
+    std::promise<bool> promise;
+    auto done = promise.get_future();
+    scheduler.schedule(hivedb::disk_request{.type = hivedb::disk_request_type::write,
+                                            .data = buffer.data(),
+                                            .page_id = 0,
+                                            .is_done = std::move(promise)});
+    REQUIRE(done.get());
+    REQUIRE(scheduler.get_stats().bytes_written == page_size);
+}
@@ -0,0 +1,465 @@
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <array>
+#include <csignal>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <future>
+#include <random>
+#include <string>
+
+#include <catch_amalgamated.hpp>
+#include <disk/disk_manager.hpp>
+#include <disk/disk_manager_compressed.hpp>
+#include <disk/disk_manager_mmap.hpp>
+#include <disk/disk_scheduler.hpp>
+#include <disk/page_directory.hpp>
+#include <misc/config.hpp>
+#include <misc/temporary_file_wrapper.hpp>
+
+namespace {
+void fill_compressible(std::array<char, hivedb::PAGE_SIZE>& buffer, hivedb::page_id_t id) {
+    buffer.fill(0);
+    for (std::size_t offset = 0; offset + 64 <= hivedb::PAGE_USABLE_SIZE; offset += 64) {
+        const auto record = "page " + std::to_string(id) + " record " + std::to_string(offset / 64);
+        std::memcpy(&buffer[offset], record.c_str(), record.size());
+    }
+}
+
+void fill_random(std::array<char, hivedb::PAGE_SIZE>& buffer, hivedb::page_id_t id) {
+    std::mt19937 gen{static_cast<std::mt19937::result_type>(id)};
+    std::uniform_int_distribution<int> dist{0, 255};
+    for (auto& c : buffer) c = static_cast<char>(dist(gen));
+}
+
+// spots in the file handed out for pages (or the slot map), extent space
+// below the end of the file included
+std::size_t allocated_spots(const std::filesystem::path& path) {
+    const int fd = open(path.c_str(), O_RDWR);
+    REQUIRE(fd != -1);
+    std::size_t count;
+    {
+        hivedb::page_directory directory{fd};
+        count = directory.allocated_offsets().size();
+    }
+    close(fd);
+    return count;
+}
+
+// Writes past the given file size fail with EFBIG while this is alive.
+struct file_size_limit {
+    rlimit old_limit{};
+    void (*old_handler)(int){};
+
+    explicit file_size_limit(std::uintmax_t size) {
+        old_handler = std::signal(SIGXFSZ, SIG_IGN);
+        REQUIRE(getrlimit(RLIMIT_FSIZE, &old_limit) == 0);
+        const rlimit limit{.rlim_cur = static_cast<rlim_t>(size), .rlim_max = old_limit.rlim_max};
+        REQUIRE(setrlimit(RLIMIT_FSIZE, &limit) == 0);
+    }
+
+    ~file_size_limit() {
+        setrlimit(RLIMIT_FSIZE, &old_limit);
+        std::signal(SIGXFSZ, old_handler);
+    }
+};
+}  // namespace
+
+
+TEST_CASE("Compressed disk manager round trips pages", "[disk_manager_compressed]") {
+    constexpr hivedb::page_id_t number_of_pages = 256;
+    hivedb::temporary_file_wrapper fw;
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+    std::array<char, hivedb::PAGE_SIZE> expected{};
+
+    {
+        hivedb::disk_manager_compressed manager{fw.get_path()};
+
+        for (hivedb::page_id_t id = 0; id < number_of_pages; ++id) {
+            fill_compressible(buffer, id);
+            manager.write_page(id, buffer.data());
+        }
+        for (hivedb::page_id_t id = 0; id < number_of_pages; ++id) {
+            fill_compressible(expected, id);
+            manager.read_page(id, buffer.data());
+            REQUIRE(std::memcmp(buffer.data(), expected.data(), hivedb::PAGE_USABLE_SIZE) == 0);
+        }
+
+        const auto stats = manager.get_stats();
+        REQUIRE(stats.compressed_pages == number_of_pages);
+        REQUIRE(stats.raw_pages == 0);
+
+        // never written
+        manager.read_page(number_of_pages + 10, buffer.data());
+        REQUIRE(buffer[0] == 0);
+        manager.sync();
+    }
+
+    // a quarter of the space or less
+    REQUIRE(std::filesystem::file_size(fw.get_path()) < number_of_pages * hivedb::PAGE_SIZE / 2);
+
+    hivedb::disk_manager_compressed manager{fw.get_path()};
+    REQUIRE(manager.page_id_end() == number_of_pages);
+    for (hivedb::page_id_t id = 0; id < number_of_pages; id += 17) {
+        fill_compressible(expected, id);
+        manager.read_page(id, buffer.data());
+        REQUIRE(std::memcmp(buffer.data(), expected.data(), hivedb::PAGE_USABLE_SIZE) == 0);
+    }
+}
+
+TEST_CASE("Compressed disk manager stores incompressible pages raw", "[disk_manager_compressed]") {
+    hivedb::temporary_file_wrapper fw;
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+    std::array<char, hivedb::PAGE_SIZE> expected{};
+
+    {
+        hivedb::disk_manager_compressed manager{fw.get_path()};
+        for (hivedb::page_id_t id = 0; id < 8; ++id) {
+            fill_random(buffer, id);
+            manager.write_page(id, buffer.data());
+        }
+        REQUIRE(manager.get_stats().raw_pages == 8);
+
+        // pages move between slot sizes as their contents change
+        fill_compressible(buffer, 3);
+        manager.write_page(3, buffer.data());
+        fill_random(buffer, 100);
+        manager.write_page(5, buffer.data());
+        manager.sync();
+    }
+
+    hivedb::disk_manager_compressed manager{fw.get_path()};
+    for (hivedb::page_id_t id = 0; id < 8; ++id) {
+        if (id == 3) {
+            fill_compressible(expected, 3);
+        } else {
+            fill_random(expected, id == 5 ? 100 : id);
+        }
+        manager.read_page(id, buffer.data());
+        REQUIRE(std::memcmp(buffer.data(), expected.data(), hivedb::PAGE_USABLE_SIZE) == 0);
+    }
+}
+
+TEST_CASE("Compressed disk manager reuses freed slots", "[disk_manager_compressed]") {
+    constexpr hivedb::page_id_t number_of_pages = 64;
+    hivedb::temporary_file_wrapper fw;
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+    std::array<char, hivedb::PAGE_SIZE> expected{};
+
+    {
+        hivedb::disk_manager_compressed manager{fw.get_path()};
+        for (hivedb::page_id_t id = 0; id < number_of_pages; ++id) {
+            fill_compressible(buffer, id);
+            manager.write_page(id, buffer.data());
+        }
+        for (hivedb::page_id_t id = 0; id < number_of_pages; id += 2) manager.delete_page(id);
+        manager.sync();
+    }
+    const auto file_size = std::filesystem::file_size(fw.get_path());
+    const auto spots = allocated_spots(fw.get_path());
+
+    // the free slots are found again after reopening
+    {
+        hivedb::disk_manager_compressed manager{fw.get_path()};
+        for (hivedb::page_id_t i = 0; i < number_of_pages / 2; ++i) {
+            const auto id = manager.allocate_page_id();
+            REQUIRE(id % 2 == 0);
+            fill_compressible(buffer, id + 1000);
+            manager.write_page(id, buffer.data());
+        }
+        manager.sync();
+        REQUIRE(std::filesystem::file_size(fw.get_path()) == file_size);
+
+        for (hivedb::page_id_t id = 0; id < number_of_pages; ++id) {
+            fill_compressible(expected, id % 2 == 0 ? id + 1000 : id);
+            manager.read_page(id, buffer.data());
+            REQUIRE(std::memcmp(buffer.data(), expected.data(), hivedb::PAGE_USABLE_SIZE) == 0);
+        }
+    }
+    REQUIRE(allocated_spots(fw.get_path()) == spots);
+}
+
+TEST_CASE("Compressed disk manager walks the directory when the slot map is torn", "[disk_manager_compressed]") {
+    constexpr hivedb::page_id_t number_of_pages = 64;
+    hivedb::temporary_file_wrapper fw;
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+    std::array<char, hivedb::PAGE_SIZE> expected{};
+
+    {
+        hivedb::disk_manager_compressed manager{fw.get_path()};
+        for (hivedb::page_id_t id = 0; id < number_of_pages; ++id) {
+            fill_compressible(buffer, id);
+            manager.write_page(id, buffer.data());
+        }
+        // so the bitmap of free spots has its page already
+        fill_random(buffer, number_of_pages);
+        manager.write_page(number_of_pages, buffer.data());
+        manager.delete_page(number_of_pages);
+        for (hivedb::page_id_t id = 0; id < number_of_pages; id += 2) manager.delete_page(id);
+        manager.sync();
+    }
+    const auto file_size = std::filesystem::file_size(fw.get_path());
+    const auto spots = allocated_spots(fw.get_path());
+
+    {
+        const int fd = open(fw.get_path().c_str(), O_RDWR);
+        REQUIRE(fd != -1);
+        hivedb::offset_t slot_map_offset;
+        {
+            hivedb::page_directory directory{fd};
+            slot_map_offset = directory.slot_map_offset();
+        }
+        REQUIRE(slot_map_offset != 0);
+        const char garbage = 0x5a;
+        REQUIRE(pwrite(fd, &garbage, 1, static_cast<off_t>(slot_map_offset + 100)) == 1);
+        close(fd);
+    }
+
+    {
+        hivedb::disk_manager_compressed manager{fw.get_path()};
+        for (hivedb::page_id_t i = 0; i < number_of_pages / 2; ++i) {
+            const auto id = manager.allocate_page_id();
+            fill_compressible(buffer, id + 1000);
+            manager.write_page(id, buffer.data());
+        }
+        manager.sync();
+        REQUIRE(std::filesystem::file_size(fw.get_path()) == file_size);
+
+        for (hivedb::page_id_t id = 0; id < number_of_pages; ++id) {
+            fill_compressible(expected, id % 2 == 0 ? id + 1000 : id);
+            manager.read_page(id, buffer.data());
+            REQUIRE(std::memcmp(buffer.data(), expected.data(), hivedb::PAGE_USABLE_SIZE) == 0);
+        }
+    }
+    REQUIRE(allocated_spots(fw.get_path()) == spots);
+}
+
+TEST_CASE("Compressed disk manager keeps freed slots until the directory is synced", "[disk_manager_compressed]") {
+    hivedb::temporary_file_wrapper fw;
+    const auto crashed_path = fw.get_path().string() + ".crashed";
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+    std::array<char, hivedb::PAGE_SIZE> expected{};
+
+    {
+        hivedb::disk_manager_compressed manager{fw.get_path()};
+        fill_compressible(buffer, 0);
+        manager.write_page(0, buffer.data());
+        manager.sync();
+
+        // page 0 moves to a raw page, page 1 needs a slot like its old one
+        fill_random(buffer, 0);
+        manager.write_page(0, buffer.data());
+        fill_compressible(buffer, 1);
+        manager.write_page(1, buffer.data());
+
+        // what a crash before the next sync would have left behind
+        std::filesystem::copy_file(fw.get_path(), crashed_path);
+    }
+
+    {
+        hivedb::disk_manager_compressed manager{crashed_path};
+        fill_compressible(expected, 0);
+        manager.read_page(0, buffer.data());
+        REQUIRE(std::memcmp(buffer.data(), expected.data(), hivedb::PAGE_USABLE_SIZE) == 0);
+    }
+    std::filesystem::remove(crashed_path);
+}
+
+TEST_CASE("Compressed disk manager keeps a moving page in its old slot until the new one is written", "[disk_manager_compressed]") {
+    hivedb::temporary_file_wrapper fw;
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+    std::array<char, hivedb::PAGE_SIZE> expected{};
+    fill_compressible(expected, 0);
+
+    {
+        hivedb::disk_manager_compressed manager{fw.get_path()};
+        manager.write_page(0, expected.data());
+        manager.sync();
+        // raw pages until the file grows into a new extent, the next one
+        // handed out lies past the end of the file
+        const auto extent_end = std::filesystem::file_size(fw.get_path());
+        for (hivedb::page_id_t id = 1; std::filesystem::file_size(fw.get_path()) == extent_end; ++id) {
+            fill_random(buffer, id);
+            manager.write_page(id, buffer.data());
+        }
+        manager.sync();
+
+        // page 0 moves to a raw page, which the file can't grow for
+        fill_random(buffer, 0);
+        {
+            file_size_limit limit{std::filesystem::file_size(fw.get_path())};
+            REQUIRE_THROWS(manager.write_page(0, buffer.data()));
+        }
+
+        manager.read_page(0, buffer.data());
+        REQUIRE(std::memcmp(buffer.data(), expected.data(), hivedb::PAGE_USABLE_SIZE) == 0);
+        manager.sync();
+    }
+
+    hivedb::disk_manager_compressed manager{fw.get_path()};
+    manager.read_page(0, buffer.data());
+    REQUIRE(std::memcmp(buffer.data(), expected.data(), hivedb::PAGE_USABLE_SIZE) == 0);
+}
+
+TEST_CASE("Compressed disk manager reclaims slots freed before a close without sync", "[disk_manager_compressed]") {
+    constexpr hivedb::page_id_t number_of_pages = 64;
+    hivedb::temporary_file_wrapper fw;
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+    std::array<char, hivedb::PAGE_SIZE> expected{};
+
+    const auto fill = [&](std::array<char, hivedb::PAGE_SIZE>& page, hivedb::page_id_t id, int round) {
+        // every 8th page is stored raw
+        if (id % 8 == 0) {
+            fill_random(page, id + round * 1000);
+        } else {
+            fill_compressible(page, id + round * 1000);
+        }
+    };
+
+    {
+        hivedb::disk_manager_compressed manager{fw.get_path()};
+        for (hivedb::page_id_t id = 0; id <= number_of_pages; ++id) {
+            fill(buffer, id, 0);
+            manager.write_page(id, buffer.data());
+        }
+        // so the bitmap of free spots has its page already
+        manager.delete_page(number_of_pages);
+        manager.sync();
+
+        // whole chunks and raw pages, and no sync() to free them
+        for (hivedb::page_id_t id = 0; id < number_of_pages; ++id) manager.delete_page(id);
+    }
+    const auto file_size = std::filesystem::file_size(fw.get_path());
+
+    // enough rounds to run out of the extent space past the pages in use
+    for (int round = 1; round <= 8; ++round) {
+        hivedb::disk_manager_compressed manager{fw.get_path()};
+        for (hivedb::page_id_t i = 0; i < number_of_pages; ++i) {
+            const auto id = manager.allocate_page_id();
+            fill(buffer, id, round);
+            manager.write_page(id, buffer.data());
+        }
+        manager.sync();
+
+        for (hivedb::page_id_t id = 0; id < number_of_pages; id += 7) {
+            fill(expected, id, round);
+            manager.read_page(id, buffer.data());
+            REQUIRE(std::memcmp(buffer.data(), expected.data(), hivedb::PAGE_USABLE_SIZE) == 0);
+        }
+        for (hivedb::page_id_t id = 0; id < number_of_pages; ++id) manager.delete_page(id);
+    }
+    REQUIRE(std::filesystem::file_size(fw.get_path()) == file_size);
+}
+
+TEST_CASE("Compressed disk manager reclaims slots freed before a crash", "[disk_manager_compressed]") {
+    constexpr hivedb::page_id_t number_of_pages = 64;
+    hivedb::temporary_file_wrapper fw;
+    hivedb::temporary_file_wrapper crashed;
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+    std::array<char, hivedb::PAGE_SIZE> expected{};
+
+    const auto fill = [&](std::array<char, hivedb::PAGE_SIZE>& page, hivedb::page_id_t id, int round) {
+        // every 8th page is stored raw
+        if (id % 8 == 0) {
+            fill_random(page, id + round * 1000);
+        } else {
+            fill_compressible(page, id + round * 1000);
+        }
+    };
+
+    // The file as it is while the manager is still open after a sync(), the
+    // slots freed by that sync() are only free in memory. No slot map either,
+    // opening took it.
+    const auto crash = [&](hivedb::disk_manager_compressed& manager) {
+        manager.sync();
+        std::filesystem::copy_file(fw.get_path(), crashed.get_path(),
+                                   std::filesystem::copy_options::overwrite_existing);
+    };
+
+    {
+        hivedb::disk_manager_compressed manager{fw.get_path()};
+        // so the bitmap of free spots has its page already
+        manager.write_page(number_of_pages, buffer.data());
+        manager.delete_page(number_of_pages);
+        manager.sync();
+    }
+    const auto file_size = std::filesystem::file_size(fw.get_path());
+
+    // enough rounds to run out of the extent space past the pages in use
+    for (int round = 1; round <= 8; ++round) {
+        {
+            hivedb::disk_manager_compressed manager{fw.get_path()};
+            for (hivedb::page_id_t id = 0; id < number_of_pages; ++id) {
+                fill(buffer, id, round);
+                manager.write_page(id, buffer.data());
+            }
+            manager.sync();
+
+            for (hivedb::page_id_t id = 0; id < number_of_pages; id += 7) {
+                fill(expected, id, round);
+                manager.read_page(id, buffer.data());
+                REQUIRE(std::memcmp(buffer.data(), expected.data(), hivedb::PAGE_USABLE_SIZE) == 0);
+            }
+            for (hivedb::page_id_t id = 0; id < number_of_pages; ++id) manager.delete_page(id);
+            crash(manager);
+        }
+        std::filesystem::copy_file(crashed.get_path(), fw.get_path(),
+                                   std::filesystem::copy_options::overwrite_existing);
+    }
+    REQUIRE(std::filesystem::file_size(fw.get_path()) == file_size);
+}
+
+TEST_CASE("Compressed disk manager works with the disk scheduler", "[disk_manager_compressed]") {
+    hivedb::temporary_file_wrapper fw;
+    hivedb::disk_scheduler<hivedb::disk_manager_compressed> scheduler{fw.get_path()};
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+    std::array<char, hivedb::PAGE_SIZE> expected{};
+
+    fill_compressible(expected, 7);
+    std::memcpy(buffer.data(), expected.data(), buffer.size());
+
+    std::promise<bool> is_done_write_promise{};
+    auto is_done = is_done_write_promise.get_future();
+    scheduler.schedule(hivedb::disk_request{
+        .type = hivedb::disk_request_type::write,
+        .data = buffer.data(),
+        .page_id = 7,
+        .is_done = std::move(is_done_write_promise)
+    });
+    REQUIRE(is_done.get());
+
+    buffer.fill(0);
+
+    std::promise<bool> is_done_read_promise{};
+    is_done = is_done_read_promise.get_future();
+    scheduler.schedule(hivedb::disk_request{
+        .type = hivedb::disk_request_type::read,
+        .data = buffer.data(),
+        .page_id = 7,
+        .is_done = std::move(is_done_read_promise)
+    });
+    REQUIRE(is_done.get());
+    REQUIRE(std::memcmp(buffer.data(), expected.data(), hivedb::PAGE_USABLE_SIZE) == 0);
+}
+
+TEST_CASE("Other disk managers refuse compressed files", "[disk_manager_compressed]") {
+    hivedb::temporary_file_wrapper fw;
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+    {
+        hivedb::disk_manager manager{fw.get_path()};
+        fill_compressible(buffer, 0);
+        manager.write_page(0, buffer.data());
+    }
+    REQUIRE_THROWS_AS(hivedb::disk_manager_compressed{fw.get_path()}, std::runtime_error);
+
+    hivedb::temporary_file_wrapper compressed;
+    {
+        hivedb::disk_manager_compressed manager{compressed.get_path()};
+        manager.write_page(0, buffer.data());
+    }
+    REQUIRE_THROWS_AS(hivedb::disk_manager{compressed.get_path()}, std::runtime_error);
+    REQUIRE_THROWS_AS(hivedb::disk_manager_mmap{compressed.get_path()}, std::runtime_error);
+}
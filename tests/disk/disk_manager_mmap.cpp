@@ -0,0 +1,184 @@
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <array>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <catch_amalgamated.hpp>
+#include <buffer_pool/buffer_pool.hpp>
+#include <disk/disk_manager.hpp>
+#include <disk/disk_manager_mmap.hpp>
+#include <misc/config.hpp>
+#include <misc/temporary_file_wrapper.hpp>
+
+
+TEST_CASE("Disk manager mmap simple tests", "[disk_manager_mmap]") {
+    // enough pages to force the mapping to grow a few times
+    constexpr auto number_of_pages = 200;
+    hivedb::temporary_file_wrapper fw;
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+
+    {
+        hivedb::disk_manager_mmap manager{fw.get_path()};
+
+        try {
+            manager.read_page(-1, &buffer[0]);
+        } catch (std::exception& err) {
+            REQUIRE(std::string_view{err.what()} == "Invalid id detected!: -1");
+        }
+
+        for (auto i = 0; i < number_of_pages; ++i) {
+            const auto data = "page number " + std::to_string(i);
+            std::memcpy(&buffer[0], data.c_str(), data.size() + 1);
+            manager.write_page(i, &buffer[0]);
+        }
+
+        manager.set_access_pattern(hivedb::access_pattern::random);
+        for (auto i = number_of_pages - 1; i >= 0; --i) {
+            manager.read_page(i, &buffer[0]);
+            REQUIRE(std::string{buffer.data()} == "page number " + std::to_string(i));
+        }
+
+        manager.delete_page(3);
+        manager.read_page(3, &buffer[0]);
+        REQUIRE(buffer[0] == 0);
+        manager.sync();
+    }
+
+    // same on-disk format as disk_manager
+    hivedb::disk_manager manager{fw.get_path()};
+    manager.read_page(42, &buffer[0]);
+    REQUIRE(std::string{buffer.data()} == "page number 42");
+}
+
+TEST_CASE("Buffer pool over mmap keeps allocating after a reopen", "[disk_manager_mmap]") {
+    hivedb::temporary_file_wrapper fw;
+    {
+        hivedb::buffer_pool<hivedb::disk_manager_mmap> bp{4, fw.get_path()};
+        for (hivedb::page_id_t id = 0; id < 8; ++id) {
+            REQUIRE(bp.allocate_new_page() == id);
+            auto& frame = bp.request_page(id);
+            const auto data = "page number " + std::to_string(id);
+            std::memcpy(frame.get_data(), data.c_str(), data.size() + 1);
+            frame.is_dirty = true;
+            REQUIRE(bp.flush_page(id));
+        }
+        bp.delete_page(3);
+    }
+
+    // the pages written before are neither handed out nor overwritten again
+    hivedb::buffer_pool<hivedb::disk_manager_mmap> bp{4, fw.get_path()};
+    REQUIRE(bp.allocate_new_page() == 3);
+    REQUIRE(bp.allocate_new_page() == 8);
+
+    auto& frame = bp.request_page(7);
+    REQUIRE(std::string{frame.get_data()} == "page number 7");
+    frame.decrease_pin_count();
+}
+
+TEST_CASE("Disk manager mmap only maps space the file really has", "[disk_manager_mmap]") {
+    hivedb::temporary_file_wrapper fw;
+    hivedb::disk_manager_mmap manager{fw.get_path()};
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+    for (hivedb::page_id_t id = 0; id < 200; ++id) manager.write_page(id, buffer.data());
+
+    // a store into a hole would SIGBUS on a full filesystem
+    struct stat st{};
+    REQUIRE(stat(fw.get_path().c_str(), &st) == 0);
+    REQUIRE(static_cast<std::uintmax_t>(st.st_blocks) * 512 >= static_cast<std::uintmax_t>(st.st_size));
+}
+
+TEST_CASE("Disk manager mmap closes files it refuses", "[disk_manager_mmap]") {
+    hivedb::temporary_file_wrapper fw;
+    {
+        std::ofstream file{fw.get_path(), std::ios::binary};
+        const std::string garbage(hivedb::PAGE_SIZE, 'x');
+        file.write(garbage.data(), static_cast<std::streamsize>(garbage.size()));
+    }
+
+    const auto open_files = [] {
+        return std::distance(std::filesystem::directory_iterator{"/proc/self/fd"}, {});
+    };
+    const auto before = open_files();
+    for (int i = 0; i < 8; ++i) REQUIRE_THROWS_AS(hivedb::disk_manager_mmap{fw.get_path()}, std::runtime_error);
+    REQUIRE(open_files() == before);
+}
+
+template <hivedb::disk_manager_t T>
+void fill_pages(const std::filesystem::path& path, hivedb::page_id_t number_of_pages) {
+    T manager{path};
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+    for (hivedb::page_id_t id = 0; id < number_of_pages; ++id) {
+        buffer[0] = static_cast<char>(id);
+        manager.write_page(id, &buffer[0]);
+    }
+}
+
+// Run with: ./tests "[benchmark]"
+TEST_CASE("Disk manager mmap vs pread benchmark", "[.][benchmark]") {
+    constexpr hivedb::page_id_t number_of_pages = 4096;
+    hivedb::temporary_file_wrapper fw;
+    fill_pages<hivedb::disk_manager>(fw.get_path(), number_of_pages);
+
+    std::vector<hivedb::page_id_t> random_ids(number_of_pages);
+    std::iota(random_ids.begin(), random_ids.end(), 0);
+    std::shuffle(random_ids.begin(), random_ids.end(), std::mt19937{42});
+
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+    hivedb::disk_manager manager{fw.get_path()};
+    hivedb::disk_manager_mmap mmap_manager{fw.get_path()};
+
+    BENCHMARK("disk_manager sequential reads") {
+        for (hivedb::page_id_t id = 0; id < number_of_pages; ++id) manager.read_page(id, &buffer[0]);
+        return buffer[0];
+    };
+    BENCHMARK("disk_manager_mmap sequential reads") {
+        for (hivedb::page_id_t id = 0; id < number_of_pages; ++id) mmap_manager.read_page(id, &buffer[0]);
+        return buffer[0];
+    };
+
+    BENCHMARK("disk_manager random reads") {
+        for (const auto id : random_ids) manager.read_page(id, &buffer[0]);
+        return buffer[0];
+    };
+    BENCHMARK("disk_manager_mmap random reads") {
+        for (const auto id : random_ids) mmap_manager.read_page(id, &buffer[0]);
+        return buffer[0];
+    };
+}
+
+// The fault heavy pattern from the buffer pool tests: far more pages than
+// frames, so nearly every request_page goes to the disk manager.
+template <hivedb::disk_manager_t T>
+char scan_through_buffer_pool(hivedb::buffer_pool<T>& bp, hivedb::page_id_t number_of_pages) {
+    char checksum = 0;
+    for (hivedb::page_id_t id = 0; id < number_of_pages; ++id) {
+        auto& frame = bp.request_page(id);
+        checksum ^= frame.get_data()[0];
+        frame.decrease_pin_count();
+    }
+    return checksum;
+}
+
+TEST_CASE("Buffer pool page faults mmap vs pread benchmark", "[.][benchmark]") {
+    constexpr hivedb::page_id_t number_of_pages = 512;
+    hivedb::temporary_file_wrapper fw;
+    fill_pages<hivedb::disk_manager>(fw.get_path(), number_of_pages);
+
+    hivedb::buffer_pool<hivedb::disk_manager> bp{16, fw.get_path()};
+    BENCHMARK("buffer_pool<disk_manager> scan") {
+        return scan_through_buffer_pool(bp, number_of_pages);
+    };
+
+    hivedb::buffer_pool<hivedb::disk_manager_mmap> mmap_bp{16, fw.get_path()};
+    BENCHMARK("buffer_pool<disk_manager_mmap> scan") {
+        return scan_through_buffer_pool(mmap_bp, number_of_pages);
+    };
+}
@@ -0,0 +1,145 @@
+#include <array>
+#include <filesystem>
+#include <future>
+#include <string>
+#include <vector>
+
+#include <catch_amalgamated.hpp>
+#include <disk/disk_manager.hpp>
+#include <disk/disk_manager_segmented.hpp>
+#include <disk/disk_scheduler.hpp>
+#include <misc/aligned_buffer.hpp>
+#include <misc/config.hpp>
+#include <misc/temporary_file_wrapper.hpp>
+
+namespace {
+// temporary_file_wrapper only knows about the db file
+struct segment_cleanup {
+    std::vector<std::filesystem::path> paths;
+
+    ~segment_cleanup() {
+        for (const auto& path : paths) std::filesystem::remove(path);
+    }
+};
+
+hivedb::segment_options small_segments() {
+    return hivedb::segment_options{.segment_count = 3,
+                                   .pages_per_segment = 4 * hivedb::PAGES_PER_SEGMENT_STRIPE};
+}
+}  // namespace
+
+
+TEST_CASE("Segmented disk manager stripes pages over the segments", "[disk_manager_segmented]") {
+    hivedb::temporary_file_wrapper fw;
+    segment_cleanup cleanup;
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+    const auto number_of_pages = 3 * 4 * hivedb::PAGES_PER_SEGMENT_STRIPE;
+
+    {
+        hivedb::disk_manager_segmented manager{fw.get_path(), small_segments()};
+        for (std::size_t i = 0; i < manager.segment_count(); ++i)
+            cleanup.paths.push_back(manager.get_segment_path(i));
+
+        REQUIRE(manager.segment_of(0) == 0);
+        REQUIRE(manager.segment_of(hivedb::PAGES_PER_SEGMENT_STRIPE - 1) == 0);
+        REQUIRE(manager.segment_of(hivedb::PAGES_PER_SEGMENT_STRIPE) == 1);
+        REQUIRE(manager.segment_of(3 * hivedb::PAGES_PER_SEGMENT_STRIPE) == 0);
+
+        // new ids fill a stripe before moving on to the next segment
+        for (hivedb::page_id_t id = 0; id < number_of_pages; ++id)
+            REQUIRE(manager.allocate_page_id() == id);
+        REQUIRE_THROWS_AS(manager.allocate_page_id(), std::runtime_error);
+
+        for (hivedb::page_id_t id = 0; id < number_of_pages; ++id) {
+            const auto data = "page number " + std::to_string(id);
+            std::memcpy(buffer.data(), data.c_str(), data.size() + 1);
+            manager.write_page(id, buffer.data());
+        }
+        REQUIRE_THROWS_AS(manager.write_page(number_of_pages, buffer.data()), std::runtime_error);
+
+        manager.delete_page(70);
+        manager.sync();
+    }
+
+    // every segment holds its share
+    for (const auto& path : cleanup.paths)
+        REQUIRE(std::filesystem::file_size(path) >= 4 * hivedb::PAGES_PER_SEGMENT_STRIPE * hivedb::PAGE_SIZE);
+
+    hivedb::disk_manager_segmented manager{fw.get_path(), small_segments()};
+    REQUIRE(manager.page_id_end() == number_of_pages);
+    REQUIRE(manager.allocate_page_id() == 70);
+    for (hivedb::page_id_t id = 0; id < number_of_pages; ++id) {
+        manager.read_page(id, buffer.data());
+        if (id == 70) {
+            REQUIRE(buffer[0] == 0);
+        } else {
+            REQUIRE(std::string{buffer.data()} == "page number " + std::to_string(id));
+        }
+    }
+}
+
+TEST_CASE("Segmented disk manager checks the layout", "[disk_manager_segmented]") {
+    hivedb::temporary_file_wrapper fw;
+    segment_cleanup cleanup;
+    {
+        hivedb::disk_manager_segmented manager{fw.get_path(), small_segments()};
+        for (std::size_t i = 0; i < manager.segment_count(); ++i)
+            cleanup.paths.push_back(manager.get_segment_path(i));
+    }
+
+    auto options = small_segments();
+    options.segment_count = 2;
+    REQUIRE_THROWS_AS((hivedb::disk_manager_segmented{fw.get_path(), options}), std::runtime_error);
+
+    options = small_segments();
+    options.pages_per_segment = 100;
+    REQUIRE_THROWS_AS((hivedb::disk_manager_segmented{fw.get_path(), options}), std::invalid_argument);
+}
+
+TEST_CASE("Disk scheduler gives every segment its own workers", "[disk_manager_segmented]") {
+    hivedb::temporary_file_wrapper fw;
+    segment_cleanup cleanup;
+    constexpr hivedb::page_id_t number_of_pages = 3 * 4 * hivedb::PAGES_PER_SEGMENT_STRIPE;
+
+    hivedb::aligned_buffer pages{number_of_pages * hivedb::PAGE_SIZE};
+    {
+        hivedb::disk_scheduler<hivedb::disk_manager_segmented> scheduler{
+            fw.get_path(), hivedb::disk_scheduler_options{.worker_count = 2}, small_segments()};
+        auto& manager = scheduler.get_manager();
+        for (std::size_t i = 0; i < manager.segment_count(); ++i)
+            cleanup.paths.push_back(manager.get_segment_path(i));
+        REQUIRE(scheduler.worker_count() == 6);
+
+        std::vector<std::future<bool>> futures;
+        for (hivedb::page_id_t id = 0; id < number_of_pages; ++id) {
+            std::memset(pages.data() + id * hivedb::PAGE_SIZE, 'a' + id % 26, hivedb::PAGE_SIZE);
+            std::promise<bool> is_done;
+            futures.push_back(is_done.get_future());
+            scheduler.schedule(hivedb::disk_request{
+                .type = hivedb::disk_request_type::write,
+                .data = pages.data() + id * hivedb::PAGE_SIZE,
+                .page_id = id,
+                .is_done = std::move(is_done)
+            });
+        }
+        for (auto& future : futures) REQUIRE(future.get());
+
+        std::promise<bool> is_synced;
+        auto sync_future = is_synced.get_future();
+        scheduler.schedule(hivedb::disk_request{
+            .type = hivedb::disk_request_type::sync,
+            .data = nullptr,
+            .page_id = hivedb::INVALID_PAGE_ID,
+            .is_done = std::move(is_synced)
+        });
+        REQUIRE(sync_future.get());
+    }
+
+    hivedb::disk_manager_segmented manager{fw.get_path(), small_segments()};
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+    for (hivedb::page_id_t id = 0; id < number_of_pages; ++id) {
+        manager.read_page(id, buffer.data());
+        REQUIRE(buffer[0] == 'a' + id % 26);
+        REQUIRE(buffer[hivedb::PAGE_USABLE_SIZE - 1] == 'a' + id % 26);
+    }
+}
@@ -0,0 +1,168 @@
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <random>
+#include <string>
+
+#include <catch_amalgamated.hpp>
+#include <buffer_pool/buffer_pool.hpp>
+#include <disk/disk_manager.hpp>
+#include <disk/disk_manager_mock.hpp>
+#include <disk/disk_manager_simulated.hpp>
+#include <disk/disk_scheduler.hpp>
+#include <misc/config.hpp>
+#include <misc/temporary_file_wrapper.hpp>
+
+using namespace std::chrono_literals;
+
+namespace {
+hivedb::simulation_options counted(hivedb::device_model device) {
+    return hivedb::simulation_options{.device = device, .mode = hivedb::latency_mode::count_only};
+}
+}  // namespace
+
+
+TEST_CASE("Simulated disk seeks cost by distance", "[disk_manager_simulated]") {
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+    auto device = hivedb::hdd_device_model();
+    device.jitter = 0ns;
+    device.full_seek_distance = 1024;
+
+    hivedb::disk_manager_simulated<hivedb::disk_manager_mock> sequential{"", counted(device)};
+    for (hivedb::page_id_t id = 0; id < 100; ++id) sequential.read_page(id, buffer.data());
+
+    hivedb::disk_manager_simulated<hivedb::disk_manager_mock> random{"", counted(device)};
+    // the mock only grows a few pages at a time, fill it past the head's travel
+    for (hivedb::page_id_t id = 0; id < 1024; ++id) random.get_manager().write_page(id, buffer.data());
+    std::mt19937 gen{7};
+    std::uniform_int_distribution<hivedb::page_id_t> dist{0, 1023};
+    for (auto i = 0; i < 100; ++i) random.read_page(dist(gen), buffer.data());
+
+    // the first read moves nothing, then it's latency and transfer only
+    const auto transfer = std::chrono::nanoseconds{hivedb::PAGE_SIZE * 1'000'000'000ull / device.bandwidth};
+    REQUIRE(sequential.get_device_time() == 100 * (device.read_latency + transfer));
+    // every random read waits for the platter and a seek
+    REQUIRE(random.get_device_time() > 100 * (device.read_latency + transfer + device.rotation));
+    REQUIRE(random.get_device_time() < 100 * (device.read_latency + transfer + device.rotation + device.full_seek));
+}
+
+TEST_CASE("Simulated disk caps bandwidth and is reproducible", "[disk_manager_simulated]") {
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+
+    // 1000 pages a second, spread over 4 channels
+    const hivedb::device_model device{.bandwidth = 1000 * hivedb::PAGE_SIZE, .parallelism = 4};
+    hivedb::disk_manager_simulated<hivedb::disk_manager_mock> capped{"", counted(device)};
+    for (hivedb::page_id_t id = 0; id < 10; ++id) capped.write_page(id, buffer.data());
+    // each channel moves a quarter of the bandwidth
+    REQUIRE(capped.get_device_time() == 40ms);
+
+    const auto jittery = [&buffer]() {
+        hivedb::disk_manager_simulated<hivedb::disk_manager_mock> manager{"", counted(hivedb::ssd_device_model())};
+        for (hivedb::page_id_t id = 0; id < 100; ++id) manager.read_page(id * 3, buffer.data());
+        return manager.get_device_time();
+    };
+    REQUIRE(jittery() == jittery());
+}
+
+TEST_CASE("Simulated disk takes its time", "[disk_manager_simulated]") {
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+    const hivedb::device_model device{.read_latency = 2ms};
+    hivedb::disk_manager_simulated<hivedb::disk_manager_mock> manager{"", hivedb::simulation_options{.device = device}};
+
+    const auto start = std::chrono::steady_clock::now();
+    for (hivedb::page_id_t id = 0; id < 5; ++id) manager.read_page(id, buffer.data());
+    REQUIRE(std::chrono::steady_clock::now() - start >= 10ms);
+}
+
+TEST_CASE("Simulated disk injects faults", "[disk_manager_simulated]") {
+    std::array<char, hivedb::PAGE_SIZE> old_page{};
+    std::array<char, hivedb::PAGE_SIZE> new_page{};
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+    old_page.fill('a');
+    new_page.fill('b');
+
+    SECTION("failed writes leave the page alone") {
+        hivedb::disk_manager_simulated<hivedb::disk_manager_mock> manager{
+            "", hivedb::simulation_options{.faults = {.read_error_rate = 1, .write_error_rate = 1}}};
+        manager.get_manager().write_page(0, old_page.data());
+
+        REQUIRE_THROWS_AS(manager.write_page(0, new_page.data()), std::runtime_error);
+        REQUIRE_THROWS_AS(manager.read_page(0, buffer.data()), std::runtime_error);
+        REQUIRE(manager.get_injected_faults() == 2);
+
+        manager.get_manager().read_page(0, buffer.data());
+        REQUIRE(buffer == old_page);
+    }
+
+    SECTION("torn writes leave half of the page") {
+        hivedb::disk_manager_simulated<hivedb::disk_manager_mock> manager{
+            "", hivedb::simulation_options{.faults = {.torn_write_rate = 1}}};
+        manager.get_manager().write_page(0, old_page.data());
+
+        REQUIRE_THROWS_AS(manager.write_page(0, new_page.data()), std::runtime_error);
+        manager.read_page(0, buffer.data());
+        REQUIRE(buffer[0] == 'b');
+        REQUIRE(buffer[hivedb::PAGE_SIZE / 2 - 1] == 'b');
+        REQUIRE(buffer[hivedb::PAGE_SIZE / 2] == 'a');
+        REQUIRE(buffer[hivedb::PAGE_SIZE - 1] == 'a');
+    }
+}
+
+TEST_CASE("Torn writes fail the page's checksum", "[disk_manager_simulated]") {
+    hivedb::temporary_file_wrapper fw;
+    std::array<char, hivedb::PAGE_SIZE> old_page{};
+    std::array<char, hivedb::PAGE_SIZE> new_page{};
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+    old_page.fill('a');
+    new_page.fill('b');
+
+    const auto torn_write_protection = GENERATE(hivedb::torn_write_protection::none,
+                                                hivedb::torn_write_protection::double_write);
+    hivedb::disk_manager_simulated<hivedb::disk_manager> manager{
+        fw.get_path(), hivedb::simulation_options{.faults = {.torn_write_rate = 1}},
+        hivedb::durability_mode::manual, hivedb::io_mode::buffered, torn_write_protection};
+    manager.get_manager().write_page(0, old_page.data());
+
+    REQUIRE_THROWS_AS(manager.write_page(0, new_page.data()), std::runtime_error);
+    REQUIRE_THROWS_WITH(manager.read_page(0, buffer.data()), "Checksum mismatch on page_id:0");
+}
+
+TEST_CASE("Disk scheduler fails the requests of faulty pages", "[disk_manager_simulated]") {
+    hivedb::disk_scheduler<hivedb::disk_manager_simulated<hivedb::disk_manager_mock>> scheduler{
+        "", hivedb::simulation_options{.faults = {.read_error_rate = 1}, .mode = hivedb::latency_mode::count_only}};
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+
+    const auto run = [&](hivedb::disk_request_type type) {
+        std::promise<bool> promise;
+        auto done = promise.get_future();
+        scheduler.schedule(hivedb::disk_request{
+            .type = type, .data = buffer.data(), .page_id = 0, .is_done = std::move(promise)});
+        return done.get();
+    };
+
+    // the worker lives on after a failed request
+    REQUIRE_FALSE(run(hivedb::disk_request_type::read));
+    REQUIRE(run(hivedb::disk_request_type::write));
+    REQUIRE_FALSE(run(hivedb::disk_request_type::read));
+    REQUIRE(scheduler.get_manager().get_injected_faults() == 2);
+}
+
+TEST_CASE("Buffer pool on a simulated disk", "[disk_manager_simulated]") {
+    hivedb::temporary_file_wrapper fw;
+    auto device = hivedb::ssd_device_model();
+    device.jitter = 0ns;
+    hivedb::buffer_pool<hivedb::disk_manager_simulated<hivedb::disk_manager>> pool{
+        8, fw.get_path(), hivedb::simulation_options{.device = device}};
+
+    const auto start = std::chrono::steady_clock::now();
+    for (auto i = 0; i < 8; ++i) {
+        const auto id = pool.allocate_new_page();
+        auto& frame = pool.request_page(id);
+        std::memcpy(frame.get_data(), &id, sizeof(id));
+        frame.is_dirty = true;
+        frame.decrease_pin_count();
+    }
+    REQUIRE(pool.flush_pages());
+    REQUIRE(std::chrono::steady_clock::now() - start >= 8 * device.write_latency);
+}
@@ -0,0 +1,147 @@
+#include <array>
+#include <exception>
+#include <fstream>
+#include <future>
+#include <string>
+#include <vector>
+
+#include <catch_amalgamated.hpp>
+#include <disk/disk_manager.hpp>
+#include <disk/disk_manager_compressed.hpp>
+#include <disk/disk_manager_uring.hpp>
+#include <disk/disk_scheduler.hpp>
+#include <misc/config.hpp>
+#include <misc/temporary_file_wrapper.hpp>
+
+
+TEST_CASE("Disk manager uring simple tests", "[disk_manager_uring]") {
+    hivedb::temporary_file_wrapper fw;
+    hivedb::disk_manager_uring manager{fw.get_path()};
+    // the pread/pwrite fallback would pass all of this too
+    if (!manager.is_using_uring()) SKIP("The kernel doesn't give us an io_uring");
+
+    constexpr std::string_view page_1_data = "ILOVEJOE!?!?!?!?!?!?!?!?!?!?!?!?!?!?!?!";
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+
+    try {
+        manager.write_page(-1, nullptr);
+    } catch (std::exception& err) {
+        REQUIRE(std::string_view{err.what()} == "Invalid id detected!: -1");
+    }
+
+    // never written pages read back as zeroes
+    buffer.fill('x');
+    manager.read_page(3, &buffer[0]);
+    REQUIRE(buffer[0] == 0);
+    REQUIRE(buffer[hivedb::PAGE_SIZE - 1] == 0);
+
+    std::memcpy(&buffer[0], page_1_data.data(), page_1_data.size());
+    manager.write_page(0, &buffer[0]);
+    std::memset(&buffer[0], 0, hivedb::PAGE_SIZE);
+    manager.read_page(0, &buffer[0]);
+    REQUIRE(std::string_view{buffer.data()} == page_1_data);
+
+    manager.delete_page(0);
+    manager.read_page(0, &buffer[0]);
+    REQUIRE(buffer[0] == 0);
+}
+
+TEST_CASE("Disk scheduler batches requests into the ring", "[disk_manager_uring]") {
+    constexpr auto number_of_pages = 200;
+    hivedb::temporary_file_wrapper fw;
+    // every worker gets a ring of its own
+    hivedb::disk_scheduler<hivedb::disk_manager_uring> scheduler{fw.get_path(), hivedb::disk_scheduler_options{.worker_count = 4}};
+    if (!scheduler.get_manager().is_using_uring()) SKIP("The kernel doesn't give us an io_uring");
+
+    std::vector<std::array<char, hivedb::PAGE_SIZE>> pages(number_of_pages);
+    std::vector<std::future<bool>> results;
+
+    for (auto i = 0; i < number_of_pages; ++i) {
+        const auto data = "page number " + std::to_string(i);
+        std::memcpy(pages[i].data(), data.c_str(), data.size() + 1);
+
+        std::promise<bool> is_done;
+        results.push_back(is_done.get_future());
+        scheduler.schedule(hivedb::disk_request{
+            .type = hivedb::disk_request_type::write,
+            .data = pages[i].data(),
+            .page_id = i,
+            .is_done = std::move(is_done)
+        });
+    }
+    for (auto& result : results) REQUIRE(result.get());
+
+    results.clear();
+    for (auto& page : pages) page.fill(0);
+
+    for (auto i = 0; i < number_of_pages; ++i) {
+        std::promise<bool> is_done;
+        results.push_back(is_done.get_future());
+        scheduler.schedule(hivedb::disk_request{
+            .type = hivedb::disk_request_type::read,
+            .data = pages[i].data(),
+            .page_id = i,
+            .is_done = std::move(is_done)
+        });
+    }
+    for (auto& result : results) REQUIRE(result.get());
+
+    for (auto i = 0; i < number_of_pages; ++i) {
+        REQUIRE(std::string{pages[i].data()} == "page number " + std::to_string(i));
+    }
+}
+
+TEST_CASE("Disk manager uring shares its files with disk_manager", "[disk_manager_uring]") {
+    constexpr hivedb::page_id_t number_of_pages = 100;
+    hivedb::temporary_file_wrapper fw;
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+
+    {
+        hivedb::disk_manager manager{fw.get_path()};
+        for (hivedb::page_id_t id = 0; id < number_of_pages; id += 2) {
+            const auto data = "disk_manager page " + std::to_string(id);
+            std::memcpy(buffer.data(), data.c_str(), data.size() + 1);
+            manager.write_page(id, buffer.data());
+        }
+    }
+
+    {
+        hivedb::disk_manager_uring manager{fw.get_path()};
+        for (hivedb::page_id_t id = 0; id < number_of_pages; id += 2) {
+            manager.read_page(id, buffer.data());
+            REQUIRE(std::string{buffer.data()} == "disk_manager page " + std::to_string(id));
+        }
+        for (hivedb::page_id_t id = 1; id < number_of_pages; id += 2) {
+            const auto data = "uring page " + std::to_string(id);
+            std::memcpy(buffer.data(), data.c_str(), data.size() + 1);
+            manager.write_page(id, buffer.data());
+        }
+        manager.sync();
+    }
+
+    // the directory and the checksums of the uring's pages are disk_manager's
+    hivedb::disk_manager manager{fw.get_path()};
+    for (hivedb::page_id_t id = 0; id < number_of_pages; ++id) {
+        manager.read_page(id, buffer.data());
+        const auto prefix = id % 2 == 0 ? "disk_manager page " : "uring page ";
+        REQUIRE(std::string{buffer.data()} == prefix + std::to_string(id));
+    }
+}
+
+TEST_CASE("Disk manager uring refuses files it doesn't understand", "[disk_manager_uring]") {
+    hivedb::temporary_file_wrapper garbage;
+    {
+        std::ofstream file{garbage.get_path(), std::ios::binary};
+        const std::string data(hivedb::PAGE_SIZE, 'x');
+        file.write(data.data(), static_cast<std::streamsize>(data.size()));
+    }
+    REQUIRE_THROWS_AS(hivedb::disk_manager_uring{garbage.get_path()}, std::runtime_error);
+
+    hivedb::temporary_file_wrapper compressed;
+    {
+        hivedb::disk_manager_compressed manager{compressed.get_path()};
+        std::array<char, hivedb::PAGE_SIZE> buffer{};
+        manager.write_page(0, buffer.data());
+    }
+    REQUIRE_THROWS_AS(hivedb::disk_manager_uring{compressed.get_path()}, std::runtime_error);
+}
@@ -1,9 +1,23 @@
 #include "catch_amalgamated.hpp"
 
 #include <misc/config.hpp>
+#include <misc/temporary_file_wrapper.hpp>
+#include <disk/disk_completion_queue.hpp>
 #include <disk/disk_scheduler.hpp>
+#include <disk/disk_manager.hpp>
 #include <disk/disk_manager_mock.hpp>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <future>
+#include <mutex>
+#include <span>
+#include <stdexcept>
 #include <thread>
+#include <vector>
 
 
 TEST_CASE("Disk scheduler simple test", "[disk_scheduler]") {
@@ -48,3 +62,299 @@ TEST_CASE("Disk scheduler simple test", "[disk_scheduler]") {
 
     REQUIRE(data == std::string_view{buffer.data()});
 }
+
+TEST_CASE("Disk scheduler multiple workers", "[disk_scheduler]") {
+    constexpr hivedb::page_id_t number_of_pages = 512;
+    constexpr auto number_of_producers = 4;
+
+    hivedb::temporary_file_wrapper fw;
+    hivedb::disk_scheduler<hivedb::disk_manager> scheduler{
+        fw.get_path(), hivedb::disk_scheduler_options{.worker_count = 4}};
+    REQUIRE(scheduler.worker_count() == 4);
+
+    const auto schedule = [&scheduler](hivedb::disk_request_type type, hivedb::page_id_t id, char* data) {
+        std::promise<bool> is_done{};
+        auto future = is_done.get_future();
+        scheduler.schedule(hivedb::disk_request{
+            .type = type,
+            .data = data,
+            .page_id = id,
+            .is_done = std::move(is_done)
+        });
+        return future;
+    };
+
+    // every page is written twice without waiting in between, a read has to
+    // see the second write no matter which worker served what
+    std::vector<std::array<char, hivedb::PAGE_SIZE>> first(number_of_pages);
+    std::vector<std::array<char, hivedb::PAGE_SIZE>> second(number_of_pages);
+    // Catch's assertions aren't thread safe, check the results afterwards
+    std::vector<bool> is_written(number_of_producers, true);
+    std::vector<std::thread> producers;
+    for (auto producer = 0; producer < number_of_producers; ++producer) {
+        producers.emplace_back([&, producer]() {
+            std::vector<std::future<bool>> futures;
+            for (hivedb::page_id_t id = producer; id < number_of_pages; id += number_of_producers) {
+                first[id].fill('a');
+                second[id].fill('b');
+                std::memcpy(second[id].data(), &id, sizeof(id));
+                futures.push_back(schedule(hivedb::disk_request_type::write, id, first[id].data()));
+                futures.push_back(schedule(hivedb::disk_request_type::write, id, second[id].data()));
+            }
+            for (auto& future : futures) {
+                if (!future.get()) is_written[producer] = false;
+            }
+        });
+    }
+    for (auto& producer : producers) producer.join();
+    REQUIRE(std::all_of(is_written.begin(), is_written.end(), [](bool is_ok) { return is_ok; }));
+
+    REQUIRE(schedule(hivedb::disk_request_type::sync, hivedb::INVALID_PAGE_ID, nullptr).get());
+
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+    for (hivedb::page_id_t id = 0; id < number_of_pages; ++id) {
+        REQUIRE(schedule(hivedb::disk_request_type::read, id, buffer.data()).get());
+        REQUIRE(std::memcmp(buffer.data(), second[id].data(), hivedb::PAGE_USABLE_SIZE) == 0);
+    }
+}
+
+// Records the order pages are served in. The first request blocks until the
+// test opens the gate, so everything scheduled meanwhile piles up.
+struct ordering_disk_manager {
+    static inline std::mutex latch;
+    static inline std::vector<hivedb::page_id_t> served;
+    static inline std::promise<void> started;
+    static inline std::shared_future<void> gate;
+
+    explicit ordering_disk_manager(const std::filesystem::path&) {}
+
+    void record(hivedb::page_id_t id) {
+        std::unique_lock ul{latch};
+        if (served.empty()) {
+            served.push_back(id);
+            ul.unlock();
+            started.set_value();
+            gate.wait();
+            return;
+        }
+        served.push_back(id);
+    }
+
+    void read_page(hivedb::page_id_t id, char*) { record(id); }
+    void write_page(hivedb::page_id_t id, const char*) { record(id); }
+    void delete_page(hivedb::page_id_t) {}
+};
+
+TEST_CASE("Disk scheduler priority classes", "[disk_scheduler]") {
+    constexpr hivedb::page_id_t blocker = 0;
+    constexpr hivedb::page_id_t first_prefetch = 1000;
+    constexpr hivedb::page_id_t first_flush = 2000;
+    constexpr hivedb::page_id_t first_read = 3000;
+    constexpr auto number_of_reads = 6 * static_cast<hivedb::page_id_t>(hivedb::MAX_DISK_BATCH_SIZE);
+
+    std::promise<void> gate;
+    ordering_disk_manager::served.clear();
+    ordering_disk_manager::started = std::promise<void>{};
+    ordering_disk_manager::gate = gate.get_future().share();
+
+    std::vector<std::future<bool>> futures;
+    hivedb::disk_scheduler<ordering_disk_manager> scheduler{""};
+    const auto schedule = [&](hivedb::page_id_t id, hivedb::disk_request_type type, hivedb::disk_request_priority priority) {
+        std::promise<bool> is_done;
+        futures.push_back(is_done.get_future());
+        scheduler.schedule(hivedb::disk_request{
+            .type = type,
+            .data = nullptr,
+            .page_id = id,
+            .is_done = std::move(is_done),
+            .priority = priority
+        });
+    };
+
+    schedule(blocker, hivedb::disk_request_type::read, hivedb::disk_request_priority::foreground_read);
+    ordering_disk_manager::started.get_future().wait();
+
+    // least urgent first, so FIFO order would be exactly backwards
+    schedule(first_prefetch, hivedb::disk_request_type::read, hivedb::disk_request_priority::prefetch);
+    for (auto i = 0; i < 8; ++i) {
+        schedule(first_flush + i, hivedb::disk_request_type::write, hivedb::disk_request_priority::background_flush);
+    }
+    for (auto i = 0; i < number_of_reads; ++i) {
+        schedule(first_read + i, hivedb::disk_request_type::read, hivedb::disk_request_priority::foreground_read);
+    }
+
+    gate.set_value();
+    for (auto& future : futures) REQUIRE(future.get());
+
+    const auto& served = ordering_disk_manager::served;
+    REQUIRE(served.size() == futures.size());
+    REQUIRE(served[1] == first_read);
+
+    // the lower classes get through before the reads run out
+    const auto position = [&served](hivedb::page_id_t id) {
+        return std::distance(served.begin(), std::find(served.begin(), served.end(), id));
+    };
+    const auto last_read = position(first_read + number_of_reads - 1);
+    REQUIRE(position(first_flush) < last_read);
+    REQUIRE(position(first_prefetch) < last_read);
+    REQUIRE(position(first_flush) < position(first_prefetch));
+}
+
+TEST_CASE("Disk scheduler completion callbacks", "[disk_scheduler]") {
+    constexpr hivedb::page_id_t number_of_pages = 100;
+    hivedb::disk_scheduler<hivedb::disk_manager_mock> scheduler{""};
+    std::vector<std::array<char, hivedb::PAGE_SIZE>> pages(number_of_pages);
+
+    hivedb::disk_completion_queue completions;
+    for (hivedb::page_id_t id = 0; id < number_of_pages; ++id) {
+        pages[id].fill(static_cast<char>(id));
+        hivedb::disk_request req{
+            .type = hivedb::disk_request_type::write,
+            .data = pages[id].data(),
+            .page_id = id,
+            .is_done = std::nullopt
+        };
+        completions.attach(req, 1000 + id);
+        scheduler.schedule(std::move(req));
+    }
+
+    std::vector<hivedb::disk_completion> completed;
+    REQUIRE(completions.wait(completed, number_of_pages) == number_of_pages);
+    REQUIRE(completions.poll(completed) == 0);
+
+    std::vector<bool> seen(number_of_pages, false);
+    for (const auto& completion : completed) {
+        REQUIRE(completion.is_ok);
+        REQUIRE(completion.tag == static_cast<std::uint64_t>(1000 + completion.page_id));
+        seen[completion.page_id] = true;
+    }
+    REQUIRE(std::all_of(seen.begin(), seen.end(), [](bool is_seen) { return is_seen; }));
+
+    // a plain callback, the sync completes last
+    std::atomic<int> reads_done{0};
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+    hivedb::disk_request read{
+        .type = hivedb::disk_request_type::read,
+        .data = buffer.data(),
+        .page_id = 42,
+        .is_done = std::nullopt,
+        .on_complete = [](void* counter, const hivedb::disk_request& req, bool is_ok) {
+            if (is_ok && req.data[0] == 42) static_cast<std::atomic<int>*>(counter)->fetch_add(1);
+        },
+        .context = &reads_done
+    };
+    scheduler.schedule(std::move(read));
+
+    std::promise<bool> is_synced;
+    auto synced = is_synced.get_future();
+    scheduler.schedule(hivedb::disk_request{
+        .type = hivedb::disk_request_type::sync,
+        .data = nullptr,
+        .page_id = hivedb::INVALID_PAGE_ID,
+        .is_done = std::move(is_synced)
+    });
+    REQUIRE(synced.get());
+    REQUIRE(reads_done == 1);
+}
+
+// Counts syncs, each of which takes a while like a real fdatasync does.
+struct slow_sync_disk_manager {
+    static inline std::atomic<std::size_t> syncs{0};
+
+    explicit slow_sync_disk_manager(const std::filesystem::path&) {}
+
+    void read_page(hivedb::page_id_t, char*) {}
+    void write_page(hivedb::page_id_t, const char*) {}
+    void delete_page(hivedb::page_id_t) {}
+
+    void sync() {
+        std::this_thread::sleep_for(std::chrono::milliseconds{5});
+        ++syncs;
+    }
+    void end_batch() {}
+};
+
+TEST_CASE("Disk scheduler commits concurrent syncs in groups", "[disk_scheduler]") {
+    constexpr auto number_of_committers = 8;
+    constexpr auto commits_per_committer = 20;
+    slow_sync_disk_manager::syncs = 0;
+
+    hivedb::disk_scheduler<slow_sync_disk_manager> scheduler{
+        "", hivedb::disk_scheduler_options{.worker_count = 2,
+                                           .group_commit_window = std::chrono::microseconds{500}}};
+
+    // every committer writes a page and waits for its sync, like a session
+    // committing a transaction
+    std::vector<bool> is_committed(number_of_committers, true);
+    std::vector<std::thread> committers;
+    for (auto committer = 0; committer < number_of_committers; ++committer) {
+        committers.emplace_back([&, committer]() {
+            for (auto i = 0; i < commits_per_committer; ++i) {
+                std::promise<bool> is_written;
+                auto written = is_written.get_future();
+                scheduler.schedule(hivedb::disk_request{
+                    .type = hivedb::disk_request_type::write,
+                    .data = nullptr,
+                    .page_id = committer * commits_per_committer + i,
+                    .is_done = std::move(is_written)
+                });
+
+                std::promise<bool> is_synced;
+                auto synced = is_synced.get_future();
+                scheduler.schedule(hivedb::disk_request{
+                    .type = hivedb::disk_request_type::sync,
+                    .data = nullptr,
+                    .page_id = hivedb::INVALID_PAGE_ID,
+                    .is_done = std::move(is_synced)
+                });
+                if (!written.get() || !synced.get()) is_committed[committer] = false;
+            }
+        });
+    }
+    for (auto& committer : committers) committer.join();
+
+    REQUIRE(std::all_of(is_committed.begin(), is_committed.end(), [](bool is_ok) { return is_ok; }));
+    // one sync per commit would be number_of_committers * commits_per_committer
+    REQUIRE(slow_sync_disk_manager::syncs < number_of_committers * commits_per_committer / 2);
+}
+
+// Serves the even pages of a batch, then gives up on the rest by throwing
+// something that is not a std::runtime_error.
+struct half_failing_disk_manager {
+    explicit half_failing_disk_manager(const std::filesystem::path&) {}
+
+    void read_page(hivedb::page_id_t, char*) {}
+    void write_page(hivedb::page_id_t, const char*) {}
+    void delete_page(hivedb::page_id_t) {}
+
+    void submit_batch(std::span<hivedb::disk_request> batch) {
+        for (auto& req : batch) {
+            if (req.page_id % 2 == 0) req.complete(true);
+        }
+        for (const auto& req : batch) {
+            if (req.page_id % 2 != 0) throw std::logic_error("odd page");
+        }
+    }
+};
+
+TEST_CASE("Disk scheduler fails what a throwing batch left pending", "[disk_scheduler]") {
+    constexpr hivedb::page_id_t number_of_pages = 16;
+    hivedb::disk_scheduler<half_failing_disk_manager> scheduler{""};
+
+    std::vector<std::future<bool>> futures;
+    for (hivedb::page_id_t id = 0; id < number_of_pages; ++id) {
+        std::promise<bool> is_done;
+        futures.push_back(is_done.get_future());
+        scheduler.schedule(hivedb::disk_request{
+            .type = hivedb::disk_request_type::read,
+            .data = nullptr,
+            .page_id = id,
+            .is_done = std::move(is_done)
+        });
+    }
+
+    // every request hears back exactly once, the worker lives on
+    for (hivedb::page_id_t id = 0; id < number_of_pages; ++id) {
+        REQUIRE(futures[id].get() == (id % 2 == 0));
+    }
+}
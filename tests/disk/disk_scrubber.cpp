@@ -0,0 +1,107 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <catch_amalgamated.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <disk/disk_manager.hpp>
+#include <disk/disk_scheduler.hpp>
+#include <disk/disk_scrubber.hpp>
+#include <misc/config.hpp>
+#include <misc/temporary_file_wrapper.hpp>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace {
+// flips a byte right after the first copy of marker in the file
+void corrupt_after(const std::filesystem::path& path, std::string_view marker) {
+    const int fd = open(path.c_str(), O_RDWR);
+    REQUIRE(fd != -1);
+
+    std::vector<char> contents(std::filesystem::file_size(path));
+    REQUIRE(pread(fd, contents.data(), contents.size(), 0) == static_cast<ssize_t>(contents.size()));
+    const auto it = std::search(contents.begin(), contents.end(), marker.begin(), marker.end());
+    REQUIRE(it != contents.end());
+
+    const auto offset = std::distance(contents.begin(), it) + marker.size();
+    const char flipped = static_cast<char>(contents[offset] ^ 0x20);
+    REQUIRE(pwrite(fd, &flipped, 1, offset) == 1);
+    close(fd);
+}
+
+// zeroes the trailer of the page holding the first copy of marker
+void wipe_trailer_after(const std::filesystem::path& path, std::string_view marker) {
+    const int fd = open(path.c_str(), O_RDWR);
+    REQUIRE(fd != -1);
+
+    std::vector<char> contents(std::filesystem::file_size(path));
+    REQUIRE(pread(fd, contents.data(), contents.size(), 0) == static_cast<ssize_t>(contents.size()));
+    const auto it = std::search(contents.begin(), contents.end(), marker.begin(), marker.end());
+    REQUIRE(it != contents.end());
+
+    const auto page_start = std::distance(contents.begin(), it) / hivedb::PAGE_SIZE * hivedb::PAGE_SIZE;
+    const std::array<char, hivedb::PAGE_TRAILER_SIZE> zeroes{};
+    REQUIRE(pwrite(fd, zeroes.data(), zeroes.size(), page_start + hivedb::PAGE_USABLE_SIZE) ==
+            static_cast<ssize_t>(zeroes.size()));
+    close(fd);
+}
+}  // namespace
+
+TEST_CASE("Disk manager rejects pages that don't match their checksum", "[disk_scrubber]") {
+    hivedb::temporary_file_wrapper fw;
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+    {
+        hivedb::disk_manager manager{fw.get_path()};
+        for (hivedb::page_id_t id = 0; id < 4; ++id) {
+            const auto data = "checksummed page " + std::to_string(id);
+            std::memcpy(buffer.data(), data.c_str(), data.size() + 1);
+            manager.write_page(id, buffer.data());
+        }
+    }
+
+    corrupt_after(fw.get_path(), "checksummed page 2");
+    // a page that lost its trailer doesn't get to skip the check
+    wipe_trailer_after(fw.get_path(), "checksummed page 3");
+
+    hivedb::disk_manager manager{fw.get_path()};
+    manager.read_page(1, buffer.data());
+    REQUIRE(std::string{buffer.data()} == "checksummed page 1");
+    REQUIRE_THROWS(manager.read_page(2, buffer.data()));
+    REQUIRE_THROWS(manager.read_page(3, buffer.data()));
+}
+
+TEST_CASE("Disk scrubber finds corrupted pages", "[disk_scrubber]") {
+    using namespace std::chrono_literals;
+    constexpr hivedb::page_id_t number_of_pages = 40;
+    hivedb::temporary_file_wrapper fw;
+    {
+        hivedb::disk_manager manager{fw.get_path()};
+        std::array<char, hivedb::PAGE_SIZE> buffer{};
+        for (hivedb::page_id_t id = 0; id < number_of_pages; ++id) {
+            REQUIRE(manager.allocate_page_id() == id);
+            const auto data = "scrubbed page " + std::to_string(id) + ";";
+            std::memcpy(buffer.data(), data.c_str(), data.size() + 1);
+            manager.write_page(id, buffer.data());
+        }
+    }
+
+    corrupt_after(fw.get_path(), "scrubbed page 17;");
+    corrupt_after(fw.get_path(), "scrubbed page 31;");
+
+    hivedb::disk_scheduler<hivedb::disk_manager> scheduler{fw.get_path()};
+    hivedb::disk_scrubber scrubber{scheduler, {.pages_per_second = 4000, .batch_size = 8}};
+
+    for (int i = 0; i < 500 && scrubber.completed_passes() == 0; ++i)
+        std::this_thread::sleep_for(10ms);
+    REQUIRE(scrubber.completed_passes() > 0);
+    REQUIRE(scrubber.scrubbed_pages() >= number_of_pages);
+
+    auto corrupted = scrubber.corrupted_pages();
+    std::sort(corrupted.begin(), corrupted.end());
+    REQUIRE(corrupted == std::vector<hivedb::page_id_t>{17, 31});
+}
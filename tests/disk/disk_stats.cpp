@@ -0,0 +1,106 @@
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <vector>
+
+#include <catch_amalgamated.hpp>
+#include <disk/disk_manager.hpp>
+#include <disk/disk_scheduler.hpp>
+#include <disk/disk_stats.hpp>
+#include <misc/config.hpp>
+#include <misc/temporary_file_wrapper.hpp>
+
+
+TEST_CASE("Latency histogram buckets", "[disk_stats]") {
+    // every value lands in the bucket whose range holds it
+    for (std::uint64_t value : {0ull, 1ull, 7ull, 8ull, 9ull, 15ull, 16ull, 100ull, 1000ull, 123456789ull, ~0ull}) {
+        const auto bucket = hivedb::latency_histogram::bucket_of(value);
+        REQUIRE(bucket < hivedb::LATENCY_BUCKET_COUNT);
+        REQUIRE(hivedb::latency_histogram::bucket_start(bucket) <= value);
+        if (bucket + 1 < hivedb::LATENCY_BUCKET_COUNT) {
+            REQUIRE(value < hivedb::latency_histogram::bucket_start(bucket + 1));
+        }
+    }
+
+    // buckets are at most an eighth of their start wide
+    for (std::size_t bucket = hivedb::LATENCY_SUB_BUCKETS; bucket + 1 < hivedb::LATENCY_BUCKET_COUNT; ++bucket) {
+        const auto start = hivedb::latency_histogram::bucket_start(bucket);
+        const auto end = hivedb::latency_histogram::bucket_start(bucket + 1);
+        REQUIRE(end > start);
+        REQUIRE(end - start <= start / 8);
+    }
+}
+
+TEST_CASE("Latency histogram percentiles", "[disk_stats]") {
+    hivedb::latency_histogram histogram;
+    for (std::uint64_t value = 1; value <= 1000; ++value) histogram.record(value);
+
+    auto snapshot = histogram.snapshot();
+    // keep it in ticks so the numbers are easy to check
+    snapshot.nanoseconds_per_tick = 1.0;
+    snapshot.total = std::chrono::nanoseconds{500500};
+
+    REQUIRE(snapshot.count == 1000);
+    REQUIRE(snapshot.mean() == std::chrono::nanoseconds{500});
+
+    const auto median = snapshot.percentile(0.5).count();
+    REQUIRE(median >= 500);
+    REQUIRE(median <= 500 + 500 / 8 + 1);
+    const auto p99 = snapshot.percentile(0.99).count();
+    REQUIRE(p99 >= 990);
+    REQUIRE(p99 <= 990 + 990 / 8 + 1);
+
+    REQUIRE(hivedb::latency_histogram{}.snapshot().percentile(0.5).count() == 0);
+}
+
+TEST_CASE("Disk scheduler records request stats", "[disk_stats]") {
+    constexpr hivedb::page_id_t number_of_pages = 64;
+    hivedb::temporary_file_wrapper fw;
+    hivedb::disk_scheduler<hivedb::disk_manager> scheduler{fw.get_path()};
+    std::vector<std::array<char, hivedb::PAGE_SIZE>> pages(number_of_pages);
+
+    const auto schedule = [&scheduler](hivedb::disk_request_type type, hivedb::page_id_t id, char* data) {
+        std::promise<bool> is_done{};
+        auto future = is_done.get_future();
+        scheduler.schedule(hivedb::disk_request{
+            .type = type,
+            .data = data,
+            .page_id = id,
+            .is_done = std::move(is_done)
+        });
+        return future;
+    };
+
+    std::vector<std::future<bool>> futures;
+    for (hivedb::page_id_t id = 0; id < number_of_pages; ++id)
+        futures.push_back(schedule(hivedb::disk_request_type::write, id, pages[id].data()));
+    for (auto& future : futures) REQUIRE(future.get());
+    futures.clear();
+
+    for (hivedb::page_id_t id = 0; id < number_of_pages; ++id)
+        futures.push_back(schedule(hivedb::disk_request_type::read, id, pages[id].data()));
+    futures.push_back(schedule(hivedb::disk_request_type::sync, hivedb::INVALID_PAGE_ID, nullptr));
+    for (auto& future : futures) REQUIRE(future.get());
+
+    const auto stats = scheduler.get_stats();
+    const auto& writes = stats.get(hivedb::disk_request_type::write);
+    const auto& reads = stats.get(hivedb::disk_request_type::read);
+    const auto& syncs = stats.get(hivedb::disk_request_type::sync);
+
+    REQUIRE(writes.completed == number_of_pages);
+    REQUIRE(writes.queue_time.count == number_of_pages);
+    REQUIRE(writes.device_time.count == number_of_pages);
+    REQUIRE(writes.device_time.percentile(0.5).count() > 0);
+    REQUIRE(reads.completed == number_of_pages);
+    REQUIRE(reads.failed == 0);
+    REQUIRE(syncs.completed == 1);
+
+    REQUIRE(stats.bytes_written == number_of_pages * hivedb::PAGE_SIZE);
+    REQUIRE(stats.bytes_read == number_of_pages * hivedb::PAGE_SIZE);
+    REQUIRE(stats.bytes_per_second() > 0);
+
+    REQUIRE(stats.queue_depth == 0);
+    REQUIRE(stats.max_queue_depth >= 1);
+    REQUIRE(stats.max_queue_depth <= 2 * number_of_pages);
+}
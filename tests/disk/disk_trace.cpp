@@ -0,0 +1,166 @@
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <vector>
+
+#include <catch_amalgamated.hpp>
+#include <disk/disk_manager.hpp>
+#include <disk/disk_manager_mock.hpp>
+#include <disk/disk_manager_simulated.hpp>
+#include <disk/disk_scheduler.hpp>
+#include <disk/disk_trace.hpp>
+#include <disk/disk_trace_replay.hpp>
+#include <misc/config.hpp>
+#include <misc/temporary_file_wrapper.hpp>
+
+using namespace std::chrono_literals;
+
+namespace {
+hivedb::disk_trace_record make_record(std::uint64_t enqueued_at, hivedb::disk_request_type type, hivedb::page_id_t page_id) {
+    return hivedb::disk_trace_record{.enqueued_at = enqueued_at,
+                                     .queue_time = 0,
+                                     .device_time = 0,
+                                     .page_id = page_id,
+                                     .type = static_cast<std::uint8_t>(type),
+                                     .priority = 0,
+                                     .is_ok = 1};
+}
+}  // namespace
+
+
+TEST_CASE("Disk scheduler records a trace of its requests", "[disk_trace]") {
+    hivedb::temporary_file_wrapper db_file{};
+    hivedb::temporary_file_wrapper trace_file{};
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+
+    {
+        hivedb::disk_scheduler<hivedb::disk_manager> scheduler{
+            db_file.get_path(), hivedb::disk_scheduler_options{.worker_count = 2, .trace_path = trace_file.get_path()}};
+
+        std::vector<std::future<bool>> done;
+        for (hivedb::page_id_t id = 0; id < 100; ++id) {
+            std::promise<bool> promise;
+            done.push_back(promise.get_future());
+            scheduler.schedule(hivedb::disk_request{.type = hivedb::disk_request_type::write,
+                                                    .data = buffer.data(),
+                                                    .page_id = id,
+                                                    .is_done = std::move(promise),
+                                                    .priority = hivedb::disk_request_priority::background_flush});
+        }
+        std::promise<bool> synced;
+        done.push_back(synced.get_future());
+        scheduler.schedule(hivedb::disk_request{.type = hivedb::disk_request_type::sync,
+                                                .data = nullptr,
+                                                .page_id = hivedb::INVALID_PAGE_ID,
+                                                .is_done = std::move(synced)});
+        for (auto &future : done) REQUIRE(future.get());
+
+        std::promise<bool> read;
+        auto read_done = read.get_future();
+        scheduler.schedule(hivedb::disk_request{.type = hivedb::disk_request_type::read,
+                                                .data = buffer.data(),
+                                                .page_id = 42,
+                                                .is_done = std::move(read)});
+        REQUIRE(read_done.get());
+    }
+
+    const auto trace = hivedb::read_disk_trace(trace_file.get_path());
+    REQUIRE(trace.size() == 102);
+
+    // ordered by when they were scheduled, which is the order above
+    for (std::size_t i = 0; i < 100; ++i) {
+        REQUIRE(trace[i].type == static_cast<std::uint8_t>(hivedb::disk_request_type::write));
+        REQUIRE(trace[i].priority == static_cast<std::uint8_t>(hivedb::disk_request_priority::background_flush));
+        REQUIRE(trace[i].page_id == static_cast<hivedb::page_id_t>(i));
+        REQUIRE(trace[i].is_ok);
+        if (i > 0) REQUIRE(trace[i].enqueued_at >= trace[i - 1].enqueued_at);
+    }
+    REQUIRE(trace[100].type == static_cast<std::uint8_t>(hivedb::disk_request_type::sync));
+    REQUIRE(trace[100].is_ok);
+    REQUIRE(trace[101].type == static_cast<std::uint8_t>(hivedb::disk_request_type::read));
+    REQUIRE(trace[101].page_id == 42);
+    REQUIRE(trace[101].is_ok);
+    REQUIRE(trace[101].priority == static_cast<std::uint8_t>(hivedb::disk_request_priority::foreground_read));
+}
+
+TEST_CASE("Disk traces replay against any disk manager", "[disk_trace]") {
+    hivedb::temporary_file_wrapper trace_file{};
+    std::array<char, hivedb::PAGE_SIZE> buffer{};
+
+    // capture a workload on a mock
+    {
+        hivedb::disk_scheduler<hivedb::disk_manager_mock> scheduler{
+            "", hivedb::disk_scheduler_options{.trace_path = trace_file.get_path()}};
+        for (auto round = 0; round < 3; ++round) {
+            std::vector<std::future<bool>> done;
+            for (hivedb::page_id_t id = 0; id < 50; ++id) {
+                std::promise<bool> promise;
+                done.push_back(promise.get_future());
+                scheduler.schedule(hivedb::disk_request{
+                    .type = round == 0 ? hivedb::disk_request_type::write : hivedb::disk_request_type::read,
+                    .data = buffer.data(),
+                    .page_id = id,
+                    .is_done = std::move(promise)});
+            }
+            for (auto &future : done) REQUIRE(future.get());
+        }
+    }
+    const auto trace = hivedb::read_disk_trace(trace_file.get_path());
+    REQUIRE(trace.size() == 150);
+
+    SECTION("on a file") {
+        hivedb::temporary_file_wrapper db_file{};
+        hivedb::disk_scheduler<hivedb::disk_manager> scheduler{db_file.get_path()};
+
+        const auto result = hivedb::replay_disk_trace(scheduler, trace, {.speed = 0, .max_in_flight = 16});
+        REQUIRE(result.completed == 150);
+        REQUIRE(result.failed == 0);
+
+        const auto stats = scheduler.get_stats();
+        REQUIRE(stats.get(hivedb::disk_request_type::write).completed == 50);
+        REQUIRE(stats.get(hivedb::disk_request_type::read).completed == 100);
+
+        // writes carry the page id, so every page went where it belonged
+        std::array<char, hivedb::PAGE_SIZE> page{};
+        for (hivedb::page_id_t id = 0; id < 50; ++id) {
+            scheduler.get_manager().read_page(id, page.data());
+            hivedb::page_id_t written{};
+            std::memcpy(&written, page.data(), sizeof(written));
+            REQUIRE(written == id);
+        }
+    }
+
+    SECTION("on a simulated device") {
+        hivedb::disk_scheduler<hivedb::disk_manager_simulated<hivedb::disk_manager_mock>> scheduler{
+            "", hivedb::simulation_options{.device = {.read_latency = 100us, .write_latency = 100us},
+                                           .mode = hivedb::latency_mode::count_only}};
+
+        const auto result = hivedb::replay_disk_trace(scheduler, trace, {.speed = 0});
+        REQUIRE(result.completed == 150);
+        REQUIRE(scheduler.get_manager().get_device_time() == 150 * 100us);
+    }
+}
+
+TEST_CASE("Disk trace replay keeps the recorded pace", "[disk_trace]") {
+    // a read every 20ms
+    std::vector<hivedb::disk_trace_record> trace;
+    for (std::uint64_t i = 0; i < 6; ++i) {
+        trace.push_back(make_record(i * 20'000'000, hivedb::disk_request_type::read, static_cast<hivedb::page_id_t>(i)));
+    }
+
+    hivedb::disk_scheduler<hivedb::disk_manager_mock> scheduler{""};
+    const auto original = hivedb::replay_disk_trace(scheduler, trace);
+    REQUIRE(original.completed == 6);
+    REQUIRE(original.elapsed >= 100ms);
+
+    const auto accelerated = hivedb::replay_disk_trace(scheduler, trace, {.speed = 4});
+    REQUIRE(accelerated.completed == 6);
+    REQUIRE(accelerated.elapsed >= 25ms);
+    REQUIRE(accelerated.elapsed < original.elapsed);
+
+    trace.push_back(make_record(0, hivedb::disk_request_type::read, 0));
+    trace.back().type = 42;
+    REQUIRE_THROWS_AS(hivedb::replay_disk_trace(scheduler, trace, {.speed = 0}), std::runtime_error);
+}
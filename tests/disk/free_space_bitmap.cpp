@@ -0,0 +1,76 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <catch_amalgamated.hpp>
+
+#include <disk/free_space_bitmap.hpp>
+#include <misc/config.hpp>
+#include <misc/temporary_file_wrapper.hpp>
+#include <vector>
+
+
+TEST_CASE("Free space bitmap hands out the lowest free slot", "[free_space_bitmap]") {
+    hivedb::temporary_file_wrapper fw;
+    const int fd = open(fw.get_path().c_str(), O_RDWR);
+    REQUIRE(fd != -1);
+
+    hivedb::free_space_bitmap bitmap{fd};
+    REQUIRE(bitmap.capacity() == 0);
+    REQUIRE_FALSE(bitmap.take().has_value());
+
+    bitmap.add_page(hivedb::PAGE_SIZE);
+    REQUIRE(bitmap.capacity() == hivedb::free_space_bitmap::BITS_PER_PAGE);
+    REQUIRE_FALSE(bitmap.take().has_value());
+
+    for (const std::size_t slot : {700, 3, 64, 65, 4000})
+        bitmap.release(slot);
+    bitmap.release(3);
+    REQUIRE(bitmap.free_count() == 5);
+    REQUIRE(bitmap.is_free(64));
+    REQUIRE_FALSE(bitmap.is_free(66));
+
+    // without taking anything
+    REQUIRE(bitmap.next_free(0) == 3);
+    REQUIRE(bitmap.next_free(4) == 64);
+    REQUIRE(bitmap.next_free(66) == 700);
+    REQUIRE_FALSE(bitmap.next_free(4001).has_value());
+    REQUIRE(bitmap.free_count() == 5);
+
+    bitmap.mark_used(64);
+    REQUIRE(bitmap.take() == 3);
+    REQUIRE(bitmap.take() == 65);
+
+    // releasing below the scan position is found again
+    bitmap.release(1);
+    REQUIRE(bitmap.take() == 1);
+    REQUIRE(bitmap.take() == 700);
+    REQUIRE(bitmap.take() == 4000);
+    REQUIRE_FALSE(bitmap.take().has_value());
+    REQUIRE_THROWS(bitmap.release(hivedb::free_space_bitmap::BITS_PER_PAGE));
+
+    close(fd);
+}
+
+TEST_CASE("Free space bitmap survives a reload", "[free_space_bitmap]") {
+    hivedb::temporary_file_wrapper fw;
+    const int fd = open(fw.get_path().c_str(), O_RDWR);
+    REQUIRE(fd != -1);
+
+    constexpr auto bits = hivedb::free_space_bitmap::BITS_PER_PAGE;
+    const std::vector<std::size_t> released{5, bits - 1, bits + 17, 2 * bits + 3};
+    {
+        hivedb::free_space_bitmap bitmap{fd};
+        for (std::size_t i = 0; i < 3; ++i)
+            bitmap.add_page((i + 1) * hivedb::PAGE_SIZE);
+        for (const auto slot : released) bitmap.release(slot);
+        bitmap.flush();
+    }
+
+    hivedb::free_space_bitmap bitmap{fd};
+    bitmap.load(hivedb::PAGE_SIZE);
+    REQUIRE(bitmap.capacity() == 3 * bits);
+    REQUIRE(bitmap.free_count() == released.size());
+    for (const auto slot : released) REQUIRE(bitmap.take() == slot);
+
+    close(fd);
+}
@@ -0,0 +1,73 @@
+#include <catch_amalgamated.hpp>
+
+#include <disk/page_checksum.hpp>
+#include <misc/aligned_buffer.hpp>
+#include <misc/config.hpp>
+#include <cstring>
+#include <random>
+#include <string_view>
+#include <vector>
+
+
+TEST_CASE("crc32c matches the reference values", "[page_checksum]") {
+    constexpr std::string_view check = "123456789";
+    REQUIRE(hivedb::crc32c(0, check.data(), check.size()) == 0xe3069283);
+    REQUIRE(hivedb::crc32c_portable(0, check.data(), check.size()) == 0xe3069283);
+
+    // from RFC 3720
+    const std::vector<char> zeroes(32, 0);
+    REQUIRE(hivedb::crc32c(0, zeroes.data(), zeroes.size()) == 0x8a9136aa);
+    const std::vector<char> ones(32, static_cast<char>(0xff));
+    REQUIRE(hivedb::crc32c(0, ones.data(), ones.size()) == 0x62a8ab43);
+
+    // continuing a crc is the same as doing it in one go
+    const auto first = hivedb::crc32c(0, check.data(), 4);
+    REQUIRE(hivedb::crc32c(first, check.data() + 4, check.size() - 4) == 0xe3069283);
+}
+
+TEST_CASE("crc32c hardware and portable paths agree", "[page_checksum]") {
+    std::mt19937 generator{42};
+    std::vector<char> data(5 * hivedb::PAGE_SIZE + 3);
+    for (auto& byte : data) byte = static_cast<char>(generator());
+
+    for (const std::size_t size : {0, 1, 7, 8, 100, 4087, 4088, 4089, 12345, 20480}) {
+        for (const std::size_t skew : {0, 3}) {
+            REQUIRE(hivedb::crc32c(7, data.data() + skew, size) ==
+                    hivedb::crc32c_portable(7, data.data() + skew, size));
+        }
+    }
+}
+
+TEST_CASE("Page trailers catch corruption", "[page_checksum]") {
+    hivedb::aligned_buffer page{hivedb::PAGE_SIZE};
+    // zeroed and never stamped pages pass
+    REQUIRE(hivedb::verify_page(3, page.data()));
+
+    std::mt19937 generator{7};
+    for (int i = 0; i < hivedb::PAGE_USABLE_SIZE; ++i)
+        page.data()[i] = static_cast<char>(generator());
+    hivedb::stamp_page(3, page.data());
+    REQUIRE(hivedb::verify_page(3, page.data()));
+
+    // a page in the wrong spot
+    REQUIRE_FALSE(hivedb::verify_page(4, page.data()));
+
+    page.data()[1000] ^= 0x10;
+    REQUIRE_FALSE(hivedb::verify_page(3, page.data()));
+    page.data()[1000] ^= 0x10;
+
+    page.data()[hivedb::PAGE_USABLE_SIZE] ^= 0x01;
+    REQUIRE_FALSE(hivedb::verify_page(3, page.data()));
+    page.data()[hivedb::PAGE_USABLE_SIZE] ^= 0x01;
+
+    // losing the magic doesn't turn the check off
+    page.data()[hivedb::PAGE_SIZE - 1] ^= 0x01;
+    REQUIRE_FALSE(hivedb::verify_page(3, page.data()));
+    page.data()[hivedb::PAGE_SIZE - 1] ^= 0x01;
+
+    // nor does a zeroed last sector
+    std::memset(page.data() + hivedb::PAGE_SIZE - 512, 0, 512);
+    REQUIRE_FALSE(hivedb::verify_page(3, page.data()));
+    // unless the file is from before trailers
+    REQUIRE(hivedb::verify_page(3, page.data(), hivedb::PAGE_SIZE, false));
+}
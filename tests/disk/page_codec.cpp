@@ -0,0 +1,73 @@
+#include <array>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <catch_amalgamated.hpp>
+#include <disk/page_codec.hpp>
+#include <misc/config.hpp>
+
+
+TEST_CASE("Page codec round trips pages", "[page_codec]") {
+    std::array<char, hivedb::PAGE_SIZE> page{};
+    std::array<char, hivedb::PAGE_SIZE> compressed{};
+    std::array<char, hivedb::PAGE_SIZE> decompressed{};
+
+    SECTION("zeroed page") {
+        const auto size = hivedb::compress_block(page.data(), page.size(), compressed.data(), compressed.size());
+        REQUIRE(size > 0);
+        REQUIRE(size < 64);
+        REQUIRE(hivedb::decompress_block(compressed.data(), size, decompressed.data(), decompressed.size()));
+        REQUIRE(page == decompressed);
+    }
+
+    SECTION("repetitive records") {
+        for (std::size_t offset = 0; offset + 32 <= page.size(); offset += 32) {
+            const auto record = "key " + std::to_string(offset / 32) + " value";
+            std::memcpy(&page[offset], record.c_str(), record.size());
+        }
+
+        const auto size = hivedb::compress_block(page.data(), page.size(), compressed.data(), compressed.size());
+        REQUIRE(size > 0);
+        REQUIRE(size < page.size() / 2);
+        REQUIRE(hivedb::decompress_block(compressed.data(), size, decompressed.data(), decompressed.size()));
+        REQUIRE(page == decompressed);
+    }
+
+    SECTION("random bytes") {
+        std::mt19937 gen{42};
+        std::uniform_int_distribution<int> dist{0, 255};
+        for (auto& c : page) c = static_cast<char>(dist(gen));
+
+        // doesn't fit anything smaller than the page
+        REQUIRE(hivedb::compress_block(page.data(), page.size(), compressed.data(), page.size() / 2) == 0);
+
+        std::vector<char> large(2 * hivedb::PAGE_SIZE);
+        const auto size = hivedb::compress_block(page.data(), page.size(), large.data(), large.size());
+        REQUIRE(size > 0);
+        REQUIRE(hivedb::decompress_block(large.data(), size, decompressed.data(), decompressed.size()));
+        REQUIRE(page == decompressed);
+    }
+}
+
+TEST_CASE("Page codec rejects malformed input", "[page_codec]") {
+    std::array<char, hivedb::PAGE_SIZE> page{};
+    std::array<char, hivedb::PAGE_SIZE> compressed{};
+    std::array<char, hivedb::PAGE_SIZE> decompressed{};
+    for (std::size_t i = 0; i < page.size(); ++i) page[i] = static_cast<char>(i % 7);
+
+    const auto size = hivedb::compress_block(page.data(), page.size(), compressed.data(), compressed.size());
+    REQUIRE(size > 0);
+
+    // cut short
+    REQUIRE_FALSE(hivedb::decompress_block(compressed.data(), size / 2, decompressed.data(), decompressed.size()));
+    // doesn't fill the output
+    REQUIRE_FALSE(hivedb::decompress_block(compressed.data(), size, decompressed.data(), decompressed.size() + 1));
+    // would write past the output
+    REQUIRE_FALSE(hivedb::decompress_block(compressed.data(), size, decompressed.data(), decompressed.size() - 1));
+
+    // a match reaching back before the start of the output
+    const std::array<char, 4> bad_offset{0x00, 0x10, 0x00, 0x00};
+    REQUIRE_FALSE(hivedb::decompress_block(bad_offset.data(), bad_offset.size(), decompressed.data(), decompressed.size()));
+}
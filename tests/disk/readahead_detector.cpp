@@ -0,0 +1,62 @@
+#include <catch_amalgamated.hpp>
+
+#include <disk/readahead_detector.hpp>
+#include <misc/config.hpp>
+
+
+TEST_CASE("Readahead detector follows sequential scans", "[readahead_detector]") {
+    hivedb::readahead_detector detector;
+
+    // one page says nothing yet
+    REQUIRE_FALSE(detector.record(10).has_value());
+
+    auto range = detector.record(11);
+    REQUIRE(range.has_value());
+    REQUIRE(range->first == 12);
+    REQUIRE(range->count == hivedb::MIN_READAHEAD_PAGES);
+
+    // repeats and pages well inside the window don't ask for more
+    REQUIRE_FALSE(detector.record(11).has_value());
+    REQUIRE_FALSE(detector.record(12).has_value());
+
+    // once the reader gets close to the end the window grows
+    range = detector.record(14);
+    REQUIRE(range.has_value());
+    REQUIRE(range->first == 16);
+    REQUIRE(range->count == 2 * hivedb::MIN_READAHEAD_PAGES - 1);
+
+    // never more than the maximum
+    hivedb::page_id_t end = range->first + range->count;
+    for (hivedb::page_id_t id = 15; id < 1000; ++id) {
+        range = detector.record(id);
+        if (!range.has_value()) continue;
+
+        REQUIRE(range->first == end);
+        REQUIRE(range->count <= hivedb::MAX_READAHEAD_PAGES);
+        end = range->first + range->count;
+    }
+    // and the reader never caught up with it
+    REQUIRE(end > 999 + static_cast<hivedb::page_id_t>(hivedb::MAX_READAHEAD_PAGES / 2));
+}
+
+TEST_CASE("Readahead detector ignores random access", "[readahead_detector]") {
+    hivedb::readahead_detector detector;
+
+    for (const hivedb::page_id_t id : {7, 3, 90, 41, 12, 66, 5, 28})
+        REQUIRE_FALSE(detector.record(id).has_value());
+}
+
+TEST_CASE("Readahead detector tells interleaved scans apart", "[readahead_detector]") {
+    hivedb::readahead_detector detector;
+
+    REQUIRE_FALSE(detector.record(100).has_value());
+    REQUIRE_FALSE(detector.record(500).has_value());
+
+    const auto first = detector.record(101);
+    REQUIRE(first.has_value());
+    REQUIRE(first->first == 102);
+
+    const auto second = detector.record(501);
+    REQUIRE(second.has_value());
+    REQUIRE(second->first == 502);
+}
@@ -0,0 +1,87 @@
+#include <catch_amalgamated.hpp>
+
+#include <misc/mpsc_ring.hpp>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+
+TEST_CASE("mpsc ring simple tests", "[mpsc_ring]") {
+    hivedb::mpsc_ring<std::unique_ptr<int>> ring{3};
+    REQUIRE(ring.capacity() == 4);
+    REQUIRE_FALSE(ring.try_pop().has_value());
+
+    for (auto i = 0; i < 4; ++i) REQUIRE(ring.try_push(std::make_unique<int>(i)));
+
+    // full, the value stays with the caller
+    auto rejected = std::make_unique<int>(4);
+    REQUIRE_FALSE(ring.try_push(std::move(rejected)));
+    REQUIRE(rejected != nullptr);
+
+    for (auto i = 0; i < 4; ++i) {
+        auto value = ring.try_pop();
+        REQUIRE(value.has_value());
+        REQUIRE(**value == i);
+    }
+    REQUIRE_FALSE(ring.try_pop().has_value());
+
+    // wraps around
+    REQUIRE(ring.try_push(std::move(rejected)));
+    std::vector<std::unique_ptr<int>> out;
+    REQUIRE(ring.pop_batch(out, 10) == 1);
+    REQUIRE(*out[0] == 4);
+
+    // leftovers are destroyed with the ring
+    REQUIRE(ring.try_push(std::make_unique<int>(5)));
+}
+
+TEST_CASE("mpsc ring many producers", "[mpsc_ring]") {
+    constexpr auto number_of_producers = 8;
+    constexpr auto items_per_producer = 20000;
+
+    // small on purpose so producers have to wait for room
+    hivedb::mpsc_ring<std::pair<int, int>> ring{64};
+
+    std::vector<std::thread> producers;
+    for (auto producer = 0; producer < number_of_producers; ++producer) {
+        producers.emplace_back([&ring, producer]() {
+            for (auto i = 0; i < items_per_producer; ++i) ring.push({producer, i});
+        });
+    }
+
+    // every producer's items come out in the order it pushed them
+    std::vector<int> next(number_of_producers, 0);
+    std::vector<std::pair<int, int>> out;
+    auto received = 0;
+    while (received < number_of_producers * items_per_producer) {
+        out.clear();
+        if (ring.pop_batch(out, 32) == 0) {
+            ring.wait(std::chrono::milliseconds{1});
+            continue;
+        }
+        for (const auto& [producer, i] : out) {
+            REQUIRE(next[producer] == i);
+            next[producer]++;
+        }
+        received += static_cast<int>(out.size());
+    }
+
+    for (auto& producer : producers) producer.join();
+    REQUIRE_FALSE(ring.try_pop().has_value());
+}
+
+TEST_CASE("mpsc ring notify wakes the consumer", "[mpsc_ring]") {
+    using namespace std::chrono_literals;
+    hivedb::mpsc_ring<int> ring{8};
+
+    std::thread notifier{[&ring]() {
+        std::this_thread::sleep_for(10ms);
+        ring.notify();
+    }};
+
+    const auto start = std::chrono::steady_clock::now();
+    ring.wait(10s);
+    REQUIRE(std::chrono::steady_clock::now() - start < 5s);
+    notifier.join();
+}